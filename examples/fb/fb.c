@@ -0,0 +1,453 @@
+// fb.c
+// Framebuffer drawing with one set of row loops per instruction set, in
+// the style of the loader's libk: the vector loops are inline assembly
+// in functions compiled for that target only. Everything is built from
+// two primitives, filling a row and copying one, so a full-screen clear
+// or flush runs at store bandwidth instead of one pixel per iteration.
+#include "fb.h"
+
+#define CPUID1_PAT (1u << 16)   // EDX
+#define CPUID1_OSXSAVE (1u << 27)
+#define CPUID1_AVX (1u << 28)
+#define CPUID7_AVX2 (1u << 5)
+#define XCR0_SSE_AVX 0x6
+
+#define MSR_PAT 0x277
+#define PAT_WC 0x01
+#define PAT_WC_INDEX 5 // PAT=1 PCD=0 PWT=1: WT after reset, unused by the loader's tables
+
+#define PTE_PRESENT 0x001
+#define PTE_WRITE 0x002
+#define PTE_USER 0x004
+#define PTE_PWT 0x008
+#define PTE_PCD 0x010
+#define PTE_LARGE 0x080    // PS in a PD or PDPT entry
+#define PTE_PAT_4K 0x080   // The same bit in a page table entry
+#define PTE_PAT_LARGE 0x1000
+#define PTE_NX (1ull << 63)
+#define PTE_ADDR 0x000FFFFFFFFFF000ull
+#define PTE_ADDR_1G 0x000FFFFFC0000000ull
+
+#define CR0_WP (1ull << 16)
+#define CR0_NW (1ull << 29)
+#define CR0_CD (1ull << 30)
+#define RFLAGS_IF (1ull << 9)
+#define CR4_PGE (1ull << 7)
+#define CR4_LA57 (1ull << 12)
+
+#define LARGE_PAGE 0x200000ull
+#define SPLIT_TABLES 4 // 1 GB pages split on the way to a framebuffer
+
+struct fb_rows
+{
+    const char *name;
+    void (*fill)(uint32_t *dst, uint32_t n, uint32_t color);
+    void (*copy)(uint32_t *dst, const uint32_t *src, uint32_t n);
+};
+
+// ------------------------------------------------------------------ SSE2
+
+// Stores are aligned to 16 bytes so each one is a whole piece of a
+// write-combining line; loads may be unaligned
+__attribute__((target("sse2"))) static void fill_sse2(uint32_t *d, uint32_t n, uint32_t color)
+{
+    for (; n && ((uintptr_t)d & 15); n--) *d++ = color;
+    uint64_t blocks = n / 16;
+    if (blocks)
+        __asm__ volatile("movd %[color], %%xmm0\n\t"
+                         "pshufd $0, %%xmm0, %%xmm0\n\t"
+                         "1:\n\t"
+                         "movdqa %%xmm0, (%[d])\n\t"
+                         "movdqa %%xmm0, 16(%[d])\n\t"
+                         "movdqa %%xmm0, 32(%[d])\n\t"
+                         "movdqa %%xmm0, 48(%[d])\n\t"
+                         "add $64, %[d]\n\t"
+                         "dec %[blocks]\n\t"
+                         "jnz 1b"
+                         : [d] "+r"(d), [blocks] "+r"(blocks)
+                         : [color] "r"(color)
+                         : "xmm0", "memory");
+    for (n %= 16; n; n--) *d++ = color;
+}
+
+__attribute__((target("sse2"))) static void copy_sse2(uint32_t *d, const uint32_t *s, uint32_t n)
+{
+    for (; n && ((uintptr_t)d & 15); n--) *d++ = *s++;
+    uint64_t blocks = n / 16;
+    if (blocks)
+        __asm__ volatile("1:\n\t"
+                         "movdqu (%[s]), %%xmm0\n\t"
+                         "movdqu 16(%[s]), %%xmm1\n\t"
+                         "movdqu 32(%[s]), %%xmm2\n\t"
+                         "movdqu 48(%[s]), %%xmm3\n\t"
+                         "movdqa %%xmm0, (%[d])\n\t"
+                         "movdqa %%xmm1, 16(%[d])\n\t"
+                         "movdqa %%xmm2, 32(%[d])\n\t"
+                         "movdqa %%xmm3, 48(%[d])\n\t"
+                         "add $64, %[s]\n\t"
+                         "add $64, %[d]\n\t"
+                         "dec %[blocks]\n\t"
+                         "jnz 1b"
+                         : [d] "+r"(d), [s] "+r"(s), [blocks] "+r"(blocks)
+                         :
+                         : "xmm0", "xmm1", "xmm2", "xmm3", "memory");
+    for (n %= 16; n; n--) *d++ = *s++;
+}
+
+// ------------------------------------------------------------------ AVX2
+
+__attribute__((target("avx2"))) static void fill_avx2(uint32_t *d, uint32_t n, uint32_t color)
+{
+    for (; n && ((uintptr_t)d & 31); n--) *d++ = color;
+    uint64_t blocks = n / 32;
+    if (blocks)
+        __asm__ volatile("vmovd %[color], %%xmm0\n\t"
+                         "vpbroadcastd %%xmm0, %%ymm0\n\t"
+                         "1:\n\t"
+                         "vmovdqa %%ymm0, (%[d])\n\t"
+                         "vmovdqa %%ymm0, 32(%[d])\n\t"
+                         "vmovdqa %%ymm0, 64(%[d])\n\t"
+                         "vmovdqa %%ymm0, 96(%[d])\n\t"
+                         "add $128, %[d]\n\t"
+                         "dec %[blocks]\n\t"
+                         "jnz 1b\n\t"
+                         "vzeroupper"
+                         : [d] "+r"(d), [blocks] "+r"(blocks)
+                         : [color] "r"(color)
+                         : "xmm0", "memory");
+    for (n %= 32; n; n--) *d++ = color;
+}
+
+__attribute__((target("avx2"))) static void copy_avx2(uint32_t *d, const uint32_t *s, uint32_t n)
+{
+    for (; n && ((uintptr_t)d & 31); n--) *d++ = *s++;
+    uint64_t blocks = n / 32;
+    if (blocks)
+        __asm__ volatile("1:\n\t"
+                         "vmovdqu (%[s]), %%ymm0\n\t"
+                         "vmovdqu 32(%[s]), %%ymm1\n\t"
+                         "vmovdqu 64(%[s]), %%ymm2\n\t"
+                         "vmovdqu 96(%[s]), %%ymm3\n\t"
+                         "vmovdqa %%ymm0, (%[d])\n\t"
+                         "vmovdqa %%ymm1, 32(%[d])\n\t"
+                         "vmovdqa %%ymm2, 64(%[d])\n\t"
+                         "vmovdqa %%ymm3, 96(%[d])\n\t"
+                         "add $128, %[s]\n\t"
+                         "add $128, %[d]\n\t"
+                         "dec %[blocks]\n\t"
+                         "jnz 1b\n\t"
+                         "vzeroupper"
+                         : [d] "+r"(d), [s] "+r"(s), [blocks] "+r"(blocks)
+                         :
+                         : "xmm0", "xmm1", "xmm2", "xmm3", "memory");
+    for (n %= 32; n; n--) *d++ = *s++;
+}
+
+static const struct fb_rows g_sse2 = {"SSE2", fill_sse2, copy_sse2};
+static const struct fb_rows g_avx2 = {"AVX2", fill_avx2, copy_avx2};
+static const struct fb_rows *g_rows = &g_sse2;
+
+// ------------------------------------------------------------------- CPU
+
+static void cpuid(uint32_t leaf, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
+{
+    __asm__ volatile("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(0));
+}
+
+// AVX2 in the CPU and AVX state enabled by whoever owns CR4 and XCR0
+static int avx2_usable(void)
+{
+    uint32_t a, b, c, d;
+    cpuid(0, &a, &b, &c, &d);
+    if (a < 7) return 0;
+    cpuid(1, &a, &b, &c, &d);
+    if ((c & (CPUID1_OSXSAVE | CPUID1_AVX)) != (CPUID1_OSXSAVE | CPUID1_AVX)) return 0;
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    if ((lo & XCR0_SSE_AVX) != XCR0_SSE_AVX) return 0;
+    cpuid(7, &a, &b, &c, &d);
+    return (b & CPUID7_AVX2) != 0;
+}
+
+static inline uint64_t rdmsr(uint32_t msr)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value)
+{
+    __asm__ volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+// Stores to a write-combining framebuffer are weakly ordered: drain them
+// before anything that expects the picture to be complete
+static inline void sfence(void)
+{
+    __asm__ volatile("sfence" : : : "memory");
+}
+
+void fb_init(struct fb *fb, uint64_t base, uint32_t width, uint32_t height, uint32_t pitch)
+{
+    fb->base = (uint32_t *)(uintptr_t)base;
+    fb->width = width;
+    fb->height = height;
+    fb->pitch = pitch;
+    fb->shadow = 0;
+    fb->dirty = 0;
+    fb->dirty_y0 = height;
+    fb->dirty_y1 = 0;
+    fb->wc = 0;
+    g_rows = avx2_usable() ? &g_avx2 : &g_sse2;
+}
+
+const char *fb_variant(void)
+{
+    return g_rows->name;
+}
+
+// ------------------------------------------------------- write combining
+
+static uint64_t g_split[SPLIT_TABLES][512] __attribute__((aligned(4096)));
+static uint32_t g_split_count;
+static uint64_t g_pat; // What fb_enable_wc wrote to the PAT, 0 before that
+
+static uint64_t *table(uint64_t entry)
+{
+    return (uint64_t *)(uintptr_t)(entry & PTE_ADDR);
+}
+
+// Replace a 1 GB page by a page directory of 2 MB pages with the same
+// attributes, so the memory type can change for the framebuffer alone
+// and not for the APICs and other MMIO sharing its gigabyte
+static int split_gb(uint64_t *pdpte)
+{
+    if (g_split_count == SPLIT_TABLES) return 0;
+    uint64_t *pd = g_split[g_split_count++];
+    uint64_t e = *pdpte;
+    uint64_t attrs = e & (0xFFF | PTE_PAT_LARGE | PTE_NX);
+    for (uint64_t i = 0; i < 512; i++)
+        pd[i] = ((e & PTE_ADDR_1G) + i * LARGE_PAGE) | attrs;
+    *pdpte = (uintptr_t)pd | (e & (PTE_PRESENT | PTE_WRITE | PTE_USER));
+    return 1;
+}
+
+// Point the pages covering [start, end) at PAT entry PAT_WC_INDEX
+static int map_wc(uint64_t start, uint64_t end)
+{
+    uint64_t cr3, cr4;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    if (cr4 & CR4_LA57) return 0;
+
+    uint64_t *pml4 = table(cr3);
+    for (uint64_t a = start & ~0xFFFull; a < end;)
+    {
+        uint64_t *e = &pml4[(a >> 39) & 511];
+        if (!(*e & PTE_PRESENT)) return 0;
+        e = &table(*e)[(a >> 30) & 511];
+        if (!(*e & PTE_PRESENT)) return 0;
+        if ((*e & PTE_LARGE) && !split_gb(e)) return 0;
+        e = &table(*e)[(a >> 21) & 511];
+        if (!(*e & PTE_PRESENT)) return 0;
+        if (*e & PTE_LARGE)
+        {
+            *e = (*e & ~(uint64_t)PTE_PCD) | PTE_PWT | PTE_PAT_LARGE;
+            a = (a | (LARGE_PAGE - 1)) + 1;
+            continue;
+        }
+        e = &table(*e)[(a >> 12) & 511];
+        if (!(*e & PTE_PRESENT)) return 0;
+        *e = (*e & ~(uint64_t)PTE_PCD) | PTE_PWT | PTE_PAT_4K;
+        a += 0x1000;
+    }
+    return 1;
+}
+
+// Changing the PAT or the entry a page uses, as the SDM lays it out
+// (11.12.4 with 11.11.8): interrupts off, caches in no-fill mode and
+// written back, TLB flushed with global pages off; then the change; then
+// another write-back and TLB flush before the caches and PGE come back.
+// No line or translation of the old memory type survives.
+struct pat_change
+{
+    uint64_t rflags, cr0, cr4;
+};
+
+static void pat_change_begin(struct pat_change *s)
+{
+    __asm__ volatile("pushfq; popq %0; cli" : "=r"(s->rflags) : : "memory");
+    __asm__ volatile("mov %%cr0, %0" : "=r"(s->cr0));
+    __asm__ volatile("mov %%cr4, %0" : "=r"(s->cr4));
+    __asm__ volatile("mov %0, %%cr0" : : "r"((s->cr0 | CR0_CD) & ~CR0_NW) : "memory");
+    __asm__ volatile("wbinvd" : : : "memory");
+    if (s->cr4 & CR4_PGE)
+        __asm__ volatile("mov %0, %%cr4" : : "r"(s->cr4 & ~CR4_PGE) : "memory");
+    else
+        __asm__ volatile("mov %%cr3, %%rax; mov %%rax, %%cr3" : : : "rax", "memory");
+}
+
+static void pat_change_end(const struct pat_change *s)
+{
+    __asm__ volatile("wbinvd" : : : "memory");
+    __asm__ volatile("mov %%cr3, %%rax; mov %%rax, %%cr3" : : : "rax", "memory");
+    __asm__ volatile("mov %0, %%cr0" : : "r"(s->cr0) : "memory");
+    __asm__ volatile("mov %0, %%cr4" : : "r"(s->cr4) : "memory");
+    if (s->rflags & RFLAGS_IF) __asm__ volatile("sti");
+}
+
+int fb_enable_wc(struct fb *fb)
+{
+    uint32_t a, b, c, d;
+    cpuid(1, &a, &b, &c, &d);
+    if (!(d & CPUID1_PAT)) return 0;
+
+    uint64_t pat = rdmsr(MSR_PAT);
+    pat &= ~(0xFFull << (PAT_WC_INDEX * 8));
+    pat |= (uint64_t)PAT_WC << (PAT_WC_INDEX * 8);
+
+    struct pat_change s;
+    pat_change_begin(&s);
+    wrmsr(MSR_PAT, pat);
+    g_pat = pat;
+
+    // UEFI firmware may keep its page tables read-only
+    __asm__ volatile("mov %0, %%cr0" : : "r"((s.cr0 | CR0_CD) & ~(CR0_NW | CR0_WP)));
+    uint64_t start = (uintptr_t)fb->base;
+    int ok = map_wc(start, start + (uint64_t)fb->pitch * fb->height * 4);
+    pat_change_end(&s);
+
+    fb->wc = ok;
+    return ok;
+}
+
+void fb_sync_pat(void)
+{
+    if (!g_pat || rdmsr(MSR_PAT) == g_pat) return;
+    struct pat_change s;
+    pat_change_begin(&s);
+    wrmsr(MSR_PAT, g_pat);
+    pat_change_end(&s);
+}
+
+// --------------------------------------------------------------- drawing
+
+// Where drawing goes, and its pixels per row
+static uint32_t *target(const struct fb *fb, uint32_t *pitch)
+{
+    if (fb->shadow)
+    {
+        *pitch = fb->width;
+        return fb->shadow;
+    }
+    *pitch = fb->pitch;
+    return fb->base;
+}
+
+// Clip to the framebuffer; 0 if nothing is left
+static int clip(const struct fb *fb, uint32_t x, uint32_t y, uint32_t *w, uint32_t *h)
+{
+    if (x >= fb->width || y >= fb->height) return 0;
+    if (*w > fb->width - x) *w = fb->width - x;
+    if (*h > fb->height - y) *h = fb->height - y;
+    return *w && *h;
+}
+
+// After drawing: remember what the next flush copies, or drain the
+// stores that went straight to the screen
+static void drawn(struct fb *fb, uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+    if (!fb->shadow)
+    {
+        sfence();
+        return;
+    }
+    for (uint32_t row = y; row < y + h; row++)
+    {
+        struct fb_span *s = &fb->dirty[row];
+        if (x < s->x0) s->x0 = x;
+        if (x + w > s->x1) s->x1 = x + w;
+    }
+    if (y < fb->dirty_y0) fb->dirty_y0 = y;
+    if (y + h > fb->dirty_y1) fb->dirty_y1 = y + h;
+}
+
+void fb_fill(struct fb *fb, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color)
+{
+    if (!clip(fb, x, y, &w, &h)) return;
+    uint32_t pitch;
+    uint32_t *p = target(fb, &pitch) + (uint64_t)y * pitch + x;
+    for (uint32_t row = 0; row < h; row++, p += pitch)
+        g_rows->fill(p, w, color);
+    drawn(fb, x, y, w, h);
+}
+
+// A src_pitch of 0 repeats the first source row
+void fb_blit(struct fb *fb, uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint32_t *src,
+             uint32_t src_pitch)
+{
+    if (!clip(fb, x, y, &w, &h)) return;
+    uint32_t pitch;
+    uint32_t *p = target(fb, &pitch) + (uint64_t)y * pitch + x;
+    for (uint32_t row = 0; row < h; row++, p += pitch, src += src_pitch)
+        g_rows->copy(p, src, w);
+    drawn(fb, x, y, w, h);
+}
+
+void fb_scroll(struct fb *fb, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t lines, uint32_t bg)
+{
+    if (!clip(fb, x, y, &w, &h)) return;
+    if (lines > h) lines = h;
+    uint32_t pitch;
+    uint32_t *p = target(fb, &pitch) + (uint64_t)y * pitch + x;
+
+    // Rows only move up, so copying top to bottom never reads a row
+    // that was already overwritten
+    uint32_t row = 0;
+    for (; row < h - lines; row++, p += pitch)
+        g_rows->copy(p, p + (uint64_t)lines * pitch, w);
+    for (; row < h; row++, p += pitch)
+        g_rows->fill(p, w, bg);
+    drawn(fb, x, y, w, h);
+}
+
+// ---------------------------------------------------------------- shadow
+
+uint64_t fb_shadow_size(const struct fb *fb)
+{
+    return (uint64_t)fb->width * fb->height * sizeof(uint32_t) + (uint64_t)fb->height * sizeof(struct fb_span);
+}
+
+// The shadow starts as a copy of the screen, read back once, so scrolls
+// and partial redraws never expose stale memory
+void fb_set_shadow(struct fb *fb, void *mem)
+{
+    fb->shadow = mem;
+    fb->dirty = (struct fb_span *)(fb->shadow + (uint64_t)fb->width * fb->height);
+    for (uint32_t y = 0; y < fb->height; y++)
+    {
+        g_rows->copy(fb->shadow + (uint64_t)y * fb->width, fb->base + (uint64_t)y * fb->pitch, fb->width);
+        fb->dirty[y].x0 = fb->width;
+        fb->dirty[y].x1 = 0;
+    }
+    fb->dirty_y0 = fb->height;
+    fb->dirty_y1 = 0;
+}
+
+void fb_flush(struct fb *fb)
+{
+    if (!fb->shadow) return;
+    for (uint32_t y = fb->dirty_y0; y < fb->dirty_y1; y++)
+    {
+        struct fb_span *s = &fb->dirty[y];
+        if (s->x0 < s->x1)
+            g_rows->copy(fb->base + (uint64_t)y * fb->pitch + s->x0, fb->shadow + (uint64_t)y * fb->width + s->x0,
+                         s->x1 - s->x0);
+        s->x0 = fb->width;
+        s->x1 = 0;
+    }
+    fb->dirty_y0 = fb->height;
+    fb->dirty_y1 = 0;
+    sfence();
+}
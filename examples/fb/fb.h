@@ -0,0 +1,78 @@
+// fb.h
+// Framebuffer drawing for the 64-bit example payloads (KERN64.BIN,
+// TEST64.BIN): rectangle fills, blits and scrolls with SSE2 or AVX2 row
+// loops, a small bitmap font, an optional shadow buffer that is copied
+// out in dirty spans, and a write-combining mapping of the framebuffer.
+// 32 bits per pixel (0x00RRGGBB) only; freestanding, ring 0.
+#ifndef FB_H
+#define FB_H
+
+#include <stdint.h>
+
+// Text cells: 5x7 glyphs with one column and two rows of spacing
+#define FB_CELL_W 6
+#define FB_CELL_H 9
+
+// Columns [x0, x1) of a row changed since the last flush; clean when
+// x0 >= x1
+struct fb_span
+{
+    uint32_t x0, x1;
+};
+
+struct fb
+{
+    uint32_t *base;         // Scanout memory
+    uint32_t width, height; // Pixels
+    uint32_t pitch;         // Pixels per scanline of base
+    uint32_t *shadow;       // Drawing goes here when set (pitch = width)
+    struct fb_span *dirty;  // One per row, with the shadow
+    uint32_t dirty_y0;      // Rows [dirty_y0, dirty_y1) may have spans
+    uint32_t dirty_y1;
+    int wc;                 // base is mapped write-combining
+};
+
+// Describe a framebuffer and pick the row loops for this CPU. Uses AVX2
+// only if whoever ran before (loader or payload) enabled AVX state.
+void fb_init(struct fb *fb, uint64_t base, uint32_t width, uint32_t height, uint32_t pitch);
+const char *fb_variant(void);
+
+// Map the framebuffer write-combining: PAT entry 5 becomes WC and the
+// pages covering base get PAT+PWT in the current page tables (a 1 GB
+// page is split into 2 MB ones first). Returns 0 if the CPU has no PAT
+// or the tables do not map base.
+int fb_enable_wc(struct fb *fb);
+
+// The PAT MSR is per CPU and INIT resets it: every other CPU that uses
+// the same page tables must call this, before it touches memory through
+// them, to load the PAT fb_enable_wc programmed. Nothing to do if
+// fb_enable_wc has not run.
+void fb_sync_pat(void);
+
+// Bytes a shadow buffer for this framebuffer needs, and handing one
+// over. From then on drawing only reaches the screen through fb_flush.
+uint64_t fb_shadow_size(const struct fb *fb);
+void fb_set_shadow(struct fb *fb, void *mem);
+
+// Drawing, clipped to the framebuffer
+void fb_fill(struct fb *fb, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color);
+void fb_blit(struct fb *fb, uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint32_t *src,
+             uint32_t src_pitch);
+
+// Move the rectangle's contents up by `lines` rows and fill the rows
+// that open up at its bottom with `bg`. Without a shadow buffer this
+// reads the framebuffer back, which is slow.
+void fb_scroll(struct fb *fb, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t lines, uint32_t bg);
+
+// Copy the dirty spans of the shadow buffer to the screen
+void fb_flush(struct fb *fb);
+
+// ------------------------------------------------------------- font.c
+
+// Text with its top left corner at pixel (x, y), each glyph pixel drawn
+// as a `scale` x `scale` square, in FB_CELL_W x FB_CELL_H cells (times
+// scale) filled with bg. Lowercase is drawn as uppercase; characters
+// without a glyph as spaces. Returns the width drawn in pixels.
+uint32_t fb_text(struct fb *fb, uint32_t x, uint32_t y, const char *s, uint32_t scale, uint32_t fg, uint32_t bg);
+
+#endif // FB_H
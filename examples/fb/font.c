@@ -0,0 +1,109 @@
+// font.c
+// The 5x7 font of the example payloads and a text renderer on top of
+// fb_blit: each pixel row of a string is built once in a buffer and
+// copied with the row loops, `scale` rows at a time.
+#include "fb.h"
+
+#define LINE_PIXELS 768 // Buffered pixels per piece of a text row
+
+// 5x7 glyphs, one byte per row, bit 4 = leftmost column
+static const char g_glyph_chars[] = " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:/-%(),+=_>!";
+static const uint8_t g_glyphs[][7] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // space
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}, // 0
+    {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E},
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F},
+    {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E},
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02},
+    {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E},
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E},
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E},
+    {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}, // 9
+    {0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11}, // A
+    {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E},
+    {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E},
+    {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C},
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F},
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10},
+    {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F},
+    {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11},
+    {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E},
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C},
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11},
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F},
+    {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11},
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11},
+    {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},
+    {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10},
+    {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D},
+    {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11},
+    {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E},
+    {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04},
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04},
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A},
+    {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11},
+    {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04},
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}, // Z
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}, // .
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00}, // :
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}, // /
+    {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}, // -
+    {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}, // %
+    {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}, // (
+    {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}, // )
+    {0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08}, // ,
+    {0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00}, // +
+    {0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00}, // =
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F}, // _
+    {0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08}, // >
+    {0x04, 0x04, 0x04, 0x04, 0x00, 0x00, 0x04}, // !
+};
+
+static const uint8_t *glyph(char c)
+{
+    if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+    for (uint32_t i = 0; g_glyph_chars[i]; i++)
+        if (g_glyph_chars[i] == c) return g_glyphs[i];
+    return g_glyphs[0];
+}
+
+uint32_t fb_text(struct fb *fb, uint32_t x, uint32_t y, const char *s, uint32_t scale, uint32_t fg, uint32_t bg)
+{
+    uint32_t row[LINE_PIXELS];
+    const uint8_t *glyphs[LINE_PIXELS / FB_CELL_W];
+
+    if (scale == 0) scale = 1;
+    if (scale > LINE_PIXELS / FB_CELL_W) scale = LINE_PIXELS / FB_CELL_W;
+    uint32_t cell_w = FB_CELL_W * scale;
+    uint32_t per_piece = LINE_PIXELS / cell_w;
+
+    uint32_t len = 0;
+    while (s[len]) len++;
+
+    for (uint32_t first = 0; first < len; first += per_piece)
+    {
+        uint32_t count = len - first < per_piece ? len - first : per_piece;
+        uint32_t px = x + first * cell_w;
+        if (px >= fb->width) break;
+        for (uint32_t i = 0; i < count; i++) glyphs[i] = glyph(s[first + i]);
+
+        // Glyph rows 1-7 of the cell hold the font; 0 and 8 are spacing
+        for (uint32_t gy = 0; gy < FB_CELL_H; gy++)
+        {
+            uint32_t *p = row;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                uint8_t bits = gy >= 1 && gy <= 7 ? glyphs[i][gy - 1] : 0;
+                for (uint32_t gx = 0; gx < FB_CELL_W; gx++)
+                {
+                    uint32_t color = gx < 5 && (bits & (0x10 >> gx)) ? fg : bg;
+                    for (uint32_t k = 0; k < scale; k++) *p++ = color;
+                }
+            }
+            fb_blit(fb, px, y + gy * scale, count * cell_w, scale, row, 0);
+        }
+    }
+    return len * cell_w;
+}
@@ -6,6 +6,16 @@ void _start()
     volatile char *vga = (volatile char *)0xB8000;
     const char *msg = "Atlas Kernel Loaded Successfully!";
 
+#ifdef ATLAS_BENCH
+    // Benchmark builds only (bench target): tell scripts/bench_boot.py the
+    // kernel is running with a line on COM1, then leave through QEMU's
+    // isa-debug-exit port. Real hardware may have another device at 0xF4.
+    const char *mark = "kernel: entered\n";
+    for (int i = 0; mark[i]; i++)
+        __asm__ volatile("outb %0, %1" : : "a"(mark[i]), "Nd"((unsigned short)0x3F8));
+    __asm__ volatile("outb %0, %1" : : "a"((unsigned char)0), "Nd"((unsigned short)0xF4));
+#endif
+
     // Clear screen
     for (int i = 0; i < 80 * 25 * 2; i++)
         vga[i] = 0;
@@ -1,37 +1,66 @@
 #include <stdint.h>
 
-struct boot_info {
-    uint64_t fb_base;
-    uint32_t width;
-    uint32_t height;
-    uint32_t pitch;
-};
+#include "bootinfo.h"
+#include "fb.h"
+
+#define VGA_TEXT 0xB8000
+#define BG 0x00001A3A
+#define LOG_LINES 4
+
+static void vga_text(const char *msg);
+
+extern char __bss_start[];
+extern char _end[];
 
 __attribute__((noreturn))
 void _start(uint64_t fb_base_arg) {
+#ifdef ATLAS_BENCH
+    // Only in the bench target's build, as in main.c: the COM1 mark and
+    // the isa-debug-exit write that scripts/bench_boot.py waits for
+    const char *mark = "kernel: entered\n";
+    for (int i = 0; mark[i]; i++)
+        __asm__ volatile("outb %0, %1" : : "a"(mark[i]), "Nd"((uint16_t)0x3F8));
+    __asm__ volatile("outb %0, %1" : : "a"((uint8_t)0), "Nd"((uint16_t)0xF4));
+#endif
+
+    // The loader only copies the file; .bss is whatever was in RAM
+    for (char *p = __bss_start; p < _end; p++)
+        *p = 0;
+
     // Read boot info
-    struct boot_info *info = (struct boot_info*)0x1F0000;
-    
-    volatile uint32_t *fb = (volatile uint32_t*)info->fb_base;
+    struct boot_info *info = (struct boot_info*)BOOT_INFO_ADDR;
+
+    uint64_t fb_base = info->fb_base;
     uint32_t width = info->width;
     uint32_t height = info->height;
     uint32_t pitch = info->pitch;
-    
+
+    // BIOS hands over the VGA text screen, not pixels
+    if (fb_base == VGA_TEXT) {
+        vga_text("Atlas 64-bit Kernel Loaded Successfully! (text mode, no framebuffer)");
+        for (;;)
+            __asm__ volatile("hlt");
+    }
+
     // Fallback if boot info looks invalid
     if (width == 0 || width > 10000 || height == 0 || height > 10000 || pitch == 0) {
-        fb = (volatile uint32_t*)fb_base_arg;
+        fb_base = fb_base_arg;
         width = 1280;
         height = 720;
         pitch = 1280;
     }
-    
+
+    struct fb fb;
+    fb_init(&fb, fb_base, width, height, pitch);
+    fb_enable_wc(&fb);
+
     // Clear screen to dark blue
-    for (uint32_t y = 0; y < height; y++) {
-        for (uint32_t x = 0; x < width; x++) {
-            fb[y * pitch + x] = 0x00001A3A;
-        }
-    }
-    
+    fb_fill(&fb, 0, 0, width, height, BG);
+
+    uint32_t scale = width >= 960 ? 2 : 1;
+    uint32_t line_h = FB_CELL_H * scale;
+    fb_text(&fb, 20, 4, "ATLAS 64-BIT KERNEL", scale, 0x00FFFFFF, BG);
+
     // Draw a colorful grid of rectangles that fits any resolution
     uint32_t colors[] = {
         0x00FF0000, // Red
@@ -43,61 +72,72 @@ void _start(uint64_t fb_base_arg) {
         0x00FFFFFF, // White
         0x00FFA500  // Orange
     };
-    
+
     int rect_size = (width < 800) ? 80 : 150;
     int spacing = 20;
     int color_idx = 0;
-    
-    for (uint32_t y = spacing; y < height - rect_size; y += rect_size + spacing) {
+    uint32_t log_h = LOG_LINES * line_h;
+    uint32_t grid_bottom = height > log_h + 80 ? height - log_h - 80 : 0;
+
+    for (uint32_t y = spacing + line_h; y + rect_size < grid_bottom; y += rect_size + spacing) {
         for (uint32_t x = spacing; x < width - rect_size; x += rect_size + spacing) {
-            uint32_t color = colors[color_idx % 8];
-            
-            // Draw filled rectangle
-            for (uint32_t dy = 0; dy < (uint32_t)rect_size; dy++) {
-                for (uint32_t dx = 0; dx < (uint32_t)rect_size; dx++) {
-                    if (y + dy < height && x + dx < width) {
-                        fb[(y + dy) * pitch + (x + dx)] = color;
-                    }
-                }
-            }
-            
+            fb_fill(&fb, x, y, rect_size, rect_size, colors[color_idx % 8]);
             color_idx++;
         }
     }
-    
-    // Animate: bouncing square at bottom
+
+    // Animate: bouncing square at bottom, and a log above it that
+    // scrolls a line each time the square turns
     int x = 0;
     int square_size = 50;
     int y_pos = (height > square_size) ? height - square_size - 10 : 0;
     int direction = 1;
-    
+    uint32_t log_y = y_pos > (int)(log_h + 10) ? y_pos - log_h - 10 : 0;
+    uint32_t turns = 0;
+    char line[32];
+
     while(1) {
         // Clear previous position
-        for (int dy = 0; dy < square_size; dy++) {
-            for (int dx = 0; dx < square_size; dx++) {
-                if ((uint32_t)(y_pos + dy) < height && (uint32_t)(x + dx) < width) {
-                    fb[(y_pos + dy) * pitch + (x + dx)] = 0x00001A3A;
-                }
-            }
-        }
-        
+        fb_fill(&fb, x, y_pos, square_size, square_size, BG);
+
         // Move
         x += direction * 10;
-        if (x >= (int)width - square_size) direction = -1;
-        if (x <= 0) direction = 1;
-        
-        // Draw at new position
-        for (int dy = 0; dy < square_size; dy++) {
-            for (int dx = 0; dx < square_size; dx++) {
-                if ((uint32_t)(y_pos + dy) < height && (uint32_t)(x + dx) < width) {
-                    fb[(y_pos + dy) * pitch + (x + dx)] = 0x00FFFFFF;
-                }
-            }
+        if ((x >= (int)width - square_size && direction == 1) || (x <= 0 && direction == -1)) {
+            direction = -direction;
+            turns++;
+
+            // "TURN <n> USING <variant>"
+            char *p = line;
+            for (const char *s = "TURN "; *s; s++) *p++ = *s;
+            char digits[10];
+            int n = 0;
+            uint32_t v = turns;
+            do digits[n++] = '0' + v % 10; while (v /= 10);
+            while (n) *p++ = digits[--n];
+            for (const char *s = " USING "; *s; s++) *p++ = *s;
+            for (const char *s = fb_variant(); *s; s++) *p++ = *s;
+            if (fb.wc)
+                for (const char *s = ", WC"; *s; s++) *p++ = *s;
+            *p = 0;
+
+            fb_scroll(&fb, 0, log_y, width, log_h, line_h, BG);
+            fb_text(&fb, 20, log_y + log_h - line_h, line, scale, 0x00D0D0D0, BG);
         }
-        
+
+        // Draw at new position
+        fb_fill(&fb, x, y_pos, square_size, square_size, 0x00FFFFFF);
+
         // Delay
         for (volatile int i = 0; i < 2000000; i++);
     }
-    
+
     __builtin_unreachable();
-}
\ No newline at end of file
+}
+
+static void vga_text(const char *msg) {
+    volatile uint16_t *cells = (volatile uint16_t*)VGA_TEXT;
+    for (int i = 0; i < 80 * 25; i++)
+        cells[i] = 0x0720;
+    for (int i = 0; msg[i]; i++)
+        cells[i] = 0x0F00 | (uint8_t)msg[i];
+}
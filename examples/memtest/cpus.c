@@ -0,0 +1,290 @@
+// cpus.c
+// Application processors for the memory test. The loader leaves them in
+// wait-for-SIPI and lists the ones the MADT enables in the boot info
+// block; INIT-SIPI-SIPI goes to each of those by APIC ID (never as a
+// broadcast, which would also wake CPUs the firmware disabled) and the
+// trampoline below takes each from real mode to long mode on the page
+// tables the loader built. They then spin on the job pool, with
+// interrupts off, until the machine is reset.
+#include "memtest.h"
+#include "fb.h"
+
+#define LAPIC_ICR_LO 0x300
+#define LAPIC_ICR_HI 0x310
+
+#define ICR_INIT 0x500
+#define ICR_STARTUP 0x600
+#define ICR_PENDING 0x1000 // xAPIC only: previous IPI not sent yet
+#define ICR_ASSERT 0x4000
+#define ICR_LEVEL 0x8000
+
+#define MSR_APIC_BASE 0x1B
+#define APIC_BASE_EXTD (1u << 10) // x2APIC mode: registers are MSRs
+#define APIC_BASE_EN (1u << 11)
+#define X2APIC_MSR(reg) (0x800 + ((reg) >> 4))
+
+// Wait this long for every listed AP to check in, and then for the ones
+// that did to finish setting up
+#define START_TIMEOUT_MS 1000
+#define READY_TIMEOUT_MS 20
+
+// Stacks for every CPU, the boot CPU's first (main64.c, _start)
+uint8_t mt_stacks[MT_MAX_CPUS][MT_STACK_SIZE] __attribute__((aligned(16)));
+const uint64_t mt_stack_size = MT_STACK_SIZE;
+
+// Read by the trampoline: page tables, and the arrival counter that
+// hands each AP its stack
+uint32_t mt_ap_cr3;
+uint32_t mt_ap_next;
+uint32_t mt_ap_limit;
+
+extern const uint8_t mt_trampoline[];
+extern const uint8_t mt_trampoline_end[];
+
+// SIPI lands in the copy at MT_TRAMPOLINE_ADDR with CS = 0x0600, IP = 0;
+// only this first part runs from there. It enters protected mode on a
+// GDT in the image, then long mode, then the C side on its own stack.
+__asm__(".section .text\n"
+        ".code16\n"
+        ".globl mt_trampoline\n"
+        ".globl mt_trampoline_end\n"
+        "mt_trampoline:\n"
+        "    cli\n"
+        "    mov %cs, %ax\n"
+        "    mov %ax, %ds\n"
+        "    lgdtl mt_trampoline_gdtr - mt_trampoline\n"
+        "    mov %cr0, %eax\n"
+        "    or $1, %al\n"
+        "    mov %eax, %cr0\n"
+        "    ljmpl $0x18, $mt_ap_entry32\n"
+        "    .balign 4\n"
+        "mt_trampoline_gdtr:\n"
+        "    .word mt_gdt_end - mt_gdt - 1\n"
+        "    .long mt_gdt\n"
+        "mt_trampoline_end:\n"
+        "\n"
+        ".code32\n"
+        "mt_ap_entry32:\n"
+        "    mov $0x10, %ax\n"
+        "    mov %ax, %ds\n"
+        "    mov %ax, %es\n"
+        "    mov %ax, %ss\n"
+        "    mov %cr4, %eax\n"
+        "    or $0x620, %eax\n"          // PAE, OSFXSR, OSXMMEXCPT
+        "    mov %eax, %cr4\n"
+        "    mov mt_ap_cr3, %eax\n"
+        "    mov %eax, %cr3\n"
+        "    mov $0xC0000080, %ecx\n"    // EFER.LME
+        "    rdmsr\n"
+        "    or $0x100, %eax\n"
+        "    wrmsr\n"
+        "    mov %cr0, %eax\n"
+        "    and $0x9FFFFFFB, %eax\n"    // INIT leaves the caches off (CD, NW); no x87 emulation (EM)
+        "    or $0x80000002, %eax\n"     // PG, MP
+        "    mov %eax, %cr0\n"
+        "    ljmp $0x08, $mt_ap_entry64\n"
+        "\n"
+        ".code64\n"
+        "mt_ap_entry64:\n"
+        "    mov $0x10, %ax\n"
+        "    mov %ax, %ds\n"
+        "    mov %ax, %es\n"
+        "    mov %ax, %ss\n"
+        "    xor %eax, %eax\n"
+        "    mov %ax, %fs\n"
+        "    mov %ax, %gs\n"
+        "    fninit\n"
+        "    mov $1, %eax\n"
+        "    lock xadd %eax, mt_ap_next(%rip)\n"
+        "    cmp mt_ap_limit(%rip), %eax\n"
+        "    jae 2f\n"
+        "    mov %eax, %edi\n"               // mt_ap_main(index)
+        "    lea 2(%rax), %rsp\n"            // Stack index + 1, top of it
+        "    imul mt_stack_size(%rip), %rsp\n"
+        "    lea mt_stacks(%rip), %rax\n"
+        "    add %rax, %rsp\n"
+        "    call mt_ap_main\n"
+        "2:  cli\n"
+        "    hlt\n"
+        "    jmp 2b\n"
+        "\n"
+        "    .balign 8\n"
+        "mt_gdt:\n"
+        "    .quad 0\n"
+        "    .quad 0x00AF9B000000FFFF\n"     // 0x08 64-bit code
+        "    .quad 0x00CF93000000FFFF\n"     // 0x10 data
+        "    .quad 0x00CF9B000000FFFF\n"     // 0x18 32-bit code
+        "mt_gdt_end:\n");
+
+static volatile uint32_t *g_lapic;
+static int g_x2apic;
+static uint32_t g_tsc_khz;
+static uint32_t g_workers = 1;
+static volatile uint32_t g_ready[MT_MAX_CPUS];
+
+static struct
+{
+    mt_job_fn fn;
+    void *ctx;
+    uint32_t count;
+    uint32_t workers;             // Taking part in this job
+    volatile uint32_t next;       // Next item to claim
+    volatile uint32_t active;     // APs still working on it
+    volatile uint32_t generation; // Bumped for each job
+} g_job;
+
+static inline void cpu_pause(void)
+{
+    __asm__ volatile("pause");
+}
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t rdmsr(uint32_t msr)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value)
+{
+    __asm__ volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+// TSC busy-wait. Without a calibrated TSC, assume a fast one: waiting
+// too long is harmless here, too short is not.
+static void delay_us(uint32_t us)
+{
+    uint64_t per_us = g_tsc_khz ? g_tsc_khz / 1000 + 1 : 6000;
+    uint64_t end = rdtsc() + per_us * us;
+    while (rdtsc() < end)
+        cpu_pause();
+}
+
+static void send_ipi(uint32_t apic_id, uint32_t icr)
+{
+    if (g_x2apic)
+    {
+        wrmsr(X2APIC_MSR(LAPIC_ICR_LO), ((uint64_t)apic_id << 32) | icr);
+        return;
+    }
+    while (g_lapic[LAPIC_ICR_LO / 4] & ICR_PENDING)
+        cpu_pause();
+    g_lapic[LAPIC_ICR_HI / 4] = apic_id << 24;
+    g_lapic[LAPIC_ICR_LO / 4] = icr;
+}
+
+static void run_items(void (*poll)(void))
+{
+    uint32_t i;
+    while ((i = __atomic_fetch_add(&g_job.next, 1, __ATOMIC_RELAXED)) < g_job.count)
+    {
+        g_job.fn(g_job.ctx, i);
+        if (poll) poll();
+    }
+}
+
+void mt_ap_main(uint32_t index)
+{
+    uint32_t self = index + 1;
+    // INIT put this CPU's PAT back to its reset value; the framebuffer
+    // pages in the shared tables need the boot CPU's WC entry
+    fb_sync_pat();
+    mt_cpu_init();
+    __atomic_store_n(&g_ready[self], 1, __ATOMIC_RELEASE);
+
+    uint32_t seen = 0;
+    for (;;)
+    {
+        while (__atomic_load_n(&g_job.generation, __ATOMIC_ACQUIRE) == seen)
+            cpu_pause();
+        seen = g_job.generation;
+        if (self < g_job.workers)
+        {
+            run_items(0);
+            __atomic_sub_fetch(&g_job.active, 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+uint32_t mt_cpus_start(uint32_t tsc_khz, const uint32_t *apic_ids, uint32_t count)
+{
+    g_tsc_khz = tsc_khz;
+    g_workers = 1;
+    if (count == 0) return 1;
+    if (count > MT_MAX_CPUS - 1) count = MT_MAX_CPUS - 1;
+
+    uint64_t base = rdmsr(MSR_APIC_BASE);
+    if (!(base & APIC_BASE_EN)) return 1;
+    g_x2apic = (base & APIC_BASE_EXTD) != 0;
+    g_lapic = (volatile uint32_t *)(uintptr_t)(base & 0xFFFFF000);
+
+    // The trampoline loads CR3 in 32-bit code
+    uint64_t cr3;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+    if (cr3 >= 0x100000000ull) return 1;
+    mt_ap_cr3 = (uint32_t)cr3;
+    mt_ap_next = 0;
+    mt_ap_limit = count;
+
+    uint8_t *dst = (uint8_t *)MT_TRAMPOLINE_ADDR;
+    for (const uint8_t *src = mt_trampoline; src < mt_trampoline_end; src++)
+        *dst++ = *src;
+
+    // INIT all of them, then the SIPIs: one wait for the lot
+    for (uint32_t i = 0; i < count; i++)
+    {
+        send_ipi(apic_ids[i], ICR_INIT | ICR_ASSERT | ICR_LEVEL);
+        if (!g_x2apic) send_ipi(apic_ids[i], ICR_INIT | ICR_LEVEL); // Deassert (P6 and older)
+    }
+    delay_us(10000);
+    for (int sipi = 0; sipi < 2; sipi++)
+    {
+        for (uint32_t i = 0; i < count; i++)
+            send_ipi(apic_ids[i], ICR_STARTUP | (MT_TRAMPOLINE_ADDR >> 12));
+        delay_us(200);
+    }
+
+    for (uint32_t ms = 0; __atomic_load_n(&mt_ap_next, __ATOMIC_ACQUIRE) < count && ms < START_TIMEOUT_MS; ms++)
+        delay_us(1000);
+    uint32_t arrived = __atomic_load_n(&mt_ap_next, __ATOMIC_ACQUIRE);
+    if (arrived > count) arrived = count;
+
+    // Workers are numbered in arrival order: take the ones that have
+    // finished setting up, up to the first gap
+    for (uint32_t ms = 0; g_workers <= arrived && ms < READY_TIMEOUT_MS;)
+    {
+        if (g_ready[g_workers])
+            g_workers++;
+        else
+        {
+            delay_us(1000);
+            ms++;
+        }
+    }
+    return g_workers;
+}
+
+void mt_parallel(uint32_t count, mt_job_fn fn, void *ctx, void (*poll)(void))
+{
+    g_job.fn = fn;
+    g_job.ctx = ctx;
+    g_job.count = count;
+    g_job.workers = g_workers;
+    g_job.next = 0;
+    g_job.active = g_workers - 1;
+    __atomic_add_fetch(&g_job.generation, 1, __ATOMIC_RELEASE);
+
+    run_items(poll);
+    while (__atomic_load_n(&g_job.active, __ATOMIC_ACQUIRE))
+    {
+        if (poll) poll();
+        cpu_pause();
+    }
+}
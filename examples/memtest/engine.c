@@ -0,0 +1,577 @@
+// engine.c
+// Pattern kernels for the memory test, one variant per instruction set.
+// Writes are non-temporal stores, so the data under test never sits in
+// the caches; reads are streaming loads (AVX2) or follow NTA prefetches
+// (SSE2), so every compare reads DRAM. A kernel stops at the first
+// 64-byte block that differs from the pattern and returns it; mt_run
+// finds the bad words in it with scalar code and carries on after it.
+#include "memtest.h"
+
+#define CR4_OSXSAVE (1u << 18)
+#define CPUID1_XSAVE (1u << 26)
+#define CPUID1_AVX (1u << 28)
+#define CPUID7_AVX2 (1u << 5)
+#define XCR0_AVX 0x7 // x87, SSE and AVX state
+
+struct mt_kernels
+{
+    const char *name;
+    void (*fill_const)(uint64_t *p, uint64_t *end, uint64_t value);
+    uint64_t *(*check_const)(uint64_t *p, uint64_t *end, uint64_t value);
+    uint64_t *(*invert_up)(uint64_t *p, uint64_t *end, uint64_t value);
+    uint64_t *(*invert_down)(uint64_t *p, uint64_t *end, uint64_t value);
+    void (*fill_seq)(uint64_t *p, uint64_t *end, const struct mt_step *s);
+    uint64_t *(*check_seq)(uint64_t *p, uint64_t *end, const struct mt_step *s);
+};
+
+static const struct mt_kernels *g_kernels;
+
+static void cpuid(uint32_t leaf, uint32_t sub, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
+{
+    __asm__ volatile("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(sub));
+}
+
+static int has_avx2(void)
+{
+    uint32_t a, b, c, d;
+    cpuid(0, 0, &a, &b, &c, &d);
+    if (a < 7) return 0;
+    cpuid(1, 0, &a, &b, &c, &d);
+    if ((c & (CPUID1_XSAVE | CPUID1_AVX)) != (CPUID1_XSAVE | CPUID1_AVX)) return 0;
+    cpuid(7, 0, &a, &b, &c, &d);
+    return (b & CPUID7_AVX2) != 0;
+}
+
+void mt_cpu_init(void)
+{
+    // _start and the AP entry have already turned on SSE (CR0.MP,
+    // CR4.OSFXSR); AVX also needs XSAVE enabled and its state in XCR0
+    if (!has_avx2()) return;
+    uint64_t cr4;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4 | CR4_OSXSAVE));
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    __asm__ volatile("xsetbv" : : "a"(lo | XCR0_AVX), "d"(hi), "c"(0));
+}
+
+// Starting addresses of the words in one block, for the SEQ kernels
+static void block_addresses(uint64_t out[8], const uint64_t *p)
+{
+    for (int i = 0; i < 8; i++)
+        out[i] = (uint64_t)(uintptr_t)(p + i);
+}
+
+// ------------------------------------------------------------------ SSE2
+
+__attribute__((target("sse2"))) static void fill_const_sse2(uint64_t *p, uint64_t *end, uint64_t value)
+{
+    __asm__ volatile("movq %[value], %%xmm0\n\t"
+                     "punpcklqdq %%xmm0, %%xmm0\n\t"
+                     "1:\n\t"
+                     "movntdq %%xmm0, (%[p])\n\t"
+                     "movntdq %%xmm0, 16(%[p])\n\t"
+                     "movntdq %%xmm0, 32(%[p])\n\t"
+                     "movntdq %%xmm0, 48(%[p])\n\t"
+                     "add $64, %[p]\n\t"
+                     "cmp %[end], %[p]\n\t"
+                     "jb 1b\n\t"
+                     "sfence"
+                     : [p] "+r"(p)
+                     : [end] "r"(end), [value] "r"(value)
+                     : "xmm0", "memory", "cc");
+}
+
+// Compare one block with xmm0; leaves the byte mask in mask (0xFFFF = match)
+#define SSE2_COMPARE                           \
+    "movdqa (%[p]), %%xmm1\n\t"                \
+    "movdqa 16(%[p]), %%xmm2\n\t"              \
+    "movdqa 32(%[p]), %%xmm3\n\t"              \
+    "movdqa 48(%[p]), %%xmm4\n\t"              \
+    "pcmpeqd %%xmm0, %%xmm1\n\t"               \
+    "pcmpeqd %%xmm0, %%xmm2\n\t"               \
+    "pcmpeqd %%xmm0, %%xmm3\n\t"               \
+    "pcmpeqd %%xmm0, %%xmm4\n\t"               \
+    "pand %%xmm2, %%xmm1\n\t"                  \
+    "pand %%xmm4, %%xmm3\n\t"                  \
+    "pand %%xmm3, %%xmm1\n\t"                  \
+    "pmovmskb %%xmm1, %k[mask]\n\t"            \
+    "cmp $0xFFFF, %k[mask]\n\t"
+
+__attribute__((target("sse2"))) static uint64_t *check_const_sse2(uint64_t *p, uint64_t *end, uint64_t value)
+{
+    uint32_t mask;
+    __asm__ volatile("movq %[value], %%xmm0\n\t"
+                     "punpcklqdq %%xmm0, %%xmm0\n\t"
+                     "1:\n\t"
+                     "prefetchnta 512(%[p])\n\t"
+                     SSE2_COMPARE
+                     "jne 2f\n\t"
+                     "add $64, %[p]\n\t"
+                     "cmp %[end], %[p]\n\t"
+                     "jb 1b\n\t"
+                     "xor %[p], %[p]\n\t"
+                     "2:"
+                     : [p] "+r"(p), [mask] "=&r"(mask)
+                     : [end] "r"(end), [value] "r"(value)
+                     : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "memory", "cc");
+    return p;
+}
+
+__attribute__((target("sse2"))) static uint64_t *invert_up_sse2(uint64_t *p, uint64_t *end, uint64_t value)
+{
+    uint32_t mask;
+    __asm__ volatile("movq %[value], %%xmm0\n\t"
+                     "punpcklqdq %%xmm0, %%xmm0\n\t"
+                     "pcmpeqd %%xmm5, %%xmm5\n\t"
+                     "pxor %%xmm0, %%xmm5\n\t"
+                     "1:\n\t"
+                     "prefetchnta 512(%[p])\n\t"
+                     SSE2_COMPARE
+                     "jne 2f\n\t"
+                     "movntdq %%xmm5, (%[p])\n\t"
+                     "movntdq %%xmm5, 16(%[p])\n\t"
+                     "movntdq %%xmm5, 32(%[p])\n\t"
+                     "movntdq %%xmm5, 48(%[p])\n\t"
+                     "add $64, %[p]\n\t"
+                     "cmp %[end], %[p]\n\t"
+                     "jb 1b\n\t"
+                     "xor %[p], %[p]\n\t"
+                     "2:\n\t"
+                     "sfence"
+                     : [p] "+r"(p), [mask] "=&r"(mask)
+                     : [end] "r"(end), [value] "r"(value)
+                     : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "memory", "cc");
+    return p;
+}
+
+// Walks down from `end`; returns the bad block, or 0 once `start` is done
+__attribute__((target("sse2"))) static uint64_t *invert_down_sse2(uint64_t *start, uint64_t *end, uint64_t value)
+{
+    uint64_t *p = end;
+    uint32_t mask;
+    __asm__ volatile("movq %[value], %%xmm0\n\t"
+                     "punpcklqdq %%xmm0, %%xmm0\n\t"
+                     "pcmpeqd %%xmm5, %%xmm5\n\t"
+                     "pxor %%xmm0, %%xmm5\n\t"
+                     "1:\n\t"
+                     "sub $64, %[p]\n\t"
+                     "prefetchnta -512(%[p])\n\t"
+                     SSE2_COMPARE
+                     "jne 2f\n\t"
+                     "movntdq %%xmm5, (%[p])\n\t"
+                     "movntdq %%xmm5, 16(%[p])\n\t"
+                     "movntdq %%xmm5, 32(%[p])\n\t"
+                     "movntdq %%xmm5, 48(%[p])\n\t"
+                     "cmp %[start], %[p]\n\t"
+                     "ja 1b\n\t"
+                     "xor %[p], %[p]\n\t"
+                     "2:\n\t"
+                     "sfence"
+                     : [p] "+r"(p), [mask] "=&r"(mask)
+                     : [start] "r"(start), [value] "r"(value)
+                     : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "memory", "cc");
+    return p;
+}
+
+// x = (a ^ key) ^ lo32(a ^ key) * mul; x ^= x >> shift, for the address
+// vector `a`, into xmm8. key xmm4, mul xmm5, shift xmm6; xmm9 is scratch.
+#define SSE2_SEQ(a)                            \
+    "movdqa " a ", %%xmm8\n\t"                 \
+    "pxor %%xmm4, %%xmm8\n\t"                  \
+    "movdqa %%xmm8, %%xmm9\n\t"                \
+    "pmuludq %%xmm5, %%xmm9\n\t"               \
+    "pxor %%xmm9, %%xmm8\n\t"                  \
+    "movdqa %%xmm8, %%xmm9\n\t"                \
+    "psrlq %%xmm6, %%xmm9\n\t"                 \
+    "pxor %%xmm9, %%xmm8\n\t"                  \
+    "paddq %%xmm7, " a "\n\t"
+
+#define SSE2_SEQ_SETUP                         \
+    "movdqu (%[args]), %%xmm0\n\t"             \
+    "movdqu 16(%[args]), %%xmm1\n\t"           \
+    "movdqu 32(%[args]), %%xmm2\n\t"           \
+    "movdqu 48(%[args]), %%xmm3\n\t"           \
+    "movq 64(%[args]), %%xmm4\n\t"             \
+    "punpcklqdq %%xmm4, %%xmm4\n\t"            \
+    "movq 72(%[args]), %%xmm5\n\t"             \
+    "punpcklqdq %%xmm5, %%xmm5\n\t"            \
+    "movq 80(%[args]), %%xmm6\n\t"             \
+    "movq 88(%[args]), %%xmm7\n\t"             \
+    "punpcklqdq %%xmm7, %%xmm7\n\t"
+
+// Loop state for the SEQ kernels: the addresses of one block, then the
+// pattern constants and the per-block address step
+struct seq_args
+{
+    uint64_t addr[8];
+    uint64_t key;
+    uint64_t mul;
+    uint64_t shift;
+    uint64_t step;
+};
+
+static void seq_args(struct seq_args *a, const uint64_t *p, const struct mt_step *s)
+{
+    block_addresses(a->addr, p);
+    a->key = s->key;
+    a->mul = s->mul & 0xFFFFFFFF;
+    a->shift = s->shift;
+    a->step = MT_BLOCK;
+}
+
+__attribute__((target("sse2"))) static void fill_seq_sse2(uint64_t *p, uint64_t *end, const struct mt_step *s)
+{
+    struct seq_args a;
+    seq_args(&a, p, s);
+    __asm__ volatile(SSE2_SEQ_SETUP
+                     "1:\n\t"
+                     SSE2_SEQ("%%xmm0")
+                     "movntdq %%xmm8, (%[p])\n\t"
+                     SSE2_SEQ("%%xmm1")
+                     "movntdq %%xmm8, 16(%[p])\n\t"
+                     SSE2_SEQ("%%xmm2")
+                     "movntdq %%xmm8, 32(%[p])\n\t"
+                     SSE2_SEQ("%%xmm3")
+                     "movntdq %%xmm8, 48(%[p])\n\t"
+                     "add $64, %[p]\n\t"
+                     "cmp %[end], %[p]\n\t"
+                     "jb 1b\n\t"
+                     "sfence"
+                     : [p] "+r"(p)
+                     : [end] "r"(end), [args] "r"(&a)
+                     : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8", "xmm9",
+                       "memory", "cc");
+}
+
+__attribute__((target("sse2"))) static uint64_t *check_seq_sse2(uint64_t *p, uint64_t *end, const struct mt_step *s)
+{
+    struct seq_args a;
+    uint32_t mask;
+    seq_args(&a, p, s);
+    __asm__ volatile(SSE2_SEQ_SETUP
+                     "1:\n\t"
+                     "prefetchnta 512(%[p])\n\t"
+                     SSE2_SEQ("%%xmm0")
+                     "pcmpeqd (%[p]), %%xmm8\n\t"
+                     "movdqa %%xmm8, %%xmm10\n\t"
+                     SSE2_SEQ("%%xmm1")
+                     "pcmpeqd 16(%[p]), %%xmm8\n\t"
+                     "pand %%xmm8, %%xmm10\n\t"
+                     SSE2_SEQ("%%xmm2")
+                     "pcmpeqd 32(%[p]), %%xmm8\n\t"
+                     "pand %%xmm8, %%xmm10\n\t"
+                     SSE2_SEQ("%%xmm3")
+                     "pcmpeqd 48(%[p]), %%xmm8\n\t"
+                     "pand %%xmm8, %%xmm10\n\t"
+                     "pmovmskb %%xmm10, %k[mask]\n\t"
+                     "cmp $0xFFFF, %k[mask]\n\t"
+                     "jne 2f\n\t"
+                     "add $64, %[p]\n\t"
+                     "cmp %[end], %[p]\n\t"
+                     "jb 1b\n\t"
+                     "xor %[p], %[p]\n\t"
+                     "2:"
+                     : [p] "+r"(p), [mask] "=&r"(mask)
+                     : [end] "r"(end), [args] "r"(&a)
+                     : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8", "xmm9",
+                       "xmm10", "memory", "cc");
+    return p;
+}
+
+static const struct mt_kernels g_sse2 = {
+    "SSE2", fill_const_sse2, check_const_sse2, invert_up_sse2, invert_down_sse2, fill_seq_sse2, check_seq_sse2,
+};
+
+// ------------------------------------------------------------------ AVX2
+
+__attribute__((target("avx2"))) static void fill_const_avx2(uint64_t *p, uint64_t *end, uint64_t value)
+{
+    __asm__ volatile("vmovq %[value], %%xmm0\n\t"
+                     "vpbroadcastq %%xmm0, %%ymm0\n\t"
+                     "1:\n\t"
+                     "vmovntdq %%ymm0, (%[p])\n\t"
+                     "vmovntdq %%ymm0, 32(%[p])\n\t"
+                     "add $64, %[p]\n\t"
+                     "cmp %[end], %[p]\n\t"
+                     "jb 1b\n\t"
+                     "sfence\n\t"
+                     "vzeroupper"
+                     : [p] "+r"(p)
+                     : [end] "r"(end), [value] "r"(value)
+                     : "xmm0", "memory", "cc");
+}
+
+// Streaming loads of one block compared with ymm0; ZF clear on a mismatch
+#define AVX2_COMPARE                           \
+    "vmovntdqa (%[p]), %%ymm1\n\t"             \
+    "vmovntdqa 32(%[p]), %%ymm2\n\t"           \
+    "vpxor %%ymm0, %%ymm1, %%ymm1\n\t"         \
+    "vpxor %%ymm0, %%ymm2, %%ymm2\n\t"         \
+    "vpor %%ymm2, %%ymm1, %%ymm1\n\t"          \
+    "vptest %%ymm1, %%ymm1\n\t"
+
+__attribute__((target("avx2"))) static uint64_t *check_const_avx2(uint64_t *p, uint64_t *end, uint64_t value)
+{
+    __asm__ volatile("vmovq %[value], %%xmm0\n\t"
+                     "vpbroadcastq %%xmm0, %%ymm0\n\t"
+                     "1:\n\t"
+                     AVX2_COMPARE
+                     "jnz 2f\n\t"
+                     "add $64, %[p]\n\t"
+                     "cmp %[end], %[p]\n\t"
+                     "jb 1b\n\t"
+                     "xor %[p], %[p]\n\t"
+                     "2:\n\t"
+                     "vzeroupper"
+                     : [p] "+r"(p)
+                     : [end] "r"(end), [value] "r"(value)
+                     : "xmm0", "xmm1", "xmm2", "memory", "cc");
+    return p;
+}
+
+__attribute__((target("avx2"))) static uint64_t *invert_up_avx2(uint64_t *p, uint64_t *end, uint64_t value)
+{
+    __asm__ volatile("vmovq %[value], %%xmm0\n\t"
+                     "vpbroadcastq %%xmm0, %%ymm0\n\t"
+                     "vpcmpeqq %%ymm3, %%ymm3, %%ymm3\n\t"
+                     "vpxor %%ymm0, %%ymm3, %%ymm3\n\t"
+                     "1:\n\t"
+                     AVX2_COMPARE
+                     "jnz 2f\n\t"
+                     "vmovntdq %%ymm3, (%[p])\n\t"
+                     "vmovntdq %%ymm3, 32(%[p])\n\t"
+                     "add $64, %[p]\n\t"
+                     "cmp %[end], %[p]\n\t"
+                     "jb 1b\n\t"
+                     "xor %[p], %[p]\n\t"
+                     "2:\n\t"
+                     "sfence\n\t"
+                     "vzeroupper"
+                     : [p] "+r"(p)
+                     : [end] "r"(end), [value] "r"(value)
+                     : "xmm0", "xmm1", "xmm2", "xmm3", "memory", "cc");
+    return p;
+}
+
+__attribute__((target("avx2"))) static uint64_t *invert_down_avx2(uint64_t *start, uint64_t *end, uint64_t value)
+{
+    uint64_t *p = end;
+    __asm__ volatile("vmovq %[value], %%xmm0\n\t"
+                     "vpbroadcastq %%xmm0, %%ymm0\n\t"
+                     "vpcmpeqq %%ymm3, %%ymm3, %%ymm3\n\t"
+                     "vpxor %%ymm0, %%ymm3, %%ymm3\n\t"
+                     "1:\n\t"
+                     "sub $64, %[p]\n\t"
+                     AVX2_COMPARE
+                     "jnz 2f\n\t"
+                     "vmovntdq %%ymm3, (%[p])\n\t"
+                     "vmovntdq %%ymm3, 32(%[p])\n\t"
+                     "cmp %[start], %[p]\n\t"
+                     "ja 1b\n\t"
+                     "xor %[p], %[p]\n\t"
+                     "2:\n\t"
+                     "sfence\n\t"
+                     "vzeroupper"
+                     : [p] "+r"(p)
+                     : [start] "r"(start), [value] "r"(value)
+                     : "xmm0", "xmm1", "xmm2", "xmm3", "memory", "cc");
+    return p;
+}
+
+// The SSE2_SEQ step on four words: address vector `a` in, ymm8 out
+#define AVX2_SEQ(a)                            \
+    "vpxor %%ymm4, " a ", %%ymm8\n\t"          \
+    "vpmuludq %%ymm5, %%ymm8, %%ymm9\n\t"      \
+    "vpxor %%ymm9, %%ymm8, %%ymm8\n\t"         \
+    "vpsrlq %%xmm6, %%ymm8, %%ymm9\n\t"        \
+    "vpxor %%ymm9, %%ymm8, %%ymm8\n\t"         \
+    "vpaddq %%ymm7, " a ", " a "\n\t"
+
+#define AVX2_SEQ_SETUP                         \
+    "vmovdqu (%[args]), %%ymm0\n\t"            \
+    "vmovdqu 32(%[args]), %%ymm1\n\t"          \
+    "vpbroadcastq 64(%[args]), %%ymm4\n\t"     \
+    "vpbroadcastq 72(%[args]), %%ymm5\n\t"     \
+    "vmovq 80(%[args]), %%xmm6\n\t"            \
+    "vpbroadcastq 88(%[args]), %%ymm7\n\t"
+
+__attribute__((target("avx2"))) static void fill_seq_avx2(uint64_t *p, uint64_t *end, const struct mt_step *s)
+{
+    struct seq_args a;
+    seq_args(&a, p, s);
+    __asm__ volatile(AVX2_SEQ_SETUP
+                     "1:\n\t"
+                     AVX2_SEQ("%%ymm0")
+                     "vmovntdq %%ymm8, (%[p])\n\t"
+                     AVX2_SEQ("%%ymm1")
+                     "vmovntdq %%ymm8, 32(%[p])\n\t"
+                     "add $64, %[p]\n\t"
+                     "cmp %[end], %[p]\n\t"
+                     "jb 1b\n\t"
+                     "sfence\n\t"
+                     "vzeroupper"
+                     : [p] "+r"(p)
+                     : [end] "r"(end), [args] "r"(&a)
+                     : "xmm0", "xmm1", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8", "xmm9", "memory", "cc");
+}
+
+__attribute__((target("avx2"))) static uint64_t *check_seq_avx2(uint64_t *p, uint64_t *end, const struct mt_step *s)
+{
+    struct seq_args a;
+    seq_args(&a, p, s);
+    __asm__ volatile(AVX2_SEQ_SETUP
+                     "1:\n\t"
+                     AVX2_SEQ("%%ymm0")
+                     "vmovntdqa (%[p]), %%ymm10\n\t"
+                     "vpxor %%ymm8, %%ymm10, %%ymm10\n\t"
+                     AVX2_SEQ("%%ymm1")
+                     "vmovntdqa 32(%[p]), %%ymm11\n\t"
+                     "vpxor %%ymm8, %%ymm11, %%ymm11\n\t"
+                     "vpor %%ymm11, %%ymm10, %%ymm10\n\t"
+                     "vptest %%ymm10, %%ymm10\n\t"
+                     "jnz 2f\n\t"
+                     "add $64, %[p]\n\t"
+                     "cmp %[end], %[p]\n\t"
+                     "jb 1b\n\t"
+                     "xor %[p], %[p]\n\t"
+                     "2:\n\t"
+                     "vzeroupper"
+                     : [p] "+r"(p)
+                     : [end] "r"(end), [args] "r"(&a)
+                     : "xmm0", "xmm1", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8", "xmm9", "xmm10", "xmm11",
+                       "memory", "cc");
+    return p;
+}
+
+static const struct mt_kernels g_avx2 = {
+    "AVX2", fill_const_avx2, check_const_avx2, invert_up_avx2, invert_down_avx2, fill_seq_avx2, check_seq_avx2,
+};
+
+// ---------------------------------------------------------------- errors
+
+static volatile uint64_t g_error_count;
+static volatile uint32_t g_error_lock;
+static struct mt_error g_error_log[MT_ERROR_LOG];
+static uint32_t g_error_next;
+
+static void hex64(char *out, uint64_t v)
+{
+    for (int i = 15; i >= 0; i--, v >>= 4)
+        out[i] = "0123456789ABCDEF"[v & 0xF];
+}
+
+static void report(uint64_t addr, uint64_t expected, uint64_t actual)
+{
+    uint64_t n = __atomic_add_fetch(&g_error_count, 1, __ATOMIC_RELAXED);
+    while (__atomic_exchange_n(&g_error_lock, 1, __ATOMIC_ACQUIRE))
+        __asm__ volatile("pause");
+
+    struct mt_error *e = &g_error_log[g_error_next++ % MT_ERROR_LOG];
+    e->addr = addr;
+    e->expected = expected;
+    e->actual = actual;
+
+    // A failing DIMM can produce millions; the screen keeps the latest
+    if (n <= 1000)
+    {
+        char line[] = "memtest: error at ................ expected ................ read ................\n";
+        hex64(line + 18, addr);
+        hex64(line + 44, expected);
+        hex64(line + 66, actual);
+        mt_log(line);
+    }
+    __atomic_store_n(&g_error_lock, 0, __ATOMIC_RELEASE);
+}
+
+uint64_t mt_error_count(void)
+{
+    return g_error_count;
+}
+
+uint32_t mt_error_latest(struct mt_error *out, uint32_t max)
+{
+    while (__atomic_exchange_n(&g_error_lock, 1, __ATOMIC_ACQUIRE))
+        __asm__ volatile("pause");
+    uint32_t n = g_error_next < MT_ERROR_LOG ? g_error_next : MT_ERROR_LOG;
+    if (n > max) n = max;
+    for (uint32_t i = 0; i < n; i++)
+        out[i] = g_error_log[(g_error_next - 1 - i) % MT_ERROR_LOG];
+    __atomic_store_n(&g_error_lock, 0, __ATOMIC_RELEASE);
+    return n;
+}
+
+// ------------------------------------------------------------------ steps
+
+void mt_engine_init(void)
+{
+    g_kernels = has_avx2() ? &g_avx2 : &g_sse2;
+}
+
+const char *mt_engine_variant(void)
+{
+    return g_kernels->name;
+}
+
+uint64_t mt_expected(const struct mt_step *step, uint64_t addr)
+{
+    if (step->kind == MT_CONST) return step->value;
+
+    uint64_t x = addr ^ step->key;
+    x ^= (x & 0xFFFFFFFF) * (step->mul & 0xFFFFFFFF);
+    return step->shift < 64 ? x ^ (x >> step->shift) : x;
+}
+
+// Scalar pass over a block a kernel stopped at: report each bad word and,
+// for the inversions, write the complement the kernel would have
+static void block_failed(const struct mt_step *step, uint64_t *block)
+{
+    volatile uint64_t *w = block;
+    for (int i = 0; i < MT_BLOCK / 8; i++)
+    {
+        uint64_t addr = (uint64_t)(uintptr_t)(block + i);
+        uint64_t expected = mt_expected(step, addr);
+        uint64_t actual = w[i];
+        if (actual != expected) report(addr, expected, actual);
+        if (step->op == MT_INVERT_UP || step->op == MT_INVERT_DOWN) w[i] = ~expected;
+    }
+}
+
+void mt_run(const struct mt_step *step, uint64_t start, uint64_t end)
+{
+    const struct mt_kernels *k = g_kernels;
+    uint64_t *p = (uint64_t *)(uintptr_t)start;
+    uint64_t *e = (uint64_t *)(uintptr_t)end;
+    uint64_t *bad;
+
+    while (p < e)
+    {
+        switch (step->op)
+        {
+        case MT_FILL:
+            if (step->kind == MT_CONST)
+                k->fill_const(p, e, step->value);
+            else
+                k->fill_seq(p, e, step);
+            return;
+        case MT_CHECK:
+            bad = step->kind == MT_CONST ? k->check_const(p, e, step->value) : k->check_seq(p, e, step);
+            if (!bad) return;
+            block_failed(step, bad);
+            p = bad + MT_BLOCK / 8;
+            break;
+        case MT_INVERT_UP:
+            bad = k->invert_up(p, e, step->value);
+            if (!bad) return;
+            block_failed(step, bad);
+            p = bad + MT_BLOCK / 8;
+            break;
+        case MT_INVERT_DOWN:
+            bad = k->invert_down(p, e, step->value);
+            if (!bad) return;
+            block_failed(step, bad);
+            e = bad;
+            break;
+        }
+    }
+}
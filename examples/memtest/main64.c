@@ -1,201 +1,545 @@
-#include <stdint.h>
+// main64.c
+// Memory test payload for 64-bit boots (TEST64.BIN). It tests every RAM
+// range of the loader's memory map above 1 MB, except its own image,
+// on all CPUs, in endless passes of address-in-address, moving
+// inversions and random sequence tests. Progress, speed and the latest
+// error addresses are drawn on the framebuffer (or the VGA text screen
+// on BIOS) and every error is logged on COM1.
+#include "memtest.h"
+#include "bootinfo.h"
+#include "fb.h"
 
-struct boot_info {
-    uint64_t fb_base;
-    uint32_t width;
-    uint32_t height;
-    uint32_t pitch;
-};
+#define LOW_MEMORY 0x100000 // BIOS data, the loader and the AP trampoline live below
+#define PAGE 0x1000
+#define VGA_TEXT 0xB8000
+#define COM1 0x3F8
+#define MAX_RANGES BOOT_INFO_MAX_MMAP
 
-// Memory test patterns
-#define PATTERN_1 0xAAAAAAAAAAAAAAAAUL
-#define PATTERN_2 0x5555555555555555UL
-#define PATTERN_3 0xDEADBEEFCAFEBABEUL
-#define PATTERN_4 0x0123456789ABCDEFUL
-
-// Colors
-#define COLOR_BG      0x00001020
-#define COLOR_TITLE   0x00003060
-#define COLOR_GREEN   0x0000FF00
-#define COLOR_RED     0x00FF0000
-#define COLOR_YELLOW  0x00FFFF00
-#define COLOR_CYAN    0x0000FFFF
-#define COLOR_WHITE   0x00FFFFFF
-
-// Draw a filled rectangle
-static void draw_rect(uint32_t *fb, uint32_t pitch, int x, int y, int w, int h, uint32_t color) {
-    for (int dy = 0; dy < h; dy++) {
-        for (int dx = 0; dx < w; dx++) {
-            fb[(y + dy) * pitch + (x + dx)] = color;
-        }
-    }
+// Runs before any C: clear .bss, move to our own stack (the loader's may
+// be in RAM under test), turn on SSE, and pass the loader's RDI along
+__asm__(".section .text\n"
+        ".globl _start\n"
+        "_start:\n"
+        "    cli\n"
+        "    cld\n"
+        "    mov %rdi, %r12\n"
+        "    lea __bss_start(%rip), %rdi\n"
+        "    lea _end(%rip), %rcx\n"
+        "    sub %rdi, %rcx\n"
+        "    xor %eax, %eax\n"
+        "    rep stosb\n"
+        "    lea mt_stacks(%rip), %rsp\n"
+        "    add mt_stack_size(%rip), %rsp\n"
+        "    mov %cr0, %rax\n"
+        "    and $~0x4, %rax\n"     // No x87 emulation (EM)
+        "    or $0x2, %rax\n"       // MP
+        "    mov %rax, %cr0\n"
+        "    mov %cr4, %rax\n"
+        "    or $0x600, %rax\n"     // OSFXSR, OSXMMEXCPT
+        "    mov %rax, %cr4\n"
+        "    fninit\n"
+        "    mov %r12, %rdi\n"
+        "    call memtest_main\n"
+        "1:  cli\n"
+        "    hlt\n"
+        "    jmp 1b\n");
+
+extern const uint8_t _start[];
+extern const uint8_t _end[];
+
+// GCC may call these for struct copies and loops it recognises
+void *memcpy(void *dst, const void *src, size_t n)
+{
+    void *d = dst;
+    __asm__ volatile("rep movsb" : "+D"(d), "+S"(src), "+c"(n) : : "memory");
+    return dst;
 }
 
-// Test a memory region with a pattern
-static int test_pattern(volatile uint64_t *addr, uint64_t pattern) {
-    *addr = pattern;
-    return (*addr == pattern) ? 1 : 0;
-}
-
-// Test a region with all 4 patterns
-static int test_region(volatile uint64_t *addr) {
-    int passed = 0;
-    if (test_pattern(addr, PATTERN_1)) passed++;
-    if (test_pattern(addr, PATTERN_2)) passed++;
-    if (test_pattern(addr, PATTERN_3)) passed++;
-    if (test_pattern(addr, PATTERN_4)) passed++;
-    return passed;
-}
-
-// Draw a simple digit (0-4) - 5x7 bitmap
-static void draw_digit(uint32_t *fb, uint32_t pitch, int x, int y, int digit, uint32_t color) {
-    // Simple 5x7 font for digits 0-4
-    const uint8_t font[5][7] = {
-        // 0
-        {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},
-        // 1
-        {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E},
-        // 2
-        {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F},
-        // 3
-        {0x0E, 0x11, 0x01, 0x0E, 0x01, 0x11, 0x0E},
-        // 4
-        {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}
-    };
-    
-    if (digit < 0 || digit > 4) return;
-    
-    for (int row = 0; row < 7; row++) {
-        for (int col = 0; col < 5; col++) {
-            if (font[digit][row] & (1 << (4 - col))) {
-                fb[(y + row * 2) * pitch + (x + col * 2)] = color;
-                fb[(y + row * 2) * pitch + (x + col * 2 + 1)] = color;
-                fb[(y + row * 2 + 1) * pitch + (x + col * 2)] = color;
-                fb[(y + row * 2 + 1) * pitch + (x + col * 2 + 1)] = color;
-            }
-        }
+void *memset(void *dst, int c, size_t n)
+{
+    void *d = dst;
+    __asm__ volatile("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+    return dst;
+}
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint8_t inb(uint16_t port)
+{
+    uint8_t v;
+    __asm__ volatile("inb %1, %0" : "=a"(v) : "Nd"(port));
+    return v;
+}
+
+static inline void outb(uint16_t port, uint8_t v)
+{
+    __asm__ volatile("outb %0, %1" : : "a"(v), "Nd"(port));
+}
+
+void mt_log(const char *s)
+{
+    for (; *s; s++)
+    {
+        for (int spin = 0; spin < 100000 && !(inb(COM1 + 5) & 0x20); spin++)
+            ;
+        outb(COM1, *s);
     }
 }
 
-__attribute__((noreturn))
-void _start(uint64_t fb_base_arg) {
-    // Read boot info
-    struct boot_info *info = (struct boot_info*)0x1F0000;
-    
-    volatile uint32_t *fb = (volatile uint32_t*)info->fb_base;
-    uint32_t width = info->width;
-    uint32_t height = info->height;
-    uint32_t pitch = info->pitch;
-    
-    // Fallback
-    if (width == 0 || width > 10000 || height == 0 || height > 10000 || pitch == 0) {
-        fb = (volatile uint32_t*)fb_base_arg;
+// -------------------------------------------------------------- formatting
+
+static char *put_str(char *p, const char *s)
+{
+    while (*s) *p++ = *s++;
+    *p = 0;
+    return p;
+}
+
+static char *put_dec(char *p, uint64_t v)
+{
+    char tmp[20];
+    int n = 0;
+    do tmp[n++] = '0' + v % 10; while (v /= 10);
+    while (n) *p++ = tmp[--n];
+    *p = 0;
+    return p;
+}
+
+static char *put_hex(char *p, uint64_t v)
+{
+    for (int i = 15; i >= 0; i--)
+        p[15 - i] = "0123456789ABCDEF"[(v >> (i * 4)) & 0xF];
+    p[16] = 0;
+    return p + 16;
+}
+
+// v / 2^30 with one decimal
+static char *put_gb(char *p, uint64_t v)
+{
+    uint64_t tenths = (v * 10 + (1ull << 29)) >> 30;
+    p = put_dec(p, tenths / 10);
+    *p++ = '.';
+    return put_dec(p, tenths % 10);
+}
+
+// ------------------------------------------------------------------ screen
+
+enum color
+{
+    C_TEXT,
+    C_DIM,
+    C_TITLE,
+    C_OK,
+    C_BAD,
+};
+
+static const uint8_t g_text_attr[] = {0x07, 0x08, 0x1F, 0x0A, 0x0C};
+static const uint32_t g_rgb[] = {0x00D0D0D0, 0x00707890, 0x00FFFFFF, 0x0040FF40, 0x00FF4040};
+#define RGB_BG 0x00001020
+#define RGB_TITLE_BG 0x00003060
+
+static struct
+{
+    int text;                 // VGA text mode (BIOS) rather than a framebuffer
+    volatile uint16_t *cells;
+    struct fb fb;
+    uint32_t scale;           // Glyph pixel size
+    uint32_t cols, rows;
+} g_screen;
+
+static void screen_init(const struct boot_info *info, uint64_t fb_arg)
+{
+    if (info->fb_base == VGA_TEXT || (info->width == 0 && fb_arg == VGA_TEXT))
+    {
+        g_screen.text = 1;
+        g_screen.cells = (volatile uint16_t *)VGA_TEXT;
+        g_screen.cols = info->width ? info->width : 80;
+        g_screen.rows = info->height ? info->height : 25;
+        for (uint32_t i = 0; i < g_screen.cols * g_screen.rows; i++)
+            g_screen.cells[i] = 0x0720;
+        return;
+    }
+
+    uint64_t base = info->fb_base;
+    uint32_t width = info->width, height = info->height, pitch = info->pitch;
+    if (width == 0 || width > 10000 || height == 0 || height > 10000 || pitch < width)
+    {
+        base = fb_arg;
         width = 1280;
         height = 800;
         pitch = 1280;
     }
-    
-    // Clear screen
-    for (uint32_t y = 0; y < height; y++) {
-        for (uint32_t x = 0; x < width; x++) {
-            fb[y * pitch + x] = COLOR_BG;
+    fb_init(&g_screen.fb, base, width, height, pitch);
+    fb_enable_wc(&g_screen.fb);
+    g_screen.scale = width >= 960 ? 2 : 1;
+    g_screen.cols = width / (FB_CELL_W * g_screen.scale);
+    g_screen.rows = height / (FB_CELL_H * g_screen.scale);
+    fb_fill(&g_screen.fb, 0, 0, width, height, RGB_BG);
+}
+
+// Text at (col, row), padded with spaces to `width` cells so it covers
+// what was there before
+static void put_text(uint32_t col, uint32_t row, const char *s, uint32_t width, enum color color)
+{
+    if (col >= g_screen.cols || row >= g_screen.rows) return;
+    uint32_t len = 0;
+    while (s[len]) len++;
+
+    if (!g_screen.text)
+    {
+        uint32_t cell_w = FB_CELL_W * g_screen.scale, cell_h = FB_CELL_H * g_screen.scale;
+        uint32_t bg = color == C_TITLE ? RGB_TITLE_BG : RGB_BG;
+        uint32_t x = col * cell_w + fb_text(&g_screen.fb, col * cell_w, row * cell_h, s, g_screen.scale,
+                                            g_rgb[color], bg);
+        if (len < width) fb_fill(&g_screen.fb, x, row * cell_h, (width - len) * cell_w, cell_h, bg);
+        return;
+    }
+
+    volatile uint16_t *cell = g_screen.cells + row * g_screen.cols;
+    for (uint32_t i = 0; i < len || i < width; i++)
+    {
+        if (col + i >= g_screen.cols) break;
+        char c = i < len ? s[i] : ' ';
+        if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        cell[col + i] = (uint16_t)(g_text_attr[color] << 8 | (uint8_t)c);
+    }
+}
+
+// ------------------------------------------------------------------ ranges
+
+struct range
+{
+    uint64_t start, end;
+    uint32_t first_chunk;
+};
+
+static struct boot_info g_info;
+static struct range g_ranges[MAX_RANGES];
+static uint32_t g_range_count;
+static uint32_t g_chunks;
+static uint64_t g_bytes;
+static volatile uint64_t g_done; // Bytes of the current step finished
+
+// Identity-mapped? Walks the page tables the loader left in CR3
+static int mapped(uint64_t addr)
+{
+    uint64_t cr3;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+    const uint64_t *table = (const uint64_t *)(uintptr_t)(cr3 & ~0xFFFull);
+    for (int shift = 39; shift >= 12; shift -= 9)
+    {
+        uint64_t e = table[(addr >> shift) & 511];
+        if (!(e & 1)) return 0;
+        if (shift == 12 || (shift < 39 && (e & 0x80))) return 1; // 4 KB, or a 2 MB / 1 GB page
+        table = (const uint64_t *)(uintptr_t)(e & 0x000FFFFFFFFFF000ull);
+    }
+    return 1;
+}
+
+static void add_range(uint64_t start, uint64_t end)
+{
+    // Stop at the first 2 MB the page tables do not cover
+    for (uint64_t a = start & ~0x1FFFFFull; a < end; a += 0x200000)
+        if (!mapped(a))
+        {
+            end = a > start ? a : start;
+            break;
+        }
+    if (end <= start) return;
+
+    if (g_range_count && g_ranges[g_range_count - 1].end == start)
+    {
+        g_ranges[g_range_count - 1].end = end;
+        return;
+    }
+    if (g_range_count < MAX_RANGES)
+        g_ranges[g_range_count++] = (struct range){start, end, 0};
+}
+
+// RAM the loader reported as free or as its own (reclaimable once the
+// payload runs), minus low memory and this image
+static void build_ranges(void)
+{
+    uint64_t image_start = (uintptr_t)_start & ~(uint64_t)(PAGE - 1);
+    uint64_t image_end = ((uintptr_t)_end + PAGE - 1) & ~(uint64_t)(PAGE - 1);
+
+    for (uint32_t i = 0; i < g_info.mmap_count && i < BOOT_INFO_MAX_MMAP; i++)
+    {
+        const struct boot_mmap_entry *m = &g_info.mmap[i];
+        if (m->type != BOOT_MEM_USABLE && m->type != BOOT_MEM_LOADER) continue;
+
+        uint64_t start = (m->base + PAGE - 1) & ~(uint64_t)(PAGE - 1);
+        uint64_t end = (m->base + m->length) & ~(uint64_t)(PAGE - 1);
+        if (start < LOW_MEMORY) start = LOW_MEMORY;
+        if (end <= start) continue;
+
+        if (start < image_end && end > image_start)
+        {
+            if (start < image_start) add_range(start, image_start);
+            if (end > image_end) add_range(image_end, end);
         }
+        else
+            add_range(start, end);
+    }
+
+    for (uint32_t i = 0; i < g_range_count; i++)
+    {
+        g_ranges[i].first_chunk = g_chunks;
+        g_chunks += (uint32_t)((g_ranges[i].end - g_ranges[i].start + MT_CHUNK - 1) / MT_CHUNK);
+        g_bytes += g_ranges[i].end - g_ranges[i].start;
+    }
+}
+
+// ------------------------------------------------------------------ passes
+
+struct pass_step
+{
+    const char *test;
+    const char *what;
+    struct mt_step step;
+};
+
+#define MAX_STEPS 24
+#define SEQ_MUL 0x9E3779B1 // 2^32 / golden ratio
+#define SEQ_SHIFT 29
+
+static struct pass_step g_steps[MAX_STEPS];
+static uint32_t g_step_count;
+
+static void add_step(const char *test, const char *what, enum mt_op op, enum mt_kind kind, uint64_t value,
+                     uint64_t mul, uint64_t shift)
+{
+    struct pass_step *s = &g_steps[g_step_count++];
+    s->test = test;
+    s->what = what;
+    s->step = (struct mt_step){op, kind, value, value, mul, shift};
+}
+
+// Fill with p, then check p and write ~p upwards, check ~p and write p
+// downwards, and check p once more
+static void add_inversions(const char *test, uint64_t p)
+{
+    add_step(test, "FILL", MT_FILL, MT_CONST, p, 0, 0);
+    add_step(test, "CHECK AND INVERT, UP", MT_INVERT_UP, MT_CONST, p, 0, 0);
+    add_step(test, "CHECK AND INVERT, DOWN", MT_INVERT_DOWN, MT_CONST, ~p, 0, 0);
+    add_step(test, "CHECK", MT_CHECK, MT_CONST, p, 0, 0);
+}
+
+static void build_pass(uint32_t pass, uint64_t seed)
+{
+    g_step_count = 0;
+    add_step("ADDRESS IN ADDRESS", "FILL", MT_FILL, MT_SEQ, 0, 0, 64);
+    add_step("ADDRESS IN ADDRESS", "CHECK", MT_CHECK, MT_SEQ, 0, 0, 64);
+    add_step("ADDRESS IN ADDRESS", "FILL, COMPLEMENT", MT_FILL, MT_SEQ, ~0ull, 0, 64);
+    add_step("ADDRESS IN ADDRESS", "CHECK, COMPLEMENT", MT_CHECK, MT_SEQ, ~0ull, 0, 64);
+    add_inversions("MOVING INVERSIONS, ZEROS AND ONES", 0);
+    add_inversions("MOVING INVERSIONS, WALKING ONE", 0x0101010101010101ull << (pass % 8));
+    add_inversions("MOVING INVERSIONS, RANDOM", seed);
+    add_step("RANDOM SEQUENCE", "FILL", MT_FILL, MT_SEQ, seed, SEQ_MUL, SEQ_SHIFT);
+    add_step("RANDOM SEQUENCE", "CHECK", MT_CHECK, MT_SEQ, seed, SEQ_MUL, SEQ_SHIFT);
+    add_step("RANDOM SEQUENCE", "FILL, COMPLEMENT", MT_FILL, MT_SEQ, ~seed, SEQ_MUL, SEQ_SHIFT);
+    add_step("RANDOM SEQUENCE", "CHECK, COMPLEMENT", MT_CHECK, MT_SEQ, ~seed, SEQ_MUL, SEQ_SHIFT);
+}
+
+// Chunk `index` of the tested ranges; the downward inversion takes them
+// from the top so each CPU's sweep, and the whole step, runs high to low
+static void run_chunk(void *ctx, uint32_t index)
+{
+    const struct mt_step *step = ctx;
+    if (step->op == MT_INVERT_DOWN) index = g_chunks - 1 - index;
+
+    uint32_t r = 0;
+    while (r + 1 < g_range_count && g_ranges[r + 1].first_chunk <= index) r++;
+    uint64_t start = g_ranges[r].start + (uint64_t)(index - g_ranges[r].first_chunk) * MT_CHUNK;
+    uint64_t end = g_ranges[r].end - start > MT_CHUNK ? start + MT_CHUNK : g_ranges[r].end;
+
+    mt_run(step, start, end);
+    __atomic_add_fetch(&g_done, end - start, __ATOMIC_RELAXED);
+}
+
+// ------------------------------------------------------------------ status
+
+#define ERROR_ROW 11
+#define REFRESH_MS 250
+
+static uint32_t g_cpus;
+static uint32_t g_pass;
+static uint32_t g_step;
+static uint64_t g_step_tsc;
+static uint64_t g_last_draw;
+static uint64_t g_refresh_ticks;
+static uint64_t g_last_pass_rate; // Bytes per second, 0 before the first pass ends
+
+// Bytes per second for `bytes` done in `ticks`, 0 when it cannot tell
+static uint64_t rate(uint64_t bytes, uint64_t ticks)
+{
+    uint64_t ms = g_info.tsc_khz ? ticks / g_info.tsc_khz : 0;
+    return ms ? bytes * 1000 / ms : 0;
+}
+
+static void put_label(uint32_t row, const char *label, const char *value, enum color color)
+{
+    put_text(1, row, label, 10, C_DIM);
+    put_text(11, row, value, g_screen.cols > 12 ? g_screen.cols - 12 : 0, color);
+}
+
+static void draw_status(void)
+{
+    char line[96], *p;
+    const struct pass_step *s = &g_steps[g_step < g_step_count ? g_step : g_step_count - 1];
+
+    p = put_dec(line, g_pass);
+    if (g_last_pass_rate)
+    {
+        p = put_str(p, "   (LAST PASS ");
+        p = put_gb(p, g_last_pass_rate);
+        put_str(p, " GB/S)");
     }
-    
-    // Title bar
-    draw_rect((uint32_t*)fb, pitch, 0, 0, width, 50, COLOR_TITLE);
-    
-    // Test memory regions
-    int test_y = 80;
-    int bar_height = 60;
-    int spacing = 20;
-    int total_passed = 0;
-    
-    // Test addresses
-    uint64_t test_addrs[] = {0x200000, 0x400000, 0x800000, 0x1000000};
-    
-    for (int i = 0; i < 4; i++) {
-        volatile uint64_t *mem = (volatile uint64_t *)test_addrs[i];
-        int passed = test_region(mem);
-        
-        // Draw bar background
-        draw_rect((uint32_t*)fb, pitch, 50, test_y, 400, bar_height, 0x00002040);
-        
-        // Draw progress bar (green = pass, red = fail)
-        int bar_width = (400 * passed) / 4;
-        uint32_t bar_color = (passed == 4) ? COLOR_GREEN : COLOR_RED;
-        draw_rect((uint32_t*)fb, pitch, 50, test_y, bar_width, bar_height, bar_color);
-        
-        // Draw score as digit
-        draw_digit((uint32_t*)fb, pitch, 470, test_y + 20, passed, COLOR_WHITE);
-        
-        if (passed == 4) total_passed++;
-        test_y += bar_height + spacing;
+    put_label(3, "PASS", line, C_TEXT);
+    put_label(4, "TEST", s->test, C_TEXT);
+
+    p = put_str(line, s->what);
+    p = put_str(p, "   (");
+    p = put_dec(p, g_step + 1);
+    p = put_str(p, " OF ");
+    p = put_dec(p, g_step_count);
+    put_str(p, ")");
+    put_label(5, "STEP", line, C_TEXT);
+
+    uint64_t done = g_done;
+    p = put_dec(line, (g_step * 100 + done * 100 / g_bytes) / g_step_count);
+    put_str(p, "% OF PASS");
+    put_label(6, "PROGRESS", line, C_TEXT);
+
+    uint64_t r = rate(done, rdtsc() - g_step_tsc);
+    p = line;
+    if (r)
+    {
+        p = put_gb(p, r);
+        put_str(p, " GB/S");
     }
-    
-    // Summary box
-    int summary_x = width - 300;
-    int summary_y = 80;
-    draw_rect((uint32_t*)fb, pitch, summary_x, summary_y, 250, 250, 0x00003050);
-    
-    // Draw border
-    draw_rect((uint32_t*)fb, pitch, summary_x, summary_y, 250, 3, COLOR_CYAN);
-    draw_rect((uint32_t*)fb, pitch, summary_x, summary_y + 247, 250, 3, COLOR_CYAN);
-    draw_rect((uint32_t*)fb, pitch, summary_x, summary_y, 3, 250, COLOR_CYAN);
-    draw_rect((uint32_t*)fb, pitch, summary_x + 247, summary_y, 3, 250, COLOR_CYAN);
-    
-    // Draw summary indicators (circles made of rectangles)
-    for (int i = 0; i < 4; i++) {
-        int cx = summary_x + 60 + (i % 2) * 100;
-        int cy = summary_y + 60 + (i / 2) * 100;
-        uint32_t circle_color = (i < total_passed) ? COLOR_GREEN : COLOR_RED;
-        
-        // Draw a filled circle approximation
-        for (int r = 0; r < 25; r++) {
-            for (int angle = 0; angle < 360; angle += 10) {
-                int dx = (r * 866) / 1000;  // cos approximation
-                int dy = (r * 500) / 1000;  // sin approximation
-                if (angle > 90 && angle < 270) dx = -dx;
-                if (angle > 180) dy = -dy;
-                
-                int px = cx + dx;
-                int py = cy + dy;
-                if (px >= 0 && px < (int)width && py >= 0 && py < (int)height) {
-                    fb[py * pitch + px] = circle_color;
-                }
-            }
+    else
+        put_str(p, "-");
+    put_label(7, "SPEED", line, C_TEXT);
+
+    uint64_t errors = mt_error_count();
+    put_dec(line, errors);
+    put_label(8, "ERRORS", line, errors ? C_BAD : C_OK);
+
+    if (errors)
+    {
+        struct mt_error latest[MT_ERROR_LOG];
+        uint32_t rows = g_screen.rows > ERROR_ROW + 1 ? g_screen.rows - ERROR_ROW - 1 : 0;
+        uint32_t n = mt_error_latest(latest, rows < MT_ERROR_LOG ? rows : MT_ERROR_LOG);
+        put_text(1, ERROR_ROW - 1, "LATEST    ADDRESS           EXPECTED          READ", 0, C_DIM);
+        for (uint32_t i = 0; i < n; i++)
+        {
+            p = put_hex(line, latest[i].addr);
+            p = put_str(p, "  ");
+            p = put_hex(p, latest[i].expected);
+            p = put_str(p, "  ");
+            put_hex(p, latest[i].actual);
+            put_text(11, ERROR_ROW + i, line, 0, C_BAD);
         }
     }
-    
-    // Display pass count
-    int digit_x = summary_x + 100;
-    int digit_y = summary_y + 200;
-    draw_digit((uint32_t*)fb, pitch, digit_x, digit_y, total_passed, 
-               (total_passed == 4) ? COLOR_GREEN : COLOR_YELLOW);
-    
-    // Animate - pulsing border on summary box
-    int pulse = 0;
-    int pulse_dir = 1;
-    
-    while(1) {
-        // Pulse border color
-        uint32_t pulse_color = COLOR_CYAN;
-        if (pulse > 50) {
-            pulse_color = COLOR_WHITE;
+    g_last_draw = rdtsc();
+}
+
+// Between chunks on the boot CPU
+static void poll(void)
+{
+    if (rdtsc() - g_last_draw >= g_refresh_ticks) draw_status();
+}
+
+static void halt(void)
+{
+    for (;;)
+        __asm__ volatile("cli; hlt");
+}
+
+void memtest_main(uint64_t fb_arg)
+{
+    char line[96], *p;
+
+    // Keep a copy: the loader's block is in RAM under test
+    memcpy(&g_info, (const void *)BOOT_INFO_ADDR, sizeof(g_info));
+    mt_cpu_init();
+    mt_engine_init();
+    screen_init(&g_info, fb_arg);
+    put_text(0, 0, " ATLAS MEMORY TEST", g_screen.cols, C_TITLE);
+    mt_log("memtest: started\n");
+
+    if (g_info.mmap_count == 0)
+    {
+        put_text(1, 2, "THE LOADER PASSED NO MEMORY MAP (UEFI BOOT): NOTHING TO TEST", 0, C_BAD);
+        mt_log("memtest: no memory map from the loader\n");
+        halt();
+    }
+    build_ranges();
+    if (g_bytes == 0)
+    {
+        put_text(1, 2, "NO RAM ABOVE 1 MB TO TEST", 0, C_BAD);
+        mt_log("memtest: no RAM to test\n");
+        halt();
+    }
+
+    // Only the CPUs the loader found enabled in the MADT; none without a list
+    uint32_t aps = g_info.cpu_count ? g_info.cpu_count - 1 : 0;
+    if (aps > BOOT_INFO_MAX_CPUS - 1) aps = BOOT_INFO_MAX_CPUS - 1;
+    g_cpus = mt_cpus_start(g_info.tsc_khz, g_info.apic_ids, aps);
+    g_refresh_ticks = g_info.tsc_khz ? (uint64_t)g_info.tsc_khz * REFRESH_MS : 1000000000ull;
+
+    p = put_dec(line, g_cpus);
+    p = put_str(p, g_cpus == 1 ? " CPU, " : " CPUS, ");
+    put_str(p, mt_engine_variant());
+    put_text(g_screen.cols > 24 ? g_screen.cols - 24 : 0, 0, line, 24, C_TITLE);
+
+    p = put_gb(line, g_bytes);
+    p = put_str(p, " GB IN ");
+    p = put_dec(p, g_range_count);
+    put_str(p, g_range_count == 1 ? " RANGE" : " RANGES");
+    put_label(2, "MEMORY", line, C_TEXT);
+
+    mt_log("memtest: testing ");
+    mt_log(line);
+    p = put_str(line, " on ");
+    p = put_dec(p, g_cpus);
+    p = put_str(p, " CPU(s) with ");
+    p = put_str(p, mt_engine_variant());
+    put_str(p, "\n");
+    mt_log(line);
+
+    uint64_t seed = rdtsc();
+    for (g_pass = 1;; g_pass++)
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        build_pass(g_pass - 1, seed);
+        uint64_t errors = mt_error_count();
+        uint64_t pass_tsc = rdtsc();
+
+        for (g_step = 0; g_step < g_step_count; g_step++)
+        {
+            g_done = 0;
+            g_step_tsc = rdtsc();
+            draw_status();
+            mt_parallel(g_chunks, run_chunk, &g_steps[g_step].step, poll);
         }
-        
-        draw_rect((uint32_t*)fb, pitch, summary_x, summary_y, 250, 3, pulse_color);
-        draw_rect((uint32_t*)fb, pitch, summary_x, summary_y + 247, 250, 3, pulse_color);
-        draw_rect((uint32_t*)fb, pitch, summary_x, summary_y, 3, 250, pulse_color);
-        draw_rect((uint32_t*)fb, pitch, summary_x + 247, summary_y, 3, 250, pulse_color);
-        
-        pulse += pulse_dir;
-        if (pulse >= 100) pulse_dir = -1;
-        if (pulse <= 0) pulse_dir = 1;
-        
-        // Delay
-        for (volatile int i = 0; i < 1000000; i++);
+        g_step = g_step_count - 1;
+        g_last_pass_rate = rate(g_bytes * g_step_count, rdtsc() - pass_tsc);
+        draw_status();
+
+        p = put_str(line, "memtest: pass ");
+        p = put_dec(p, g_pass);
+        p = put_str(p, " done, ");
+        p = put_dec(p, mt_error_count() - errors);
+        p = put_str(p, " new error(s), ");
+        p = put_gb(p, g_last_pass_rate);
+        put_str(p, " GB/s\n");
+        mt_log(line);
     }
-    
-    __builtin_unreachable();
-}
\ No newline at end of file
+}
@@ -0,0 +1,91 @@
+// memtest.h
+// Shared by the parts of the 64-bit memory test payload (TEST64.BIN):
+// main64.c (entry, passes, screen), engine.c (pattern kernels) and
+// cpus.c (application processors and the job pool).
+#ifndef MEMTEST_H
+#define MEMTEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MT_MAX_CPUS 64
+#define MT_STACK_SIZE 0x4000
+#define MT_CHUNK 0x400000          // Unit of work a CPU claims (4 MB)
+#define MT_BLOCK 64                // Bytes per step of a kernel loop
+#define MT_TRAMPOLINE_ADDR 0x6000  // Below 1 MB, page aligned: SIPI vector 0x06
+#define MT_ERROR_LOG 16            // Most recent errors kept for the screen
+
+// What a step does to each word of a range
+enum mt_op
+{
+    MT_FILL,        // Write the pattern
+    MT_CHECK,       // Compare with the pattern
+    MT_INVERT_UP,   // Compare with the pattern, write its complement, low to high
+    MT_INVERT_DOWN, // The same, high to low
+};
+
+// CONST: every word is `value`. SEQ: word at address a is
+//   x = (a ^ key) ^ lo32(a ^ key) * mul;  x ^ (x >> shift)
+// mul 0 and shift 64 leave the address itself (address-in-address);
+// otherwise it is a pseudo-random sequence any CPU can regenerate from
+// the address alone.
+enum mt_kind
+{
+    MT_CONST,
+    MT_SEQ,
+};
+
+struct mt_step
+{
+    enum mt_op op;
+    enum mt_kind kind;
+    uint64_t value; // CONST
+    uint64_t key;   // SEQ
+    uint64_t mul;   // SEQ, low 32 bits used
+    uint64_t shift; // SEQ, 64 or more shifts everything out
+};
+
+struct mt_error
+{
+    uint64_t addr;
+    uint64_t expected;
+    uint64_t actual;
+};
+
+// ------------------------------------------------------------ engine.c
+
+// Enable SSE (and AVX where present) on the calling CPU
+void mt_cpu_init(void);
+
+// Pick kernels for this CPU (after mt_cpu_init on the boot CPU)
+void mt_engine_init(void);
+const char *mt_engine_variant(void);
+
+// Run one step over [start, end), both MT_BLOCK aligned. Words that do
+// not match are reported through the error log.
+void mt_run(const struct mt_step *step, uint64_t start, uint64_t end);
+
+// The word a step expects to read at `addr`
+uint64_t mt_expected(const struct mt_step *step, uint64_t addr);
+
+// Errors so far, and up to `max` of the latest (newest first)
+uint64_t mt_error_count(void);
+uint32_t mt_error_latest(struct mt_error *out, uint32_t max);
+
+// ------------------------------------------------------------- cpus.c
+
+// Start the application processors with these APIC IDs (the boot info
+// block's list); returns the CPUs taking work, the boot CPU included
+uint32_t mt_cpus_start(uint32_t tsc_khz, const uint32_t *apic_ids, uint32_t count);
+
+// Run fn(ctx, i) for i in [0, count) on every CPU. The boot CPU calls
+// poll between items and while it waits for the others.
+typedef void (*mt_job_fn)(void *ctx, uint32_t index);
+void mt_parallel(uint32_t count, mt_job_fn fn, void *ctx, void (*poll)(void));
+
+// ------------------------------------------------------------ main64.c
+
+// Line on COM1
+void mt_log(const char *s);
+
+#endif // MEMTEST_H
@@ -0,0 +1,65 @@
+// acpi.h
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+
+// ACPI tables for the BIOS build: the RSDP is found in the EBDA or the
+// BIOS area (0xE0000-0xFFFFF), then the XSDT or RSDT lists the rest.
+// Paging is off, so tables below 4 GB are read in place.
+
+struct acpi_header
+{
+    char signature[4];
+    uint32_t length;      // Whole table, header included
+    uint8_t revision;
+    uint8_t checksum;     // All bytes of the table sum to 0
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+// MADT ("APIC"): the interrupt controllers, one entry per CPU
+struct acpi_madt
+{
+    struct acpi_header header;
+    uint32_t lapic_addr;  // Local APIC MMIO base
+    uint32_t flags;
+    // Variable-length entries follow: type, length, ...
+} __attribute__((packed));
+
+#define MADT_LAPIC 0          // uid, APIC ID, flags
+#define MADT_LAPIC_OVERRIDE 5 // 64-bit local APIC address
+#define MADT_X2APIC 9         // x2APIC ID, flags, uid
+
+#define MADT_ENABLED 0x1        // CPU usable now
+#define MADT_ONLINE_CAPABLE 0x2 // Can be enabled later (hot-plug): leave alone
+
+struct acpi_madt_lapic
+{
+    uint8_t type;
+    uint8_t length;
+    uint8_t uid;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed));
+
+struct acpi_madt_x2apic
+{
+    uint8_t type;
+    uint8_t length;
+    uint16_t reserved;
+    uint32_t apic_id;
+    uint32_t flags;
+    uint32_t uid;
+} __attribute__((packed));
+
+// Physical address of a valid RSDP, or 0
+uint32_t acpi_rsdp(void);
+
+// The first table with this signature whose checksum holds, or 0
+const struct acpi_header *acpi_find_table(const char *signature);
+
+#endif // ACPI_H
@@ -0,0 +1,84 @@
+// bootinfo.h
+#ifndef BOOTINFO_H
+#define BOOTINFO_H
+
+#include <stdint.h>
+
+// Boot information block handed to the kernel at a fixed address.
+// Every 64-bit field sits on an 8-byte boundary so the layout is
+// identical for the 32-bit BIOS build and the 64-bit UEFI build.
+#define BOOT_INFO_ADDR 0x1F0000
+#define BOOT_INFO_SIZE 0x2000
+
+#define BOOT_INFO_MAX_MODULES 8
+#define BOOT_INFO_CMDLINE_MAX 256
+#define BOOT_INFO_MAX_MMAP 128
+#define BOOT_INFO_MAX_TIMELINE 48
+#define BOOT_INFO_MAX_CPUS 64
+
+// Memory map types: 1-7 are the E820 types, the rest describe RAM the
+// loader handed out
+#define BOOT_MEM_USABLE   1
+#define BOOT_MEM_RESERVED 2
+#define BOOT_MEM_ACPI     3
+#define BOOT_MEM_NVS      4
+#define BOOT_MEM_BAD      5
+#define BOOT_MEM_LOADER   0x1000 // Loader heap and tables, reclaimable once booted
+#define BOOT_MEM_KERNEL   0x1001 // Kernel image and modules
+
+struct boot_module
+{
+    uint64_t start; // Physical address of the first byte
+    uint64_t size;  // Size in bytes
+};
+
+struct boot_mmap_entry
+{
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+    uint32_t reserved;
+};
+
+// Boot timeline events (see include/timeline.h)
+#define BOOT_EV_ENTRY      1  // Stage 2 (BIOS) or efi_main (UEFI) entered
+#define BOOT_EV_PMODE      2  // Protected mode reached (BIOS)
+#define BOOT_EV_KMAIN      3
+#define BOOT_EV_FAT32_INIT 4
+#define BOOT_EV_CONFIG     5  // Menu entries ready
+#define BOOT_EV_MENU       6  // Menu drawn, waiting for a key or the timeout
+#define BOOT_EV_SELECTED   7  // Entry chosen
+#define BOOT_EV_FILE_OPEN  8  // arg = file index (0 = kernel)
+#define BOOT_EV_FILE_READ  9  // arg = file index
+#define BOOT_EV_JUMP       10 // Last probe before the kernel runs
+#define BOOT_EV_SMP        11 // APs started (BIOS), arg = CPUs taking work
+
+struct boot_timestamp
+{
+    uint64_t tsc;
+    uint32_t event;
+    uint32_t arg;
+};
+
+struct boot_info
+{
+    uint64_t fb_base;  // 0
+    uint32_t width;    // 8
+    uint32_t height;   // 12
+    uint32_t pitch;    // 16  Pixels per scanline
+    uint32_t mod_count; // 20
+    uint64_t cmdline;  // 24  Pointer to cmdline_buf (0 if none)
+    struct boot_module mods[BOOT_INFO_MAX_MODULES]; // 32
+    char cmdline_buf[BOOT_INFO_CMDLINE_MAX]; // 160
+    uint32_t mmap_count; // 416  0 if the loader has no map for the kernel
+    uint32_t reserved;   // 420
+    struct boot_mmap_entry mmap[BOOT_INFO_MAX_MMAP]; // 424, sorted by base
+    uint32_t tsc_khz;        // 3496  TSC ticks per millisecond
+    uint32_t timeline_count; // 3500
+    struct boot_timestamp timeline[BOOT_INFO_MAX_TIMELINE]; // 3504, in probe order
+    uint32_t cpu_count;   // 4272  CPUs enabled in the MADT, the boot CPU included; 0 if unknown
+    uint32_t bsp_apic_id; // 4276  APIC ID of the CPU that enters the kernel
+    uint32_t apic_ids[BOOT_INFO_MAX_CPUS - 1]; // 4280  The other cpu_count - 1, in wait-for-SIPI
+};
+
+#endif // BOOTINFO_H
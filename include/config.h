@@ -0,0 +1,82 @@
+// config.h
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+#include "vga.h"
+
+// Compiled boot configuration (ATLAS.BIN), produced from atlas.cfg by
+// scripts/create_disk.py. The loader uses it in place: entry records hold
+// offsets into a string table of NUL-terminated strings, and offset 0 is
+// always the empty string. All fields are little-endian.
+#define CONFIG_BLOB_MAGIC 0x424C5441 // "ATLB"
+#define CONFIG_BLOB_VERSION 4
+
+// Stage 2 loads at most this much of the config file (one INT 13h read)
+#define CONFIG_MAX_SIZE (127 * 512)
+
+struct config_blob_header
+{
+    uint32_t magic;        // 0
+    uint16_t version;      // 4
+    uint16_t header_size;  // 6
+    uint32_t total_size;   // 8   Header, entries and strings
+    uint32_t crc32c;       // 12  CRC-32C of bytes 16 .. total_size
+    uint16_t entry_count;  // 16
+    uint16_t entry_size;   // 18
+    uint32_t entries_off;  // 20
+    uint32_t strings_off;  // 24
+    uint32_t strings_size; // 28
+    uint32_t title;        // 32  String offset, 0 = built-in title
+    uint16_t default_entry; // 36 Index of the default [entry], CONFIG_BLOB_NO_DEFAULT if none
+    int16_t timeout;       // 38  Seconds, -1 = wait for a key
+    uint16_t console;      // 40  CONSOLE_* flags (serial.h), 0 = not set
+    uint16_t fallback_entry; // 42 Booted when the selected entry fails verification
+    uint32_t checksums_off;  // 44 Manifest of struct config_blob_checksum
+    uint32_t checksum_count; // 48
+} __attribute__((packed));
+
+#define CONFIG_BLOB_NO_DEFAULT 0xFFFF
+
+struct config_blob_entry
+{
+    uint32_t name;
+    uint32_t kernel_x86;
+    uint32_t kernel_x64;
+    uint32_t kernel;
+    uint32_t cmdline;
+    uint16_t module_count;
+    uint16_t reserved;
+    uint32_t modules[MAX_MODULES];
+} __attribute__((packed));
+
+// Expected CRC-32C of a boot file, generated by create_disk.py
+struct config_blob_checksum
+{
+    uint32_t path;
+    uint32_t crc32c;
+} __attribute__((packed));
+
+#define CONFIG_MAX_CHECKSUMS 64
+
+int config_blob_detect(const void *buf);
+
+// Validate a blob and fill menu->entries (up to max) with the entries that
+// have a kernel for this firmware, plus length, selected, timeout, console
+// and fallback, and add its manifest to the checksum table; menu->title is
+// left alone unless the blob sets one. Returns -1 if the blob is damaged.
+int config_blob_load(const void *blob, uint32_t size, struct menu *menu, int max);
+
+// Parse atlas.cfg text into the same fields. The text is split into lines
+// in place (trailing spaces are cut), values are copied into the strings
+// arena and checksum= lines go to the checksum table.
+struct arena;
+void config_parse_text(char *text, struct menu *menu, int max, struct arena *strings);
+
+// Boot file checksums (the blob manifest or checksum= lines). Paths match
+// without a leading '/' and in any case. find returns 0 and sets *crc if
+// the file has one.
+int config_add_checksum(const char *path, uint32_t crc);
+int config_find_checksum(const char *path, uint32_t *crc);
+
+#endif // CONFIG_H
@@ -0,0 +1,114 @@
+// cpu.h
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
+{
+    __asm__ volatile("cpuid"
+                     : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+                     : "a"(leaf), "c"(subleaf));
+}
+
+// Highest extended CPUID leaf, or 0 if leaf 0x80000000 is missing
+static inline uint32_t cpuid_max_ext(void)
+{
+    uint32_t a, b, c, d;
+    cpuid(0x80000000, 0, &a, &b, &c, &d);
+    return (a & 0x80000000) ? a : 0;
+}
+
+// CPUID.80000001h:EDX feature bits
+#define CPUID_EXT_PDPE1GB (1u << 26)
+#define CPUID_EXT_LM (1u << 29)
+
+static inline uint32_t cpuid_ext_features(void)
+{
+    uint32_t a, b, c, d;
+    if (cpuid_max_ext() < 0x80000001) return 0;
+    cpuid(0x80000001, 0, &a, &b, &c, &d);
+    return d;
+}
+
+// Highest basic CPUID leaf
+static inline uint32_t cpuid_max(void)
+{
+    uint32_t a, b, c, d;
+    cpuid(0, 0, &a, &b, &c, &d);
+    return a;
+}
+
+// CPUID.1:ECX feature bits
+#define CPUID_SSE42 (1u << 20)
+#define CPUID_XSAVE (1u << 26)
+#define CPUID_OSXSAVE (1u << 27)
+#define CPUID_AVX (1u << 28)
+
+// CPUID.1:EDX feature bits
+#define CPUID_APIC (1u << 9)
+#define CPUID_SSE2 (1u << 26)
+
+// CPUID.7.0:EBX feature bits
+#define CPUID_7_AVX2 (1u << 5)
+#define CPUID_7_ERMS (1u << 9)
+
+static inline uint32_t cpuid_features_ecx(void)
+{
+    uint32_t a, b, c, d;
+    cpuid(1, 0, &a, &b, &c, &d);
+    return c;
+}
+
+static inline uint32_t cpuid_features_edx(void)
+{
+    uint32_t a, b, c, d;
+    cpuid(1, 0, &a, &b, &c, &d);
+    return d;
+}
+
+static inline uint32_t cpuid_features7_ebx(void)
+{
+    uint32_t a, b, c, d;
+    if (cpuid_max() < 7) return 0;
+    cpuid(7, 0, &a, &b, &c, &d);
+    return b;
+}
+
+// Extended control register 0: which register state the OS saves
+#define XCR0_SSE (1u << 1)
+#define XCR0_AVX (1u << 2)
+
+static inline uint64_t xgetbv(uint32_t index)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(index));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t rdmsr(uint32_t msr)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value)
+{
+    __asm__ volatile("wrmsr" : : "a"((uint32_t)value), "d"((uint32_t)(value >> 32)), "c"(msr) : "memory");
+}
+
+// Spin-wait hint: yields the core to its sibling thread and saves power
+static inline void cpu_pause(void)
+{
+    __asm__ volatile("pause" ::: "memory");
+}
+
+#endif // CPU_H
@@ -0,0 +1,20 @@
+// crc32.h
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+
+// CRC-32C (Castagnoli, reflected polynomial 0x82F63B78), the checksum used
+// by the compiled config blob and the boot file manifest. Start with
+// crc = 0; pass the previous result to continue over more data. Uses the
+// SSE4.2 CRC32 instruction when CPUID reports it, a table otherwise.
+uint32_t crc32c(uint32_t crc, const void *data, uint32_t len);
+
+// CRC of A followed by B, from crc1 = crc32c(0, A), crc2 = crc32c(0, B)
+// and B's length: lets pieces of a buffer be checksummed separately
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint32_t len2);
+
+// 1 if crc32c runs on the SSE4.2 instruction
+int crc32c_hw(void);
+
+#endif // CRC32_H
@@ -0,0 +1,34 @@
+// e820.h
+#ifndef E820_H
+#define E820_H
+
+#include <stdint.h>
+
+// BIOS memory map collected by Stage 2 (INT 15h, EAX=E820) before it
+// leaves real mode: a dword entry count followed by 24-byte entries.
+#define E820_MAP_ADDR 0x1000
+#define E820_MAX_ENTRIES 128
+
+#define E820_RAM 1
+#define E820_RESERVED 2
+#define E820_ACPI 3
+#define E820_NVS 4
+#define E820_UNUSABLE 5
+#define E820_PMEM 7
+
+struct e820_entry
+{
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+    uint32_t acpi; // ACPI 3.0 extended attributes
+} __attribute__((packed));
+
+struct e820_map
+{
+    uint32_t count;
+    uint32_t reserved;
+    struct e820_entry entries[E820_MAX_ENTRIES];
+} __attribute__((packed));
+
+#endif // E820_H
@@ -22,9 +22,92 @@ struct fat32_bpb {
     uint16_t ext_flags;           // 40
     uint16_t fs_version;          // 42
     uint32_t root_cluster;        // 44
+    uint16_t fs_info_sector;      // 48
+    uint16_t backup_boot_sector;  // 50
+    uint8_t  reserved[12];        // 52
+    uint8_t  drive_number;        // 64
+    uint8_t  reserved1;           // 65
+    uint8_t  boot_signature;      // 66
+    uint32_t volume_id;           // 67
 } __attribute__((packed));
 
+// Boot map: a blocklist of the boot files that create_disk.py writes to
+// the reserved sectors after FSInfo, so both come in with one read. It is
+// only trusted while the volume ID and FSInfo's free cluster count and
+// hint still match the ones it was built with (any FAT driver that writes
+// to the volume changes them); otherwise, and for files it does not list,
+// the loader walks the directory and the FAT.
+#define BOOTMAP_LBA 2
+#define BOOTMAP_SECTORS 4
+#define BOOTMAP_MAGIC 0x50414D42 // "BMAP"
+#define BOOTMAP_VERSION 1
+
+struct bootmap_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t file_count;
+    uint32_t crc32c;              // CRC-32C of the map from byte 12 on
+    uint32_t volume_id;           // BPB volume ID
+    uint32_t free_clusters;       // FSInfo free cluster count
+    uint32_t next_free;           // FSInfo next free cluster
+    uint16_t extent_count;
+    uint16_t reserved;
+    uint32_t reserved2;
+};
+
+// Files are followed by the extent table they index
+struct bootmap_file {
+    char name[11];                // 8.3, as in the directory entry
+    uint8_t extent_count;
+    uint32_t size;
+    uint32_t crc32c;              // Of the whole file
+    uint32_t first_extent;
+};
+
+struct bootmap_extent {
+    uint32_t lba;
+    uint32_t sectors;
+};
+
+struct preload_file;
+struct preload_table;
+
+// An opened file: enough to locate its data without another directory walk
+struct fat32_file {
+    const char *path;
+    uint32_t cluster;             // First data cluster (disk position)
+    uint32_t size;                // Size in bytes
+    const struct bootmap_file *map; // Boot map entry (BIOS), or 0
+    const struct preload_file *preload; // Copy Stage 2 preloaded (BIOS), or 0
+};
+
+// One step of a load plan: copy `length` bytes starting at `offset`
+// (a multiple of 512) of `file` to `dest`. With `verify` set, the whole
+// file is read and its CRC-32C must equal `crc32c`.
+struct fat32_load_req {
+    struct fat32_file file;
+    uint32_t offset;
+    uint32_t length;
+    void *dest;
+    int verify;
+    uint32_t crc32c;
+};
+
+#define FAT32_MAX_PLAN 16
+
+// Reads that fail verification are retried this many times
+#define FAT32_VERIFY_RETRIES 2
+
+// fat32_load result when a file read fine but its checksum is wrong
+#define FAT32_ERR_CHECKSUM -2
+
 void fat32_init(struct fat32_bpb *bpb);
 int fat32_read_file(const char *filename, void *dest);
+int fat32_open(const char *filename, struct fat32_file *file);
+int fat32_load(struct fat32_load_req *reqs, int count);
+
+// BIOS: serve the files in Stage 2's preload table (preload.h) from
+// memory, and keep the pages that hold them out of the allocator
+void fat32_use_preload(const struct preload_table *table);
 
 #endif
@@ -8,7 +8,16 @@ extern "C"
 {
 #endif
 
+    // BIOS IRQ1 handler: only queues the scancode for menu_poll
     void keyboard_handler_c(uint8_t scancode);
+    int keyboard_pending(void);
+
+    // Handle queued keys (keyboard and serial line) and redraw the menu once
+    void menu_poll(void);
+    void menu_boot_selected(int quiet);
+
+    // Set by menu_poll on any key press
+    extern volatile int g_menu_key_seen;
 #ifdef UEFI_BUILD
     int uefi_get_scancode();
 #endif
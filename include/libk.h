@@ -0,0 +1,38 @@
+// libk.h
+#ifndef LIBK_H
+#define LIBK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Freestanding memory and string routines. The C names double as the
+// functions GCC calls for struct copies. Each dispatches through a pointer
+// that libk_init points at the best variant for this CPU; until then the
+// portable variants are used.
+void *memcpy(void *dst, const void *src, size_t n);
+void *memmove(void *dst, const void *src, size_t n);
+void *memset(void *dst, int c, size_t n);
+int memcmp(const void *a, const void *b, size_t n);
+size_t strlen(const char *s);
+int strcmp(const char *a, const char *b);
+
+// memset at or above this size uses non-temporal stores where available:
+// a large clear would only evict the cache for data nobody reads soon
+#define LIBK_NT_THRESHOLD 0x40000
+
+// Pick variants from CPUID. On BIOS this also turns on SSE (and AVX when
+// the CPU has it), which the firmware leaves off.
+void libk_init(void);
+
+// BIOS: set up SSE/AVX on an application processor as libk_init did on
+// the boot CPU, so the variants it picked run there too
+void libk_init_ap(void);
+
+// Variant names in use, for diagnostics
+const char *libk_memcpy_variant(void);
+const char *libk_memset_variant(void);
+
+// Time every variant the CPU supports and show bytes per cycle
+void libk_bench(void);
+
+#endif // LIBK_H
@@ -0,0 +1,21 @@
+// linux.h
+#ifndef LINUX_H
+#define LINUX_H
+
+#include <stdint.h>
+#include "fat32.h"
+#include "vga.h"
+
+// Handoff data for the x86 Linux boot protocol (BIOS build; UEFI allocates it)
+#define LINUX_BOOT_PARAMS_ADDR 0x4000
+#define LINUX_CMDLINE_ADDR 0x5000
+#define LINUX_CMDLINE_MAX 2048
+
+// Returns 1 if `kernel` is a bzImage Atlas can boot directly
+int linux_detect(struct fat32_file *kernel);
+
+// Load a bzImage and its initrd (reqs[1..count-1], concatenated) and enter
+// the kernel. Only returns on failure.
+int linux_boot(struct menu_entry *entry, struct fat32_load_req *reqs, int count);
+
+#endif // LINUX_H
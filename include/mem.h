@@ -3,20 +3,79 @@
 
 #include <stdint.h>
 
-#define HEAP_START 0x00100000 // 1 MB
-#define HEAP_SIZE 0x00100000  // 1 MB heap
+// Heap memory is added in page runs of at least this size as kmalloc needs
+// them: from the top of physical memory on BIOS, from AllocatePages on UEFI
+#define KHEAP_GROW_SIZE 0x00040000 // 256 KB
 
-typedef struct block_header
-{
-    uint32_t size;             // Size of the block (excluding header)
-    uint8_t free;              // 1 = free, 0 = used
-    struct block_header *next; // Pointer to next block
-} block_header_t;
+#define PAGE_SIZE 0x1000
+#define ALIGN_UP(x, a) (((x) + ((a) - 1)) & ~((uintptr_t)(a) - 1))
+
+// Every kmalloc result is aligned to two machine words:
+// 8 bytes in the 32-bit BIOS build, 16 bytes in the 64-bit UEFI build.
+#define KHEAP_ALIGN (2 * sizeof(uintptr_t))
+
+// Size classes: one per power of two from 128 (BIOS) / 256 (UEFI) bytes
+// up, plus one for all smaller requests
+#define KHEAP_CLASSES 26
 
-static block_header_t *free_list = (block_header_t *)HEAP_START;
+struct kheap_stats
+{
+    uint32_t total;        // Bytes managed by the heap, including headers
+    uint32_t in_use;       // Bytes handed out by kmalloc
+    uint32_t peak;         // High-water mark of in_use
+    uint32_t free;         // Bytes in free blocks
+    uint32_t largest_free; // Largest single free block
+    uint32_t frag_pct;     // 100 - largest_free * 100 / free
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failed;
+    uint32_t class_allocs[KHEAP_CLASSES];
+};
 
 void kheap_init();
 void *kmalloc(uint32_t size);
 void kfree(void *ptr);
+void kheap_get_stats(struct kheap_stats *out);
+
+// Arena (bump) allocator for data that is built once and dropped together.
+// Memory comes from kmalloc in chunks of at least chunk_size bytes; an
+// allocation is a pointer increment within the newest chunk.
+struct arena_chunk
+{
+    struct arena_chunk *prev;
+    uint32_t size; // Usable bytes after the header
+    uint32_t used;
+};
+
+struct arena
+{
+    struct arena_chunk *head;
+    uint32_t chunk_size;
+};
+
+struct arena_mark
+{
+    struct arena_chunk *chunk;
+    uint32_t used;
+};
+
+void arena_init(struct arena *a, uint32_t chunk_size);
+void *arena_alloc(struct arena *a, uint32_t size); // KHEAP_ALIGN aligned
+void *arena_alloc_aligned(struct arena *a, uint32_t size, uint32_t align);
+char *arena_strdup(struct arena *a, const char *str);
+struct arena_mark arena_mark(struct arena *a);
+void arena_reset(struct arena *a, struct arena_mark mark); // Drop everything after mark
+void arena_release(struct arena *a);                       // Drop the whole arena
+
+// Claim [addr, addr + size) for a kernel image, module or handoff data
+int kreserve(uintptr_t addr, uint32_t size);
+// Claim the lowest free, align-aligned range of size bytes at or above min.
+// Returns its address, or 0 if there is none.
+uintptr_t kplace(uintptr_t min, uint32_t size, uintptr_t align);
+// Claim the highest free page-aligned range of size bytes that ends at or
+// below limit. Returns its address, or 0 if there is none.
+uintptr_t kplace_below(uint64_t limit, uint32_t size);
+// Give back a range from kreserve or kplace (a load that failed)
+void krelease(uintptr_t addr, uint32_t size);
 
-#endif
\ No newline at end of file
+#endif
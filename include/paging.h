@@ -0,0 +1,24 @@
+// paging.h
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stdint.h>
+
+// Page tables for 64-bit kernels booted from BIOS (PML4, PDPT, PDs)
+#define PAGING_AREA_ADDR 0x70000
+#define PAGING_AREA_SIZE 0x10000
+
+#define LARGE_PAGE_SIZE 0x200000 // 2 MB
+
+int paging_long_mode_supported(void);
+
+// Identity-map all RAM reported by E820 (and at least the low 4 GB) with
+// 1 GB pages where the CPU has them, 2 MB pages otherwise. Returns the
+// PML4 address for CR3.
+uint32_t paging_build_identity(void);
+
+// boot2.asm: enable PAE/LME/paging and call `entry` in 64-bit mode with
+// RDI = rdi and RSI = rsi. Does not return.
+void long_mode_enter(uint32_t pml4, uint32_t entry, uint32_t rdi, uint32_t rsi);
+
+#endif // PAGING_H
@@ -0,0 +1,35 @@
+// pmm.h
+#ifndef PMM_H
+#define PMM_H
+
+#include <stdint.h>
+#include "bootinfo.h"
+
+// Physical page allocator for the BIOS build. One bit per 4 KB page of the
+// low 4 GB, built from the E820 map: set = used or not RAM. Everything
+// below 1 MB and the boot info block are never handed out.
+#define PMM_LOW_LIMIT 0x100000
+
+void pmm_init(void);
+
+// Lowest free run of pages at or above min, aligned to align. 0 if none.
+uintptr_t pmm_alloc(uintptr_t min, uint32_t pages, uintptr_t align);
+// Highest free run of pages (used for the loader's own heap)
+uintptr_t pmm_alloc_top(uint32_t pages);
+// Highest free run of pages that ends at or below limit. 0 if none.
+uintptr_t pmm_alloc_below(uint64_t limit, uint32_t pages);
+// Claim exactly [addr, addr + size); -1 if any page is in use or not RAM
+int pmm_reserve(uintptr_t addr, uint32_t size);
+void pmm_free(uintptr_t addr, uint32_t size);
+
+// Mark a claimed range as kernel/module memory in the exported map
+void pmm_tag_kernel(uintptr_t addr, uint32_t size);
+// Forget the kernel range that starts at addr
+void pmm_untag_kernel(uintptr_t addr);
+
+uint32_t pmm_free_pages(void);
+
+// Fill info->mmap: firmware ranges plus what the loader used
+void pmm_export_map(struct boot_info *info);
+
+#endif // PMM_H
@@ -0,0 +1,40 @@
+// preload.h
+#ifndef PRELOAD_H
+#define PRELOAD_H
+
+#include <stdint.h>
+
+// Files Stage 2 read with INT 13h and copied above 1 MB in unreal mode
+// before leaving real mode: the kernel and modules of the compiled
+// config's default entry. fat32.c serves them from memory, so the BIOS
+// disk path reads them once, at firmware speed, on any boot medium.
+#define PRELOAD_ADDR 0x0800
+#define PRELOAD_MAGIC 0x4C525041 // "APRL", written last
+#define PRELOAD_MAX_FILES 9      // Kernel + MAX_MODULES (vga.h)
+
+// Staging goes below the top of the highest RAM range under 4 GB, clear
+// of the PMM bitmap and heap there, and never below PRELOAD_MIN_ADDR,
+// where kernels, modules and Linux payloads are placed.
+#define PRELOAD_HEADROOM 0x1000000
+#define PRELOAD_MIN_ADDR 0x4000000
+
+struct preload_file
+{
+    char name[11];    // 8.3, as in the directory entry
+    uint8_t reserved;
+    uint32_t cluster; // First data cluster
+    uint32_t size;
+    uint32_t addr;    // Copy in memory, 4 KB aligned
+} __attribute__((packed));
+
+struct preload_table
+{
+    uint32_t magic;
+    uint16_t count;
+    uint16_t reserved;
+    uint32_t base;    // Staging area, all files
+    uint32_t size;
+    struct preload_file files[PRELOAD_MAX_FILES];
+} __attribute__((packed));
+
+#endif // PRELOAD_H
@@ -0,0 +1,50 @@
+// serial.h
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+
+// 16550 on COM1, 115200 8N1 with the FIFOs on
+#define SERIAL_COM1 0x3F8
+#define SERIAL_BAUD 115200
+
+// Output ring; a power of two. Bytes written while it is full are dropped.
+#define SERIAL_RING_SIZE 8192
+
+// Where the menu and loader messages go (console= key)
+#define CONSOLE_VGA 1
+#define CONSOLE_SERIAL 2
+
+extern int g_console;
+
+// Probe and program COM1; returns 0 if a UART answered. Safe to call twice.
+int serial_init(void);
+int serial_present(void);
+
+// Queue a string ("\n" becomes "\r\n") without waiting for the UART, then
+// top up the transmit FIFO if it has room
+void serial_write(const char *s);
+
+// Move queued bytes into the transmit FIFO if it is empty; never waits.
+// Called from the idle loops and (BIOS) the COM1 interrupt.
+void serial_poll(void);
+
+// Wait until the ring has drained, e.g. before handing over to a kernel
+void serial_flush(void);
+
+// Mirror one screen cell (ANSI cursor addressing) or a screen clear
+void serial_put_cell(char c, char attr, int row, int col);
+void serial_clear(void);
+
+// Next key typed on the serial line as a keyboard scancode, 0 if none
+int serial_get_scancode(void);
+
+// Diagnostics that only belong in the serial log
+void klog(const char *s);
+
+#ifndef UEFI_BUILD
+// Called by isr_serial in boot2.asm
+void serial_irq_c(void);
+#endif
+
+#endif // SERIAL_H
@@ -0,0 +1,47 @@
+// smp.h
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+
+// Application processors (BIOS build). smp_init finds them in the ACPI
+// MADT, starts them with INIT-SIPI-SIPI and parks each in a loop that
+// sleeps in HLT until the boot CPU posts work. smp_park puts them back
+// in wait-for-SIPI, the state a kernel expects to find them in, and must
+// run before any kernel is entered.
+#define SMP_MAX_CPUS 64
+#define SMP_TRAMPOLINE_ADDR 0x6000 // Below 1 MB, page aligned: SIPI vector 0x06
+#define SMP_AP_STACK_SIZE 0x4000
+#define SMP_WAKE_VECTOR 0x40       // IPI that ends an AP's HLT (isr_smp_wake)
+#define SMP_SPURIOUS_VECTOR 0xFF
+
+// Wait this long for every AP to check in after the SIPIs
+#define SMP_START_TIMEOUT_MS 100
+
+void smp_init(void);
+
+// CPUs taking work, the boot CPU included (1 before smp_init or after smp_park)
+uint32_t smp_cpu_count(void);
+
+// Process items [begin, end) of a job; runs on any CPU
+typedef void (*smp_fn)(void *ctx, uint32_t begin, uint32_t end);
+
+// Run fn over [0, count) in pieces of `grain` items on every CPU and
+// return when all are done. Each CPU starts on its own equal share and
+// then steals pieces from the shares of the others. Small jobs (count
+// <= grain) run on the caller alone. fn must not call parallel_for.
+void parallel_for(uint32_t count, uint32_t grain, smp_fn fn, void *ctx);
+
+// Split submission: post a job, do other work, then help finish it.
+// One job at a time; smp_wait must come before the next smp_submit.
+void smp_submit(uint32_t count, uint32_t grain, smp_fn fn, void *ctx);
+void smp_wait(void);
+
+void smp_park(void);
+
+// List the CPUs found in the MADT in the boot info block (none if
+// smp_init found no APIC or no MADT)
+struct boot_info;
+void smp_export(struct boot_info *info);
+
+#endif // SMP_H
@@ -0,0 +1,34 @@
+// timeline.h
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdint.h>
+#include "bootinfo.h"
+#include "cpu.h"
+
+// Boot-stage timestamps: a probe is one RDTSC and a store into a fixed
+// table, which is appended to the boot info for the kernel and can be
+// viewed from the menu with T.
+extern struct boot_timestamp g_timeline[BOOT_INFO_MAX_TIMELINE];
+extern uint32_t g_timeline_count;
+
+static inline void timeline_mark(uint32_t event, uint32_t arg)
+{
+    if (g_timeline_count < BOOT_INFO_MAX_TIMELINE)
+    {
+        struct boot_timestamp *t = &g_timeline[g_timeline_count++];
+        t->tsc = rdtsc();
+        t->event = event;
+        t->arg = arg;
+    }
+}
+
+// Pick up the probes Stage 2 took before any C code ran
+void timeline_init(void);
+void timeline_export(struct boot_info *info);
+// One "timeline <event> <us>" line per probe on the serial log, for
+// scripts/bench_boot.py
+void timeline_log(void);
+void timeline_show(void);
+
+#endif // TIMELINE_H
@@ -0,0 +1,31 @@
+// timer.h
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+// BIOS: PIT channel 0 interrupts at TIMER_HZ (isr_timer counts them)
+#define TIMER_HZ 100
+
+// TSC calibration window
+#define TIMER_CALIBRATE_MS 10
+
+// Calibrate the TSC (against PIT channel 2 on BIOS, Stall() on UEFI) and,
+// on BIOS, start the periodic tick
+void timer_init(void);
+
+// Milliseconds since timer_init
+uint32_t timer_ms(void);
+
+// TSC ticks per millisecond (0 before timer_init)
+uint32_t timer_tsc_khz(void);
+
+// Microseconds in a TSC delta (0 before timer_init)
+uint32_t timer_tsc_to_us(uint64_t ticks);
+
+#ifndef UEFI_BUILD
+// Incremented by isr_timer in boot2.asm
+extern volatile uint32_t g_timer_ticks;
+#endif
+
+#endif // TIMER_H
@@ -2,6 +2,8 @@
 #ifndef VGA_DRIVER_H
 #define VGA_DRIVER_H
 
+#include <stdint.h>
+
 // Screen dimensions (Dynamic)
 extern int g_vga_width;
 extern int g_vga_height;
@@ -19,10 +21,17 @@ typedef struct
     volatile char attr;
 } __attribute__((packed)) vga_cell_t;
 
+// Modules (initrd= and module= keys) loaded alongside the kernel
+#define MAX_MODULES 8
+
 struct menu_entry
 {
     char *name;
     char *kernel_path;
+    char *cmdline;
+    char long_mode; // 1 = 64-bit kernel, entered in long mode
+    short module_count;
+    char *modules[MAX_MODULES];
 };
 
 struct menu
@@ -31,13 +40,18 @@ struct menu
     short length;
     struct menu_entry *entries;
     char *title;
+    short timeout; // Seconds before the selected entry boots, -1 = wait for a key
+    char console;  // CONSOLE_* flags from console=, 0 = not set
+    short fallback; // Entry to boot if the selected one fails verification, -1 = none
 };
 
 void vga_clear_screen(char attr);
 void vga_put_char(char c, char attr, int row, int col);
 void vga_put_string(const char *str, char attr);
+void vga_put_uint(uint32_t n, int width, char attr);
 void vga_init(void);
 void draw_menu(struct menu menu_opt);
+void draw_countdown(struct menu menu_opt, int seconds);
 void draw_box(int row, int col, int w, int h, char attr);
 
 #endif // VGA_DRIVER_H
\ No newline at end of file
@@ -0,0 +1,493 @@
+"""Boot read-cost analyzer.
+
+Reads an Atlas disk image (or a block device, read-only) and replays what
+the BIOS loader does for every entry in its ATLAS.CFG, with the same rules
+as src/kernel/fat32.c: the boot map, directory walks a sector at a time,
+the one-sector FAT cache, runs of contiguous clusters merged into reads of
+up to 128 sectors, the bounce read for a partial last sector, and the
+Linux setup-header read before the real load.
+
+For each file it reports the extents and how fragmented they are, and for
+each entry the read commands, FAT and directory reads and bytes. A
+throughput profile (per-command cost, seek cost, MB/s) turns those into a
+load-time estimate per kind of disk. Hot files that are fragmented get a
+relocation plan: a contiguous free run for each, and what the entry would
+cost afterwards.
+
+    python scripts/analyze_image.py build/disk.img
+    python scripts/analyze_image.py /dev/sdb --profile profiles.json --json report.json
+"""
+import argparse
+import copy
+import json
+import os
+import struct
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from create_disk import (BOOTMAP_EXTENT, BOOTMAP_FILE, BOOTMAP_HEADER, BOOTMAP_LBA, BOOTMAP_MAGIC,
+                         BOOTMAP_SECTORS, BOOTMAP_VERSION, DIR_ENTRY, crc32c, format_name)
+
+SECTOR_SIZE = 512
+FAT32_EOC = 0x0FFFFFF8
+ATA_MAX_SECTORS = 128 # fat32.c: largest single read
+LINUX_SETUP_READ = 1024 # linux.c: g_setup, read before the kernel is placed
+STAGE2_CONFIG_MAX = 127 * SECTOR_SIZE
+
+# Rough BIOS INT 13h figures; pass --profile to use measured ones
+DEFAULT_PROFILES = {
+    "hdd": {"command_ms": 0.2, "seek_ms": 8.0, "mb_per_s": 80},
+    "usb2": {"command_ms": 1.0, "seek_ms": 0.0, "mb_per_s": 25},
+    "usb3": {"command_ms": 0.3, "seek_ms": 0.0, "mb_per_s": 120},
+    "ssd": {"command_ms": 0.1, "seek_ms": 0.0, "mb_per_s": 250},
+    "qemu": {"command_ms": 0.05, "seek_ms": 0.0, "mb_per_s": 400},
+}
+
+
+def image_name(path):
+    """format_83() in fat32.c: the name the BIOS loader looks for in the root
+    directory. It does not split paths, so "/BOOT/X.BIN" is never found."""
+    name = bytearray(b' ' * 11)
+    i = 0
+    while i < len(path) and path[i] != '.' and i < 8:
+        name[i] = ord(path[i].upper() if 'a' <= path[i] <= 'z' else path[i]) & 0xFF
+        i += 1
+    while i < len(path) and path[i] != '.':
+        i += 1
+    if i < len(path):
+        i += 1
+        j = 0
+        while i < len(path) and path[i] != ' ' and j < 3:
+            name[8 + j] = ord(path[i].upper() if 'a' <= path[i] <= 'z' else path[i]) & 0xFF
+            i += 1
+            j += 1
+    return bytes(name)
+
+
+class Volume:
+    """The FAT32 volume at LBA 0 of the image, as fat32_init() sees it."""
+    def __init__(self, path):
+        self.f = open(path, 'rb')
+        boot = self.read(0, 1)
+        (self.bytes_per_sector, self.spc, self.reserved, self.fat_count) = struct.unpack_from('<HBHB', boot, 11)
+        self.sectors_per_fat, = struct.unpack_from('<L', boot, 36)
+        self.root_cluster, self.fs_info = struct.unpack_from('<LH', boot, 44)
+        self.volume_id, = struct.unpack_from('<L', boot, 67)
+        if self.bytes_per_sector != SECTOR_SIZE or self.spc == 0 or self.sectors_per_fat == 0:
+            raise ValueError(f"{path} does not start with a FAT32 boot sector")
+        self.data_lba = self.reserved + self.fat_count * self.sectors_per_fat
+        fat = self.read(self.reserved, self.sectors_per_fat)
+        self.fat = struct.unpack('<%dL' % (len(fat) // 4), fat)
+        total, = struct.unpack_from('<L', boot, 32)
+        self.cluster_count = min((total - self.data_lba) // self.spc, len(self.fat) - 2)
+
+    def read(self, lba, count):
+        self.f.seek(lba * SECTOR_SIZE)
+        return self.f.read(count * SECTOR_SIZE)
+
+    def next_cluster(self, cluster):
+        return self.fat[cluster] & 0x0FFFFFFF if cluster < len(self.fat) else FAT32_EOC
+
+    def cluster_lba(self, cluster):
+        return self.data_lba + (cluster - 2) * self.spc
+
+    def chain(self, cluster):
+        clusters = []
+        while 2 <= cluster < FAT32_EOC and len(clusters) <= self.cluster_count:
+            clusters.append(cluster)
+            cluster = self.next_cluster(cluster)
+        return clusters
+
+    def root_entries(self):
+        """Live root entries as (8.3 name, first cluster, size, directory
+        sector index), and the index of the sector holding the end marker."""
+        entries = []
+        index = 0
+        for cluster in self.chain(self.root_cluster):
+            data = self.read(self.cluster_lba(cluster), self.spc)
+            for off in range(0, len(data), DIR_ENTRY.size):
+                name = data[off:off + 11]
+                if name[0] == 0:
+                    return entries, index + off // SECTOR_SIZE
+                if name[0] != 0xE5:
+                    hi, = struct.unpack_from('<H', data, off + 20)
+                    lo, size = struct.unpack_from('<HL', data, off + 26)
+                    entries.append((bytes(name), hi << 16 | lo, size, index + off // SECTOR_SIZE))
+            index += self.spc
+        return entries, None
+
+    def bootmap(self):
+        """The boot map's files by 8.3 name, or (None, reason) if the loader would not trust it."""
+        if self.fs_info != BOOTMAP_LBA - 1:
+            return None, "no FSInfo before the map"
+        raw = self.read(self.fs_info, 1 + BOOTMAP_SECTORS)
+        fsinfo, data = raw[:SECTOR_SIZE], raw[SECTOR_SIZE:]
+        (magic, version, file_count, crc, volume_id, free_clusters, next_free,
+         extent_count, _, _) = BOOTMAP_HEADER.unpack_from(data)
+        if magic != BOOTMAP_MAGIC:
+            return None, "none"
+        files_off = BOOTMAP_HEADER.size
+        extents_off = files_off + file_count * BOOTMAP_FILE.size
+        if (version != BOOTMAP_VERSION or extents_off + extent_count * BOOTMAP_EXTENT.size > len(data)
+                or crc32c(data[12:]) != crc):
+            return None, "damaged"
+        fs_free, fs_next = struct.unpack_from('<LL', fsinfo, 488)
+        if (fsinfo[:4] != b'RRaA' or volume_id != self.volume_id
+                or free_clusters != fs_free or next_free != fs_next):
+            return None, "stale"
+        extents = [BOOTMAP_EXTENT.unpack_from(data, extents_off + i * BOOTMAP_EXTENT.size)
+                   for i in range(extent_count)]
+        files = {}
+        for i in range(file_count):
+            name, count, size, file_crc, first = BOOTMAP_FILE.unpack_from(data, files_off + i * BOOTMAP_FILE.size)
+            if first + count > extent_count:
+                return None, "damaged"
+            files[name] = (size, extents[first:first + count])
+        return files, "valid"
+
+
+class Replay:
+    """One boot of one entry: every ata_read_sectors() call fat32.c makes."""
+    def __init__(self, vol, bootmap):
+        self.vol = vol
+        self.bootmap = bootmap
+        self.reads = [] # (kind, lba, sectors)
+        self.fat_cache = None
+        if vol.fs_info == BOOTMAP_LBA - 1:
+            self.read("map", BOOTMAP_LBA - 1, 1 + BOOTMAP_SECTORS)
+
+    def read(self, kind, lba, count):
+        self.reads.append((kind, lba, count))
+
+    def next_cluster(self, cluster):
+        fat_lba = self.vol.reserved + cluster // 128
+        if fat_lba != self.fat_cache:
+            self.read("fat", fat_lba, 1)
+            self.fat_cache = fat_lba
+        return self.vol.next_cluster(cluster)
+
+    def open(self, path, root):
+        """fat32_open(): (first cluster, size, map extents or None), or None."""
+        name = image_name(path)
+        if self.bootmap and name in self.bootmap:
+            size, extents = self.bootmap[name]
+            cluster = (extents[0][0] - self.vol.data_lba) // self.vol.spc + 2 if extents else 0
+            return cluster, size, extents
+        entries, end = root
+        by_sector = {}
+        for entry_name, first, size, sector in entries:
+            by_sector.setdefault(sector, []).append((entry_name, first, size))
+        cluster = self.vol.root_cluster
+        index = 0
+        while 2 <= cluster < FAT32_EOC:
+            lba = self.vol.cluster_lba(cluster)
+            for s in range(self.vol.spc):
+                self.read("dir", lba + s, 1)
+                for entry_name, first, size in by_sector.get(index, []):
+                    if entry_name == name:
+                        return first, size, None
+                if index == end:
+                    return None
+                index += 1
+            cluster = self.next_cluster(cluster)
+        return None
+
+    def load(self, file, offset, length):
+        """fat32_load_one() or the boot map read, for one request."""
+        cluster, size, extents = file
+        if extents is not None:
+            skip = offset // SECTOR_SIZE
+            remaining = length
+            for lba, sectors in extents:
+                if remaining == 0:
+                    break
+                if skip >= sectors:
+                    skip -= sectors
+                    continue
+                lba, sectors, skip = lba + skip, sectors - skip, 0
+                whole = min(remaining // SECTOR_SIZE, sectors)
+                self.run(lba, whole)
+                remaining -= whole * SECTOR_SIZE
+                if 0 < remaining < SECTOR_SIZE and whole < sectors:
+                    self.read("data", lba + whole, 1)
+                    remaining = 0
+            return
+
+        spc = self.vol.spc
+        cluster_bytes = spc * SECTOR_SIZE
+        first_sector = (offset % cluster_bytes) // SECTOR_SIZE
+        remaining = length
+        for _ in range(offset // cluster_bytes):
+            cluster = self.next_cluster(cluster)
+        while remaining > 0 and 2 <= cluster < FAT32_EOC:
+            run_start = cluster
+            run_sectors = spc - first_sector
+            nxt = cluster
+            while run_sectors * SECTOR_SIZE < remaining:
+                nxt = self.next_cluster(cluster)
+                if nxt != cluster + 1:
+                    break
+                cluster = nxt
+                run_sectors += spc
+            nbytes = min(run_sectors * SECTOR_SIZE, remaining)
+            lba = self.vol.cluster_lba(run_start) + first_sector
+            self.run(lba, nbytes // SECTOR_SIZE)
+            if nbytes % SECTOR_SIZE:
+                self.read("data", lba + nbytes // SECTOR_SIZE, 1)
+            remaining -= nbytes
+            first_sector = 0
+            cluster = nxt
+
+    def run(self, lba, count):
+        while count > 0:
+            chunk = min(count, ATA_MAX_SECTORS)
+            self.read("data", lba, chunk)
+            lba += chunk
+            count -= chunk
+
+    def cost(self):
+        summary = {"commands": len(self.reads), "sectors": 0, "seeks": 0}
+        for kind in ("map", "dir", "fat", "data"):
+            summary[kind + "_reads"] = 0
+        position = None
+        for kind, lba, count in self.reads:
+            summary[kind + "_reads"] += 1
+            summary["sectors"] += count
+            if position is not None and lba != position:
+                summary["seeks"] += 1
+            position = lba + count
+        summary["bytes"] = summary["sectors"] * SECTOR_SIZE
+        return summary
+
+
+def estimate_ms(cost, profile):
+    return (cost["commands"] * profile["command_ms"] + cost["seeks"] * profile["seek_ms"]
+            + cost["bytes"] / (profile["mb_per_s"] * 1e6) * 1e3)
+
+
+def parse_entries(text):
+    """The BIOS view of ATLAS.CFG: name, kernel (kernel_x86=, kernel=, then
+    kernel_x64=) and modules of every entry that has a kernel."""
+    entries = []
+    for raw in text.splitlines():
+        line = raw.strip()
+        if line.startswith("[entry]"):
+            entries.append({"name": "Unknown Entry", "kernel_x86": "", "kernel": "", "kernel_x64": "", "modules": []})
+            continue
+        key, sep, value = line.partition('=')
+        if not sep or not entries:
+            continue
+        if key in ("name", "kernel_x86", "kernel", "kernel_x64"):
+            entries[-1][key] = value.strip()
+        elif key in ("initrd", "module"):
+            entries[-1]["modules"].append(value.strip())
+    result = []
+    for e in entries:
+        kernel = e["kernel_x86"] or e["kernel"] or e["kernel_x64"]
+        if kernel:
+            result.append({"name": e["name"], "files": [kernel] + e["modules"][:8]})
+    return result
+
+
+def file_extents(vol, cluster, size):
+    """Disk runs of a file's cluster chain: [(first cluster, cluster count)]."""
+    needed = -(-size // (vol.spc * SECTOR_SIZE))
+    runs = []
+    for c in vol.chain(cluster)[:needed]:
+        if runs and runs[-1][0] + runs[-1][1] == c:
+            runs[-1][1] += 1
+        else:
+            runs.append([c, 1])
+    return [tuple(r) for r in runs]
+
+
+def replay_entry(vol, bootmap, root, paths):
+    """Replay load_entry(): open every file, let linux_detect() read the
+    kernel's setup header, then run the plan in disk order like fat32_load()."""
+    rp = Replay(vol, bootmap)
+    opened = []
+    for path in paths:
+        f = rp.open(path, root)
+        if f is None:
+            return rp, None, path
+        opened.append((path, f))
+
+    kernel = opened[0][1]
+    offset0 = 0
+    if kernel[1] >= LINUX_SETUP_READ:
+        rp.load(kernel, 0, LINUX_SETUP_READ)
+        runs = file_extents(vol, kernel[0], LINUX_SETUP_READ)
+        header = b''.join(vol.read(vol.cluster_lba(c), n * vol.spc) for c, n in runs)
+        if (header[0x202:0x206] == b'HdrS' and struct.unpack_from('<H', header, 0x206)[0] >= 0x0206
+                and header[0x211] & 1):
+            offset0 = ((header[0x1F1] or 4) + 1) * SECTOR_SIZE
+
+    plan = [(f[0], offset0 if i == 0 else 0, f) for i, (_, f) in enumerate(opened)]
+    for _, offset, f in sorted(plan, key=lambda p: (p[0], p[1])):
+        rp.load(f, offset, f[1] - offset)
+    return rp, opened, None
+
+
+def relocation_plan(vol, hot):
+    """First-fit contiguous free runs for the fragmented hot files, taken in
+    boot order so an entry's files end up close together. The old clusters
+    stay allocated: a file is written to its new place before it is freed."""
+    used = [c < 2 or vol.fat[c] != 0 for c in range(len(vol.fat))]
+    limit = min(len(vol.fat), vol.cluster_count + 2)
+    moves = []
+    start = 2
+    for name, (path, cluster, size) in hot.items():
+        runs = file_extents(vol, cluster, size)
+        if len(runs) <= 1:
+            continue
+        needed = sum(n for _, n in runs)
+        c, free = start, 0
+        while c < limit and free < needed:
+            free = free + 1 if not used[c] else 0
+            c += 1
+        move = {"file": path, "name": name, "size": size,
+                "extents": len(runs), "clusters": needed, "to": None}
+        if free == needed:
+            move["to"] = c - needed
+            move["lba"] = vol.cluster_lba(move["to"])
+            for i in range(move["to"], c):
+                used[i] = True
+            start = c
+        moves.append(move)
+    return moves
+
+
+def relocated(vol, root, bootmap, moves):
+    """The volume, root directory and boot map as they would look after the moves."""
+    sim = copy.copy(vol)
+    sim.fat = list(vol.fat)
+    entries, end = root
+    new_first = {}
+    for m in moves:
+        if m["to"] is None:
+            continue
+        for i in range(m["clusters"]):
+            sim.fat[m["to"] + i] = m["to"] + i + 1 if i + 1 < m["clusters"] else 0x0FFFFFFF
+        new_first[m["name"]] = m["to"]
+    entries = [(n, new_first.get(n, c), size, sector) for n, c, size, sector in entries]
+    if bootmap is not None:
+        bootmap = dict(bootmap)
+        for m in moves:
+            if m["to"] is not None and m["name"] in bootmap:
+                bootmap[m["name"]] = (m["size"], [(m["lba"], -(-m["size"] // SECTOR_SIZE))])
+    return sim, (entries, end), bootmap
+
+
+def print_cost(cost, times, indent="  "):
+    print(f"{indent}reads: {cost['commands']} commands ({cost['map_reads']} map, {cost['dir_reads']} directory, "
+          f"{cost['fat_reads']} FAT, {cost['data_reads']} data), {cost['bytes'] / 1024:.1f} KB, "
+          f"{cost['seeks']} seeks")
+    print(f"{indent}estimate: " + "  ".join(f"{name} {ms:.1f} ms" for name, ms in times.items()))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Predict Atlas's boot read cost for a disk image")
+    parser.add_argument("image", help="disk image or block device (opened read-only)")
+    parser.add_argument("--profile", help="JSON file of throughput profiles: "
+                        "{name: {command_ms, seek_ms, mb_per_s}}")
+    parser.add_argument("--json", metavar="FILE", help="also write the report as JSON")
+    args = parser.parse_args()
+
+    profiles = DEFAULT_PROFILES
+    if args.profile:
+        with open(args.profile) as f:
+            profiles = json.load(f)
+
+    try:
+        vol = Volume(args.image)
+    except (OSError, ValueError) as e:
+        print(e)
+        return 1
+    root = vol.root_entries()
+    bootmap, map_state = vol.bootmap()
+    by_name = {name: (cluster, size, sector) for name, cluster, size, sector in root[0]}
+    report = {"image": args.image, "cluster_bytes": vol.spc * SECTOR_SIZE, "data_lba": vol.data_lba,
+              "bootmap": map_state, "profiles": profiles, "files": {}, "entries": []}
+
+    print(f"{args.image}: FAT32, {vol.spc * SECTOR_SIZE}-byte clusters, data at LBA {vol.data_lba}, "
+          f"boot map: {map_state}" + (f" ({len(bootmap)} files)" if bootmap else ""))
+
+    # Stage 2 only looks at the first sector of the root directory
+    for cfg in ("ATLAS.BIN", "ATLAS.CFG"):
+        found = by_name.get(format_name(cfg))
+        if found and found[2] != 0:
+            print(f"Warning: {cfg} is not in the first root directory sector; Stage 2 will not find it")
+        if found and found[1] > STAGE2_CONFIG_MAX:
+            print(f"Warning: {cfg} is larger than the {STAGE2_CONFIG_MAX} bytes Stage 2 loads")
+
+    cfg = by_name.get(format_name("ATLAS.CFG"))
+    if not cfg:
+        print("No ATLAS.CFG in the root directory: nothing to analyze.")
+        return 1
+    text = b''.join(vol.read(vol.cluster_lba(c), n * vol.spc) for c, n in file_extents(vol, cfg[0], cfg[1]))
+    entries = parse_entries(text[:cfg[1]].decode('ascii', 'replace'))
+
+    hot = {}
+    for index, entry in enumerate(entries):
+        rp, opened, missing = replay_entry(vol, bootmap, root, entry["files"])
+        if missing:
+            print(f"\nEntry {index} \"{entry['name']}\": {missing} not found, the entry does not boot")
+            report["entries"].append({"name": entry["name"], "missing": missing})
+            continue
+
+        print(f"\nEntry {index} \"{entry['name']}\"")
+        print(f"  {'file':<20}{'size':>11}{'extents':>9}{'frag%':>7}  via  first LBA")
+        for path, (cluster, size, extents) in opened:
+            runs = file_extents(vol, cluster, size)
+            clusters = sum(n for _, n in runs)
+            frag = (len(runs) - 1) * 100 // (clusters - 1) if clusters > 1 else 0
+            via = "map" if extents is not None else "FAT"
+            first = vol.cluster_lba(runs[0][0]) if runs else 0
+            print(f"  {path:<20}{size:>11}{len(runs):>9}{frag:>7}  {via:<4} {first}")
+            report["files"][path] = {"size": size, "via": via, "fragmentation": frag,
+                                     "extents": [[vol.cluster_lba(c), n * vol.spc] for c, n in runs]}
+            hot.setdefault(image_name(path), (path, cluster, size))
+
+        cost = rp.cost()
+        times = {name: round(estimate_ms(cost, p), 2) for name, p in profiles.items()}
+        print_cost(cost, times)
+        report["entries"].append({"name": entry["name"], "files": entry["files"], "cost": cost, "estimate_ms": times})
+
+    moves = relocation_plan(vol, hot)
+    report["relocation"] = [{k: v for k, v in m.items() if k != "name"} for m in moves]
+    if moves:
+        print("\nRelocation plan (fragmented hot files to contiguous free runs):")
+        for m in moves:
+            if m["to"] is None:
+                print(f"  {m['file']:<20}{m['extents']:>5} extents: no free run of {m['clusters']} clusters")
+            else:
+                print(f"  {m['file']:<20}{m['extents']:>5} extents -> clusters {m['to']}-{m['to'] + m['clusters'] - 1} "
+                      f"(LBA {m['lba']})")
+
+        sim, sim_root, sim_map = relocated(vol, root, bootmap, moves)
+        for index, entry in enumerate(entries):
+            if not any(image_name(p) in {m["name"] for m in moves} for p in entry["files"]):
+                continue
+            rp, _, missing = replay_entry(sim, sim_map, sim_root, entry["files"])
+            if missing:
+                continue
+            cost = rp.cost()
+            times = {name: round(estimate_ms(cost, p), 2) for name, p in profiles.items()}
+            print(f"Entry {index} afterwards:")
+            print_cost(cost, times)
+            report["entries"][index]["relocated_cost"] = cost
+            report["entries"][index]["relocated_estimate_ms"] = times
+        print("Rebuilding the image with create_disk.py stores every file contiguously.")
+    else:
+        print("\nEvery hot file is contiguous.")
+    if bootmap is None and map_state != "none":
+        print(f"The boot map is {map_state}: rebuild the image to bring it back.")
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(report, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
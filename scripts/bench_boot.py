@@ -0,0 +1,265 @@
+"""Headless boot-time benchmark.
+
+Boots a disk image in QEMU (BIOS and/or OVMF) N times with the serial
+port on a pipe, and times every boot from the host side:
+
+    loader_ms           QEMU start -> "Atlas: Stage 2 running"
+    time_to_kernel_ms   QEMU start -> "kernel: entered" (the example kernels
+                        built with ATLAS_BENCH print it on COM1, then write
+                        QEMU's isa-debug-exit port, which ends the run)
+
+plus the loader's own TSC timeline ("timeline <event> <us>" lines logged
+just before the jump) as timeline.<event>_ms. Results are written as JSON
+with median/p95 per metric and can be compared against a stored baseline.
+
+The image should boot its default entry without waiting (timeout=0), see
+config/bench.cfg and the bench target in CMakeLists.txt.
+
+With --smp N, QEMU gets N CPUs and every BIOS boot must also log the
+loader's "timeline smp#N" probe, i.e. all N CPUs joined the worker pool;
+a boot that reports fewer counts as failed (the smp-check target).
+"""
+import argparse
+import json
+import os
+import platform
+import queue
+import re
+import subprocess
+import sys
+import threading
+import time
+
+LOADER_MARK = b"Atlas: Stage 2 running"
+KERNEL_MARK = b"kernel: entered"
+TIMELINE_LINE = re.compile(rb"^timeline (\S+) (\d+)")
+SMP_PROBE = re.compile(r"^smp#(\d+)$")
+DEBUG_EXIT = "isa-debug-exit,iobase=0xf4,iosize=0x04"
+
+# =========================================================
+# One boot
+# =========================================================
+def qemu_command(args, mode):
+    cmd = [
+        args.qemu,
+        "-drive", f"format=raw,file={args.image},snapshot=on",
+        "-m", args.memory,
+        "-display", "none",
+        "-serial", "stdio",
+        "-monitor", "none",
+        "-no-reboot",
+        "-device", DEBUG_EXIT,
+    ]
+    if args.smp:
+        cmd += ["-smp", str(args.smp)]
+    for accel in args.accel.split(","):
+        cmd += ["-accel", accel]
+    if mode == "uefi":
+        cmd += ["-bios", args.ovmf]
+    return cmd
+
+
+def _pump(stream, lines):
+    """Reader thread: hand each serial line to the main thread with its arrival time."""
+    for line in iter(stream.readline, b""):
+        lines.put((time.perf_counter(), line))
+    lines.put((time.perf_counter(), None))
+
+
+def boot_once(args, mode):
+    """Returns ({metric: ms}, None) or (partial metrics, error text)."""
+    metrics = {}
+    log = []
+    start = time.perf_counter()
+    proc = subprocess.Popen(qemu_command(args, mode), stdin=subprocess.DEVNULL,
+                            stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    lines = queue.Queue()
+    threading.Thread(target=_pump, args=(proc.stdout, lines), daemon=True).start()
+
+    error = None
+    cpus = None
+    deadline = start + args.timeout
+    while True:
+        try:
+            stamp, line = lines.get(timeout=max(0.0, deadline - time.perf_counter()))
+        except queue.Empty:
+            error = f"timed out after {args.timeout}s"
+            break
+        if line is None:
+            break
+        log.append(line)
+        ms = (stamp - start) * 1000.0
+        if LOADER_MARK in line and "loader_ms" not in metrics:
+            metrics["loader_ms"] = ms
+        match = TIMELINE_LINE.match(line.strip())
+        if match:
+            name = match.group(1).decode(errors="replace")
+            metrics[f"timeline.{name}_ms"] = int(match.group(2)) / 1000.0
+            smp = SMP_PROBE.match(name)
+            if smp:
+                cpus = int(smp.group(1))
+        if KERNEL_MARK in line:
+            metrics["time_to_kernel_ms"] = ms
+            break
+
+    if proc.poll() is None:
+        proc.kill()
+    proc.wait()
+
+    if error is None and "time_to_kernel_ms" not in metrics:
+        stderr = proc.stderr.read().decode(errors="replace").strip()
+        error = f"QEMU exited ({proc.returncode}) before the kernel marker"
+        if stderr:
+            error += f": {stderr.splitlines()[-1]}"
+    # Only Stage 2 starts the APs; the UEFI loader runs on the boot CPU
+    if error is None and args.smp and mode == "bios" and cpus != args.smp:
+        error = f"expected {args.smp} CPUs in the worker pool, the timeline has " + \
+                (f"{cpus}" if cpus is not None else "no smp probe")
+    if error and args.verbose:
+        sys.stderr.write(b"".join(log).decode(errors="replace"))
+    return metrics, error
+
+# =========================================================
+# Statistics
+# =========================================================
+def percentile(sorted_values, pct):
+    """Nearest-rank percentile of an already sorted list."""
+    rank = max(1, -(-len(sorted_values) * pct // 100))
+    return sorted_values[int(rank) - 1]
+
+
+def summarize(samples):
+    values = sorted(samples)
+    return {
+        "median": round(percentile(values, 50), 3),
+        "p95": round(percentile(values, 95), 3),
+        "min": round(values[0], 3),
+        "max": round(values[-1], 3),
+        "samples": [round(v, 3) for v in samples],
+    }
+
+
+def run_mode(args, mode):
+    samples = {}
+    failures = []
+    for i in range(args.warmup + args.runs):
+        metrics, error = boot_once(args, mode)
+        measured = i >= args.warmup
+        status = error or f"{metrics['time_to_kernel_ms']:.1f} ms to kernel"
+        print(f"[{mode}] run {i + 1 - args.warmup if measured else 'warm-up'}: {status}")
+        if not measured:
+            continue
+        if error:
+            failures.append(error)
+            continue
+        for name, value in metrics.items():
+            samples.setdefault(name, []).append(value)
+    return {
+        "runs": args.runs,
+        "failures": failures,
+        "metrics": {name: summarize(values) for name, values in sorted(samples.items())},
+    }
+
+# =========================================================
+# Baseline comparison
+# =========================================================
+def compare(results, baseline, threshold_pct, floor_ms):
+    """Print median deltas; returns the list of regressed (mode, metric) pairs."""
+    regressions = []
+    for mode, result in results["modes"].items():
+        base_mode = baseline.get("modes", {}).get(mode)
+        if not base_mode:
+            print(f"[{mode}] no baseline")
+            continue
+        for name, stats in result["metrics"].items():
+            base = base_mode["metrics"].get(name)
+            if not base:
+                continue
+            old, new = base["median"], stats["median"]
+            delta = new - old
+            pct = (delta / old * 100.0) if old else 0.0
+            regressed = delta > floor_ms and new > old * (1 + threshold_pct / 100.0)
+            flag = "  REGRESSION" if regressed else ""
+            print(f"[{mode}] {name:32} {old:10.3f} -> {new:10.3f} ms ({pct:+6.1f}%){flag}")
+            if regressed:
+                regressions.append((mode, name))
+        if result["failures"] and not base_mode.get("failures"):
+            print(f"[{mode}] {len(result['failures'])} failed boots (baseline had none)  REGRESSION")
+            regressions.append((mode, "failures"))
+    return regressions
+
+
+def qemu_version(qemu):
+    try:
+        out = subprocess.run([qemu, "--version"], capture_output=True, text=True, timeout=10).stdout
+        return out.splitlines()[0] if out else None
+    except (OSError, subprocess.TimeoutExpired):
+        return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Time headless Atlas boots in QEMU")
+    parser.add_argument("image", help="raw disk image to boot")
+    parser.add_argument("--mode", choices=["bios", "uefi", "both"], default="both")
+    parser.add_argument("--ovmf", help="OVMF firmware for --mode uefi/both")
+    parser.add_argument("--runs", type=int, default=10)
+    parser.add_argument("--warmup", type=int, default=1, help="unmeasured boots before the runs")
+    parser.add_argument("--timeout", type=float, default=60.0, help="seconds per boot")
+    parser.add_argument("--qemu", default="qemu-system-x86_64")
+    parser.add_argument("--accel", default="kvm,tcg", help="accelerators to try, in order")
+    parser.add_argument("--memory", default="256M")
+    parser.add_argument("--smp", type=int, default=0,
+                        help="CPUs to give QEMU; BIOS boots fail unless all of them join the worker pool")
+    parser.add_argument("--output", default="bench.json", help="JSON results file")
+    parser.add_argument("--baseline", help="JSON results to compare against (skipped if missing)")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="percent a median may grow before it counts as a regression")
+    parser.add_argument("--floor", type=float, default=1.0,
+                        help="ms a median may grow regardless of --threshold (timer noise)")
+    parser.add_argument("--verbose", action="store_true", help="dump the serial log of failed boots")
+    args = parser.parse_args()
+
+    modes = ["bios", "uefi"] if args.mode == "both" else [args.mode]
+    if "uefi" in modes and not (args.ovmf and os.path.exists(args.ovmf)):
+        if args.mode == "both":
+            print("No OVMF firmware, benchmarking BIOS only")
+            modes = ["bios"]
+        else:
+            print("--mode uefi needs --ovmf <OVMF.fd>")
+            return 2
+
+    results = {
+        "image": os.path.basename(args.image),
+        "date": time.strftime("%Y-%m-%dT%H:%M:%S"),
+        "host": platform.node(),
+        "qemu": qemu_version(args.qemu),
+        "accel": args.accel,
+        "modes": {mode: run_mode(args, mode) for mode in modes},
+    }
+    with open(args.output, "w") as f:
+        json.dump(results, f, indent=2)
+    print(f"Wrote {args.output}")
+
+    for mode, result in results["modes"].items():
+        kernel = result["metrics"].get("time_to_kernel_ms")
+        if kernel:
+            print(f"[{mode}] time to kernel: median {kernel['median']:.1f} ms, p95 {kernel['p95']:.1f} ms")
+
+    if args.baseline:
+        if not os.path.exists(args.baseline):
+            print(f"No baseline at {args.baseline}")
+        else:
+            with open(args.baseline) as f:
+                baseline = json.load(f)
+            if compare(results, baseline, args.threshold, args.floor):
+                return 1
+
+    failed = any(not r["metrics"] for r in results["modes"].values())
+    # The SMP check is pass/fail per boot, not a timing
+    if args.smp and any(r["failures"] for r in results["modes"].values()):
+        failed = True
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,17 +1,26 @@
+import argparse
+import ctypes
+import errno
+import hashlib
+import json
+import mmap
 import os
-import subprocess
 import platform
-import json
+import stat
+import subprocess
 import sys
-import ctypes
+import threading
 import time
+from concurrent.futures import ThreadPoolExecutor
 from ctypes import wintypes
 
+IS_WINDOWS = platform.system() == "Windows"
+
 # =========================================================
 # Admin / Root Check
 # =========================================================
 def is_admin():
-    if platform.system() == "Windows":
+    if IS_WINDOWS:
         try:
             return ctypes.windll.shell32.IsUserAnAdmin()
         except Exception:
@@ -21,7 +30,7 @@ def is_admin():
 
 
 def run_as_admin():
-    if platform.system() == "Windows":
+    if IS_WINDOWS:
         if not is_admin():
             ctypes.windll.shell32.ShellExecuteW(
                 None,
@@ -92,8 +101,6 @@ def get_drives_linux():
 # =========================================================
 # Windows Volume Locking
 # =========================================================
-kernel32 = ctypes.WinDLL('kernel32.dll')  # Use WinDLL for __stdcall
-
 # Define constants
 INVALID_HANDLE_VALUE = -1  # Since wintypes.HANDLE(-1).value, but simplify
 FSCTL_LOCK_VOLUME = 0x00090018
@@ -104,74 +111,82 @@ FILE_SHARE_READ = 0x00000001
 FILE_SHARE_WRITE = 0x00000002
 OPEN_EXISTING = 3
 FILE_ATTRIBUTE_NORMAL = 0x80
-FILE_BEGIN = 0
-
-# Function prototypes
-CreateFileW = kernel32.CreateFileW
-CreateFileW.restype = wintypes.HANDLE
-CreateFileW.argtypes = [
-    wintypes.LPCWSTR,  # lpFileName
-    wintypes.DWORD,    # dwDesiredAccess
-    wintypes.DWORD,    # dwShareMode
-    wintypes.LPVOID,   # lpSecurityAttributes
-    wintypes.DWORD,    # dwCreationDisposition
-    wintypes.DWORD,    # dwFlagsAndAttributes
-    wintypes.HANDLE    # hTemplateFile
-]
-
-DeviceIoControl = kernel32.DeviceIoControl
-DeviceIoControl.restype = wintypes.BOOL
-DeviceIoControl.argtypes = [
-    wintypes.HANDLE,   # hDevice
-    wintypes.DWORD,    # dwIoControlCode
-    wintypes.LPVOID,   # lpInBuffer
-    wintypes.DWORD,    # nInBufferSize
-    wintypes.LPVOID,   # lpOutBuffer
-    wintypes.DWORD,    # nOutBufferSize
-    wintypes.LPDWORD,  # lpBytesReturned
-    wintypes.LPVOID    # lpOverlapped
-]
-
-WriteFile = kernel32.WriteFile
-WriteFile.restype = wintypes.BOOL
-WriteFile.argtypes = [
-    wintypes.HANDLE,   # hFile
-    wintypes.LPCVOID,  # lpBuffer
-    wintypes.DWORD,    # nNumberOfBytesToWrite
-    wintypes.LPDWORD,  # lpNumberOfBytesWritten
-    wintypes.LPVOID    # lpOverlapped
-]
-
-ReadFile = kernel32.ReadFile
-ReadFile.restype = wintypes.BOOL
-ReadFile.argtypes = [
-    wintypes.HANDLE,   # hFile
-    wintypes.LPVOID,   # lpBuffer
-    wintypes.DWORD,    # nNumberOfBytesToRead
-    wintypes.LPDWORD,  # lpNumberOfBytesRead
-    wintypes.LPVOID    # lpOverlapped
-]
-
-SetFilePointer = kernel32.SetFilePointer
-SetFilePointer.restype = wintypes.LONG
-SetFilePointer.argtypes = [
-    wintypes.HANDLE,   # hFile
-    wintypes.LONG,     # lDistanceToMove
-    wintypes.PLONG,    # lpDistanceToMoveHigh
-    wintypes.DWORD     # dwMoveMethod
-]
-
-FlushFileBuffers = kernel32.FlushFileBuffers
-FlushFileBuffers.restype = wintypes.BOOL
-FlushFileBuffers.argtypes = [wintypes.HANDLE]
-
-CloseHandle = kernel32.CloseHandle
-CloseHandle.restype = wintypes.BOOL
-CloseHandle.argtypes = [wintypes.HANDLE]
-
-GetLastError = kernel32.GetLastError
-GetLastError.restype = wintypes.DWORD
-GetLastError.argtypes = []
+FILE_FLAG_WRITE_THROUGH = 0x80000000
+FILE_FLAG_NO_BUFFERING = 0x20000000
+IOCTL_DISK_GET_LENGTH_INFO = 0x0007405C
+
+# The bindings only exist on Windows; the constants are harmless elsewhere
+if IS_WINDOWS:
+    kernel32 = ctypes.WinDLL('kernel32.dll')  # Use WinDLL for __stdcall
+
+    # Function prototypes
+    CreateFileW = kernel32.CreateFileW
+    CreateFileW.restype = wintypes.HANDLE
+    CreateFileW.argtypes = [
+        wintypes.LPCWSTR,  # lpFileName
+        wintypes.DWORD,    # dwDesiredAccess
+        wintypes.DWORD,    # dwShareMode
+        wintypes.LPVOID,   # lpSecurityAttributes
+        wintypes.DWORD,    # dwCreationDisposition
+        wintypes.DWORD,    # dwFlagsAndAttributes
+        wintypes.HANDLE    # hTemplateFile
+    ]
+
+    DeviceIoControl = kernel32.DeviceIoControl
+    DeviceIoControl.restype = wintypes.BOOL
+    DeviceIoControl.argtypes = [
+        wintypes.HANDLE,   # hDevice
+        wintypes.DWORD,    # dwIoControlCode
+        wintypes.LPVOID,   # lpInBuffer
+        wintypes.DWORD,    # nInBufferSize
+        wintypes.LPVOID,   # lpOutBuffer
+        wintypes.DWORD,    # nOutBufferSize
+        wintypes.LPDWORD,  # lpBytesReturned
+        wintypes.LPVOID    # lpOverlapped
+    ]
+
+    WriteFile = kernel32.WriteFile
+    WriteFile.restype = wintypes.BOOL
+    WriteFile.argtypes = [
+        wintypes.HANDLE,   # hFile
+        wintypes.LPCVOID,  # lpBuffer
+        wintypes.DWORD,    # nNumberOfBytesToWrite
+        wintypes.LPDWORD,  # lpNumberOfBytesWritten
+        wintypes.LPVOID    # lpOverlapped
+    ]
+
+    ReadFile = kernel32.ReadFile
+    ReadFile.restype = wintypes.BOOL
+    ReadFile.argtypes = [
+        wintypes.HANDLE,   # hFile
+        wintypes.LPVOID,   # lpBuffer
+        wintypes.DWORD,    # nNumberOfBytesToRead
+        wintypes.LPDWORD,  # lpNumberOfBytesRead
+        wintypes.LPVOID    # lpOverlapped
+    ]
+
+    # Carries the offset of a ReadFile/WriteFile, so threads sharing a
+    # handle never depend on its file pointer
+    class OVERLAPPED(ctypes.Structure):
+        _fields_ = [
+            ("Internal", ctypes.c_void_p),
+            ("InternalHigh", ctypes.c_void_p),
+            ("Offset", wintypes.DWORD),
+            ("OffsetHigh", wintypes.DWORD),
+            ("hEvent", wintypes.HANDLE)
+        ]
+
+    FlushFileBuffers = kernel32.FlushFileBuffers
+    FlushFileBuffers.restype = wintypes.BOOL
+    FlushFileBuffers.argtypes = [wintypes.HANDLE]
+
+    CloseHandle = kernel32.CloseHandle
+    CloseHandle.restype = wintypes.BOOL
+    CloseHandle.argtypes = [wintypes.HANDLE]
+
+    GetLastError = kernel32.GetLastError
+    GetLastError.restype = wintypes.DWORD
+    GetLastError.argtypes = []
 
 
 def lock_and_dismount_volume(letter):
@@ -242,105 +257,309 @@ def lock_all_volumes_on_disk(disk_number):
     return handles
 
 # =========================================================
-# Raw Disk Writer (Windows)
+# Write Targets
 # =========================================================
-def burn_image_ctypes(image_path, drive_path, disk_number):
-    try:
-        volume_handles = lock_all_volumes_on_disk(disk_number)
-    except RuntimeError as e:
-        print(e)
-        return False
-
-    # Removed offlining step as it's not supported for removable media like USB drives
-
-    handle = CreateFileW(
-        drive_path,
-        GENERIC_READ | GENERIC_WRITE,
-        FILE_SHARE_READ | FILE_SHARE_WRITE,
-        None,
-        OPEN_EXISTING,
-        FILE_ATTRIBUTE_NORMAL,
-        None
-    )
-
-    if handle == INVALID_HANDLE_VALUE:
-        print(f"Failed to open disk (error {GetLastError()})")
-        return False
-
-    try:
-        total = os.path.getsize(image_path)
-        written_total = 0
-        chunk_size = 1024 * 1024
-
-        with open(image_path, "rb") as img:
-            while True:
-                data = img.read(chunk_size)
-                if not data:
-                    break
-
-                buffer = ctypes.create_string_buffer(data)
-                written = wintypes.DWORD()
-                if not WriteFile(
-                    handle,
-                    buffer,
-                    len(data),
-                    ctypes.byref(written),
-                    None
-                ):
-                    print(f"Write failed (error {GetLastError()})")
-                    return False
-
-                written_total += written.value
-                percent = written_total * 100 / total
-                print(f"\rProgress: {percent:6.2f}%", end="")
-                sys.stdout.flush()
-
-        FlushFileBuffers(handle)
-        print("\nWrite complete.")
-
-        # Verify boot signature
-        SetFilePointer(handle, 0, None, FILE_BEGIN)
-        buf = ctypes.create_string_buffer(512)
-        read = wintypes.DWORD()
-
-        ReadFile(handle, buf, 512, ctypes.byref(read), None)
-
-        if buf.raw[510] == 0x55.to_bytes(1, 'big')[0] and buf.raw[511] == 0xAA.to_bytes(1, 'big')[0]:
-            print("Boot signature verified.")
+BLOCK_SIZE = 4 * 1024 * 1024
+ALIGN = 4096  # O_DIRECT / FILE_FLAG_NO_BUFFERING: buffer, offset and length
+
+
+def aligned_buffer(size):
+    """Anonymous mmaps are page aligned, which unbuffered I/O needs."""
+    return mmap.mmap(-1, size)
+
+
+class PosixTarget:
+    """A block device (USB stick, loop device) or a regular file.
+
+    Opened with O_DIRECT where the file system allows it, so large writes
+    go straight to the device and the readback sees the device, not the
+    page cache. A regular file is truncated and re-created at the image's
+    size, so it is known to be blank.
+    """
+    def __init__(self, path, size):
+        self.path = path
+        self.regular = not os.path.exists(path) or stat.S_ISREG(os.stat(path).st_mode)
+        flags = os.O_RDWR | (os.O_CREAT | os.O_TRUNC if self.regular else 0)
+        self.direct = False
+        self.fd = None
+        if hasattr(os, "O_DIRECT"):
+            try:
+                self.fd = os.open(path, flags | os.O_DIRECT, 0o644)
+                self.direct = True
+            except OSError:
+                pass  # tmpfs and friends refuse O_DIRECT
+        if self.fd is None:
+            self.fd = os.open(path, flags, 0o644)
+        self.buffered_fd = None
+        self.blank = self.regular
+        if self.regular:
+            os.ftruncate(self.fd, size)
+            self.size = size
         else:
-            print("Warning: boot signature mismatch.")
-
-        return True
-
-    finally:
-        CloseHandle(handle)
-        for h in volume_handles:
+            self.size = os.lseek(self.fd, 0, os.SEEK_END)
+
+    def _fd_for(self, length):
+        # Unbuffered I/O must be a multiple of the sector size; an odd tail
+        # goes through a second, buffered descriptor
+        if not self.direct or length % ALIGN == 0:
+            return self.fd
+        if self.buffered_fd is None:
+            self.buffered_fd = os.open(self.path, os.O_RDWR)
+            if hasattr(os, "posix_fadvise"):
+                os.posix_fadvise(self.buffered_fd, 0, 0, os.POSIX_FADV_DONTNEED)
+        return self.buffered_fd
+
+    def write_at(self, offset, buf, length):
+        view = memoryview(buf)[:length]
+        while view:
+            done = os.pwrite(self._fd_for(len(view)), view, offset)
+            view = view[done:]
+            offset += done
+
+    def read_at(self, offset, buf, length):
+        got = os.preadv(self._fd_for(length), [memoryview(buf)[:length]], offset)
+        if got != length:
+            raise OSError(errno.EIO, f"short read at {offset}")
+
+    def flush(self):
+        for fd in (self.fd, self.buffered_fd):
+            if fd is not None:
+                os.fsync(fd)
+        # Make the readback come from the device, not the page cache: all
+        # of it without O_DIRECT, the odd tail (buffered_fd) with it
+        if hasattr(os, "posix_fadvise"):
+            for fd in (self.fd, self.buffered_fd):
+                if fd is not None:
+                    os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+
+    def close(self):
+        for fd in (self.fd, self.buffered_fd):
+            if fd is not None:
+                os.close(fd)
+
+
+class WindowsTarget:
+    """A physical drive, opened unbuffered and write-through, with its
+    volumes locked and dismounted for as long as it is open."""
+    def __init__(self, path, disk_number):
+        self.volume_handles = lock_all_volumes_on_disk(disk_number)
+        self.handle = CreateFileW(
+            path,
+            GENERIC_READ | GENERIC_WRITE,
+            FILE_SHARE_READ | FILE_SHARE_WRITE,
+            None,
+            OPEN_EXISTING,
+            FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH,
+            None
+        )
+        if self.handle == INVALID_HANDLE_VALUE:
+            self.close()
+            raise RuntimeError(f"Failed to open disk (error {GetLastError()})")
+
+        length = ctypes.c_longlong()
+        returned = wintypes.DWORD()
+        DeviceIoControl(self.handle, IOCTL_DISK_GET_LENGTH_INFO, None, 0,
+                        ctypes.byref(length), ctypes.sizeof(length), ctypes.byref(returned), None)
+        self.size = length.value
+        self.direct = True
+        self.blank = False
+
+    @staticmethod
+    def _at(offset):
+        # The handle is not opened for overlapped I/O, so the call still
+        # completes before it returns; only the position comes from here
+        ov = OVERLAPPED()
+        ov.Offset = offset & 0xFFFFFFFF
+        ov.OffsetHigh = offset >> 32
+        return ov
+
+    def write_at(self, offset, buf, length):
+        # Drives take whole sectors only: an odd tail is padded with zeros
+        padded = (length + 511) // 512 * 512
+        buf[length:padded] = bytes(padded - length)
+        length = padded
+        written = wintypes.DWORD()
+        ov = self._at(offset)
+        address = ctypes.addressof(ctypes.c_char.from_buffer(buf))
+        if (not WriteFile(self.handle, address, length, ctypes.byref(written), ctypes.byref(ov))
+                or written.value != length):
+            raise OSError(f"Write failed at {offset} (error {GetLastError()})")
+
+    def read_at(self, offset, buf, length):
+        length = (length + 511) // 512 * 512
+        read = wintypes.DWORD()
+        ov = self._at(offset)
+        address = ctypes.addressof(ctypes.c_char.from_buffer(buf))
+        if (not ReadFile(self.handle, address, length, ctypes.byref(read), ctypes.byref(ov))
+                or read.value != length):
+            raise OSError(f"Read failed at {offset} (error {GetLastError()})")
+
+    def flush(self):
+        FlushFileBuffers(self.handle)
+
+    def close(self):
+        if getattr(self, "handle", INVALID_HANDLE_VALUE) != INVALID_HANDLE_VALUE:
+            CloseHandle(self.handle)
+        for h in self.volume_handles:
             CloseHandle(h)
 
-        # Removed onlining step as offlining was skipped
-
 # =========================================================
-# Platform Dispatcher
+# Streaming Writer
 # =========================================================
-def burn_image(image_path, drive_path, disk_number):
-    confirm = input(
-        f"\nTYPE YES to overwrite {drive_path} with {image_path}: "
-    )
-    if confirm != "YES":
-        print("Aborted.")
-        return
+def image_data_ranges(path, size):
+    """(start, end) of the parts of the image that may hold data.
+
+    create_disk.py writes sparse images; SEEK_DATA/SEEK_HOLE find the holes
+    without reading them. Where the OS cannot tell, the whole image is data.
+    """
+    if not hasattr(os, "SEEK_DATA"):
+        return [(0, size)]
+    ranges = []
+    fd = os.open(path, os.O_RDONLY)
+    try:
+        pos = 0
+        while pos < size:
+            try:
+                start = os.lseek(fd, pos, os.SEEK_DATA)
+            except OSError as e:
+                if e.errno == errno.ENXIO:
+                    break  # Only a hole is left
+                return [(0, size)]
+            pos = min(os.lseek(fd, start, os.SEEK_HOLE), size)
+            ranges.append((start, pos))
+    finally:
+        os.close(fd)
+    return ranges
+
+
+def blocks(size, block_size):
+    offset = 0
+    while offset < size:
+        yield offset, min(block_size, size - offset)
+        offset += block_size
+
+
+class Progress:
+    def __init__(self, label, total):
+        self.label = label
+        self.total = total
+        self.start = time.monotonic()
+        self.last = 0
+
+    def update(self, done, skipped=0, final=False):
+        now = time.monotonic()
+        if not final and now - self.last < 0.2:
+            return
+        self.last = now
+        elapsed = max(now - self.start, 1e-6)
+        line = (f"\r{self.label}: {done * 100 / max(self.total, 1):6.2f}%  "
+                f"{done / 2**20:8.0f} / {self.total / 2**20:.0f} MB  "
+                f"{(done - skipped) / 2**20 / elapsed:7.1f} MB/s")
+        if skipped:
+            line += f"  ({skipped / 2**20:.0f} MB of zeros skipped)"
+        print(line, end="\n" if final else "")
+        sys.stdout.flush()
+
+
+def write_image(image_path, target, block_size=BLOCK_SIZE):
+    """Stream the image onto the target in large aligned blocks.
+
+    Blocks of zeros (holes in the image, or data that happens to be zero)
+    are skipped when the target is known to be blank: a fresh regular file,
+    or a device the caller vouches for with --blank.
+    """
+    size = os.path.getsize(image_path)
+    ranges = image_data_ranges(image_path, size)
+    buf = aligned_buffer(block_size)
+    zeros = bytes(block_size)
+    progress = Progress("Writing", size)
+    skipped = 0
+
+    with open(image_path, "rb", buffering=0) as img:
+        r = 0
+        for offset, length in blocks(size, block_size):
+            while r < len(ranges) and ranges[r][1] <= offset:
+                r += 1
+            hole = r == len(ranges) or ranges[r][0] >= offset + length
+            if hole:
+                buf[:length] = zeros[:length]
+            else:
+                img.seek(offset)
+                if img.readinto(memoryview(buf)[:length]) != length:
+                    raise OSError(errno.EIO, f"short read from {image_path} at {offset}")
+
+            if target.blank and (hole or buf[:length] == zeros[:length]):
+                skipped += length
+            else:
+                target.write_at(offset, buf, length)
+            progress.update(offset + length, skipped)
+
+    target.flush()
+    progress.update(size, skipped, final=True)
+    buf.close()
+
+
+def verify_image(image_path, target, block_size=BLOCK_SIZE, workers=4):
+    """Read the target back and compare block hashes with the image's.
+
+    Reading and hashing runs on several threads for the image and the
+    target at once (file reads and hashlib release the GIL), so the check
+    is bound by the target's read speed.
+    """
+    size = os.path.getsize(image_path)
+    offsets = [offset for offset, _ in blocks(size, block_size)]
+    progress = Progress("Verifying", size)
+    done = [0]
+    done_lock = threading.Lock()
+
+    def hash_image(part):
+        digests = {}
+        with open(image_path, "rb") as img:
+            for offset in part:
+                img.seek(offset)
+                digests[offset] = hashlib.blake2b(img.read(block_size)).digest()
+        return digests
+
+    def hash_target(part):
+        digests = {}
+        buf = aligned_buffer(block_size)
+        for offset in part:
+            length = min(block_size, size - offset)
+            target.read_at(offset, buf, length)
+            digests[offset] = hashlib.blake2b(memoryview(buf)[:length]).digest()
+            with done_lock:
+                done[0] += length
+                progress.update(done[0])
+        buf.close()
+        return digests
+
+    # Interleaved parts keep every worker near the same region of the disk
+    parts = [offsets[i::workers] for i in range(workers)]
+    expected, actual = {}, {}
+    with ThreadPoolExecutor(max_workers=2 * workers) as pool:
+        jobs = [(pool.submit(hash_image, part), pool.submit(hash_target, part)) for part in parts]
+        for image_job, target_job in jobs:
+            expected.update(image_job.result())
+            actual.update(target_job.result())
+    progress.update(size, final=True)
+
+    for offset in offsets:
+        if expected[offset] != actual[offset]:
+            print(f"Verify failed: the block at {offset:#x} differs from the image.")
+            return False
+    print("Verified: the target matches the image.")
+    return True
 
-    if platform.system() == "Windows":
-        if burn_image_ctypes(image_path, drive_path, disk_number):
-            print("Success.")
-        else:
-            print("Failed.")
-    else:
-        subprocess.run(
-            f'dd if="{image_path}" of="{drive_path}" bs=4M conv=fsync status=progress',
-            shell=True,
-            check=True
-        )
+
+def burn_image(image_path, target, block_size=BLOCK_SIZE, verify=True):
+    size = os.path.getsize(image_path)
+    if target.size < size:
+        print(f"Target is {target.size} bytes, the image needs {size}.")
+        return False
+    print(f"Writing {image_path} ({size / 2**20:.0f} MB) in {block_size // 2**20} MB blocks"
+          f"{', unbuffered' if target.direct else ''}{', skipping zeros' if target.blank else ''}.")
+    write_image(image_path, target, block_size)
+    return verify_image(image_path, target, block_size) if verify else True
 
 # =========================================================
 # Main
@@ -357,29 +576,68 @@ def find_disk_image():
     return None
 
 
-def main():
+def select_drive():
     run_as_admin()
-
-    image = find_disk_image()
-    if not image:
-        print("disk.img not found.")
-        return
-
-    if platform.system() == "Windows":
-        drives = get_drives_windows()
-    else:
-        drives = get_drives_linux()
-
+    drives = get_drives_windows() if IS_WINDOWS else get_drives_linux()
     if not drives:
         print("No removable drives found.")
-        return
+        return None
 
     for i, d in enumerate(drives):
         print(f"[{i}] {d['name']} ({d['size']/1024**3:.2f} GB) {d['path']}")
 
     idx = int(input("Select drive index: "))
-    burn_image(image, drives[idx]["path"], drives[idx]["id"])
+    return drives[idx]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Write an Atlas disk image to a USB drive")
+    parser.add_argument("image", nargs="?", help="image to write (default: build/disk.img)")
+    parser.add_argument("--target", help="device or file to write instead of choosing a USB drive "
+                        "(a loop device or a regular file works for testing)")
+    parser.add_argument("--block-size", type=int, default=BLOCK_SIZE // 2**20, metavar="MB",
+                        help="write and verify block size (default %(default)s)")
+    parser.add_argument("--blank", action="store_true",
+                        help="the target is known to be all zeros: skip writing zero blocks")
+    parser.add_argument("--no-verify", action="store_true", help="skip the readback check")
+    parser.add_argument("--yes", action="store_true", help="do not ask before overwriting")
+    args = parser.parse_args()
+
+    image = os.path.abspath(args.image) if args.image else find_disk_image()
+    if not image or not os.path.exists(image):
+        print("disk.img not found.")
+        return 1
+
+    if args.target:
+        path, disk_number = args.target, None
+        if IS_WINDOWS:
+            print("--target is not supported on Windows; pick the drive from the list.")
+            return 1
+    else:
+        drive = select_drive()
+        if not drive:
+            return 1
+        path, disk_number = drive["path"], drive["id"]
+
+    if not args.yes:
+        confirm = input(f"\nTYPE YES to overwrite {path} with {image}: ")
+        if confirm != "YES":
+            print("Aborted.")
+            return 1
+
+    try:
+        target = WindowsTarget(path, disk_number) if IS_WINDOWS else PosixTarget(path, os.path.getsize(image))
+    except (OSError, RuntimeError) as e:
+        print(e)
+        return 1
+    try:
+        target.blank = target.blank or args.blank
+        ok = burn_image(image, target, args.block_size * 2**20, not args.no_verify)
+    finally:
+        target.close()
+    print("Success." if ok else "Failed.")
+    return 0 if ok else 1
 
 
 if __name__ == "__main__":
-    main()
\ No newline at end of file
+    sys.exit(main())
@@ -1,221 +1,637 @@
+import argparse
 import struct
 import os
 import sys
 
-def create_fat32_image(image_path, boot1_path, boot2_path, config_path, additional_files=None):
-    if additional_files is None:
-        additional_files = []
-
-    # Parameters matches boot1.asm BPB
-    bytes_per_sector = 512
-    reserved_sectors = 32
-    fat_count = 2
-    sectors_per_fat = 0x400
-    total_sectors = 0x20000 # 64MB
-    
-    # Read core files
+# Compiled config (ATLAS.BIN), see include/config.h
+CONFIG_BLOB_MAGIC = 0x424C5441 # "ATLB"
+CONFIG_BLOB_VERSION = 4
+CONFIG_HEADER = struct.Struct('<LHHLLHHLLLLHhHHLL')
+CONFIG_CHECKSUM = struct.Struct('<LL')
+CONFIG_NO_DEFAULT = 0xFFFF
+CONFIG_MAX_MODULES = 8
+CONFIG_ENTRY = struct.Struct('<LLLLLHH%dL' % CONFIG_MAX_MODULES)
+CONFIG_MAX_SIZE = 127 * 512 # What Stage 2 loads
+CONSOLE_FLAGS = {"vga": 1, "serial": 2} # include/serial.h
+
+def _crc32c_table():
+    table = []
+    for i in range(256):
+        c = i
+        for _ in range(8):
+            c = (c >> 1) ^ 0x82F63B78 if c & 1 else c >> 1
+        table.append(c)
+    return table
+
+CRC32C_TABLE = _crc32c_table()
+
+def crc32c(data, crc=0):
+    crc ^= 0xFFFFFFFF
+    table = CRC32C_TABLE
+    for b in data:
+        crc = table[(crc ^ b) & 0xFF] ^ (crc >> 8)
+    return crc ^ 0xFFFFFFFF
+
+_CRC_CACHE = {}
+
+def file_crc32c(content):
+    """crc32c() of a whole file, computed once per build (the config
+    manifest and the boot map both want it)."""
+    if content not in _CRC_CACHE:
+        _CRC_CACHE[content] = crc32c(content)
+    return _CRC_CACHE[content]
+
+def manifest_key(path):
+    """Paths in the manifest match the loader's comparison: no leading '/', any case."""
+    return path.replace('\\', '/').lstrip('/').upper()
+
+def compile_config(text, files=None):
+    """Turn atlas.cfg into the binary blob the loader uses in place.
+
+    files maps image paths to their contents; every kernel and module the
+    entries name that is among them gets a CRC-32C in the manifest.
+    """
+    title = None
+    default = None
+    fallback = None
+    checksums = {}
+    timeout = -1
+    console = 0
+    entries = []
+    for raw in text.splitlines():
+        line = raw.strip()
+        if not line or line == "[menu]":
+            continue
+        if line.startswith("[entry]"):
+            entries.append({"name": None, "kernel_x86": "", "kernel_x64": "", "kernel": "",
+                            "cmdline": "", "modules": []})
+            continue
+        key, sep, value = line.partition('=')
+        if not sep:
+            continue
+        if key == "title":
+            title = value
+        elif key == "default":
+            default = value
+        elif key == "fallback":
+            fallback = value
+        elif key == "checksum":
+            path, _, crc = value.rpartition(' ')
+            try:
+                checksums[manifest_key(path.strip())] = (path.strip(), int(crc, 16))
+            except ValueError:
+                print(f"Warning: checksum={value}: expected '<path> <crc32c in hex>'")
+        elif key == "timeout":
+            timeout = int(value) if value.isdigit() else -1
+        elif key == "console":
+            console = 0
+            for name in value.split(','):
+                if name.strip() in CONSOLE_FLAGS:
+                    console |= CONSOLE_FLAGS[name.strip()]
+                else:
+                    print(f"Warning: console={value}: unknown console '{name}'")
+        elif not entries:
+            continue
+        elif key in ("name", "kernel_x86", "kernel_x64", "kernel", "cmdline"):
+            entries[-1][key] = value
+        elif key in ("initrd", "module"):
+            if len(entries[-1]["modules"]) < CONFIG_MAX_MODULES:
+                entries[-1]["modules"].append(value)
+
+    strings = bytearray(b"\0")
+    offsets = {"": 0}
+    def intern(value):
+        if value is None:
+            return 0
+        if value not in offsets:
+            offsets[value] = len(strings)
+            strings.extend(value.encode('ascii') + b"\0")
+        return offsets[value]
+
+    records = bytearray()
+    for e in entries:
+        mods = [intern(m) for m in e["modules"]]
+        mods += [0] * (CONFIG_MAX_MODULES - len(mods))
+        records += CONFIG_ENTRY.pack(intern(e["name"]), intern(e["kernel_x86"]), intern(e["kernel_x64"]),
+                                     intern(e["kernel"]), intern(e["cmdline"]), len(e["modules"]), 0, *mods)
+    title_off = intern(title)
+
+    # default= and fallback= are an entry position (from 0) or an entry name
+    names = [e["name"] for e in entries]
+    def find_entry(key, value):
+        if value is None:
+            return CONFIG_NO_DEFAULT
+        if value.isdigit() and int(value) < len(entries):
+            return int(value)
+        if value in names:
+            return names.index(value)
+        print(f"Warning: {key}={value} matches no entry")
+        return CONFIG_NO_DEFAULT
+    default_index = find_entry("default", default)
+    fallback_index = find_entry("fallback", fallback)
+
+    # Manifest: CRC-32C of every referenced file going into the image
+    for path, content in (files or {}).items():
+        key = manifest_key(path)
+        if key in checksums:
+            continue
+        for e in entries:
+            if key in [manifest_key(p) for p in [e["kernel_x86"], e["kernel_x64"], e["kernel"]] + e["modules"] if p]:
+                checksums[key] = (path, file_crc32c(content))
+                break
+    manifest = bytearray()
+    for path, crc in checksums.values():
+        manifest += CONFIG_CHECKSUM.pack(intern(path), crc)
+
+    entries_off = CONFIG_HEADER.size
+    checksums_off = entries_off + len(records)
+    strings_off = checksums_off + len(manifest)
+    total = strings_off + len(strings)
+    body = CONFIG_HEADER.pack(CONFIG_BLOB_MAGIC, CONFIG_BLOB_VERSION, CONFIG_HEADER.size, total, 0,
+                              len(entries), CONFIG_ENTRY.size, entries_off, strings_off, len(strings),
+                              title_off, default_index, min(timeout, 0x7FFF), console, fallback_index,
+                              checksums_off, len(checksums)) + records + manifest + strings
+    blob = bytearray(body)
+    struct.pack_into('<L', blob, 12, crc32c(blob[16:]))
+    if total > CONFIG_MAX_SIZE:
+        print(f"Warning: Compiled config is {total} bytes, Stage 2 loads at most {CONFIG_MAX_SIZE}")
+    return bytes(blob)
+
+# Layout shared with boot1.asm (BPB) and boot2.asm
+SECTOR_SIZE = 512
+RESERVED_SECTORS = 136 # Stage 2 (sectors 8-134) lives here
+STAGE2_SECTOR = 8
+STAGE2_MAX_SECTORS = 127 # Stage 1 loads 127 sectors
+FSINFO_SECTORS = (1, 7)
+BACKUP_BOOT_SECTOR = 6
+FAT_COUNT = 2
+ROOT_CLUSTER = 2
+FAT_EOC = 0x0FFFFFFF
+FAT32_MIN_CLUSTERS = 65525 # Fewer, and other systems take the volume for FAT16
+
+# Boot map in the reserved sectors after FSInfo, see include/fat32.h
+BOOTMAP_LBA = 2
+BOOTMAP_SECTORS = 4
+BOOTMAP_MAGIC = 0x50414D42 # "BMAP"
+BOOTMAP_VERSION = 1
+BOOTMAP_HEADER = struct.Struct('<LHHLLLLHHL')
+BOOTMAP_FILE = struct.Struct('<11sBLLL')
+BOOTMAP_EXTENT = struct.Struct('<LL')
+
+DIR_ENTRY = struct.Struct('<11sBBBHHHHHHHL')
+ATTR_LABEL = 0x08
+ATTR_DIR = 0x10
+ATTR_ARCHIVE = 0x20
+
+def default_cluster_sectors(size_mb):
+    """Cluster size Microsoft's format table picks for a FAT32 volume of size_mb."""
+    for limit, sectors in ((260, 1), (8192, 8), (16384, 16), (32768, 32)):
+        if size_mb <= limit:
+            return sectors
+    return 64
+
+def fat_sectors(total_sectors, cluster_sectors):
+    """Sectors per FAT copy, with the FAT specification's formula."""
+    per_sector = (256 * cluster_sectors + FAT_COUNT) // 2
+    return -(-(total_sectors - RESERVED_SECTORS) // per_sector)
+
+def format_name(name, is_dir=False):
+    if is_dir:
+        return name.upper()[:11].ljust(11).encode('ascii')
+    parts = name.split('.')
+    base = parts[0].upper()[:8].ljust(8)
+    ext = parts[1].upper()[:3].ljust(3) if len(parts) > 1 else "   "
+    return (base + ext).encode('ascii')
+
+def dir_entry(name, attr, cluster, size=0):
+    return DIR_ENTRY.pack(name, attr, 0, 0, 0, 0, 0, (cluster >> 16) & 0xFFFF, 0, 0, cluster & 0xFFFF, size)
+
+def build_bootmap(files, volume_id, free_clusters, next_free):
+    """The blocklist Stage 2 reads instead of walking the directory and the
+    FAT: (8.3 name, content, [(lba, sectors)]) per root directory file, in
+    order, as many as fit."""
+    size = BOOTMAP_SECTORS * SECTOR_SIZE
+    records = bytearray()
+    extents = bytearray()
+    listed = 0
+    for name, content, runs in files:
+        need = BOOTMAP_HEADER.size + len(records) + len(extents) + BOOTMAP_FILE.size + BOOTMAP_EXTENT.size * len(runs)
+        if need > size or len(runs) > 255:
+            break
+        records += BOOTMAP_FILE.pack(name, len(runs), len(content), file_crc32c(content),
+                                     len(extents) // BOOTMAP_EXTENT.size)
+        for lba, sectors in runs:
+            extents += BOOTMAP_EXTENT.pack(lba, sectors)
+        listed += 1
+    if listed < len(files):
+        print(f"Note: the boot map lists {listed} of {len(files)} files, the loader finds the rest through the FAT")
+
+    body = BOOTMAP_HEADER.pack(BOOTMAP_MAGIC, BOOTMAP_VERSION, listed, 0, volume_id, free_clusters, next_free,
+                               len(extents) // BOOTMAP_EXTENT.size, 0, 0) + records + extents
+    bootmap = bytearray(body.ljust(size, b'\0'))
+    struct.pack_into('<L', bootmap, 8, crc32c(bootmap[12:]))
+    return bootmap
+
+def geometry(size_mb, cluster_sectors=None):
+    """(total sectors, sectors per FAT, first data LBA, cluster count,
+    sectors per cluster) of a size_mb MB volume."""
+    if cluster_sectors is None:
+        cluster_sectors = default_cluster_sectors(size_mb)
+    total_sectors = size_mb * (1 << 20) // SECTOR_SIZE
+    if total_sectors >= 1 << 32:
+        print(f"Error: {size_mb} MB does not fit the BPB's 32-bit sector count")
+        sys.exit(1)
+    sectors_per_fat = fat_sectors(total_sectors, cluster_sectors)
+    data_lba = RESERVED_SECTORS + FAT_COUNT * sectors_per_fat
+    cluster_count = (total_sectors - data_lba) // cluster_sectors if total_sectors > data_lba else 0
+    return total_sectors, sectors_per_fat, data_lba, cluster_count, cluster_sectors
+
+def read_sources(boot1_path, boot2_path, config_path, additional_files):
+    """Stage 1's sector, Stage 2, and the files of the image in order:
+    ATLAS.CFG, its compiled form ATLAS.BIN, then additional_files. The
+    config files come first so that they sit in the root directory's first
+    sector, the only one Stage 2 searches."""
     with open(boot1_path, 'rb') as f:
-        boot1 = f.read()
+        boot1 = bytearray(f.read().ljust(SECTOR_SIZE, b'\0')[:SECTOR_SIZE])
     with open(boot2_path, 'rb') as f:
         boot2 = f.read()
-    
-    # Prepare image
-    image = bytearray(total_sectors * bytes_per_sector)
-    
-    # 1. Write Boot Sector (VBR)
-    image[0:len(boot1)] = boot1
-
-    def write_fsinfo(sector_idx):
-        offset = sector_idx * 512
-        struct.pack_into('<L', image, offset + 0, 0x41615252)
-        struct.pack_into('<L', image, offset + 484, 0x61417272)
-        struct.pack_into('<L', image, offset + 488, 0xFFFFFFFF) # Free cluster count
-        struct.pack_into('<L', image, offset + 492, 0xFFFFFFFF) # Next free cluster
-        struct.pack_into('<L', image, offset + 508, 0xAA550000)
-
-    # 1.1 FSINFO (Sector 1) and Backup FSINFO (Sector 7)
-    write_fsinfo(1)
-    write_fsinfo(7)
-
-    # 1.2 Backup Boot Sector (Sector 6)
-    image[6*512 : 6*512 + 512] = image[0:512]
-    
-    # 2. Write Stage 2 (Reserved Sectors, starting at Sector 8)
-    # This avoids overlap with sectors 1, 6, 7
-    image[8*512 : 8*512 + len(boot2)] = boot2
-    
-    # 3. Initialize FATs
-    fat_start = reserved_sectors * bytes_per_sector
-    fat_size_bytes = sectors_per_fat * bytes_per_sector
-    
-    def set_fat_entry(cluster, value):
-        offset = fat_start + (cluster * 4)
-        struct.pack_into('<L', image, offset, value & 0x0FFFFFFF)
-        # Mirror to second FAT
-        struct.pack_into('<L', image, offset + fat_size_bytes, value & 0x0FFFFFFF)
-
-    # Reserved entries 0 and 1
-    # 0x0FFFFFF8 and 0x0FFFFFFF
-    set_fat_entry(0, 0x0FFFFFF8)
-    set_fat_entry(1, 0x0FFFFFFF)
-    
-    # Cluster 2 = Root Dir
-    set_fat_entry(2, 0x0FFFFFFF)
-    
-    root_lba = reserved_sectors + (fat_count * sectors_per_fat)
-    root_offset = root_lba * bytes_per_sector
-    
-    # 4. Create Volume Label Entry in Root Dir
-    # ATLAS BOOT (11 chars) + attr (0x08)
-    label_entry = struct.pack('<11sBBBHHHHHHHL',
-        b"ATLAS BOOT ", 0x08, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
-    )
-    image[root_offset : root_offset + 32] = label_entry
-    dir_entry_offset = root_offset + 32
-
-    # Files to add: ATLAS.CFG + additional_files
-    files_to_process = [("ATLAS.CFG", config_path)] + additional_files
-    
-    next_cluster = 3
-    
-    # Simple directory tracking: {path: cluster}
-    dirs = {"": 2} # Root is cluster 2
-
-    def format_name(name, is_dir=False):
-        if is_dir:
-            return name.upper()[:11].ljust(11).encode('ascii')
-        parts = name.split('.')
-        base = parts[0].upper()[:8].ljust(8)
-        ext = parts[1].upper()[:3].ljust(3) if len(parts) > 1 else "   "
-        return (base + ext).encode('ascii')
-
-    def get_or_create_dir(path):
-        if path in dirs:
-            return dirs[path]
-        
-        # Split into parent and current
-        parts = path.rsplit('/', 1)
-        parent_path = parts[0] if len(parts) > 1 else ""
-        current_name = parts[-1]
-        
-        parent_cluster = get_or_create_dir(parent_path)
-        
-        # Allocate cluster for this directory
-        nonlocal next_cluster
-        curr_cluster = next_cluster
-        next_cluster += 1
-        
-        # Mark in FAT
-        set_fat_entry(curr_cluster, 0x0FFFFFFF)
-        
-        # Initialize the new directory with . and .. entries
-        curr_lba = root_lba + (curr_cluster - 2)
-        curr_offset = curr_lba * bytes_per_sector
-        
-        # Entry: .
-        dot_entry = struct.pack('<11sBBBHHHHHHHL',
-            b".          ", 0x10, 0, 0, 0, 0, 0,
-            (curr_cluster >> 16) & 0xFFFF, 0, 0, curr_cluster & 0xFFFF, 0
-        )
-        image[curr_offset : curr_offset + 32] = dot_entry
-        
-        # Entry: ..
-        # If parent is root (2), dotdot should point to 0 according to FAT spec
-        dotdot_cluster = 0 if parent_cluster == 2 else parent_cluster
-        dotdot_entry = struct.pack('<11sBBBHHHHHHHL',
-            b"..         ", 0x10, 0, 0, 0, 0, 0,
-            (dotdot_cluster >> 16) & 0xFFFF, 0, 0, dotdot_cluster & 0xFFFF, 0
-        )
-        image[curr_offset + 32 : curr_offset + 64] = dotdot_entry
-        
-        # Add entry to parent directory
-        parent_lba = root_lba + (parent_cluster - 2)
-        parent_offset = parent_lba * bytes_per_sector
-        
-        # Find empty slot in parent (simple search)
-        found = False
-        for i in range(0, bytes_per_sector, 32):
-            if image[parent_offset + i] == 0 or image[parent_offset + i] == 0xE5:
-                entry = struct.pack('<11sBBBHHHHHHHL',
-                    format_name(current_name, True), 0x10, 0, 0, 0, 0, 0,
-                    (curr_cluster >> 16) & 0xFFFF, 0, 0, curr_cluster & 0xFFFF, 0
-                )
-                image[parent_offset + i : parent_offset + i + 32] = entry
-                found = True
-                break
-        
-        if not found:
-            print(f"Warning: No space in parent directory {parent_path} for {current_name}")
-            
-        dirs[path] = curr_cluster
-        return curr_cluster
-
-    for filename, source_path in files_to_process:
-        with open(source_path, 'rb') as f:
-            content = f.read()
-        
-        file_size = len(content)
-        num_clusters = (file_size + bytes_per_sector - 1) // bytes_per_sector
-        if num_clusters == 0: num_clusters = 1
-        
-        # Handle path
-        parts = filename.replace('\\', '/').rsplit('/', 1)
-        dir_path = parts[0] if len(parts) > 1 else ""
-        base_name = parts[-1]
-        
-        target_dir_cluster = get_or_create_dir(dir_path)
-        start_cluster = next_cluster
-        
-        # Write content 
-        for i in range(num_clusters):
-            cluster_lba = root_lba + (next_cluster - 2)
-            cluster_offset = cluster_lba * bytes_per_sector
-            chunk = content[i*bytes_per_sector : (i+1)*bytes_per_sector]
-            image[cluster_offset : cluster_offset + len(chunk)] = chunk
-            
-            if i == num_clusters - 1:
-                set_fat_entry(next_cluster, 0x0FFFFFFF)
-            else:
-                set_fat_entry(next_cluster, next_cluster + 1)
-            next_cluster += 1
-            
-        # Create Directory Entry in target_dir
-        dir_lba = root_lba + (target_dir_cluster - 2)
-        dir_offset = dir_lba * bytes_per_sector
-        
-        found = False
-        # Skip volume label if root
-        start_search = 32 if target_dir_cluster == 2 else 0
-        for i in range(start_search, bytes_per_sector, 32):
-            if image[dir_offset + i] == 0 or image[dir_offset + i] == 0xE5:
-                entry = struct.pack('<11sBBBHHHHHHHL', 
-                    format_name(base_name), 0x20, 0, 0, 0, 0, 0,
-                    (start_cluster >> 16) & 0xFFFF, 0, 0, start_cluster & 0xFFFF, file_size
-                )
-                image[dir_offset + i : dir_offset + 32 + i] = entry
-                found = True
-                break
-        if not found:
-            print(f"Warning: No space in directory {dir_path} for {base_name}")
+    if len(boot2) > STAGE2_MAX_SECTORS * SECTOR_SIZE:
+        print(f"Error: Stage 2 is {len(boot2)} bytes, Stage 1 loads at most {STAGE2_MAX_SECTORS * SECTOR_SIZE}")
+        sys.exit(1)
+
+    contents = {}
+    for name, source in additional_files or []:
+        if isinstance(source, bytes):
+            contents[name] = source
+        else:
+            with open(source, 'rb') as f:
+                contents[name] = f.read()
+    with open(config_path, 'rb') as f:
+        config_text = f.read()
+    config_blob = compile_config(config_text.decode('ascii', 'replace'), contents)
+    files = [("ATLAS.CFG", config_text), ("ATLAS.BIN", config_blob)]
+    files += [(name, contents[name]) for name, _ in additional_files or []]
+    return boot1, boot2, files
+
+def patch_boot1(boot1, cluster_sectors, total_sectors, sectors_per_fat, volume_id):
+    """Fill in the geometry boot1.asm only holds placeholders for."""
+    struct.pack_into('<B', boot1, 13, cluster_sectors)
+    struct.pack_into('<L', boot1, 32, total_sectors)
+    struct.pack_into('<L', boot1, 36, sectors_per_fat)
+    struct.pack_into('<L', boot1, 67, volume_id)
+
+def fsinfo_sector(free_clusters, next_free):
+    sector = bytearray(SECTOR_SIZE)
+    struct.pack_into('<L', sector, 0, 0x41615252)
+    struct.pack_into('<L', sector, 484, 0x61417272)
+    struct.pack_into('<L', sector, 488, free_clusters)
+    struct.pack_into('<L', sector, 492, next_free)
+    struct.pack_into('<L', sector, 508, 0xAA550000)
+    return sector
 
-    # Write to file
+class Node:
+    """A file or directory in the image: one contiguous run of clusters."""
+    def __init__(self, content=None):
+        self.content = content # None for directories
+        self.entries = [] # Directories: (8.3 name, attr, Node or None)
+        self.children = {}
+        self.parent = None
+        self.cluster = 0
+
+def create_fat32_image(image_path, boot1_path, boot2_path, config_path, additional_files=None,
+                       size_mb=64, cluster_sectors=None):
+    """Write a FAT32 image of size_mb MB, touching only the regions that hold data.
+
+    The volume is laid out in one pass before anything is written: every
+    directory and every file gets one contiguous cluster run (Stage 2 reads
+    the config that way, and the loader reads each file as a single extent),
+    directories take as many clusters as their entries need, and the rest
+    of the image is a hole in the output file.
+    """
+    total_sectors, sectors_per_fat, data_lba, cluster_count, cluster_sectors = geometry(size_mb, cluster_sectors)
+    cluster_bytes = cluster_sectors * SECTOR_SIZE
+    if cluster_count < FAT32_MIN_CLUSTERS:
+        print(f"Warning: {cluster_count} clusters is below the FAT32 minimum of {FAT32_MIN_CLUSTERS}; "
+              "use a larger image or smaller clusters for other systems to mount it")
+
+    # A fresh volume ID: the boot map is tied to it
+    volume_id = int.from_bytes(os.urandom(4), 'little')
+    boot1, boot2, files = read_sources(boot1_path, boot2_path, config_path, additional_files)
+    patch_boot1(boot1, cluster_sectors, total_sectors, sectors_per_fat, volume_id)
+
+    # 1. Directory tree
+    root = Node()
+    root.entries.append((b"ATLAS BOOT ", ATTR_LABEL, None))
+    directories = [root]
+
+    def get_dir(path):
+        node = root
+        for part in [p for p in path.split('/') if p]:
+            if part.upper() not in node.children:
+                child = Node()
+                child.parent = node
+                node.children[part.upper()] = child
+                node.entries.append((format_name(part, True), ATTR_DIR, child))
+                directories.append(child)
+            node = node.children[part.upper()]
+        return node
+
+    for filename, content in files:
+        dir_path, _, base_name = filename.replace('\\', '/').rpartition('/')
+        parent = get_dir(dir_path)
+        name = format_name(base_name)
+        if any(entry[0] == name for entry in parent.entries):
+            print(f"Error: {filename} is in the image twice (as {name.decode()})")
+            sys.exit(1)
+        parent.entries.append((name, ATTR_ARCHIVE, Node(content)))
+
+    # 2. Cluster runs: directories first (root at cluster 2), then the files
+    #    in the order given. Empty files get no cluster, as in the FAT spec.
+    next_cluster = ROOT_CLUSTER
+    fat = bytearray()
+    def allocate(node, size):
+        nonlocal next_cluster, fat
+        count = -(-size // cluster_bytes)
+        if count == 0:
+            return
+        node.cluster = next_cluster
+        next_cluster += count
+        if next_cluster - ROOT_CLUSTER > cluster_count:
+            print(f"Error: the files need more than the {cluster_count} clusters of a {size_mb} MB image")
+            sys.exit(1)
+        chain = list(range(node.cluster + 1, next_cluster)) + [FAT_EOC]
+        fat += struct.pack('<%dL' % count, *chain)
+
+    fat += struct.pack('<LL', 0x0FFFFFF8, FAT_EOC) # Reserved entries 0 and 1
+    for d in directories:
+        allocate(d, DIR_ENTRY.size * (len(d.entries) + (2 if d is not root else 0)))
+    for d in directories:
+        for _, attr, node in d.entries:
+            if attr == ATTR_ARCHIVE:
+                allocate(node, len(node.content))
+
+    def cluster_offset(cluster):
+        return (data_lba + (cluster - 2) * cluster_sectors) * SECTOR_SIZE
+
+    free_clusters = cluster_count - (next_cluster - ROOT_CLUSTER)
+
+    # Root directory files, each one extent (the loader only opens those)
+    mapped = []
+    for name, attr, node in root.entries:
+        if attr == ATTR_ARCHIVE:
+            sectors = -(-len(node.content) // SECTOR_SIZE)
+            runs = [(cluster_offset(node.cluster) // SECTOR_SIZE, sectors)] if sectors else []
+            mapped.append((name, node.content, runs))
+    bootmap = build_bootmap(mapped, volume_id, free_clusters, next_cluster)
+
+    # 3. Write: the output is created at full size and only the regions
+    #    with data are written, so the zeros in between cost nothing
     with open(image_path, 'wb') as f:
-        f.write(image)
-    print(f"Created {image_path} with {len(files_to_process)} files.")
+        f.truncate(total_sectors * SECTOR_SIZE)
+        def write_at(offset, data):
+            f.seek(offset)
+            f.write(data)
+
+        write_at(0, boot1)
+        write_at(BACKUP_BOOT_SECTOR * SECTOR_SIZE, boot1)
+        for sector in FSINFO_SECTORS:
+            write_at(sector * SECTOR_SIZE, fsinfo_sector(free_clusters, next_cluster))
+        write_at(BOOTMAP_LBA * SECTOR_SIZE, bootmap)
+        write_at(STAGE2_SECTOR * SECTOR_SIZE, boot2)
+        for copy in range(FAT_COUNT):
+            write_at((RESERVED_SECTORS + copy * sectors_per_fat) * SECTOR_SIZE, fat)
+
+        for d in directories:
+            table = bytearray()
+            if d is not root:
+                # '..' of a directory in the root points at cluster 0, as in the FAT spec
+                parent = d.parent.cluster if d.parent is not root else 0
+                table += dir_entry(b".          ", ATTR_DIR, d.cluster)
+                table += dir_entry(b"..         ", ATTR_DIR, parent)
+            for name, attr, node in d.entries:
+                if node is None:
+                    table += dir_entry(name, attr, 0)
+                elif node.content is None:
+                    table += dir_entry(name, attr, node.cluster)
+                else:
+                    table += dir_entry(name, attr, node.cluster, len(node.content))
+            write_at(cluster_offset(d.cluster), table)
+            for _, attr, node in d.entries:
+                if attr == ATTR_ARCHIVE and node.content:
+                    write_at(cluster_offset(node.cluster), node.content)
+
+    used_mb = (next_cluster - ROOT_CLUSTER) * cluster_bytes / (1 << 20)
+    print(f"Created {image_path} with {len(files)} files: {size_mb} MB, {cluster_bytes} byte clusters, "
+          f"{used_mb:.1f} MB used.")
+
+class SectorWriter:
+    """An existing image opened for update: writes skip the sectors that
+    already hold the same bytes, so unchanged data is never rewritten."""
+    def __init__(self, f):
+        self.f = f
+        self.written = 0
+
+    def read(self, lba, count):
+        self.f.seek(lba * SECTOR_SIZE)
+        return self.f.read(count * SECTOR_SIZE)
+
+    def write(self, lba, data):
+        data = bytes(data).ljust(-(-len(data) // SECTOR_SIZE) * SECTOR_SIZE, b'\0')
+        step = 2048 * SECTOR_SIZE
+        for start in range(0, len(data), step):
+            new = data[start:start + step]
+            old = self.read(lba + start // SECTOR_SIZE, len(new) // SECTOR_SIZE)
+            if old == new:
+                continue
+            # Write each run of differing sectors with one call
+            run = None
+            for i in range(0, len(new) + SECTOR_SIZE, SECTOR_SIZE):
+                same = i == len(new) or old[i:i + SECTOR_SIZE] == new[i:i + SECTOR_SIZE]
+                if not same and run is None:
+                    run = i
+                elif same and run is not None:
+                    self.f.seek(lba * SECTOR_SIZE + start + run)
+                    self.f.write(new[run:i])
+                    self.written += (i - run) // SECTOR_SIZE
+                    run = None
+
+def update_fat32_image(image_path, boot1_path, boot2_path, config_path, additional_files=None,
+                       size_mb=64, cluster_sectors=None):
+    """Bring an image written by create_fat32_image() up to date in place.
+
+    A file whose content changed loses its old cluster chain and gets the
+    first free run of clusters it fits in, which is often where it was;
+    its directory entry, both FATs, FSInfo and the boot map follow. Only
+    sectors whose bytes change are written. Returns None when done, or the
+    reason the image has to be rebuilt instead: it is missing, its geometry
+    differs, the list of files changed or a file finds no free run.
+    """
+    total_sectors, sectors_per_fat, data_lba, cluster_count, cluster_sectors = geometry(size_mb, cluster_sectors)
+    cluster_bytes = cluster_sectors * SECTOR_SIZE
+    try:
+        f = open(image_path, 'r+b')
+    except OSError:
+        return "there is no image yet"
+    with f:
+        disk = SectorWriter(f)
+        boot = disk.read(0, 1)
+        if (os.fstat(f.fileno()).st_size != total_sectors * SECTOR_SIZE or boot[510:512] != b'\x55\xAA' or
+                struct.unpack_from('<BH', boot, 13) != (cluster_sectors, RESERVED_SECTORS) or
+                struct.unpack_from('<L', boot, 36)[0] != sectors_per_fat):
+            return "the image size or cluster size changed"
+        volume_id, = struct.unpack_from('<L', boot, 67)
+
+        # The FAT as bytes (searched for free runs) and as 32-bit entries, in
+        # the host byte order: little-endian on every machine that builds Atlas
+        table = bytearray(disk.read(RESERVED_SECTORS, sectors_per_fat))
+        fat = memoryview(table).cast('I')
+        clusters_end = (cluster_count + 2) * 4
+        def free_run(count):
+            """First cluster of the first `count` free clusters in a row, or 0."""
+            zeros = bytes(4 * count)
+            start = 8
+            while True:
+                pos = table.find(zeros, start, clusters_end)
+                if pos < 0 or pos % 4 == 0:
+                    return pos // 4 if pos >= 0 else 0
+                start = pos + 4 - pos % 4
+        def cluster_lba(cluster):
+            return data_lba + (cluster - 2) * cluster_sectors
+        def chain(cluster):
+            clusters = []
+            while 2 <= cluster < FAT_EOC - 7 and len(clusters) <= cluster_count:
+                clusters.append(cluster)
+                cluster = fat[cluster] & 0x0FFFFFFF
+            return clusters
+        def runs(clusters, size):
+            """Sector extents [(lba, sectors)] of the first `size` bytes."""
+            extents = []
+            left = -(-size // SECTOR_SIZE)
+            for c in clusters:
+                if left <= 0:
+                    break
+                sectors = min(left, cluster_sectors)
+                if extents and extents[-1][0] + extents[-1][1] == cluster_lba(c):
+                    extents[-1][1] += sectors
+                else:
+                    extents.append([cluster_lba(c), sectors])
+                left -= sectors
+            return [tuple(e) for e in extents]
+        def read_file(cluster, size):
+            return b''.join(disk.read(lba, n) for lba, n in runs(chain(cluster), size))[:size]
+
+        # Every file in the image by path of 8.3 names, and where its entry is
+        found = {}
+        def walk(cluster, prefix):
+            for c in chain(cluster):
+                table = disk.read(cluster_lba(c), cluster_sectors)
+                for off in range(0, len(table), DIR_ENTRY.size):
+                    name, attr = table[off:off + 11], table[off + 11]
+                    if name[0] == 0:
+                        return
+                    if name[0] == 0xE5 or attr & ATTR_LABEL or name[0] == ord('.'):
+                        continue
+                    first = struct.unpack_from('<H', table, off + 20)[0] << 16 | struct.unpack_from('<H', table, off + 26)[0]
+                    if attr & ATTR_DIR:
+                        walk(first, prefix + (name,))
+                    else:
+                        found[prefix + (name,)] = (cluster_lba(c) + off // SECTOR_SIZE, off % SECTOR_SIZE, first,
+                                                   struct.unpack_from('<L', table, off + 28)[0])
+        walk(ROOT_CLUSTER, ())
+
+        # The CRCs of files that did not change come from the boot map, as
+        # long as the loader would still trust it
+        raw = disk.read(FSINFO_SECTORS[0], 1 + BOOTMAP_SECTORS)
+        fsinfo, bootmap = raw[:SECTOR_SIZE], raw[SECTOR_SIZE:]
+        header = BOOTMAP_HEADER.unpack_from(bootmap)
+        if (header[0] == BOOTMAP_MAGIC and header[1] == BOOTMAP_VERSION and header[3] == crc32c(bootmap[12:]) and
+                header[4] == volume_id and header[5:7] == struct.unpack_from('<LL', fsinfo, 488)):
+            for i in range(header[2]):
+                name, _, size, crc, _ = BOOTMAP_FILE.unpack_from(bootmap, BOOTMAP_HEADER.size + i * BOOTMAP_FILE.size)
+                if (name,) in found and found[(name,)][3] == size:
+                    _CRC_CACHE.setdefault(read_file(found[(name,)][2], size), crc)
+
+        boot1, boot2, files = read_sources(boot1_path, boot2_path, config_path, additional_files)
+        patch_boot1(boot1, cluster_sectors, total_sectors, sectors_per_fat, volume_id)
+        wanted = {}
+        for filename, content in files:
+            parts = [p for p in filename.replace('\\', '/').split('/') if p]
+            wanted[tuple(format_name(p, True) for p in parts[:-1]) + (format_name(parts[-1]),)] = content
+        if wanted.keys() != found.keys():
+            return "the list of files changed"
+
+        # Plan: free every changed file's chain, then give each a run
+        changed = [key for key, content in wanted.items()
+                   if found[key][3] != len(content) or read_file(found[key][2], found[key][3]) != content]
+        for key in changed:
+            for c in chain(found[key][2]):
+                fat[c] = 0
+        placed = {}
+        for key in changed:
+            count = -(-len(wanted[key]) // cluster_bytes)
+            first = free_run(count) if count else 0
+            if count and not first:
+                return f"no run of {count} free clusters for {'/'.join(n.decode().strip() for n in key)}"
+            for i in range(count):
+                fat[first + i] = first + i + 1 if i + 1 < count else FAT_EOC
+            placed[key] = first
+
+        # Write: data first, then the entries and the FATs that point at it
+        for key, first in placed.items():
+            if first:
+                disk.write(cluster_lba(first), wanted[key])
+        for key, first in placed.items():
+            lba, off, _, _ = found[key]
+            sector = bytearray(disk.read(lba, 1))
+            struct.pack_into('<H', sector, off + 20, first >> 16)
+            struct.pack_into('<H', sector, off + 26, first & 0xFFFF)
+            struct.pack_into('<L', sector, off + 28, len(wanted[key]))
+            disk.write(lba, sector)
+            found[key] = (lba, off, first, len(wanted[key]))
+        for copy in range(FAT_COUNT):
+            disk.write(RESERVED_SECTORS + copy * sectors_per_fat, table)
+
+        free_clusters = fat[2:cluster_count + 2].tolist().count(0)
+        next_free = free_run(1) or 0xFFFFFFFF
+        for sector in FSINFO_SECTORS:
+            disk.write(sector, fsinfo_sector(free_clusters, next_free))
+        mapped = [(key[0], wanted[key], runs(chain(found[key][2]), len(wanted[key])))
+                  for key in found if len(key) == 1]
+        disk.write(BOOTMAP_LBA, build_bootmap(mapped, volume_id, free_clusters, next_free))
+        disk.write(0, boot1)
+        disk.write(BACKUP_BOOT_SECTOR, boot1)
+        disk.write(STAGE2_SECTOR, boot2.ljust(STAGE2_MAX_SECTORS * SECTOR_SIZE, b'\0'))
+
+    # Nothing may have been written: make the image newer than its inputs
+    os.utime(image_path)
+    print(f"Updated {image_path}: {len(changed)} of {len(files)} files changed, {disk.written} sectors written.")
+    return None
+
+def main():
+    parser = argparse.ArgumentParser(description="Build a bootable Atlas FAT32 image")
+    parser.add_argument("output")
+    parser.add_argument("boot1")
+    parser.add_argument("boot2")
+    parser.add_argument("config")
+    parser.add_argument("files", nargs='*', metavar="name path",
+                        help="files to add: the path inside the image, then the file to copy")
+    parser.add_argument("--size", type=int, default=64, metavar="MB", help="image size (default 64)")
+    parser.add_argument("--cluster", type=int, choices=[1, 2, 4, 8, 16, 32, 64, 128], metavar="SECTORS",
+                        help="sectors per cluster (default: by image size, as Windows formats)")
+    parser.add_argument("--update", action="store_true",
+                        help="update the files of an existing image in place; it is only rebuilt "
+                             "when its size, cluster size or list of files changed")
+    args = parser.parse_args()
+    if len(args.files) % 2:
+        parser.error("files come in pairs: <name in image> <path>")
+
+    others = list(zip(args.files[0::2], args.files[1::2]))
+    if args.update:
+        reason = update_fat32_image(args.output, args.boot1, args.boot2, args.config, others, args.size, args.cluster)
+        if reason is None:
+            return
+        print(f"Rebuilding {args.output}: {reason}")
+    create_fat32_image(args.output, args.boot1, args.boot2, args.config, others, args.size, args.cluster)
 
 if __name__ == "__main__":
-    if len(sys.argv) < 5:
-        print("Usage: create_disk.py <output> <boot1> <boot2> <config> [file1_name file1_path ...]")
-        sys.exit(1)
-    
-    image_out = sys.argv[1]
-    b1 = sys.argv[2]
-    b2 = sys.argv[3]
-    cfg = sys.argv[4]
-    
-    others = []
-    for i in range(5, len(sys.argv), 2):
-        if i+1 < len(sys.argv):
-            others.append((sys.argv[i], sys.argv[i+1]))
-            
-    create_fat32_image(image_out, b1, b2, cfg, others)
+    main()
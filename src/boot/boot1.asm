@@ -13,7 +13,7 @@ nop
 oem_name            db "ATLAS   "      ; 8 bytes
 bytes_per_sector    dw 512
 sectors_per_cluster db 1
-reserved_sectors    dw 32             ; Stage 2 + kernel will live here
+reserved_sectors    dw 136            ; Stage 2 (sectors 8-134) lives here
 fat_count           db 2
 root_entry_count    dw 0              ; 0 for FAT32
 total_sectors       dw 0              ; use 32-bit version
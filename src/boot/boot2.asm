@@ -1,5 +1,26 @@
 bits 16
 global _start
+
+%define BPB 0x7C0B          ; Stage 1's BPB, still in memory (include/fat32.h)
+%define E820_MAP 0x1000     ; BIOS memory map handed to the kernel (include/e820.h)
+%define E820_MAX 128
+%define CONFIG_SEG 0x2000   ; Config file buffer (0x20000, below the root-dir buffer)
+%define CONFIG_MAX_SECTORS 127
+%define CONFIG_BLOB_MAGIC 0x424C5441 ; include/config.h
+%define CONFIG_BLOB_VERSION 4
+%define CONFIG_ENTRY_MIN 56 ; sizeof(struct config_blob_entry)
+%define CONFIG_BLOB_NO_DEFAULT 0xFFFF ; default_entry when default= is unset
+%define DIR_SEG 0x3000      ; Directory sector cache (above the 127-sector Stage 2 image)
+%define FAT_SEG 0x3020      ; FAT sector cache
+%define BOUNCE_SEG 0x4000   ; INT 13h buffer for files copied above 1 MB
+%define BOUNCE_SECTORS 127
+%define FAT32_EOC 0x0FFFFFF8
+%define PRELOAD_TABLE 0x0800 ; Files preloaded above 1 MB (include/preload.h)
+%define PRELOAD_MAGIC 0x4C525041
+%define PRELOAD_MAX_FILES 9
+%define PRELOAD_HEADROOM 0x1000000
+%define PRELOAD_MIN_ADDR 0x4000000
+
 _start:
     cld
     ; Setup segments explicitly
@@ -7,24 +28,32 @@ _start:
     mov ds, ax
     mov es, ax
 
+    ; First boot timeline probe (src/kernel/timeline.c)
+    rdtsc
+    mov [stage2_tsc], eax
+    mov [stage2_tsc + 4], edx
+
     ; Print Stage 2 message (real mode)
     mov si, msg2
     call print_string
 
     mov [boot_drive], dl
+    mov dword [PRELOAD_TABLE], 0
 
     call enable_a20
+    call collect_e820
 
     ; --- Read Root Directory ---
-    ; LBA calculation: reserved_sectors (32) + (fat_count (2) * sectors_per_fat (0x400))
-    ; = 32 + (2 * 1024) = 32 + 2048 = 2080
-    ; This matches the BPB parameters defined in boot1.asm
-    mov eax, 2080           ; LBA of Root Dir
-    mov bx, 0x1000          ; temporary buffer
-    mov es, bx
-    xor bx, bx
-    mov di, 1
-    call read_sectors_lba
+    ; Data area = reserved_sectors + fat_count * sectors_per_fat, from the
+    ; BPB create_disk.py wrote for this image's size and cluster size
+    movzx eax, byte [BPB + 5]   ; fat_count
+    mul dword [BPB + 25]        ; sectors_per_fat_32
+    movzx ecx, word [BPB + 3]   ; reserved_sectors
+    add eax, ecx
+    mov [data_lba], eax
+    mov eax, [BPB + 33]         ; root_cluster
+    call cluster_to_lba         ; First sector of the root directory
+    call read_dir_sector
 
     ; Checkpoint D
     mov al, 'D'
@@ -39,46 +68,38 @@ _start:
     inc si
     loop .show_root
 
-    ; Search for "ATLAS   CFG" in the root directory
-    mov si, 0
-.search_loop:
-    push si
-    mov di, si              ; DI = entry start in ES
-    mov si, config_filename ; SI = target name in DS
-    mov cx, 11
-    repe cmpsb
-    pop si
-    je .found_config
-    add si, 32              ; next directory entry
-    cmp si, 512             ; end of sector
-    jl .search_loop
-    
+    ; Prefer the compiled config (ATLAS.BIN), fall back to ATLAS.CFG
+    mov si, blob_filename
+    call find_file
+    jnc .load_config
+    mov si, config_filename
+    call find_file
+    jnc .load_config
+
     ; If not found, just use hardcoded defaults (handled in kernel)
+.no_config:
     mov dword [config_addr], 0
     jmp .enter_protected_mode
 
-.found_config:
-    ; Found it! Get the starting cluster
-    ; Offset 20 (high word) and 26 (low word)
-    mov ax, [es:si + 20]
-    shl eax, 16
-    mov ax, [es:si + 26]
+.load_config:
     mov [config_cluster], eax
 
-    ; Convert cluster to LBA:
-    ; LBA = (cluster - 2) * sectors_per_cluster + DataAreaStart
-    ; LBA = (cluster - 2) * 1 + 2080 (where 2080 = reserved + FAT area)
-    sub eax, 2
-    add eax, 2080
-    
-    ; Load the config file to 0x2000:0000 (0x20000)
-    mov bx, 0x2000
+    ; Whole file, up to CONFIG_MAX_SECTORS, along its cluster chain
+    cmp ecx, CONFIG_MAX_SECTORS * 512
+    jbe .config_size_ok
+    mov ecx, CONFIG_MAX_SECTORS * 512
+.config_size_ok:
+    mov [config_size], ecx
+    mov edi, CONFIG_SEG << 4
+    call load_file
+    jc .no_config
+    mov bx, CONFIG_SEG
     mov es, bx
-    xor bx, bx
-    mov di, 1               ; assume config is < 512 bytes for now
-    call read_sectors_lba
-    
-    mov dword [config_addr], 0x20000
+    mov bx, cx
+    mov byte [es:bx], 0     ; NUL-terminate text configs
+
+    mov dword [config_addr], CONFIG_SEG << 4
+    call preload_default_entry
 
 .enter_protected_mode:
     cli
@@ -105,6 +126,560 @@ enable_a20:
     popa
     ret
 
+; Collect the BIOS memory map (INT 15h, EAX=E820) at E820_MAP:
+; dword count, dword reserved, then 24-byte entries (see include/e820.h)
+collect_e820:
+    pushad
+    push es
+    xor ax, ax
+    mov es, ax
+    mov di, E820_MAP + 8
+    xor ebx, ebx
+    xor bp, bp              ; entries stored
+.e820_next:
+    mov eax, 0xE820
+    mov ecx, 24
+    mov edx, 0x534D4150     ; 'SMAP'
+    mov dword [es:di + 20], 1 ; default ACPI 3.0 attributes: entry valid
+    int 0x15
+    jc .e820_done           ; unsupported, or past the last entry
+    cmp eax, 0x534D4150
+    jne .e820_done
+    jcxz .e820_skip
+    mov eax, [es:di + 8]    ; drop zero-length ranges
+    or eax, [es:di + 12]
+    jz .e820_skip
+    inc bp
+    add di, 24
+    cmp bp, E820_MAX
+    jae .e820_done
+.e820_skip:
+    test ebx, ebx
+    jnz .e820_next
+.e820_done:
+    movzx eax, bp
+    mov [E820_MAP], eax
+    pop es
+    popad
+    ret
+
+; EAX = LBA -> that directory sector at DIR_SEG:0000, ES = DIR_SEG
+read_dir_sector:
+    push bx
+    push di
+    mov bx, DIR_SEG
+    mov es, bx
+    cmp eax, [dir_lba]
+    je .rds_done
+    mov [dir_lba], eax
+    xor bx, bx
+    mov di, 1
+    call read_sectors_lba
+.rds_done:
+    pop di
+    pop bx
+    ret
+
+; EAX = cluster -> EAX = next cluster in its chain (one FAT sector cached)
+next_cluster:
+    push ebx
+    push edx
+    push di
+    push es
+    mov edx, eax
+    and edx, 127            ; Entry within its FAT sector
+    shr eax, 7
+    movzx ebx, word [BPB + 3]   ; reserved_sectors: first FAT
+    add eax, ebx
+    mov bx, FAT_SEG
+    mov es, bx
+    cmp eax, [fat_lba]
+    je .nc_cached
+    mov [fat_lba], eax
+    xor bx, bx
+    mov di, 1
+    call read_sectors_lba
+.nc_cached:
+    mov eax, [es:edx * 4]
+    and eax, 0x0FFFFFFF
+    pop es
+    pop di
+    pop edx
+    pop ebx
+    ret
+
+; Find an 8.3 name in the root directory, following its cluster chain
+; DS:SI = 11-byte name. Returns CF clear, EAX = first cluster, ECX = size
+find_file:
+    push ebx
+    push edx
+    push di
+    push es
+    mov eax, [BPB + 33]         ; root_cluster
+.ff_cluster:
+    cmp eax, 2
+    jb .ff_missing
+    cmp eax, FAT32_EOC
+    jae .ff_missing
+    mov edx, eax
+    call cluster_to_lba
+    movzx ecx, byte [BPB + 2]   ; sectors_per_cluster
+.ff_sector:
+    call read_dir_sector
+    xor bx, bx
+.ff_entry:
+    cmp byte [es:bx], 0     ; end of directory
+    je .ff_missing
+    push si
+    push cx
+    mov di, bx
+    mov cx, 11
+    repe cmpsb
+    pop cx
+    pop si
+    je .ff_found
+    add bx, 32              ; next directory entry
+    cmp bx, 512             ; end of sector
+    jb .ff_entry
+    inc eax
+    dec ecx
+    jnz .ff_sector
+    mov eax, edx
+    call next_cluster
+    jmp .ff_cluster
+.ff_found:
+    ; Offset 20 (high word) and 26 (low word) of the start cluster, 28 = size
+    mov ax, [es:bx + 20]
+    shl eax, 16
+    mov ax, [es:bx + 26]
+    mov ecx, [es:bx + 28]
+    clc
+    jmp .ff_done
+.ff_missing:
+    stc
+.ff_done:
+    pop es
+    pop di
+    pop edx
+    pop ebx
+    ret
+
+; Read a file along its cluster chain to linear address EDI, which may be
+; above 1 MB: runs of contiguous clusters go through the bounce buffer,
+; BOUNCE_SECTORS at a time. EAX = first cluster, ECX = size in bytes.
+; Whole sectors are copied. CF set if the chain ends early.
+load_file:
+    pushad
+    mov [load_dest], edi
+    add ecx, 511
+    shr ecx, 9              ; sectors left
+.lf_run:
+    test ecx, ecx
+    jz .lf_done
+    cmp eax, 2
+    jb .lf_fail
+    cmp eax, FAT32_EOC
+    jae .lf_fail
+    mov [load_run], eax
+    movzx ebx, byte [BPB + 2]   ; sectors_per_cluster
+    mov edx, ebx            ; sectors in this run
+.lf_grow:
+    cmp edx, ecx
+    jae .lf_read
+    mov esi, eax
+    call next_cluster
+    inc esi
+    cmp eax, esi
+    jne .lf_read            ; EAX starts the next run
+    add edx, ebx
+    jmp .lf_grow
+.lf_read:
+    cmp edx, ecx
+    jbe .lf_count_ok
+    mov edx, ecx
+.lf_count_ok:
+    sub ecx, edx
+    push eax
+    mov eax, [load_run]
+    call cluster_to_lba
+    call read_to_linear
+    pop eax
+    jmp .lf_run
+.lf_done:
+    popad
+    clc
+    ret
+.lf_fail:
+    popad
+    stc
+    ret
+
+; Read EDX sectors from LBA EAX to linear [load_dest] and advance it
+read_to_linear:
+    pushad
+.rl_chunk:
+    test edx, edx
+    jz .rl_done
+    mov ecx, edx
+    cmp ecx, BOUNCE_SECTORS
+    jbe .rl_count_ok
+    mov ecx, BOUNCE_SECTORS
+.rl_count_ok:
+    push es
+    mov bx, BOUNCE_SEG
+    mov es, bx
+    xor bx, bx
+    mov di, cx
+    call read_sectors_lba
+    pop es
+    push ecx
+    shl ecx, 9
+    mov esi, BOUNCE_SEG << 4
+    mov edi, [load_dest]
+    call copy_linear
+    add [load_dest], ecx
+    pop ecx
+    add eax, ecx
+    sub edx, ecx
+    jmp .rl_chunk
+.rl_done:
+    popad
+    ret
+
+; Copy ECX bytes (a multiple of 4) from linear ESI to linear EDI
+copy_linear:
+    pushad
+    push ds
+    push es
+    call enter_unreal
+    shr ecx, 2
+    a32 rep movsd
+    pop es
+    pop ds
+    popad
+    ret
+
+; Unreal mode: DS = ES = 0 with the 4 GB limit of the flat data
+; descriptor, which they keep back in real mode until reloaded. Real-mode
+; code and BIOS calls are unaffected.
+enter_unreal:
+    push eax
+    cli
+    lgdt [gdtr]
+    mov eax, cr0
+    or al, 1
+    mov cr0, eax
+    jmp $ + 2
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov eax, cr0
+    and al, 0xFE
+    mov cr0, eax
+    xor ax, ax
+    mov ds, ax
+    mov es, ax
+    sti
+    pop eax
+    ret
+
+; ----------------- preloading -----------------
+; Read the kernel and modules of the compiled config's default entry into
+; RAM above 1 MB and describe them in the table at PRELOAD_TABLE, for
+; fat32.c to serve them from memory. The kernel is the one
+; config_blob_load picks on BIOS; text configs, and a default entry
+; without one, are left to the kernel's loader.
+preload_default_entry:
+    pushad
+    push fs
+    mov ax, CONFIG_SEG
+    mov fs, ax
+    cmp dword [fs:0], CONFIG_BLOB_MAGIC
+    jne .pl_done
+    cmp word [fs:4], CONFIG_BLOB_VERSION
+    jne .pl_done
+
+    ; Entry records must lie inside what was loaded
+    movzx eax, word [fs:16]     ; entry_count
+    movzx ecx, word [fs:18]     ; entry_size
+    cmp ecx, CONFIG_ENTRY_MIN
+    jb .pl_done
+    mul ecx
+    add eax, [fs:20]            ; entries_off
+    jc .pl_done
+    cmp eax, [config_size]
+    ja .pl_done
+
+    ; default_entry; without one the menu starts on the first entry
+    ; that has a kernel
+    mov ax, [fs:36]
+    cmp ax, CONFIG_BLOB_NO_DEFAULT
+    jne .pl_default
+    xor ax, ax
+.pl_first:
+    cmp ax, [fs:16]
+    jae .pl_done
+    call blob_entry_kernel
+    jnc .pl_entry
+    inc ax
+    jmp .pl_first
+.pl_default:
+    call blob_entry_kernel
+    jc .pl_done
+
+.pl_entry:
+    mov word [PRELOAD_TABLE + 4], 0
+    mov word [preload_slot], PRELOAD_TABLE + 16
+    mov dword [preload_total], 0
+    call preload_add
+    jc .pl_done
+    mov cx, [fs:bx + 20]        ; module_count
+    cmp cx, PRELOAD_MAX_FILES - 1
+    jbe .pl_modules
+    mov cx, PRELOAD_MAX_FILES - 1
+.pl_modules:
+    jcxz .pl_listed
+    add bx, 24                  ; modules[]
+.pl_module:
+    mov edx, [fs:bx]
+    test edx, edx
+    jz .pl_next_module
+    cmp edx, [fs:28]            ; strings_size
+    jae .pl_next_module
+    call preload_add
+    jc .pl_listed               ; fat32.c reports it
+.pl_next_module:
+    add bx, 4
+    loop .pl_module
+
+.pl_listed:
+    call preload_place
+    jc .pl_clear
+    mov edi, [preload_base]
+    mov [PRELOAD_TABLE + 8], edi
+    mov eax, [preload_total]
+    mov [PRELOAD_TABLE + 12], eax
+    mov si, PRELOAD_TABLE + 16
+    mov cx, [PRELOAD_TABLE + 4]
+.pl_load:
+    mov [si + 20], edi
+    mov eax, [si + 12]
+    push ecx
+    mov ecx, [si + 16]
+    call load_file
+    jc .pl_failed
+    add ecx, 0xFFF
+    and ecx, 0xFFFFF000
+    add edi, ecx
+    pop ecx
+    add si, 24
+    loop .pl_load
+
+    mov dword [PRELOAD_TABLE], PRELOAD_MAGIC
+    mov al, 'P'
+    call print_char
+    jmp .pl_done
+.pl_failed:
+    pop ecx
+.pl_clear:
+    mov word [PRELOAD_TABLE + 4], 0
+.pl_done:
+    pop fs
+    popad
+    ret
+
+; Compiled config entry AX (FS = CONFIG_SEG): BX = its record and EDX
+; the string offset of its kernel on BIOS, as config_blob_load chooses
+; it: kernel_x86= else kernel=, else kernel_x64= on CPUs with long mode.
+; CF set if there is no such entry or kernel.
+blob_entry_kernel:
+    push eax
+    push ecx
+    cmp ax, [fs:16]             ; entry_count
+    jae .bek_none
+    movzx eax, ax
+    movzx ecx, word [fs:18]     ; entry_size
+    mul ecx
+    add eax, [fs:20]            ; entries_off
+    mov bx, ax
+    mov edx, [fs:bx + 4]        ; kernel_x86
+    test edx, edx
+    jnz .bek_check
+    mov edx, [fs:bx + 12]       ; kernel
+.bek_check:
+    test edx, edx
+    jz .bek_x64
+    cmp edx, [fs:28]            ; strings_size
+    jb .bek_found
+.bek_x64:
+    mov edx, [fs:bx + 8]        ; kernel_x64
+    test edx, edx
+    jz .bek_none
+    cmp edx, [fs:28]
+    jae .bek_none
+    call cpu_has_long_mode
+    jc .bek_none
+.bek_found:
+    clc
+    jmp .bek_done
+.bek_none:
+    stc
+.bek_done:
+    pop ecx
+    pop eax
+    ret
+
+; CF clear if the CPU has long mode (CPUID 0x80000001, EDX bit 29)
+cpu_has_long_mode:
+    pushad
+    mov eax, 0x80000000
+    cpuid
+    cmp eax, 0x80000001
+    jb .lm_done                 ; CF set
+    mov eax, 0x80000001
+    cpuid
+    bt edx, 29
+    cmc
+.lm_done:
+    popad
+    ret
+
+; Look up the path at string offset EDX of the compiled config and add it
+; to the preload table. CF set if it is not in the root directory.
+preload_add:
+    pushad
+    mov bx, [fs:24]             ; strings_off
+    add bx, dx
+    mov di, preload_name
+    call format_83
+    mov si, preload_name
+    call find_file
+    jc .pa_done
+    mov di, [preload_slot]
+    mov [di + 12], eax
+    mov [di + 16], ecx
+    add ecx, 0xFFF
+    and ecx, 0xFFFFF000
+    add [preload_total], ecx
+    xor bx, bx
+.pa_name:
+    mov al, [preload_name + bx]
+    mov [bx + di], al
+    inc bx
+    cmp bx, 11
+    jb .pa_name
+    mov byte [di + 11], 0
+    add word [preload_slot], 24
+    inc word [PRELOAD_TABLE + 4]
+    clc
+.pa_done:
+    popad
+    ret
+
+; The 8.3 name of the path at FS:BX into DS:DI, as format_83() in fat32.c
+; makes it: the whole path, upper case, blank padded
+format_83:
+    pusha
+    mov cx, 11
+    push di
+.f83_blank:
+    mov byte [di], ' '
+    inc di
+    loop .f83_blank
+    pop di
+    xor si, si
+.f83_base:
+    mov al, [fs:bx + si]
+    test al, al
+    jz .f83_done
+    cmp al, '.'
+    je .f83_ext
+    cmp si, 8
+    jae .f83_skip
+    call upcase
+    mov [di + si], al
+.f83_skip:
+    inc si
+    jmp .f83_base
+.f83_ext:
+    inc si
+    add di, 8
+    mov cx, 3
+.f83_ext_char:
+    mov al, [fs:bx + si]
+    test al, al
+    jz .f83_done
+    cmp al, ' '
+    je .f83_done
+    call upcase
+    mov [di], al
+    inc di
+    inc si
+    loop .f83_ext_char
+.f83_done:
+    popa
+    ret
+
+upcase:
+    cmp al, 'a'
+    jb .uc_done
+    cmp al, 'z'
+    ja .uc_done
+    sub al, 'a' - 'A'
+.uc_done:
+    ret
+
+; [preload_base] = staging for [preload_total] bytes: the top of the
+; highest E820 RAM range below 4 GB, less PRELOAD_HEADROOM. CF set if
+; that falls outside the range or below PRELOAD_MIN_ADDR.
+preload_place:
+    pushad
+    xor ebx, ebx            ; end of the best range
+    xor edx, edx            ; its base
+    mov si, E820_MAP + 8
+    mov cx, [E820_MAP]
+.pp_range:
+    jcxz .pp_chosen
+    cmp dword [si + 16], 1      ; E820_RAM
+    jne .pp_next
+    cmp dword [si + 4], 0       ; starts above 4 GB
+    jne .pp_next
+    mov eax, [si]
+    mov edi, [si + 12]
+    add eax, [si + 8]
+    adc edi, 0
+    jz .pp_below_4g
+    mov eax, 0xFFFFF000
+.pp_below_4g:
+    and eax, 0xFFFFF000
+    cmp eax, ebx
+    jbe .pp_next
+    mov ebx, eax
+    mov edx, [si]
+.pp_next:
+    add si, 24
+    dec cx
+    jmp .pp_range
+.pp_chosen:
+    mov eax, ebx
+    sub eax, PRELOAD_HEADROOM
+    jb .pp_fail
+    sub eax, [preload_total]
+    jb .pp_fail
+    and eax, 0xFFFFF000
+    cmp eax, edx
+    jb .pp_fail
+    cmp eax, PRELOAD_MIN_ADDR
+    jb .pp_fail
+    mov [preload_base], eax
+    popad
+    clc
+    ret
+.pp_fail:
+    popad
+    stc
+    ret
+
 print_string:
     pusha
     mov ah, 0x0E
@@ -118,6 +693,18 @@ print_string:
     popa
     ret
 
+; EAX = cluster -> EAX = LBA of its first sector
+cluster_to_lba:
+    push ecx
+    push edx
+    sub eax, 2
+    movzx ecx, byte [BPB + 2]   ; sectors_per_cluster
+    mul ecx
+    add eax, [data_lba]
+    pop edx
+    pop ecx
+    ret
+
 ; Read sectors using LBA
 ; EAX = LBA, ES:BX = buffer, DI = count
 read_sectors_lba:
@@ -143,8 +730,25 @@ msg2 db "Stage 2 (LBA/FAT32 Support)", 0x0D, 0x0A, 0
 msg_disk_err db "LBA Read Error!", 0
 boot_drive db 0
 config_filename db "ATLAS   CFG"
+blob_filename db "ATLAS   BIN"
 config_cluster dd 0
+config_size dd 0
+data_lba dd 0               ; First sector of cluster 2
 config_addr dd 0
+dir_lba dd -1               ; Sector in the DIR_SEG cache
+fat_lba dd -1               ; Sector in the FAT_SEG cache
+load_dest dd 0
+load_run dd 0
+preload_slot dw 0
+preload_total dd 0
+preload_base dd 0
+preload_name times 11 db 0
+
+; Boot timeline probes taken before any C code runs (read by timeline.c)
+global stage2_tsc
+global pmode_tsc
+stage2_tsc dd 0, 0
+pmode_tsc dd 0, 0
 
 ; Disk Address Packet for INT 13h AH=42h
 align 4
@@ -160,9 +764,28 @@ dap_buffer_seg:
 dap_lba:
     dq 0                   ; LBA
 
+; ----------------- AP trampoline -----------------
+; Copied to SMP_TRAMPOLINE_ADDR by smp_init (src/kernel/smp.c); APs start
+; here in real mode at CS = SIPI vector << 8, IP = 0. Position independent:
+; GDTR and the far jump target are absolute.
+global smp_trampoline
+global smp_trampoline_end
+smp_trampoline:
+    cli
+    xor ax, ax
+    mov ds, ax
+    lgdt [gdtr]
+    mov eax, cr0
+    or al, 1
+    mov cr0, eax
+    jmp dword 0x08:ap_pm_entry
+smp_trampoline_end:
+
 ; ----------------- 32-bit protected mode -----------------
 bits 32
 extern kmain
+extern __bss_start
+extern __bss_end
 protected_mode_entry:
     ; set up flat data segments and stack
     mov ax, 0x10
@@ -173,6 +796,17 @@ protected_mode_entry:
     mov ss, ax
     mov esp, 0x90000        ; set stack
 
+    rdtsc
+    mov [pmode_tsc], eax
+    mov [pmode_tsc + 4], edx
+
+    ; zero .bss (it is not part of the flat binary)
+    mov edi, __bss_start
+    mov ecx, __bss_end
+    sub ecx, edi
+    xor eax, eax
+    rep stosb
+
     ; Checkpoint OK (PM)
     mov dword [0xB8000], 0x2F212F21 ; "!!" in green
 
@@ -198,6 +832,47 @@ protected_mode_entry:
     hlt
     jmp .hang_pm
 
+; ----------------- application processors -----------------
+%define SMP_AP_STACK_SIZE 0x4000 ; include/smp.h
+%define SMP_WAKE_VECTOR 0x40
+%define SMP_SPURIOUS_VECTOR 0xFF
+
+; Set by smp_init: stack area (SMP_AP_STACK_SIZE per AP) and AP count.
+; Each AP takes the next index in arrival order.
+global smp_ap_stacks
+global smp_ap_limit
+global smp_ap_next
+smp_ap_stacks dd 0
+smp_ap_limit dd 0
+smp_ap_next dd 0
+
+extern smp_ap_main
+ap_pm_entry:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+    mov eax, cr0            ; INIT leaves the caches off (CD, NW)
+    and eax, 0x9FFFFFFF
+    mov cr0, eax
+    fninit
+    mov eax, 1
+    lock xadd [smp_ap_next], eax
+    cmp eax, [smp_ap_limit]
+    jae .ap_hang
+    lea esp, [eax + 1]
+    imul esp, esp, SMP_AP_STACK_SIZE
+    add esp, [smp_ap_stacks]
+    lidt [idt_descriptor]
+    push eax                ; smp_ap_main(index)
+    call smp_ap_main
+.ap_hang:
+    cli
+    hlt
+    jmp .ap_hang
+
 ; ----------------- protected-mode helpers -----------------
 print_pm:
 .pm_loop:
@@ -211,6 +886,102 @@ print_pm:
 .pm_done:
     ret
 
+; ----------------- Linux boot protocol entry -----------------
+; void linux_enter32(uint32_t entry, uint32_t boot_params)
+; Loads a GDT with __BOOT_CS (0x10) and __BOOT_DS (0x18) and enters the
+; 32-bit kernel entry with ESI = boot_params and EBP = EDI = EBX = 0.
+global linux_enter32
+linux_enter32:
+    cli
+    mov eax, [esp + 4]      ; entry
+    mov esi, [esp + 8]      ; boot_params
+    lgdt [linux_gdtr]
+    jmp 0x10:.reload_cs
+.reload_cs:
+    mov cx, 0x18
+    mov ds, cx
+    mov es, cx
+    mov fs, cx
+    mov gs, cx
+    mov ss, cx
+    xor ebp, ebp
+    xor edi, edi
+    xor ebx, ebx
+    jmp eax
+
+linux_gdt:
+    dq 0x0000000000000000
+    dq 0x0000000000000000
+    dq 0x00CF9A000000FFFF   ; 0x10: flat 4 GiB code
+    dq 0x00CF92000000FFFF   ; 0x18: flat 4 GiB data
+linux_gdt_end:
+
+linux_gdtr:
+    dw linux_gdt_end - linux_gdt - 1
+    dd linux_gdt
+
+; ----------------- Long mode entry for 64-bit kernels -----------------
+; void long_mode_enter(uint32_t pml4, uint32_t entry, uint32_t rdi, uint32_t rsi)
+; Enables PAE and EFER.LME, loads the identity-mapping PML4 and calls
+; `entry` in 64-bit mode. The GDT follows the Linux 64-bit boot protocol:
+; 64-bit code at 0x10, data at 0x18.
+global long_mode_enter
+long_mode_enter:
+    cli
+    mov eax, [esp + 4]
+    mov cr3, eax            ; PML4
+    mov ebx, [esp + 8]      ; entry
+    mov edi, [esp + 12]
+    mov esi, [esp + 16]
+
+    mov eax, cr4
+    or eax, 1 << 5          ; PAE
+    mov cr4, eax
+
+    mov ecx, 0xC0000080     ; EFER
+    rdmsr
+    or eax, 1 << 8          ; LME
+    wrmsr
+
+    lgdt [lm_gdtr]
+    mov eax, cr0
+    or eax, 1 << 31         ; PG (PE is already set)
+    mov cr0, eax
+    jmp 0x10:.long_mode
+
+bits 64
+.long_mode:
+    mov ax, 0x18
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; upper register halves are undefined after the switch: zero-extend
+    mov ebx, ebx
+    mov edi, edi
+    mov esi, esi
+    mov esp, esp
+    and rsp, -16
+    xor ebp, ebp
+    call rbx
+.lm_hang:
+    hlt
+    jmp .lm_hang
+bits 32
+
+lm_gdt:
+    dq 0x0000000000000000
+    dq 0x0000000000000000
+    dq 0x00AF9A000000FFFF   ; 0x10: 64-bit code
+    dq 0x00CF92000000FFFF   ; 0x18: flat 4 GiB data
+lm_gdt_end:
+
+lm_gdtr:
+    dw lm_gdt_end - lm_gdt - 1
+    dd lm_gdt
+
 ; ----------------- GDT (null, code, data) -----------------
 ; 3 descriptors: null, code (0x08), data (0x10)
 gdt:
@@ -278,7 +1049,7 @@ set_idt_entry:
 
 ; ----------------- install IDT entries and load IDT -----------------
 install_idt:
-    ; create entries for IRQ0 (vector 0x20), IRQ1 (0x21), and an exception (0x0E)
+    ; create entries for IRQ0 (vector 0x20), IRQ1 (0x21), IRQ4 (0x24) and an exception (0x0E)
     mov ecx, 0x20
     mov eax, isr_timer
     call set_idt_entry
@@ -287,10 +1058,23 @@ install_idt:
     mov eax, isr_keyboard
     call set_idt_entry
 
+    mov ecx, 0x24
+    mov eax, isr_serial
+    call set_idt_entry
+
     mov ecx, 0x0E
     mov eax, isr_default
     call set_idt_entry
 
+    ; APs: the worker pool's wake-up IPI, and the local APIC's spurious vector
+    mov ecx, SMP_WAKE_VECTOR
+    mov eax, isr_smp_wake
+    call set_idt_entry
+
+    mov ecx, SMP_SPURIOUS_VECTOR
+    mov eax, isr_default
+    call set_idt_entry
+
     lidt [idt_descriptor]
     ret
 
@@ -346,10 +1130,15 @@ saved_mask1: db 0
 saved_mask2: db 0
 
 ; ----------------- IRQ handlers (32-bit stubs) -----------------
-; Use pushad/popad in protected mode and iretd to return
+; Use pushad/popad in protected mode and iretd to return. Stubs that
+; call C clear DF first: the SysV ABI expects it clear on entry, and the
+; interrupt may land inside memmove's backward (std) copy. iretd
+; restores the interrupted code's flags.
+extern g_timer_ticks
+
 isr_timer:
     pushad
-    ; (increment tick count here if you have one)
+    inc dword [g_timer_ticks] ; timer.c, TIMER_HZ per second
     ; send EOI to master PIC
     mov al, 0x20
     out 0x20, al
@@ -360,6 +1149,7 @@ isr_keyboard:
     pushad
     in al, 0x60             ; read scancode
 
+    cld
     push eax                ; argument for C handler
     call keyboard_handler_c
     add esp, 4
@@ -370,6 +1160,27 @@ isr_keyboard:
     popad
     iretd
 
+; COM1 transmitter empty: serial.c refills the FIFO from its ring
+extern serial_irq_c
+
+isr_serial:
+    pushad
+    cld
+    call serial_irq_c
+    mov al, 0x20
+    out 0x20, al
+    popad
+    iretd
+
+; Worker pool wake-up on an AP: smp.c sends the local APIC EOI
+extern smp_ipi_c
+
+isr_smp_wake:
+    pushad
+    cld
+    call smp_ipi_c
+    popad
+    iretd
 
 isr_default:
     pushad
@@ -93,6 +93,9 @@ typedef EFI_STATUS ( *EFI_FILE_CLOSE)(EFI_FILE_PROTOCOL *This);
 typedef EFI_STATUS ( *EFI_FILE_DELETE)(EFI_FILE_PROTOCOL *This);
 typedef EFI_STATUS ( *EFI_FILE_READ)(EFI_FILE_PROTOCOL *This, UINTN *BufferSize, void *Buffer);
 typedef EFI_STATUS ( *EFI_FILE_WRITE)(EFI_FILE_PROTOCOL *This, UINTN *BufferSize, void *Buffer);
+typedef EFI_STATUS ( *EFI_FILE_GET_POSITION)(EFI_FILE_PROTOCOL *This, uint64_t *Position);
+typedef EFI_STATUS ( *EFI_FILE_SET_POSITION)(EFI_FILE_PROTOCOL *This, uint64_t Position);
+typedef EFI_STATUS ( *EFI_FILE_GET_INFO)(EFI_FILE_PROTOCOL *This, EFI_GUID *InformationType, UINTN *BufferSize, void *Buffer);
 
 struct _EFI_FILE_PROTOCOL {
     uint64_t Revision;
@@ -101,9 +104,40 @@ struct _EFI_FILE_PROTOCOL {
     EFI_FILE_DELETE Delete;
     EFI_FILE_READ Read;
     EFI_FILE_WRITE Write;
+    EFI_FILE_GET_POSITION GetPosition;
+    EFI_FILE_SET_POSITION SetPosition;
+    EFI_FILE_GET_INFO GetInfo;
+    void *SetInfo;
+    void *Flush;
     // ...
 };
 
+typedef struct {
+    uint16_t Year;
+    uint8_t  Month;
+    uint8_t  Day;
+    uint8_t  Hour;
+    uint8_t  Minute;
+    uint8_t  Second;
+    uint8_t  Pad1;
+    uint32_t Nanosecond;
+    int16_t  TimeZone;
+    uint8_t  Daylight;
+    uint8_t  Pad2;
+} EFI_TIME;
+
+// Returned by GetInfo(EFI_FILE_INFO_ID); FileName follows the fixed part
+typedef struct {
+    uint64_t Size;
+    uint64_t FileSize;
+    uint64_t PhysicalSize;
+    EFI_TIME CreateTime;
+    EFI_TIME LastAccessTime;
+    EFI_TIME ModificationTime;
+    uint64_t Attribute;
+    short FileName[1];
+} EFI_FILE_INFO;
+
 typedef struct _EFI_SIMPLE_FILE_SYSTEM_PROTOCOL EFI_SIMPLE_FILE_SYSTEM_PROTOCOL;
 
 typedef EFI_STATUS ( *EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_OPEN_VOLUME)(EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *This, EFI_FILE_PROTOCOL **Root);
@@ -130,6 +164,15 @@ typedef EFI_STATUS (*EFI_FREE_POOL)(void *Buffer);
 typedef EFI_STATUS (*EFI_HANDLE_PROTOCOL)(EFI_HANDLE Handle, EFI_GUID *Protocol, void **Interface);
 typedef EFI_STATUS (*EFI_WAIT_FOR_EVENT)(UINTN NumberOfEvents, EFI_EVENT *Event, UINTN *Index);
 typedef EFI_STATUS (*EFI_ALLOCATE_PAGES)(int Type, int MemoryType, UINTN Pages, UINTN *Memory);
+typedef EFI_STATUS (*EFI_FREE_PAGES)(UINTN Memory, UINTN Pages);
+typedef EFI_STATUS (*EFI_STALL)(UINTN Microseconds);
+
+#define EVT_TIMER 0x80000000
+#define TPL_CALLBACK 8
+typedef enum { TimerCancel, TimerPeriodic, TimerRelative } EFI_TIMER_DELAY;
+
+typedef EFI_STATUS (*EFI_CREATE_EVENT)(uint32_t Type, UINTN NotifyTpl, void *NotifyFunction, void *NotifyContext, EFI_EVENT *Event);
+typedef EFI_STATUS (*EFI_SET_TIMER)(EFI_EVENT Event, EFI_TIMER_DELAY Type, uint64_t TriggerTime);
 
 typedef EFI_STATUS (*EFI_LOCATE_PROTOCOL)(EFI_GUID *Protocol, void *Registration, void **Interface);
 
@@ -146,14 +189,14 @@ typedef struct {
     
     // Memory Services
     EFI_ALLOCATE_PAGES AllocatePages;
-    void *FreePages;
+    EFI_FREE_PAGES FreePages;
     EFI_GET_MEMORY_MAP GetMemoryMap;
     EFI_ALLOCATE_POOL AllocatePool;
     EFI_FREE_POOL FreePool;
     
     // Event & Timer Services
-    void *CreateEvent;
-    void *SetTimer;
+    EFI_CREATE_EVENT CreateEvent;
+    EFI_SET_TIMER SetTimer;
     EFI_WAIT_FOR_EVENT WaitForEvent;
     void *SignalEvent;
     void *CloseEvent;
@@ -179,7 +222,7 @@ typedef struct {
     
     // Misc
     void *GetNextMonotonicCount;
-    void *Stall;
+    EFI_STALL Stall;
     void *SetWatchdogTimer;
     
     // DriverSupport
@@ -198,9 +241,19 @@ typedef struct {
     // ...
 } EFI_BOOT_SERVICES;
 
+// Entries of SystemTable->ConfigurationTable
+typedef struct {
+    EFI_GUID VendorGuid;
+    void *VendorTable;
+} EFI_CONFIGURATION_TABLE;
+
+#define EFI_ACPI_20_TABLE_GUID { 0x8868e871, 0xe4f1, 0x11d3, { 0xbc, 0x22, 0x00, 0x80, 0xc7, 0x3c, 0x88, 0x81 } }
+#define EFI_ACPI_10_TABLE_GUID { 0xeb9d2d30, 0x2d88, 0x11d3, { 0x9a, 0x16, 0x00, 0x90, 0x27, 0x3f, 0xc1, 0x4d } }
+
 // Protocol GUIDs (Globals to be defined in efi_main or somewhere)
 extern EFI_GUID EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_GUID;
 extern EFI_GUID EFI_LOADED_IMAGE_PROTOCOL_GUID;
+extern EFI_GUID EFI_FILE_INFO_ID;
 
 // EFI System Table
 struct _EFI_SYSTEM_TABLE {
@@ -216,7 +269,7 @@ struct _EFI_SYSTEM_TABLE {
     void *RuntimeServices;
     EFI_BOOT_SERVICES *BootServices;
     UINTN NumberOfTableEntries;
-    void *ConfigurationTable;
+    EFI_CONFIGURATION_TABLE *ConfigurationTable;
 };
 
 // Allocation Types
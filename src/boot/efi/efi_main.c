@@ -2,6 +2,10 @@
 #include "efi.h"
 #include "fat32.h"
 #include "mem.h"
+#include "config.h"
+#include "timeline.h"
+#include "serial.h"
+#include "libk.h"
 
 // Global System Table
 EFI_SYSTEM_TABLE *g_SystemTable = NULL;
@@ -11,12 +15,17 @@ EFI_HANDLE g_ImageHandle = NULL;
 EFI_GUID EFI_LOADED_IMAGE_PROTOCOL_GUID = { 0x5B1B31A1, 0x9562, 0x11D2, { 0x8E, 0x3F, 0x00, 0xA0, 0xC9, 0x69, 0x72, 0x3B } };
 EFI_GUID EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_GUID = { 0x0964E5B22, 0x6459, 0x11D2, { 0x8E, 0x39, 0x00, 0xA0, 0xC9, 0x69, 0x72, 0x3B } };
 EFI_GUID EFI_GRAPHICS_OUTPUT_PROTOCOL_GUID = { 0x9042a9de, 0x23dc, 0x4a38, { 0x96, 0xfb, 0x7a, 0xde, 0xd0, 0x80, 0x51, 0x6a } };
+EFI_GUID EFI_FILE_INFO_ID = { 0x09576e92, 0x6d3f, 0x11d2, { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
 
 // External Kernel Entry Point
 void kmain(char *config_addr, struct fat32_bpb *bpb);
 
 // UEFI Entry Point
 EFI_STATUS efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable) {
+    timeline_init();
+    serial_init();
+    libk_init();
+
     // Save global pointers
     g_SystemTable = SystemTable;
     g_ImageHandle = ImageHandle;
@@ -26,15 +35,23 @@ EFI_STATUS efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable) {
     SystemTable->ConOut->SetAttribute(SystemTable->ConOut, 0x07); // Light Gray on Black (Standard)
     
     // Allocate buffer for config
-    // kmalloc in UEFI mode calls AllocatePool, so safe to use immediately
-    char *config_buf = (char *)kmalloc(4096); 
+    // The heap draws pages from boot services, so it works right away
+    kheap_init();
+    char *config_buf = (char *)kmalloc(CONFIG_MAX_SIZE + 1);
     
-    // Load Configuration
+    // Load Configuration: the compiled ATLAS.BIN if present, else ATLAS.CFG
     if (config_buf) {
         // Zero out buffer
-        for(int i=0; i<4096; i++) config_buf[i] = 0;
+        memset(config_buf, 0, CONFIG_MAX_SIZE + 1);
         
-        if (fat32_read_file("ATLAS.CFG", config_buf) != 0) {
+        struct fat32_load_req req;
+        if (fat32_open("ATLAS.BIN", &req.file) == 0 || fat32_open("ATLAS.CFG", &req.file) == 0) {
+            req.offset = 0;
+            req.length = req.file.size < CONFIG_MAX_SIZE ? req.file.size : CONFIG_MAX_SIZE;
+            req.dest = config_buf;
+            req.verify = 0;
+            fat32_load(&req, 1);
+        } else {
             SystemTable->ConOut->OutputString(SystemTable->ConOut, (short*)L"Warning: ATLAS.CFG not found.\r\n");
             // kmain handles null/empty config gracefully (default entries)
         }
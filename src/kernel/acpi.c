@@ -0,0 +1,80 @@
+// acpi.c
+#include "acpi.h"
+#include "libk.h"
+
+#define EBDA_SEGMENT_PTR 0x40E // BIOS data area: EBDA segment
+#define BIOS_AREA 0xE0000
+#define BIOS_AREA_SIZE 0x20000
+
+static int checksum_ok(const void *p, uint32_t len)
+{
+    const uint8_t *b = (const uint8_t *)p;
+    uint8_t sum = 0;
+    while (len--)
+        sum += *b++;
+    return sum == 0;
+}
+
+// The RSDP sits on a 16-byte boundary; its first 20 bytes are the ACPI 1.0 part
+static uint32_t rsdp_scan(uint32_t start, uint32_t len)
+{
+    for (uint32_t addr = start; addr + 20 <= start + len; addr += 16)
+        if (memcmp((const void *)(uintptr_t)addr, "RSD PTR ", 8) == 0 && checksum_ok((const void *)(uintptr_t)addr, 20))
+            return addr;
+    return 0;
+}
+
+uint32_t acpi_rsdp(void)
+{
+    uint32_t ebda = (uint32_t)*(volatile uint16_t *)EBDA_SEGMENT_PTR << 4;
+    if (ebda >= 0x80000 && ebda < 0xA0000)
+    {
+        uint32_t rsdp = rsdp_scan(ebda, 1024);
+        if (rsdp) return rsdp;
+    }
+    return rsdp_scan(BIOS_AREA, BIOS_AREA_SIZE);
+}
+
+static const struct acpi_header *check_table(uint64_t addr, const char *signature)
+{
+    if (addr == 0 || addr >= 0x100000000ull) return 0;
+    const struct acpi_header *h = (const struct acpi_header *)(uintptr_t)addr;
+    if (memcmp(h->signature, signature, 4) != 0) return 0;
+    return checksum_ok(h, h->length) ? h : 0;
+}
+
+const struct acpi_header *acpi_find_table(const char *signature)
+{
+    const uint8_t *rsdp = (const uint8_t *)(uintptr_t)acpi_rsdp();
+    if (!rsdp) return 0;
+
+    // ACPI 2.0+: the XSDT holds 64-bit pointers (unaligned, hence memcpy)
+    uint64_t xsdt_addr;
+    memcpy(&xsdt_addr, rsdp + 24, 8);
+    const struct acpi_header *xsdt = 0;
+    if (rsdp[15] >= 2 && checksum_ok(rsdp, *(const uint32_t *)(rsdp + 20)))
+        xsdt = check_table(xsdt_addr, "XSDT");
+    if (xsdt)
+    {
+        const uint8_t *entries = (const uint8_t *)(xsdt + 1);
+        uint32_t count = (xsdt->length - sizeof(*xsdt)) / 8;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint64_t addr;
+            memcpy(&addr, entries + i * 8, 8);
+            const struct acpi_header *h = check_table(addr, signature);
+            if (h) return h;
+        }
+        return 0;
+    }
+
+    const struct acpi_header *rsdt = check_table(*(const uint32_t *)(rsdp + 16), "RSDT");
+    if (!rsdt) return 0;
+    const uint32_t *entries = (const uint32_t *)(rsdt + 1);
+    for (uint32_t i = 0; i < (rsdt->length - sizeof(*rsdt)) / 4; i++)
+    {
+        const struct acpi_header *h = check_table(entries[i], signature);
+        if (h) return h;
+    }
+    return 0;
+}
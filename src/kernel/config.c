@@ -0,0 +1,395 @@
+// config.c
+#include "config.h"
+#include "crc32.h"
+#include "mem.h"
+#include "libk.h"
+#include "serial.h"
+
+#ifndef UEFI_BUILD
+#include "paging.h"
+#endif
+
+#define CRC_START 16
+
+static struct
+{
+    const char *path;
+    uint32_t crc;
+} g_checksums[CONFIG_MAX_CHECKSUMS];
+static int g_checksum_count;
+
+static char upper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
+static int path_equal(const char *a, const char *b)
+{
+    while (*a == '/') a++;
+    while (*b == '/') b++;
+    while (*a && upper(*a) == upper(*b))
+    {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+int config_add_checksum(const char *path, uint32_t crc)
+{
+    for (int i = 0; i < g_checksum_count; i++)
+    {
+        if (path_equal(g_checksums[i].path, path))
+        {
+            g_checksums[i].crc = crc;
+            return 0;
+        }
+    }
+    if (g_checksum_count >= CONFIG_MAX_CHECKSUMS) return -1;
+    g_checksums[g_checksum_count].path = path;
+    g_checksums[g_checksum_count].crc = crc;
+    g_checksum_count++;
+    return 0;
+}
+
+int config_find_checksum(const char *path, uint32_t *crc)
+{
+    for (int i = 0; i < g_checksum_count; i++)
+    {
+        if (path_equal(g_checksums[i].path, path))
+        {
+            *crc = g_checksums[i].crc;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int config_blob_detect(const void *buf)
+{
+    return buf && ((const struct config_blob_header *)buf)->magic == CONFIG_BLOB_MAGIC;
+}
+
+static int check_header(const struct config_blob_header *h, uint32_t size)
+{
+    if (h->version != CONFIG_BLOB_VERSION) return -1;
+    if (h->header_size < sizeof(*h) || h->total_size > size || h->total_size < h->header_size) return -1;
+    if (h->entry_size < sizeof(struct config_blob_entry)) return -1;
+    if (h->checksums_off < h->header_size ||
+        h->checksums_off + (uint64_t)h->checksum_count * sizeof(struct config_blob_checksum) > h->total_size)
+        return -1;
+
+    uint64_t entries_end = h->entries_off + (uint64_t)h->entry_count * h->entry_size;
+    if (h->entries_off < h->header_size || entries_end > h->total_size) return -1;
+    if (h->strings_off < h->header_size || h->strings_size == 0 ||
+        (uint64_t)h->strings_off + h->strings_size > h->total_size)
+        return -1;
+
+    // Strings are used in place, so the table must start empty and end terminated
+    const char *strings = (const char *)h + h->strings_off;
+    if (strings[0] != '\0' || strings[h->strings_size - 1] != '\0') return -1;
+
+    if (crc32c(0, (const uint8_t *)h + CRC_START, h->total_size - CRC_START) != h->crc32c) return -1;
+    return 0;
+}
+
+int config_blob_load(const void *blob, uint32_t size, struct menu *menu, int max)
+{
+    const struct config_blob_header *h = (const struct config_blob_header *)blob;
+    if (size < sizeof(*h) || !config_blob_detect(blob) || check_header(h, size) != 0) return -1;
+
+    char *strings = (char *)blob + h->strings_off;
+#define STR(off) ((off) < h->strings_size ? strings + (off) : strings)
+
+    if (h->title) menu->title = STR(h->title);
+    menu->selected = 0;
+    menu->timeout = h->timeout;
+    menu->console = (char)h->console;
+    menu->fallback = -1;
+
+    const struct config_blob_checksum *sums =
+        (const struct config_blob_checksum *)((const uint8_t *)blob + h->checksums_off);
+    for (uint32_t i = 0; i < h->checksum_count; i++)
+        config_add_checksum(STR(sums[i].path), sums[i].crc32c);
+
+    int count = 0;
+    for (uint32_t i = 0; i < h->entry_count && count < max; i++)
+    {
+        const struct config_blob_entry *r =
+            (const struct config_blob_entry *)((const uint8_t *)blob + h->entries_off + i * h->entry_size);
+        struct menu_entry *e = &menu->entries[count];
+
+        // Same priority as the text parser: arch-specific key, then kernel=
+#ifdef UEFI_BUILD
+        e->long_mode = 1;
+        e->kernel_path = STR(r->kernel_x64 ? r->kernel_x64 : r->kernel);
+#else
+        e->long_mode = 0;
+        e->kernel_path = STR(r->kernel_x86 ? r->kernel_x86 : r->kernel);
+        if (e->kernel_path[0] == '\0' && r->kernel_x64 && paging_long_mode_supported())
+        {
+            e->kernel_path = STR(r->kernel_x64);
+            e->long_mode = 1;
+        }
+#endif
+        if (e->kernel_path[0] == '\0') continue;
+
+        e->name = r->name ? STR(r->name) : "Unknown Entry";
+        e->cmdline = STR(r->cmdline);
+        e->module_count = r->module_count < MAX_MODULES ? r->module_count : MAX_MODULES;
+        for (int m = 0; m < e->module_count; m++)
+            e->modules[m] = STR(r->modules[m]);
+        if (i == h->default_entry) menu->selected = count;
+        if (i == h->fallback_entry) menu->fallback = count;
+        count++;
+    }
+
+#undef STR
+    menu->length = count;
+    return 0;
+}
+
+static int starts_with(const char *pref, const char *str)
+{
+    while (*pref)
+    {
+        if (*pref++ != *str++)
+            return 0;
+    }
+    return 1;
+}
+
+// Decimal config value; -1 if it is not a number
+static int parse_int(const char *s)
+{
+    int n = 0;
+    if (!*s) return -1;
+    for (; *s; s++)
+    {
+        if (*s < '0' || *s > '9') return -1;
+        n = n * 10 + (*s - '0');
+    }
+    return n;
+}
+
+// default= names an entry by its position in the config (from 0) or its name
+static int find_entry(struct menu_entry *entries, int count, const char *key)
+{
+    int index = parse_int(key);
+    if (index >= 0) return index < count ? index : -1;
+
+    for (int i = 0; i < count; i++)
+        if (strcmp(entries[i].name, key) == 0) return i;
+    return -1;
+}
+
+// console= is a comma-separated list of "vga" and "serial"
+static int parse_console(const char *s)
+{
+    int flags = 0;
+    while (*s)
+    {
+        if (starts_with("vga", s)) flags |= CONSOLE_VGA;
+        else if (starts_with("serial", s)) flags |= CONSOLE_SERIAL;
+        while (*s && *s != ',') s++;
+        if (*s) s++;
+    }
+    return flags;
+}
+
+// checksum=<path> <crc32c in hex>
+static void add_checksum(const char *val, struct arena *strings)
+{
+    const char *space = 0;
+    for (const char *p = val; *p; p++)
+        if (*p == ' ') space = p;
+    if (!space || space == val || !space[1]) return;
+
+    uint32_t crc = 0;
+    for (const char *p = space + 1; *p; p++)
+    {
+        char c = *p;
+        if (c >= '0' && c <= '9') crc = (crc << 4) | (c - '0');
+        else if (c >= 'a' && c <= 'f') crc = (crc << 4) | (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') crc = (crc << 4) | (c - 'A' + 10);
+        else return;
+    }
+
+    char *path = arena_alloc_aligned(strings, space - val + 1, 1);
+    if (!path) return;
+    memcpy(path, val, space - val);
+    path[space - val] = '\0';
+    config_add_checksum(path, crc);
+}
+
+static char *copy_value(struct arena *strings, const char *val)
+{
+    char *copy = arena_strdup(strings, val);
+    return copy ? copy : "";
+}
+
+void config_parse_text(char *text, struct menu *menu, int max, struct arena *strings)
+{
+    struct menu_entry *entries = menu->entries;
+    int entry_count = 0;
+    char *default_key = 0;
+    char *fallback_key = 0;
+
+    menu->selected = 0;
+    menu->timeout = -1;
+    menu->console = 0;
+    menu->fallback = -1;
+
+    char *line = text;
+    while (*line)
+    {
+        // Skip leading whitespace/newlines
+        while (*line && (*line == ' ' || *line == '\n' || *line == '\r' || *line == '\t'))
+            line++;
+
+        if (!*line) break;
+
+        char *line_start = line;
+        while (*line && *line != '\n' && *line != '\r')
+            line++;
+
+        char save = *line;
+        *line = '\0';
+
+        // Clean trailing spaces in the line
+        char *end = line - 1;
+        while (end > line_start && *end == ' ') {
+            *end = '\0';
+            end--;
+        }
+
+        if (starts_with("[menu]", line_start))
+        {
+            // Title parsing logic
+        }
+        else if (starts_with("[entry]", line_start))
+        {
+            if (entry_count < max)
+            {
+                entries[entry_count].name = "Unknown Entry";
+                entries[entry_count].kernel_path = "";
+                entries[entry_count].cmdline = "";
+#ifdef UEFI_BUILD
+                entries[entry_count].long_mode = 1;
+#else
+                entries[entry_count].long_mode = 0;
+#endif
+                entries[entry_count].module_count = 0;
+                entry_count++;
+            }
+        }
+        else if (starts_with("name=", line_start))
+        {
+            if (entry_count > 0)
+                entries[entry_count - 1].name = copy_value(strings, line_start + 5);
+        }
+        else if (starts_with("title=", line_start))
+        {
+            menu->title = copy_value(strings, line_start + 6);
+        }
+        else if (starts_with("default=", line_start))
+        {
+            default_key = copy_value(strings, line_start + 8);
+        }
+        else if (starts_with("timeout=", line_start))
+        {
+            menu->timeout = parse_int(line_start + 8);
+        }
+        else if (starts_with("fallback=", line_start))
+        {
+            fallback_key = copy_value(strings, line_start + 9);
+        }
+        else if (starts_with("checksum=", line_start))
+        {
+            add_checksum(line_start + 9, strings);
+        }
+        else if (starts_with("console=", line_start))
+        {
+            menu->console = parse_console(line_start + 8);
+        }
+        else if (starts_with("cmdline=", line_start))
+        {
+            if (entry_count > 0)
+                entries[entry_count - 1].cmdline = copy_value(strings, line_start + 8);
+        }
+        else if (starts_with("initrd=", line_start) || starts_with("module=", line_start))
+        {
+            // Both keys append to the module list; initrd= is conventionally first
+            if (entry_count > 0 && entries[entry_count - 1].module_count < MAX_MODULES)
+            {
+                struct menu_entry *e = &entries[entry_count - 1];
+                e->modules[e->module_count++] = copy_value(strings, line_start + 7);
+            }
+        }
+        else
+        {
+            int is_kernel = 0;
+            char *val = 0;
+
+            // Priority Check: Arch-specific key
+#ifdef UEFI_BUILD
+            if (starts_with("kernel_x64=", line_start)) {
+                is_kernel = 1;
+                val = line_start + 11;
+            }
+#else
+            if (starts_with("kernel_x86=", line_start)) {
+                is_kernel = 1;
+                val = line_start + 11;
+            }
+#endif
+
+            // Fallback: Generic key
+            if (!is_kernel && starts_with("kernel=", line_start)) {
+                is_kernel = 1;
+                val = line_start + 7;
+            }
+
+            if (is_kernel && entry_count > 0)
+            {
+                entries[entry_count - 1].kernel_path = copy_value(strings, val);
+#ifndef UEFI_BUILD
+                entries[entry_count - 1].long_mode = 0;
+#endif
+            }
+#ifndef UEFI_BUILD
+            // Last resort on BIOS: a 64-bit kernel, entered in long mode
+            else if (starts_with("kernel_x64=", line_start) && entry_count > 0)
+            {
+                struct menu_entry *e = &entries[entry_count - 1];
+                if (e->kernel_path[0] == '\0' && paging_long_mode_supported())
+                {
+                    e->kernel_path = copy_value(strings, line_start + 11);
+                    e->long_mode = 1;
+                }
+            }
+#endif
+        }
+
+        *line = save;
+        if (*line) line++;
+    }
+
+    int default_index = default_key ? find_entry(entries, entry_count, default_key) : -1;
+    int fallback_index = fallback_key ? find_entry(entries, entry_count, fallback_key) : -1;
+
+    // Filter out entries with no valid kernel path for this architecture
+    int valid_count = 0;
+    for (int i = 0; i < entry_count; i++) {
+        if (entries[i].kernel_path && entries[i].kernel_path[0] != '\0') {
+            if (i == default_index) menu->selected = valid_count;
+            if (i == fallback_index) menu->fallback = valid_count;
+            // Keep this entry
+            if (valid_count != i) {
+                entries[valid_count] = entries[i];
+            }
+            valid_count++;
+        }
+    }
+    menu->length = valid_count;
+}
@@ -0,0 +1,112 @@
+// crc32.c
+#include "crc32.h"
+#include "cpu.h"
+
+#define CRC32C_POLY 0x82F63B78
+
+static uint32_t g_table[256];
+static int g_table_ready;
+static int g_hw = -1; // -1 until CPUID has been asked
+
+static void crc32c_init_table(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        g_table[i] = c;
+    }
+    g_table_ready = 1;
+}
+
+static uint32_t crc32c_table(uint32_t crc, const uint8_t *p, uint32_t len)
+{
+    if (!g_table_ready) crc32c_init_table();
+    while (len--)
+        crc = g_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+// SSE4.2 CRC32 works on general registers, so it needs no FPU/SSE state
+// set up. A word per instruction: fast enough to run at read speed.
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, uint32_t len)
+{
+    while (len && ((uintptr_t)p & (sizeof(uintptr_t) - 1)))
+    {
+        __asm__("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+        p++;
+        len--;
+    }
+#ifdef __x86_64__
+    uint64_t c = crc;
+    for (; len >= 8; len -= 8, p += 8)
+        __asm__("crc32q %1, %0" : "+r"(c) : "rm"(*(const uint64_t *)p));
+    crc = (uint32_t)c;
+#else
+    for (; len >= 4; len -= 4, p += 4)
+        __asm__("crc32l %1, %0" : "+r"(crc) : "rm"(*(const uint32_t *)p));
+#endif
+    while (len--)
+    {
+        __asm__("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+        p++;
+    }
+    return crc;
+}
+
+int crc32c_hw(void)
+{
+    if (g_hw < 0) g_hw = (cpuid_features_ecx() & CPUID_SSE42) != 0;
+    return g_hw;
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, uint32_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    crc = ~crc;
+    crc = crc32c_hw() ? crc32c_sse42(crc, p, len) : crc32c_table(crc, p, len);
+    return ~crc;
+}
+
+// Appending len2 zero bytes is linear over GF(2): square the operator for
+// one zero bit up to the bits of len2 and apply it to crc1 (as zlib does)
+static uint32_t gf2_times(const uint32_t *mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+    for (; vec; vec >>= 1, mat++)
+        if (vec & 1) sum ^= *mat;
+    return sum;
+}
+
+static void gf2_square(uint32_t *square, const uint32_t *mat)
+{
+    for (int n = 0; n < 32; n++)
+        square[n] = gf2_times(mat, mat[n]);
+}
+
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint32_t len2)
+{
+    uint32_t even[32], odd[32];
+    if (len2 == 0) return crc1;
+
+    odd[0] = CRC32C_POLY; // One zero bit
+    for (int n = 1; n < 32; n++)
+        odd[n] = 1u << (n - 1);
+    gf2_square(even, odd); // Two zero bits
+    gf2_square(odd, even); // Four
+
+    // The first squaring below gives one zero byte
+    do
+    {
+        gf2_square(even, odd);
+        if (len2 & 1) crc1 = gf2_times(even, crc1);
+        len2 >>= 1;
+        if (!len2) break;
+        gf2_square(odd, even);
+        if (len2 & 1) crc1 = gf2_times(odd, crc1);
+        len2 >>= 1;
+    } while (len2);
+    return crc1 ^ crc2;
+}
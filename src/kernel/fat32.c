@@ -1,6 +1,13 @@
 // fat32.c
 #include "fat32.h"
 #include "vga.h"
+#include "timeline.h"
+#include "serial.h"
+#include "crc32.h"
+#include "libk.h"
+
+static int fat32_load_one(struct fat32_load_req *req, uint32_t *crc);
+static int fat32_load_checked(struct fat32_load_req *req);
 
 #ifdef UEFI_BUILD
 #include "../boot/efi/efi.h"
@@ -11,27 +18,27 @@ void fat32_init(struct fat32_bpb *bpb) {
     (void)bpb;
 }
 
-int fat32_read_file(const char *filename, void *dest) {
-    if (!g_SystemTable || !g_ImageHandle) return -1;
+static EFI_FILE_PROTOCOL *uefi_open(const char *filename) {
+    if (!g_SystemTable || !g_ImageHandle) return 0;
 
     // 1. Get LoadedImage Protocol to find the DeviceHandle
     EFI_GUID loaded_image_guid = EFI_LOADED_IMAGE_PROTOCOL_GUID;
     EFI_LOADED_IMAGE_PROTOCOL *loaded_image;
     EFI_STATUS status = g_SystemTable->BootServices->HandleProtocol(g_ImageHandle, &loaded_image_guid, (void**)&loaded_image);
-    
+
     if (status != 0) {
         vga_put_string("FS: Failed to get LoadedImage\n", 0x1F);
-        return -1;
+        return 0;
     }
 
     // 2. Get SimpleFileSystem Protocol from DeviceHandle
     EFI_GUID fs_guid = EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_GUID;
     EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *fs;
     status = g_SystemTable->BootServices->HandleProtocol(loaded_image->DeviceHandle, &fs_guid, (void**)&fs);
-    
+
     if (status != 0) {
         vga_put_string("FS: Failed to get FileSystem\n", 0x1F);
-        return -1;
+        return 0;
     }
 
     // 3. Open Volume (Root Dir)
@@ -39,7 +46,7 @@ int fat32_read_file(const char *filename, void *dest) {
     status = fs->OpenVolume(fs, &root);
     if (status != 0) {
         vga_put_string("FS: Failed to open volume\n", 0x1F);
-        return -1;
+        return 0;
     }
 
     // 4. Convert ASCII filename to Unicode (short*)
@@ -54,13 +61,13 @@ int fat32_read_file(const char *filename, void *dest) {
     // 5. Open File
     EFI_FILE_PROTOCOL *file;
     status = root->Open(root, &file, name_buffer, EFI_FILE_MODE_READ, 0);
-    root->Close(root); 
+    root->Close(root);
 
     if (status != 0) {
         vga_put_string("FS: Open failed for: '", 0x1F);
         vga_put_string(filename, 0x1F);
         vga_put_string("'\n", 0x1F);
-        
+
         vga_put_string("FS: Status: ", 0x1F);
         // Simple hex printer
         char hex[] = "0123456789ABCDEF";
@@ -77,21 +84,75 @@ int fat32_read_file(const char *filename, void *dest) {
              vga_put_string(" ", 0x1F);
         }
         vga_put_string("\n", 0x1F);
+        return 0;
+    }
+
+    return file;
+}
+
+int fat32_open(const char *filename, struct fat32_file *file) {
+    EFI_FILE_PROTOCOL *handle = uefi_open(filename);
+    if (!handle) return -1;
+
+    // 6. Query the size so callers can place the file before reading it
+    EFI_GUID info_guid = EFI_FILE_INFO_ID;
+    uint64_t info_buf[(sizeof(EFI_FILE_INFO) + 512) / sizeof(uint64_t)];
+    UINTN info_size = sizeof(info_buf);
+    EFI_STATUS status = handle->GetInfo(handle, &info_guid, &info_size, info_buf);
+    handle->Close(handle);
+
+    if (status != 0) {
+        vga_put_string("FS: Failed to get file info\n", 0x1F);
         return -1;
     }
 
-    // 6. Read File
-    // Assume max file size is reasonable for the buffer. 
-    // In a real OS we'd get file info first, but here we assume 'dest' is large enough (legacy constraint).
-    UINTN read_size = 10 * 1024 * 1024; // 10MB Buffer Limit
-    status = file->Read(file, &read_size, dest);
-    file->Close(file);
+    file->path = filename;
+    file->cluster = 0; // Disk position is hidden behind the firmware
+    file->map = 0;
+    file->preload = 0;
+    file->size = (uint32_t)((EFI_FILE_INFO *)info_buf)->FileSize;
+    return 0;
+}
+
+// Read in pieces so a checksum runs over data that is still in the cache
+#define UEFI_READ_CHUNK 0x100000
+
+static int fat32_load_one(struct fat32_load_req *req, uint32_t *crc) {
+    EFI_FILE_PROTOCOL *handle = uefi_open(req->file.path);
+    if (!handle) return -1;
+
+    EFI_STATUS status = 0;
+    if (req->offset)
+        status = handle->SetPosition(handle, req->offset);
+
+    uint8_t *dest = (uint8_t *)req->dest;
+    uint32_t remaining = req->length;
+    while (status == 0 && remaining > 0) {
+        UINTN chunk = remaining < UEFI_READ_CHUNK ? remaining : UEFI_READ_CHUNK;
+        UINTN read_size = chunk;
+        status = handle->Read(handle, &read_size, dest);
+        if (status == 0 && read_size != chunk) status = 1; // Short read
+        if (crc) *crc = crc32c(*crc, dest, chunk);
+        dest += chunk;
+        remaining -= chunk;
+    }
+    handle->Close(handle);
 
     if (status != 0) {
          vga_put_string("FS: Failed to read file\n", 0x1F);
          return -1;
     }
-    
+    return 0;
+}
+
+int fat32_load(struct fat32_load_req *reqs, int count) {
+    // The firmware owns the block layout, so the plan runs in request order
+    for (int r = 0; r < count; r++) {
+        int result = fat32_load_checked(&reqs[r]);
+        if (result != 0) return result;
+        timeline_mark(BOOT_EV_FILE_READ, r);
+    }
+
     return 0; // Success
 }
 
@@ -99,10 +160,33 @@ int fat32_read_file(const char *filename, void *dest) {
 // Legacy BIOS Implementation
 #include "disk.h"
 #include "mem.h"
+#include "pmm.h"
+#include "preload.h"
+#include "smp.h"
+
+#define FAT32_EOC 0x0FFFFFF8
+#define ATA_MAX_SECTORS 128
 
 static struct fat32_bpb g_bpb;
 static uint32_t g_data_lba;
 
+// One-sector FAT cache: sequential chains hit the same sector 128 times in a row
+static uint32_t g_fat_cache[128];
+static uint32_t g_fat_cache_lba;
+
+// Bounce buffer for the partial sector at the end of a read
+static uint8_t g_bounce[512];
+
+// FSInfo followed by the boot map, as read in one command (see fat32.h)
+static uint32_t g_bootmap_buf[(1 + BOOTMAP_SECTORS) * 128];
+static const struct bootmap_header *g_bootmap;
+static int g_bootmap_trusted;
+
+// Files Stage 2 already copied to memory, or 0
+static const struct preload_table *g_preload;
+
+static void bootmap_init(void);
+
 void fat32_init(struct fat32_bpb *bpb) {
     // Manual copy to avoid unaligned access or memcpy issues
     g_bpb.bytes_per_sector = bpb->bytes_per_sector;
@@ -111,14 +195,92 @@ void fat32_init(struct fat32_bpb *bpb) {
     g_bpb.fat_count = bpb->fat_count;
     g_bpb.sectors_per_fat_32 = bpb->sectors_per_fat_32;
     g_bpb.root_cluster = bpb->root_cluster;
+    g_bpb.fs_info_sector = bpb->fs_info_sector;
+    g_bpb.volume_id = bpb->volume_id;
 
     g_data_lba = g_bpb.reserved_sectors + (g_bpb.fat_count * g_bpb.sectors_per_fat_32);
+    g_fat_cache_lba = 0xFFFFFFFF;
+    bootmap_init();
 }
 
 static uint32_t cluster_to_lba(uint32_t cluster) {
     return g_data_lba + (cluster - 2) * g_bpb.sectors_per_cluster;
 }
 
+// Trust the boot map only while it belongs to this volume and nothing has
+// allocated or freed a cluster since it was written
+static void bootmap_init(void) {
+    g_bootmap = 0;
+    g_bootmap_trusted = 0;
+    if (g_bpb.fs_info_sector != BOOTMAP_LBA - 1) return;
+
+    ata_read_sectors(BOOTMAP_LBA - 1, 1 + BOOTMAP_SECTORS, (uint16_t *)g_bootmap_buf);
+    const uint32_t *fsinfo = g_bootmap_buf;
+    const struct bootmap_header *map = (const struct bootmap_header *)(g_bootmap_buf + 128);
+    const uint32_t size = BOOTMAP_SECTORS * 512;
+    if (map->magic != BOOTMAP_MAGIC) return;
+
+    const struct bootmap_file *files = (const struct bootmap_file *)(map + 1);
+    int ok = map->version == BOOTMAP_VERSION &&
+             sizeof(*map) + map->file_count * sizeof(*files) + map->extent_count * sizeof(struct bootmap_extent) <= size &&
+             crc32c(0, (const uint8_t *)map + 12, size - 12) == map->crc32c;
+    for (int i = 0; ok && i < map->file_count; i++)
+        ok = files[i].first_extent + files[i].extent_count <= map->extent_count;
+    if (!ok) {
+        klog("FS: Boot map damaged, using the FAT\n");
+        return;
+    }
+
+    // FSInfo: lead signature, then free cluster count and next free cluster at 488/492
+    if (fsinfo[0] != 0x41615252 || map->volume_id != g_bpb.volume_id ||
+        map->free_clusters != fsinfo[122] || map->next_free != fsinfo[123]) {
+        klog("FS: Boot map is stale, using the FAT\n");
+        return;
+    }
+    g_bootmap = map;
+    g_bootmap_trusted = 1;
+    klog("FS: Boot map found\n");
+}
+
+static const struct bootmap_extent *bootmap_extents(void) {
+    return (const struct bootmap_extent *)((const struct bootmap_file *)(g_bootmap + 1) + g_bootmap->file_count);
+}
+
+static const struct bootmap_file *bootmap_find(const char *name83) {
+    if (!g_bootmap_trusted) return 0;
+    const struct bootmap_file *files = (const struct bootmap_file *)(g_bootmap + 1);
+    for (int i = 0; i < g_bootmap->file_count; i++)
+        if (memcmp(files[i].name, name83, 11) == 0) return &files[i];
+    return 0;
+}
+
+void fat32_use_preload(const struct preload_table *table) {
+    g_preload = 0;
+    if (table->magic != PRELOAD_MAGIC || table->count == 0 || table->count > PRELOAD_MAX_FILES) return;
+    if (pmm_reserve(table->base, table->size) != 0) {
+        klog("FS: Preloaded files overlap used memory, ignoring them\n");
+        return;
+    }
+    g_preload = table;
+    klog("FS: Preloaded files found\n");
+}
+
+static const struct preload_file *preload_find(const char *name83) {
+    if (!g_preload) return 0;
+    for (int i = 0; i < g_preload->count; i++)
+        if (memcmp(g_preload->files[i].name, name83, 11) == 0) return &g_preload->files[i];
+    return 0;
+}
+
+static uint32_t fat32_next_cluster(uint32_t cluster) {
+    uint32_t fat_lba = g_bpb.reserved_sectors + cluster / 128;
+    if (fat_lba != g_fat_cache_lba) {
+        ata_read_sectors(fat_lba, 1, (uint16_t *)g_fat_cache);
+        g_fat_cache_lba = fat_lba;
+    }
+    return g_fat_cache[cluster % 128] & 0x0FFFFFFF;
+}
+
 static void format_83(const char *src, char *dst) {
     for (int i = 0; i < 11; i++) dst[i] = ' ';
     int i = 0;
@@ -139,73 +301,327 @@ static void format_83(const char *src, char *dst) {
     }
 }
 
-int fat32_read_file(const char *filename, void *dest) {
+int fat32_open(const char *filename, struct fat32_file *file) {
     char target[12];
     format_83(filename, target);
     target[11] = '\0';
 
-    vga_put_string("\nFS: Searching for [", 0x1F);
-    vga_put_string(target, 0x1F);
-    vga_put_string("]", 0x1F);
+    klog("FS: Searching for [");
+    klog(target);
+    klog("]\n");
+
+    const struct preload_file *pre = preload_find(target);
+    if (pre) {
+        klog("FS: -> preloaded\n");
+        file->path = filename;
+        file->cluster = pre->cluster;
+        file->size = pre->size;
+        file->map = 0;
+        file->preload = pre;
+        return 0;
+    }
+
+    const struct bootmap_file *entry = bootmap_find(target);
+    if (entry) {
+        klog("FS: -> boot map\n");
+        file->path = filename;
+        file->size = entry->size;
+        file->map = entry;
+        file->preload = 0;
+        file->cluster = 0;
+        if (entry->extent_count) {
+            uint32_t lba = bootmap_extents()[entry->first_extent].lba;
+            file->cluster = (lba - g_data_lba) / g_bpb.sectors_per_cluster + 2;
+        }
+        return 0;
+    }
 
     uint8_t buffer[512];
     uint32_t cluster = g_bpb.root_cluster;
 
-    while (cluster < 0x0FFFFFF8) {
+    while (cluster < FAT32_EOC) {
         uint32_t lba = cluster_to_lba(cluster);
         for (int s = 0; s < g_bpb.sectors_per_cluster; s++) {
             ata_read_sectors(lba + s, 1, (uint16_t *)buffer);
             for (int i = 0; i < 512; i += 32) {
                 if (buffer[i] == 0) {
-                    vga_put_string("\nFS: End of directory reached.", 0x1F);
+                    klog("FS: End of directory reached\n");
                     return -1;
                 }
                 if (buffer[i] == 0xE5) continue;
-                
+
                 char entry_name[12];
-                for(int k=0; k<11; k++) entry_name[k] = buffer[i+k];
+                memcpy(entry_name, &buffer[i], 11);
                 entry_name[11] = '\0';
-                vga_put_string("\nFound: ", 0x1F);
-                vga_put_string(entry_name, 0x1F);
-
-                int match = 1;
-                for (int j = 0; j < 11; j++) {
-                    if (buffer[i + j] != target[j]) { match = 0; break; }
-                }
+                klog("Found: ");
+                klog(entry_name);
+                klog("\n");
 
-                if (match) {
-                    uint32_t start_cluster = (*(uint16_t *)&buffer[i + 20] << 16) | *(uint16_t *)&buffer[i + 26];
-                    vga_put_string(" -> OK!", 0x1F);
-                    
-                    uint32_t current = start_cluster;
-                    uint8_t *ptr = (uint8_t *)dest;
-                    while (current < 0x0FFFFFF8) {
-                        uint32_t file_lba = cluster_to_lba(current);
-                        for (int fs = 0; fs < g_bpb.sectors_per_cluster; fs++) {
-                            ata_read_sectors(file_lba + fs, 1, (uint16_t *)ptr);
-                            ptr += 512;
-                        }
-                        
-                        uint32_t fat_sector = current / 128;
-                        uint32_t fat_offset = current % 128;
-                        uint32_t fat_lba = g_bpb.reserved_sectors + fat_sector;
-                        uint32_t fat_buf[128];
-                        ata_read_sectors(fat_lba, 1, (uint16_t *)fat_buf);
-                        current = fat_buf[fat_offset] & 0x0FFFFFFF;
-                    }
+                if (memcmp(&buffer[i], target, 11) == 0) {
+                    klog("FS: -> OK\n");
+                    file->path = filename;
+                    file->cluster = (*(uint16_t *)&buffer[i + 20] << 16) | *(uint16_t *)&buffer[i + 26];
+                    file->size = *(uint32_t *)&buffer[i + 28];
+                    file->map = 0;
+                    file->preload = 0;
                     return 0;
                 }
             }
         }
-        
+
         // Move to next cluster in the directory chain
-        uint32_t fat_sector = cluster / 128;
-        uint32_t fat_offset = cluster % 128;
-        uint32_t fat_lba = g_bpb.reserved_sectors + fat_sector;
-        uint32_t fat_buf[128];
-        ata_read_sectors(fat_lba, 1, (uint16_t *)fat_buf);
-        cluster = fat_buf[fat_offset] & 0x0FFFFFFF;
+        cluster = fat32_next_cluster(cluster);
     }
     return -1;
 }
+
+// Read `count` whole sectors into `dest`, in the largest chunks the driver
+// takes, and fold each chunk into *crc (if set) while it is still cached
+static void read_run(uint32_t lba, uint32_t count, uint8_t *dest, uint32_t *crc) {
+    while (count > 0) {
+        uint32_t chunk = count > ATA_MAX_SECTORS ? ATA_MAX_SECTORS : count;
+        ata_read_sectors(lba, (uint8_t)chunk, (uint16_t *)dest);
+        if (crc) *crc = crc32c(*crc, dest, chunk * 512);
+        lba += chunk;
+        dest += chunk * 512;
+        count -= chunk;
+    }
+}
+
+// The partial sector at the end of a read: never write past the end of
+// the destination
+static void read_tail(uint32_t lba, uint32_t bytes, uint8_t *dest, uint32_t *crc) {
+    ata_read_sectors(lba, 1, (uint16_t *)g_bounce);
+    memcpy(dest, g_bounce, bytes);
+    if (crc) *crc = crc32c(*crc, g_bounce, bytes);
+}
+
+static int fat32_load_one(struct fat32_load_req *req, uint32_t *crc) {
+    uint32_t spc = g_bpb.sectors_per_cluster;
+    uint32_t cluster_bytes = spc * 512;
+    uint32_t cluster = req->file.cluster;
+    uint32_t first_sector = (req->offset % cluster_bytes) / 512;
+    uint32_t remaining = req->length;
+    uint8_t *ptr = (uint8_t *)req->dest;
+
+    if ((req->offset % 512) != 0 || req->offset > req->file.size ||
+        req->length > req->file.size - req->offset)
+        return -1;
+
+    // Walk past the clusters that precede the requested offset
+    for (uint32_t skip = req->offset / cluster_bytes; skip > 0; skip--) {
+        cluster = fat32_next_cluster(cluster);
+        if (cluster < 2 || cluster >= FAT32_EOC) return -1;
+    }
+
+    while (remaining > 0) {
+        if (cluster < 2 || cluster >= FAT32_EOC) return -1;
+
+        // Grow the run while the chain stays physically contiguous
+        uint32_t run_start = cluster;
+        uint32_t run_sectors = spc - first_sector;
+        uint32_t next = cluster;
+        while (run_sectors * 512 < remaining) {
+            next = fat32_next_cluster(cluster);
+            if (next != cluster + 1) break;
+            cluster = next;
+            run_sectors += spc;
+        }
+
+        uint32_t bytes = run_sectors * 512;
+        if (bytes > remaining) bytes = remaining;
+
+        uint32_t lba = cluster_to_lba(run_start) + first_sector;
+        uint32_t whole = bytes / 512;
+        read_run(lba, whole, ptr, crc);
+
+        if (bytes % 512) read_tail(lba + whole, bytes % 512, ptr + whole * 512, crc);
+
+        ptr += bytes;
+        remaining -= bytes;
+        first_sector = 0;
+        cluster = next;
+    }
+    return 0;
+}
+
+// Read straight from the boot map's extents: no directory or FAT reads
+static int bootmap_read(struct fat32_load_req *req, uint32_t *crc) {
+    const struct bootmap_file *entry = req->file.map;
+    const struct bootmap_extent *ext = bootmap_extents() + entry->first_extent;
+    uint32_t skip = req->offset / 512;
+    uint32_t remaining = req->length;
+    uint8_t *ptr = (uint8_t *)req->dest;
+
+    if ((req->offset % 512) != 0 || req->offset > req->file.size ||
+        req->length > req->file.size - req->offset)
+        return -1;
+
+    for (int e = 0; e < entry->extent_count && remaining > 0; e++) {
+        if (skip >= ext[e].sectors) {
+            skip -= ext[e].sectors;
+            continue;
+        }
+        uint32_t lba = ext[e].lba + skip;
+        uint32_t sectors = ext[e].sectors - skip;
+        uint32_t whole = remaining / 512 < sectors ? remaining / 512 : sectors;
+        skip = 0;
+
+        read_run(lba, whole, ptr, crc);
+        ptr += whole * 512;
+        remaining -= whole * 512;
+        if (remaining > 0 && remaining < 512 && whole < sectors) {
+            read_tail(lba + whole, remaining, ptr, crc);
+            remaining = 0;
+        }
+    }
+    return remaining ? -1 : 0;
+}
+
+// A whole-file read from the boot map is checked against the CRC the map
+// carries. If it does not match, the map is out of date: stop using it and
+// read the file again through the directory and the FAT.
+static int bootmap_load_checked(struct fat32_load_req *req) {
+    if (g_bootmap_trusted) {
+        int whole = req->offset == 0 && req->length == req->file.size;
+        uint32_t crc = 0;
+        if (bootmap_read(req, whole ? &crc : 0) == 0 &&
+            (!whole || (crc == req->file.map->crc32c && (!req->verify || crc == req->crc32c))))
+            return 0;
+
+        klog("FS: Boot map entry for ");
+        klog(req->file.path);
+        klog(" does not match, using the FAT\n");
+        g_bootmap_trusted = 0;
+    }
+    if (fat32_open(req->file.path, &req->file) != 0) return -1;
+    return fat32_load_checked(req);
+}
+
+// The preloaded copy is split into chunks the worker pool copies and
+// checksums in parallel; the chunk CRCs are then combined in order
+#define PRELOAD_CHUNK_MIN 0x100000
+#define PRELOAD_MAX_CHUNKS 128
+
+struct preload_copy {
+    uint8_t *dest;
+    const uint8_t *src;
+    uint32_t length;
+    uint32_t chunk;
+    int verify;
+    uint32_t crc[PRELOAD_MAX_CHUNKS];
+};
+
+// parallel_for job: copy (and checksum) chunks [begin, end)
+static void preload_copy_chunks(void *ctx, uint32_t begin, uint32_t end) {
+    struct preload_copy *copy = ctx;
+    for (uint32_t i = begin; i < end; i++) {
+        uint32_t offset = i * copy->chunk;
+        uint32_t length = copy->length - offset;
+        if (length > copy->chunk) length = copy->chunk;
+        memcpy(copy->dest + offset, copy->src + offset, length);
+        if (copy->verify) copy->crc[i] = crc32c(0, copy->dest + offset, length);
+    }
+}
+
+// Copy from Stage 2's preloaded copy. A whole-file read that fails its
+// checksum drops the preload and reads the file from disk instead.
+static int preload_load(struct fat32_load_req *req) {
+    if (req->offset > req->file.size || req->length > req->file.size - req->offset)
+        return -1;
+
+    if (g_preload) {
+        static struct preload_copy copy;
+        int whole = req->offset == 0 && req->length == req->file.size;
+        copy.dest = req->dest;
+        copy.src = (const uint8_t *)(uintptr_t)req->file.preload->addr + req->offset;
+        copy.length = req->length;
+        copy.verify = req->verify && whole;
+        copy.chunk = req->length / PRELOAD_MAX_CHUNKS + 1;
+        if (copy.chunk < PRELOAD_CHUNK_MIN) copy.chunk = PRELOAD_CHUNK_MIN;
+        uint32_t chunks = (req->length + copy.chunk - 1) / copy.chunk;
+        parallel_for(chunks, 1, preload_copy_chunks, &copy);
+        if (!copy.verify) return 0;
+
+        uint32_t crc = 0;
+        for (uint32_t i = 0; i < chunks; i++) {
+            uint32_t length = req->length - i * copy.chunk;
+            if (length > copy.chunk) length = copy.chunk;
+            crc = i == 0 ? copy.crc[0] : crc32c_combine(crc, copy.crc[i], length);
+        }
+        if (crc == req->crc32c)
+            return 0;
+
+        klog("FS: Preloaded copy of ");
+        klog(req->file.path);
+        klog(" does not match, reading the disk\n");
+        g_preload = 0;
+    }
+    if (fat32_open(req->file.path, &req->file) != 0) return -1;
+    return req->file.map ? bootmap_load_checked(req) : fat32_load_checked(req);
+}
+
+int fat32_load(struct fat32_load_req *reqs, int count) {
+    int order[FAT32_MAX_PLAN];
+    if (count > FAT32_MAX_PLAN) return -1;
+
+    // Order the plan by disk position so the drive streams through it in one pass
+    for (int i = 0; i < count; i++) {
+        int j = i;
+        while (j > 0) {
+            struct fat32_load_req *prev = &reqs[order[j - 1]];
+            if (prev->file.cluster < reqs[i].file.cluster ||
+                (prev->file.cluster == reqs[i].file.cluster && prev->offset <= reqs[i].offset))
+                break;
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    for (int i = 0; i < count; i++) {
+        struct fat32_load_req *req = &reqs[order[i]];
+        int result = req->file.preload ? preload_load(req) :
+                     req->file.map ? bootmap_load_checked(req) : fat32_load_checked(req);
+        if (result == -1) {
+            vga_put_string("\nFS: Read failed for ", 0x1F);
+            vga_put_string(req->file.path, 0x1F);
+        }
+        if (result != 0) return result;
+        timeline_mark(BOOT_EV_FILE_READ, order[i]);
+    }
+    return 0;
+}
 #endif
+
+int fat32_read_file(const char *filename, void *dest) {
+    struct fat32_load_req req;
+    if (fat32_open(filename, &req.file) != 0) return -1;
+
+    req.offset = 0;
+    req.length = req.file.size;
+    req.dest = dest;
+    req.verify = 0;
+    return fat32_load(&req, 1);
+}
+
+// Run one request; when it carries a checksum, re-read the file until the
+// data matches or the retries run out (flaky media rarely fails twice)
+static int fat32_load_checked(struct fat32_load_req *req) {
+    int verify = req->verify && req->offset == 0 && req->length == req->file.size;
+
+    for (int attempt = 0;; attempt++) {
+        uint32_t crc = 0;
+        if (fat32_load_one(req, verify ? &crc : 0) != 0) return -1;
+        if (!verify || crc == req->crc32c) return 0;
+
+        if (attempt >= FAT32_VERIFY_RETRIES) {
+            vga_put_string("\nError: Checksum mismatch for ", 0x1F);
+            vga_put_string(req->file.path, 0x1F);
+            return FAT32_ERR_CHECKSUM;
+        }
+        klog("FS: Checksum mismatch for ");
+        klog(req->file.path);
+        klog(", reading it again\n");
+    }
+}
@@ -3,198 +3,213 @@
 #include "fat32.h"
 #include "disk.h"
 #include "keyboard.h"
+#include "paging.h"
+#include "pmm.h"
+#include "config.h"
+#include "timer.h"
+#include "timeline.h"
+#include "serial.h"
+#include "libk.h"
+#include "preload.h"
+#include "smp.h"
+
+#ifdef UEFI_BUILD
+#include "../boot/efi/efi.h"
+#endif
 
 #define MAX_OPTIONS 16
 
 struct menu atlas_opts;
 
-// Helper to compare strings without library functions
-static int kstrcmp(const char *s1, const char *s2)
+// Parsed config lives as long as the menu: strings and menu structures
+// each get their own arena instead of one heap block per value
+static struct arena g_config_strings;
+static struct arena g_menu_arena;
+
+// Read ATLAS.CFG through the FAT32 driver, for when the compiled config
+// that Stage 2 preferred turns out to be damaged
+static char *load_text_config(void)
 {
-    while (*s1 && (*s1 == *s2))
-    {
-        s1++;
-        s2++;
-    }
-    return *(unsigned char *)s1 - *(unsigned char *)s2;
+    struct fat32_load_req req;
+    if (fat32_open("ATLAS.CFG", &req.file) != 0) return 0;
+
+    char *buf = arena_alloc_aligned(&g_config_strings, req.file.size + 1, 1);
+    if (!buf) return 0;
+    req.offset = 0;
+    req.length = req.file.size;
+    req.dest = buf;
+    req.verify = 0;
+    if (fat32_load(&req, 1) != 0) return 0;
+
+    buf[req.file.size] = '\0';
+    return buf;
 }
 
-// Helper to check if a line starts with a string
-static int kstarts_with(const char *pref, const char *str)
+// Advance the auto-boot countdown: redraw it when the second changes, drop
+// it on any key press, boot the selected entry when it runs out
+static void countdown_step(uint32_t deadline, int *shown)
 {
-    while (*pref)
+    if (atlas_opts.timeout < 0) return;
+
+    if (g_menu_key_seen)
+    {
+        atlas_opts.timeout = -1;
+        draw_countdown(atlas_opts, -1);
+        return;
+    }
+
+    int32_t left = (int32_t)(deadline - timer_ms());
+    if (left <= 0)
     {
-        if (*pref++ != *str++)
-            return 0;
+        atlas_opts.timeout = -1;
+        draw_countdown(atlas_opts, -1);
+        menu_boot_selected(0);
+        return;
+    }
+
+    int seconds = (left + 999) / 1000;
+    if (seconds != *shown)
+    {
+        *shown = seconds;
+        draw_countdown(atlas_opts, seconds);
     }
-    return 1;
 }
 
 void kmain(char *config_addr, struct fat32_bpb *bpb)
 {
+#ifndef UEFI_BUILD
+    timeline_init(); // efi_main does this on UEFI
+#endif
+    timeline_mark(BOOT_EV_KMAIN, 0);
     vga_init();
+    serial_init();
+    klog("Atlas: Stage 2 running\n");
+#ifndef UEFI_BUILD
+    libk_init(); // efi_main does this on UEFI
+#endif
+#ifndef UEFI_BUILD
+    pmm_init();
+#endif
     kheap_init();
     fat32_init(bpb);
+#ifndef UEFI_BUILD
+    fat32_use_preload((const struct preload_table *)PRELOAD_ADDR);
+#endif
+    timeline_mark(BOOT_EV_FAT32_INIT, 0);
 
-    vga_clear_screen(VGA_DEFAULT_ATTR);
-    draw_box(0, 0, g_vga_width, g_vga_height, VGA_DEFAULT_ATTR);
+    timer_init();
+#ifndef UEFI_BUILD
+    smp_init();
+#endif
+
+    arena_init(&g_config_strings, 1024);
+    arena_init(&g_menu_arena, sizeof(struct menu_entry) * MAX_OPTIONS);
 
-    char *title = "The Atlas Bootloader";
-    struct menu_entry *entries = kmalloc(sizeof(struct menu_entry) * MAX_OPTIONS);
+    struct menu_entry *entries = arena_alloc(&g_menu_arena, sizeof(struct menu_entry) * MAX_OPTIONS);
     if (!entries) {
         // Heap exhausted - use minimal fallback
         vga_put_string("Error: Out of memory!", VGA_DEFAULT_ATTR);
         for (;;);
     }
-    int entry_count = 0;
 
-    if (config_addr != 0)
+    struct menu parsed;
+    parsed.entries = entries;
+    parsed.title = "The Atlas Bootloader";
+    parsed.length = 0;
+    parsed.selected = 0;
+    parsed.timeout = -1;
+    parsed.console = 0;
+    parsed.fallback = -1;
+    const char *warning = 0;
+
+    // A compiled config is used in place; only text configs are parsed
+    if (config_blob_detect(config_addr))
     {
-        char *line = config_addr;
-        while (*line)
+        if (config_blob_load(config_addr, CONFIG_MAX_SIZE, &parsed, MAX_OPTIONS) != 0)
         {
-            // Skip leading whitespace/newlines
-            while (*line && (*line == ' ' || *line == '\n' || *line == '\r' || *line == '\t'))
-                line++;
-            
-            if (!*line) break;
-
-            char *line_start = line;
-            while (*line && *line != '\n' && *line != '\r')
-                line++;
-            
-            char save = *line;
-            *line = '\0';
-
-            // Clean trailing spaces in the line
-            char *end = line - 1;
-            while (end > line_start && *end == ' ') {
-                *end = '\0';
-                end--;
-            }
-
-            if (kstarts_with("[menu]", line_start))
-            {
-                // Title parsing logic
-            }
-            else if (kstarts_with("[entry]", line_start))
-            {
-                if (entry_count < MAX_OPTIONS)
-                {
-                    entries[entry_count].name = "Unknown Entry";
-                    entries[entry_count].kernel_path = "";
-                    entry_count++;
-                }
-            }
-            else if (kstarts_with("name=", line_start))
-            {
-                if (entry_count > 0)
-                {
-                    char *val = line_start + 5;
-                    int len = 0;
-                    while(val[len]) len++;
-                    char *name = kmalloc(len + 1);
-                    for (int i = 0; i < len; i++) name[i] = val[i];
-                    name[len] = '\0';
-                    entries[entry_count - 1].name = name;
-                }
-            }
-            else if (kstarts_with("title=", line_start))
-            {
-                char *val = line_start + 6;
-                int len = 0;
-                while(val[len]) len++;
-                title = kmalloc(len + 1);
-                for (int i = 0; i < len; i++) title[i] = val[i];
-                title[len] = '\0';
-            }
-            else
-            {
-                int is_kernel = 0;
-                char *val = 0;
-
-                // Priority Check: Arch-specific key
-#ifdef UEFI_BUILD
-                if (kstarts_with("kernel_x64=", line_start)) {
-                    is_kernel = 1;
-                    val = line_start + 11;
-                }
-#else
-                if (kstarts_with("kernel_x86=", line_start)) {
-                    is_kernel = 1;
-                    val = line_start + 11;
-                }
-#endif
-
-                // Fallback: Generic key
-                if (!is_kernel && kstarts_with("kernel=", line_start)) {
-                    is_kernel = 1;
-                    val = line_start + 7;
-                }
-
-                if (is_kernel && entry_count > 0)
-                {
-                    int len = 0;
-                    while(val[len]) len++;
-                    char *path = kmalloc(len + 1);
-                    for (int i = 0; i < len; i++) path[i] = val[i];
-                    path[len] = '\0';
-                    entries[entry_count - 1].kernel_path = path;
-                }
-            }
-
-            *line = save;
-            if (*line) line++;
+            warning = "Warning: ATLAS.BIN is damaged, using ATLAS.CFG";
+            config_addr = load_text_config();
         }
-    }
-
-    if (entry_count > 0)
-    {
-        // Filter out entries with no valid kernel path for this architecture
-        int valid_count = 0;
-        for (int i = 0; i < entry_count; i++) {
-            if (entries[i].kernel_path && entries[i].kernel_path[0] != '\0') {
-                // Keep this entry
-                if (valid_count != i) {
-                    entries[valid_count] = entries[i];
-                }
-                valid_count++;
-            }
+        else
+        {
+            config_addr = 0;
         }
-        entry_count = valid_count;
     }
 
-    if (entry_count == 0)
+    if (config_addr != 0)
+        config_parse_text(config_addr, &parsed, MAX_OPTIONS, &g_config_strings);
+
+    if (parsed.length == 0)
     {
         entries[0].name = "No valid entries for this mode";
         entries[0].kernel_path = "";
-        entry_count = 1;
+        entries[0].cmdline = "";
+        entries[0].long_mode = 0;
+        entries[0].module_count = 0;
+        parsed.length = 1;
+        parsed.timeout = -1; // Nothing to boot
+        parsed.fallback = -1;
     }
 
-    atlas_opts.entries = entries;
-    atlas_opts.length = entry_count;
-    atlas_opts.selected = 0;
-    atlas_opts.title = title;
+    atlas_opts = parsed;
+    if (atlas_opts.selected >= atlas_opts.length) atlas_opts.selected = 0;
+    if (atlas_opts.console && serial_present())
+        g_console = atlas_opts.console;
+    timeline_mark(BOOT_EV_CONFIG, atlas_opts.length);
 
-    draw_menu(atlas_opts);
+    // timeout=0: straight to the kernel without drawing the menu
+    if (atlas_opts.timeout == 0)
+    {
+        menu_boot_selected(1);
+
+        // Still here: the load failed. Leave the error up, then show the menu.
+        uint32_t shown_at = timer_ms();
+        while (timer_ms() - shown_at < 3000)
+            ;
+        atlas_opts.timeout = -1;
+    }
+
+    vga_clear_screen(VGA_DEFAULT_ATTR);
+    draw_box(0, 0, g_vga_width, g_vga_height, VGA_DEFAULT_ATTR);
+    if (warning) vga_put_string(warning, VGA_DEFAULT_ATTR);
 
     draw_menu(atlas_opts);
+    timeline_mark(BOOT_EV_MENU, 0);
+
+    uint32_t deadline = timer_ms() + (uint32_t)atlas_opts.timeout * 1000;
+    int shown = -1;
 
 #ifdef UEFI_BUILD
-    // UEFI Polling Loop
+    // Sleep until a key arrives or the next tick (countdown, serial line)
+    EFI_BOOT_SERVICES *bs = g_SystemTable->BootServices;
+    EFI_EVENT events[2] = { g_SystemTable->ConIn->WaitForKey, 0 };
+    UINTN event_count = 1;
+    if (bs->CreateEvent(EVT_TIMER, TPL_CALLBACK, 0, 0, &events[1]) == 0 &&
+        bs->SetTimer(events[1], TimerPeriodic, 10000000 / TIMER_HZ) == 0)
+        event_count = 2;
+
     while (1) {
-        int scancode = uefi_get_scancode();
-        if (scancode != 0) {
-            keyboard_handler_c((uint8_t)scancode);
-        }
-        // Optional: Stall to prevent 100% CPU usage if desired, but not strictly necessary for bootloader
-        // g_SystemTable->BootServices->Stall(50000); // 50ms
+        UINTN index;
+        bs->WaitForEvent(event_count, events, &index);
+        menu_poll();
+        serial_poll();
+        countdown_step(deadline, &shown);
     }
 #else
-    // Legacy BIOS Interrupt Wait
-    __asm__ __volatile__ ("sti");
-
+    // Legacy BIOS: sleep until an interrupt (key, TIMER_HZ tick, COM1).
+    // STI delays interrupts by one instruction, so an IRQ that arrives
+    // after the queue check still ends the HLT.
     for (;;)
-        ;
+    {
+        __asm__ __volatile__ ("cli");
+        if (keyboard_pending())
+            __asm__ __volatile__ ("sti");
+        else
+            __asm__ __volatile__ ("sti; hlt");
+
+        menu_poll();
+        serial_poll();
+        countdown_step(deadline, &shown);
+    }
 #endif
 }
@@ -2,6 +2,18 @@
 #include "vga.h"
 #include "fat32.h"
 #include "port.h"
+#include "mem.h"
+#include "bootinfo.h"
+#include "linux.h"
+#include "paging.h"
+#include "config.h"
+#include "timeline.h"
+#include "serial.h"
+#include "libk.h"
+#ifndef UEFI_BUILD
+#include "pmm.h"
+#include "smp.h"
+#endif
 
 extern struct menu atlas_opts;
 
@@ -23,250 +35,465 @@ int uefi_get_scancode() {
         
         // Use UnicodeChar for Enter
         if (key.UnicodeChar == 0x0D) return 0x1C; // Enter
+        if (key.UnicodeChar == 't' || key.UnicodeChar == 'T') return 0x14;
+        if (key.UnicodeChar == 'b' || key.UnicodeChar == 'B') return 0x30;
+        if (key.UnicodeChar) return 0x39; // Any other key (as Space)
     }
     return 0;
 }
 #endif
 
+// Undo the placement of the first count requests of a failed plan
+static void release_plan(struct fat32_load_req *reqs, int count)
+{
+    for (int i = 0; i < count; i++)
+        krelease((uintptr_t)reqs[i].dest, reqs[i].length);
+}
+
+// Resolve, place and read an entry's kernel and modules as one load plan.
+// The kernel goes to load_addr; every module starts on the next page
+// boundary above the kernel (and above the boot info block). 64-bit
+// kernels get 2 MB alignment so each module starts on a large page.
+static int load_entry(struct menu_entry *entry, uintptr_t load_addr)
+{
+    struct fat32_load_req reqs[1 + MAX_MODULES];
+    struct boot_info *info = (struct boot_info *)BOOT_INFO_ADDR;
+    int count = 1 + entry->module_count;
+    uintptr_t align = entry->long_mode ? LARGE_PAGE_SIZE : PAGE_SIZE;
+
+    // Look every file up before any data is read
+    for (int i = 0; i < count; i++)
+    {
+        const char *path = (i == 0) ? entry->kernel_path : entry->modules[i - 1];
+        if (fat32_open(path, &reqs[i].file) != 0)
+        {
+            vga_put_string("\nError: File not found: ", 0x1F);
+            vga_put_string(path, 0x1F);
+            return -1;
+        }
+        timeline_mark(BOOT_EV_FILE_OPEN, i);
+        reqs[i].offset = 0;
+        reqs[i].length = reqs[i].file.size;
+        reqs[i].verify = config_find_checksum(path, &reqs[i].crc32c) == 0;
+    }
+
+    // Linux bzImages are handed over through the x86 boot protocol
+    if (linux_detect(&reqs[0].file))
+        return linux_boot(entry, reqs, count);
+
+    uintptr_t kernel_end = load_addr + reqs[0].length;
+    if (load_addr < BOOT_INFO_ADDR + BOOT_INFO_SIZE && kernel_end > BOOT_INFO_ADDR)
+    {
+        vga_put_string("\nError: Kernel overlaps the boot info block!", 0x1F);
+        return -1;
+    }
+
+    uintptr_t next = kernel_end;
+    if (next < BOOT_INFO_ADDR + BOOT_INFO_SIZE)
+        next = BOOT_INFO_ADDR + BOOT_INFO_SIZE;
+
+    for (int i = 0; i < count; i++)
+    {
+        uintptr_t addr = load_addr;
+        if (i == 0 ? kreserve(addr, reqs[i].length) != 0
+                   : (addr = kplace(next, reqs[i].length, align)) == 0)
+        {
+            vga_put_string("\nError: No room to load ", 0x1F);
+            vga_put_string(reqs[i].file.path, 0x1F);
+            release_plan(reqs, i);
+            return -1;
+        }
+        reqs[i].dest = (void *)addr;
+        if (i > 0)
+            next = addr + reqs[i].length;
+    }
+
+    info->mmap_count = 0;
+    info->cpu_count = 0;
+    info->mod_count = count - 1;
+    for (int i = 1; i < count; i++)
+    {
+        info->mods[i - 1].start = (uintptr_t)reqs[i].dest;
+        info->mods[i - 1].size = reqs[i].length;
+    }
+
+    uint32_t len = strlen(entry->cmdline);
+    if (len > BOOT_INFO_CMDLINE_MAX - 1) len = BOOT_INFO_CMDLINE_MAX - 1;
+    memcpy(info->cmdline_buf, entry->cmdline, len);
+    info->cmdline_buf[len] = '\0';
+    info->cmdline = len ? (uintptr_t)info->cmdline_buf : 0;
+
+    int result = fat32_load(reqs, count);
+    if (result != 0)
+        release_plan(reqs, count);
+    return result;
+}
+
+volatile int g_menu_key_seen;
+static int g_info_shown; // Timeline or benchmark screen instead of the menu
+
+static void menu_redraw(void)
+{
+    vga_clear_screen(VGA_DEFAULT_ATTR);
+    draw_box(0, 0, g_vga_width, g_vga_height, VGA_DEFAULT_ATTR);
+    draw_menu(atlas_opts);
+}
+
+// Scancodes from IRQ1 (the only producer) waiting for the menu loop (the
+// only consumer). Each side owns one index, so neither needs a lock.
+#define KEY_QUEUE_SIZE 32
+
+static volatile uint8_t g_key_queue[KEY_QUEUE_SIZE];
+static volatile uint32_t g_key_head; // Written by the ISR
+static volatile uint32_t g_key_tail; // Written by the menu loop
+static int g_menu_dirty;
+
+// BIOS IRQ1: queue the scancode and get out
 void keyboard_handler_c(uint8_t scancode)
 {
     if (atlas_opts.entries == 0) return;
+    if (g_key_head - g_key_tail >= KEY_QUEUE_SIZE) return; // Full: drop
+
+    g_key_queue[g_key_head % KEY_QUEUE_SIZE] = scancode;
+    g_key_head++;
+}
+
+int keyboard_pending(void)
+{
+    return g_key_head != g_key_tail;
+}
+
+// Next scancode from the keyboard or the serial line, 0 if none
+static int next_scancode(void)
+{
+#ifdef UEFI_BUILD
+    int scancode = uefi_get_scancode();
+    if (scancode) return scancode;
+#else
+    if (g_key_head != g_key_tail)
+    {
+        uint8_t scancode = g_key_queue[g_key_tail % KEY_QUEUE_SIZE];
+        g_key_tail++;
+        return scancode;
+    }
+#endif
+    return serial_get_scancode();
+}
+
+// Apply one key to the menu state. Returns 1 if the rest of the batch
+// should wait (the screen no longer shows the menu).
+static int menu_key(uint8_t scancode)
+{
+    if (!(scancode & 0x80))
+        g_menu_key_seen = 1; // Any key press stops the auto-boot countdown
+
+    if (g_info_shown)
+    { // Any key leaves the info screen
+        if (!(scancode & 0x80))
+        {
+            g_info_shown = 0;
+            g_menu_dirty = 0;
+            menu_redraw();
+        }
+        return 0;
+    }
 
     if (scancode == 0x48)
     { // up arrow
         if (atlas_opts.selected > 0)
             atlas_opts.selected--;
-        draw_menu(atlas_opts);
+        g_menu_dirty = 1;
     }
     else if (scancode == 0x50)
     { // down arrow
         if (atlas_opts.selected < atlas_opts.length - 1)
             atlas_opts.selected++;
-        draw_menu(atlas_opts);
+        g_menu_dirty = 1;
     }
     else if (scancode == 0x1C)
     { // enter
+        g_menu_dirty = 0;
+        menu_boot_selected(0);
+        return 1;
+    }
+    else if (scancode == 0x14)
+    { // T: boot timeline
+        g_info_shown = 1;
+        g_menu_dirty = 0;
+        timeline_show();
+        return 1;
+    }
+    else if (scancode == 0x30)
+    { // B: libk variant benchmark
+        g_info_shown = 1;
+        g_menu_dirty = 0;
+        libk_bench();
+        return 1;
+    }
+    return 0;
+}
+
+// Apply every key that arrived since the last call, then redraw once: the
+// repeats of a held arrow key cost one draw_menu instead of one each
+void menu_poll(void)
+{
+    if (atlas_opts.entries == 0) return;
+
+    int scancode;
+    while ((scancode = next_scancode()) != 0)
+        if (menu_key((uint8_t)scancode)) break;
+
+    if (g_menu_dirty)
+    {
+        g_menu_dirty = 0;
+        draw_menu(atlas_opts);
+    }
+}
+
+// Load and enter the selected entry. quiet skips the loading screen (the
+// timeout=0 path never draws anything unless something goes wrong).
+void menu_boot_selected(int quiet)
+{
+    timeline_mark(BOOT_EV_SELECTED, atlas_opts.selected);
+    if (!quiet)
+    {
         vga_clear_screen(0x1F); // Blue screen
         vga_put_string("Loading kernel: ", 0x1F);
         vga_put_string(atlas_opts.entries[atlas_opts.selected].kernel_path, 0x1F);
         vga_put_string("...", 0x1F);
+    }
 
-        void *load_addr = (void *)0x100000;
-        int success = 0;
-        uint64_t fb_base = 0xB8000; // Default to VGA text mode address for BIOS
+    // 64-bit kernels load at 2MB (0x200000) - a standard, large-page aligned
+    // load address. 32-bit kernels keep the classic 1MB.
+    int long_mode = atlas_opts.entries[atlas_opts.selected].long_mode;
+    void *load_addr = long_mode ? (void *)LARGE_PAGE_SIZE : (void *)0x100000;
+    uint64_t fb_base = 0xB8000; // Default to VGA text mode address for BIOS
 
-#ifdef UEFI_BUILD
-        // UEFI: Try to allocate at 2MB (0x200000) - a standard load address
-        if (g_SystemTable && g_SystemTable->BootServices) {
-            UINTN pAddr = 0x200000;
-            // Allocate enough pages for kernel (256 pages = 1MB)
-            EFI_STATUS status = g_SystemTable->BootServices->AllocatePages(
-                AllocateAddress, 
-                1,  // EfiLoaderCode
-                256,
-                &pAddr
-            );
-            
-            if (status == 0) {
-                load_addr = (void*)pAddr;
-                success = (fat32_read_file(atlas_opts.entries[atlas_opts.selected].kernel_path, (void*)pAddr) == 0);
-            } else {
-                vga_put_string("\nUEFI Error: 0x200000 occupied. Cannot load kernel.", 0x1F);
-                return;
-            }
-        }
-#else
-        // BIOS: Memory map assumed available at 0x100000
-        success = (fat32_read_file(atlas_opts.entries[atlas_opts.selected].kernel_path, load_addr) == 0);
-#endif
+    int result = load_entry(&atlas_opts.entries[atlas_opts.selected], (uintptr_t)load_addr);
 
-        if (!success)
-        {
-            vga_put_string("\nError: Could not load file!", 0x1F);
-            return;
-        }
+    // Corrupt data never runs: fall back to the entry the config names
+    if (result == FAT32_ERR_CHECKSUM && atlas_opts.fallback >= 0 && atlas_opts.fallback != atlas_opts.selected)
+    {
+        vga_put_string("\nBooting the fallback entry instead", 0x1F);
+        atlas_opts.selected = atlas_opts.fallback;
+        atlas_opts.fallback = -1;
+        menu_boot_selected(quiet);
+        return;
+    }
+
+    int success = (result == 0);
+
+    if (!success)
+    {
+        vga_put_string("\nError: Could not load file!", 0x1F);
+        return;
+    }
 
+    if (!quiet)
         vga_put_string("\nExecuting...", 0x1F);
-        
+    
 #ifdef UEFI_BUILD
-        // Get Framebuffer Info via GOP
-        EFI_GUID gop_guid = EFI_GRAPHICS_OUTPUT_PROTOCOL_GUID;
-        EFI_GRAPHICS_OUTPUT_PROTOCOL *gop = NULL;
+    // Get Framebuffer Info via GOP
+    EFI_GUID gop_guid = EFI_GRAPHICS_OUTPUT_PROTOCOL_GUID;
+    EFI_GRAPHICS_OUTPUT_PROTOCOL *gop = NULL;
+    
+    EFI_STATUS gop_status = g_SystemTable->BootServices->LocateProtocol(&gop_guid, NULL, (void**)&gop);
+    if (gop_status == 0 && gop && gop->Mode) {
+        fb_base = gop->Mode->FrameBufferBase;
         
-        EFI_STATUS gop_status = g_SystemTable->BootServices->LocateProtocol(&gop_guid, NULL, (void**)&gop);
-        if (gop_status == 0 && gop && gop->Mode) {
-            fb_base = gop->Mode->FrameBufferBase;
-            
-            // Store GOP info at a known location (0x1F0000) for kernel
-            struct {
-                uint64_t fb_base;
-                uint32_t width;
-                uint32_t height;
-                uint32_t pitch;  // Pixels per scanline
-            } *boot_info = (void*)0x1F0000;
-            
-            boot_info->fb_base = gop->Mode->FrameBufferBase;
-            boot_info->width = gop->Mode->Info->HorizontalResolution;
-            boot_info->height = gop->Mode->Info->VerticalResolution;
-            boot_info->pitch = gop->Mode->Info->PixelsPerScanLine;
-            
-            // Debug: verify values before printing
-            uint32_t actual_width = gop->Mode->Info->HorizontalResolution;
-            uint32_t actual_height = gop->Mode->Info->VerticalResolution;
-            
-            vga_put_string("\n[UEFI] Framebuffer at 0x", 0x1F);
-            
-            // Print framebuffer address
-            char hex[] = "0123456789ABCDEF";
-            for(int k = 60; k >= 0; k -= 4) {
-                if (k < 28 && ((fb_base >> k) == 0)) continue;
-                char c[2] = { hex[(fb_base >> k) & 0xF], 0 };
-                vga_put_string(c, 0x1F);
-            }
-            
-            // Print resolution
-            vga_put_string("\n[UEFI] Resolution: ", 0x1F);
-            
-            // Print width
-            uint32_t w = boot_info->width;
-            char w_buf[16];
-            int w_len = 0;
-            
-            // Convert to string
-            if (w == 0) {
-                w_buf[w_len++] = '0';
-            } else {
-                uint32_t temp = w;
-                int start = 0;
-                while (temp > 0) {
-                    w_buf[w_len++] = '0' + (temp % 10);
-                    temp /= 10;
-                }
-                // Reverse
-                for (int i = 0; i < w_len / 2; i++) {
-                    char t = w_buf[i];
-                    w_buf[i] = w_buf[w_len - 1 - i];
-                    w_buf[w_len - 1 - i] = t;
-                }
-            }
-            w_buf[w_len] = 0;
-            vga_put_string(w_buf, 0x1F);
-            
-            vga_put_string(" x ", 0x1F);
-            
-            // Print height
-            uint32_t h = boot_info->height;
-            char h_buf[16];
-            int h_len = 0;
-            
-            if (h == 0) {
-                h_buf[h_len++] = '0';
-            } else {
-                uint32_t temp = h;
-                while (temp > 0) {
-                    h_buf[h_len++] = '0' + (temp % 10);
-                    temp /= 10;
-                }
-                // Reverse
-                for (int i = 0; i < h_len / 2; i++) {
-                    char t = h_buf[i];
-                    h_buf[i] = h_buf[h_len - 1 - i];
-                    h_buf[h_len - 1 - i] = t;
-                }
-            }
-            h_buf[h_len] = 0;
-            vga_put_string(h_buf, 0x1F);
-            
-            vga_put_string(" (pitch: ", 0x1F);
-            
-            // Print pitch
-            uint32_t p = boot_info->pitch;
-            char p_buf[16];
-            int p_len = 0;
-            
-            if (p == 0) {
-                p_buf[p_len++] = '0';
-            } else {
-                uint32_t temp = p;
-                while (temp > 0) {
-                    p_buf[p_len++] = '0' + (temp % 10);
-                    temp /= 10;
-                }
-                // Reverse
-                for (int i = 0; i < p_len / 2; i++) {
-                    char t = p_buf[i];
-                    p_buf[i] = p_buf[p_len - 1 - i];
-                    p_buf[p_len - 1 - i] = t;
-                }
-            }
-            p_buf[p_len] = 0;
-            vga_put_string(p_buf, 0x1F);
-            vga_put_string(")", 0x1F);
-        } else {
-            vga_put_string("\n[UEFI] Warning: GOP not available, passing VGA address", 0x1F);
-            fb_base = 0xB8000;
-        }
+        // Store GOP info in the boot info block for kernel
+        struct boot_info *boot_info = (struct boot_info *)BOOT_INFO_ADDR;
+        
+        boot_info->fb_base = gop->Mode->FrameBufferBase;
+        boot_info->width = gop->Mode->Info->HorizontalResolution;
+        boot_info->height = gop->Mode->Info->VerticalResolution;
+        boot_info->pitch = gop->Mode->Info->PixelsPerScanLine;
+        
+        // Debug: verify values before printing
+        uint32_t actual_width = gop->Mode->Info->HorizontalResolution;
+        uint32_t actual_height = gop->Mode->Info->VerticalResolution;
         
-        vga_put_string("\n[UEFI] Jumping to kernel (Boot Services still active)...", 0x1F);
+        vga_put_string("\n[UEFI] Framebuffer at 0x", 0x1F);
         
-        // Debug: Show where we're jumping
-        vga_put_string("\n[UEFI] Entry point: 0x", 0x1F);
+        // Print framebuffer address
         char hex[] = "0123456789ABCDEF";
-        uint64_t addr = (uint64_t)load_addr;
         for(int k = 60; k >= 0; k -= 4) {
-            if (k < 28 && ((addr >> k) == 0)) continue;
-            char c[2] = { hex[(addr >> k) & 0xF], 0 };
+            if (k < 28 && ((fb_base >> k) == 0)) continue;
+            char c[2] = { hex[(fb_base >> k) & 0xF], 0 };
             vga_put_string(c, 0x1F);
         }
         
-        // Debug: Show first 16 bytes at entry point
-        vga_put_string("\n[UEFI] First bytes: ", 0x1F);
-        unsigned char *bytes = (unsigned char*)load_addr;
-        for (int i = 0; i < 16; i++) {
-            char b[3] = { hex[bytes[i] >> 4], hex[bytes[i] & 0xF], ' ' };
-            vga_put_string(b, 0x1F);
-        }
-        
-        // Delay to see message
-        for (volatile int i = 0; i < 50000000; i++);
+        // Print resolution
+        vga_put_string("\n[UEFI] Resolution: ", 0x1F);
         
-        // Disable interrupts before jumping
-        __asm__ volatile("cli");
+        // Print width
+        uint32_t w = boot_info->width;
+        char w_buf[16];
+        int w_len = 0;
         
-        vga_put_string("\n[DEBUG] About to jump...", 0x1F);
-        for (volatile int i = 0; i < 50000000; i++);  // Long delay
+        // Convert to string
+        if (w == 0) {
+            w_buf[w_len++] = '0';
+        } else {
+            uint32_t temp = w;
+            int start = 0;
+            while (temp > 0) {
+                w_buf[w_len++] = '0' + (temp % 10);
+                temp /= 10;
+            }
+            // Reverse
+            for (int i = 0; i < w_len / 2; i++) {
+                char t = w_buf[i];
+                w_buf[i] = w_buf[w_len - 1 - i];
+                w_buf[w_len - 1 - i] = t;
+            }
+        }
+        w_buf[w_len] = 0;
+        vga_put_string(w_buf, 0x1F);
         
-        // Jump to kernel with framebuffer address (using existing stack)
-        void (*kernel_entry)(uint64_t) = (void (*)(uint64_t))load_addr;
+        vga_put_string(" x ", 0x1F);
         
-        // Test: Can we call a simple function pointer?
-        // Try calling with inline asm instead
-        __asm__ volatile(
-            "mov %0, %%rdi\n"        // First arg in RDI
-            "call *%1\n"             // Call kernel
-            "int3\n"                 // Breakpoint if we return
-            :
-            : "r"(fb_base), "r"((uint64_t)kernel_entry)
-            : "rdi", "memory"
-        );
+        // Print height
+        uint32_t h = boot_info->height;
+        char h_buf[16];
+        int h_len = 0;
         
-        vga_put_string("\n[DEBUG] Returned from jump!", 0x1F);
+        if (h == 0) {
+            h_buf[h_len++] = '0';
+        } else {
+            uint32_t temp = h;
+            while (temp > 0) {
+                h_buf[h_len++] = '0' + (temp % 10);
+                temp /= 10;
+            }
+            // Reverse
+            for (int i = 0; i < h_len / 2; i++) {
+                char t = h_buf[i];
+                h_buf[i] = h_buf[h_len - 1 - i];
+                h_buf[h_len - 1 - i] = t;
+            }
+        }
+        h_buf[h_len] = 0;
+        vga_put_string(h_buf, 0x1F);
         
-        // If we get here, kernel returned (shouldn't happen)
-        __asm__ volatile("sti"); // Re-enable for error display
-        vga_put_string("\n[UEFI] Error: Kernel returned!", 0x1F);
-        while(1) __asm__("hlt");
-#else
-        // BIOS: Disable interrupts and jump to kernel
-        __asm__ volatile("cli");
+        vga_put_string(" (pitch: ", 0x1F);
         
-        void (*kernel_entry)(uint64_t) = (void (*)(uint64_t))load_addr;
-        kernel_entry(fb_base);
+        // Print pitch
+        uint32_t p = boot_info->pitch;
+        char p_buf[16];
+        int p_len = 0;
         
-        // If kernel returns
-        __asm__ volatile("sti");
-        vga_put_string("\nError: Kernel returned!", 0x1F);
-        while(1) __asm__("hlt");
-#endif
+        if (p == 0) {
+            p_buf[p_len++] = '0';
+        } else {
+            uint32_t temp = p;
+            while (temp > 0) {
+                p_buf[p_len++] = '0' + (temp % 10);
+                temp /= 10;
+            }
+            // Reverse
+            for (int i = 0; i < p_len / 2; i++) {
+                char t = p_buf[i];
+                p_buf[i] = p_buf[p_len - 1 - i];
+                p_buf[p_len - 1 - i] = t;
+            }
+        }
+        p_buf[p_len] = 0;
+        vga_put_string(p_buf, 0x1F);
+        vga_put_string(")", 0x1F);
+    } else {
+        vga_put_string("\n[UEFI] Warning: GOP not available, passing VGA address", 0x1F);
+        fb_base = 0xB8000;
     }
-}
\ No newline at end of file
+    
+    vga_put_string("\n[UEFI] Jumping to kernel (Boot Services still active)...", 0x1F);
+    
+    // Debug: Show where we're jumping
+    vga_put_string("\n[UEFI] Entry point: 0x", 0x1F);
+    char hex[] = "0123456789ABCDEF";
+    uint64_t addr = (uint64_t)load_addr;
+    for(int k = 60; k >= 0; k -= 4) {
+        if (k < 28 && ((addr >> k) == 0)) continue;
+        char c[2] = { hex[(addr >> k) & 0xF], 0 };
+        vga_put_string(c, 0x1F);
+    }
+    
+    // Debug: Show first 16 bytes at entry point
+    vga_put_string("\n[UEFI] First bytes: ", 0x1F);
+    unsigned char *bytes = (unsigned char*)load_addr;
+    for (int i = 0; i < 16; i++) {
+        char b[3] = { hex[bytes[i] >> 4], hex[bytes[i] & 0xF], ' ' };
+        vga_put_string(b, 0x1F);
+    }
+    
+    // Delay to see message
+    for (volatile int i = 0; i < 50000000; i++);
+    
+    // Disable interrupts before jumping
+    __asm__ volatile("cli");
+
+    timeline_mark(BOOT_EV_JUMP, 0);
+    timeline_export((struct boot_info *)BOOT_INFO_ADDR);
+    timeline_log();
+    serial_flush();
+    
+    vga_put_string("\n[DEBUG] About to jump...", 0x1F);
+    for (volatile int i = 0; i < 50000000; i++);  // Long delay
+    
+    // Jump to kernel with framebuffer address (using existing stack)
+    void (*kernel_entry)(uint64_t) = (void (*)(uint64_t))load_addr;
+    
+    // Test: Can we call a simple function pointer?
+    // Try calling with inline asm instead
+    __asm__ volatile(
+        "mov %0, %%rdi\n"        // First arg in RDI
+        "call *%1\n"             // Call kernel
+        "int3\n"                 // Breakpoint if we return
+        :
+        : "r"(fb_base), "r"((uint64_t)kernel_entry)
+        : "rdi", "memory"
+    );
+    
+    vga_put_string("\n[DEBUG] Returned from jump!", 0x1F);
+    
+    // If we get here, kernel returned (shouldn't happen)
+    __asm__ volatile("sti"); // Re-enable for error display
+    vga_put_string("\n[UEFI] Error: Kernel returned!", 0x1F);
+    while(1) __asm__("hlt");
+#else
+    // BIOS: Describe the VGA text buffer, disable interrupts and jump to kernel
+    struct boot_info *boot_info = (struct boot_info *)BOOT_INFO_ADDR;
+    boot_info->fb_base = fb_base;
+    boot_info->width = LEGACY_WIDTH;
+    boot_info->height = LEGACY_HEIGHT;
+    boot_info->pitch = LEGACY_WIDTH;
+    pmm_export_map(boot_info);
+    smp_export(boot_info);
+
+    // The page tables are the pool's last job; then the APs go back to
+    // waiting for a SIPI, which is how the kernel expects to find them
+    uint32_t pml4 = long_mode ? paging_build_identity() : 0;
+    smp_park();
+
+    __asm__ volatile("cli");
+
+    timeline_mark(BOOT_EV_JUMP, 0);
+    timeline_export(boot_info);
+    timeline_log();
+    serial_flush();
+
+    if (long_mode)
+    {
+        // Same calling convention as UEFI: RDI = fb_base (RSI = boot info)
+        long_mode_enter(pml4, (uint32_t)load_addr, (uint32_t)fb_base, BOOT_INFO_ADDR);
+    }
+
+    void (*kernel_entry)(uint64_t) = (void (*)(uint64_t))load_addr;
+    kernel_entry(fb_base);
+    
+    // If kernel returns
+    __asm__ volatile("sti");
+    vga_put_string("\nError: Kernel returned!", 0x1F);
+    while(1) __asm__("hlt");
+#endif
+}
@@ -0,0 +1,553 @@
+// libk.c
+// Memory and string routines with one variant per instruction set. The
+// vector variants are inline assembly in functions compiled for that
+// target only, so nothing else in the loader ever touches SSE/AVX state.
+#include "libk.h"
+#include "cpu.h"
+#include "mem.h"
+#include "vga.h"
+#include "serial.h"
+
+#ifdef __x86_64__
+#define WORD_SUFFIX "q"
+#else
+#define WORD_SUFFIX "l"
+#endif
+
+#define HAS_SSE2 0x1
+#define HAS_AVX2 0x2
+#define HAS_ERMS 0x4
+
+static int g_features;
+
+typedef void *(*copy_fn)(void *, const void *, size_t);
+typedef void *(*set_fn)(void *, int, size_t);
+
+// ---------------------------------------------------------------- copies
+
+// Portable: machine words with REP MOVS, then the odd bytes
+static void *copy_generic(void *dst, const void *src, size_t n)
+{
+    void *d = dst;
+    size_t words = n / sizeof(uintptr_t);
+    size_t bytes = n % sizeof(uintptr_t);
+    __asm__ volatile("rep movs" WORD_SUFFIX "\n\t"
+                     "mov %3, %2\n\t"
+                     "rep movsb"
+                     : "+D"(d), "+S"(src), "+c"(words)
+                     : "r"(bytes)
+                     : "memory");
+    return dst;
+}
+
+// Enhanced REP MOVSB: microcode picks the chunk size and handles alignment
+static void *copy_erms(void *dst, const void *src, size_t n)
+{
+    void *d = dst;
+    __asm__ volatile("rep movsb" : "+D"(d), "+S"(src), "+c"(n) : : "memory");
+    return dst;
+}
+
+__attribute__((target("sse2"))) static void *copy_sse2(void *dst, const void *src, size_t n)
+{
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    size_t blocks = n / 64;
+
+    if (blocks)
+        __asm__ volatile("1:\n\t"
+                         "movdqu (%1), %%xmm0\n\t"
+                         "movdqu 16(%1), %%xmm1\n\t"
+                         "movdqu 32(%1), %%xmm2\n\t"
+                         "movdqu 48(%1), %%xmm3\n\t"
+                         "movdqu %%xmm0, (%0)\n\t"
+                         "movdqu %%xmm1, 16(%0)\n\t"
+                         "movdqu %%xmm2, 32(%0)\n\t"
+                         "movdqu %%xmm3, 48(%0)\n\t"
+                         "add $64, %0\n\t"
+                         "add $64, %1\n\t"
+                         "dec %2\n\t"
+                         "jnz 1b"
+                         : "+r"(d), "+r"(s), "+r"(blocks)
+                         :
+                         : "xmm0", "xmm1", "xmm2", "xmm3", "memory");
+    copy_erms(d, s, n % 64);
+    return dst;
+}
+
+__attribute__((target("avx2"))) static void *copy_avx2(void *dst, const void *src, size_t n)
+{
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    size_t blocks = n / 128;
+
+    if (blocks)
+        __asm__ volatile("1:\n\t"
+                         "vmovdqu (%1), %%ymm0\n\t"
+                         "vmovdqu 32(%1), %%ymm1\n\t"
+                         "vmovdqu 64(%1), %%ymm2\n\t"
+                         "vmovdqu 96(%1), %%ymm3\n\t"
+                         "vmovdqu %%ymm0, (%0)\n\t"
+                         "vmovdqu %%ymm1, 32(%0)\n\t"
+                         "vmovdqu %%ymm2, 64(%0)\n\t"
+                         "vmovdqu %%ymm3, 96(%0)\n\t"
+                         "add $128, %0\n\t"
+                         "add $128, %1\n\t"
+                         "dec %2\n\t"
+                         "jnz 1b\n\t"
+                         "vzeroupper"
+                         : "+r"(d), "+r"(s), "+r"(blocks)
+                         :
+                         : "xmm0", "xmm1", "xmm2", "xmm3", "memory");
+    copy_erms(d, s, n % 128);
+    return dst;
+}
+
+// ------------------------------------------------------------------ fills
+
+static void *set_generic(void *dst, int c, size_t n)
+{
+    void *d = dst;
+    uintptr_t pattern = (uint8_t)c * (~(uintptr_t)0 / 0xFF); // c in every byte
+    size_t words = n / sizeof(uintptr_t);
+    size_t bytes = n % sizeof(uintptr_t);
+    __asm__ volatile("rep stos" WORD_SUFFIX "\n\t"
+                     "mov %3, %1\n\t"
+                     "rep stosb"
+                     : "+D"(d), "+c"(words), "+a"(pattern)
+                     : "r"(bytes)
+                     : "memory");
+    return dst;
+}
+
+static void *set_erms(void *dst, int c, size_t n)
+{
+    void *d = dst;
+    __asm__ volatile("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+    return dst;
+}
+
+__attribute__((target("sse2"))) static void *set_sse2(void *dst, int c, size_t n)
+{
+    uint8_t *d = (uint8_t *)dst;
+    uint32_t pattern = (uint8_t)c * 0x01010101u;
+    size_t blocks = n / 64;
+
+    if (blocks)
+        __asm__ volatile("movd %2, %%xmm0\n\t"
+                         "pshufd $0, %%xmm0, %%xmm0\n\t"
+                         "1:\n\t"
+                         "movdqu %%xmm0, (%0)\n\t"
+                         "movdqu %%xmm0, 16(%0)\n\t"
+                         "movdqu %%xmm0, 32(%0)\n\t"
+                         "movdqu %%xmm0, 48(%0)\n\t"
+                         "add $64, %0\n\t"
+                         "dec %1\n\t"
+                         "jnz 1b"
+                         : "+r"(d), "+r"(blocks)
+                         : "r"(pattern)
+                         : "xmm0", "memory");
+    set_erms(d, c, n % 64);
+    return dst;
+}
+
+__attribute__((target("avx2"))) static void *set_avx2(void *dst, int c, size_t n)
+{
+    uint8_t *d = (uint8_t *)dst;
+    uint32_t pattern = (uint8_t)c * 0x01010101u;
+    size_t blocks = n / 128;
+
+    if (blocks)
+        __asm__ volatile("vmovd %2, %%xmm0\n\t"
+                         "vpbroadcastd %%xmm0, %%ymm0\n\t"
+                         "1:\n\t"
+                         "vmovdqu %%ymm0, (%0)\n\t"
+                         "vmovdqu %%ymm0, 32(%0)\n\t"
+                         "vmovdqu %%ymm0, 64(%0)\n\t"
+                         "vmovdqu %%ymm0, 96(%0)\n\t"
+                         "add $128, %0\n\t"
+                         "dec %1\n\t"
+                         "jnz 1b\n\t"
+                         "vzeroupper"
+                         : "+r"(d), "+r"(blocks)
+                         : "r"(pattern)
+                         : "xmm0", "memory");
+    set_erms(d, c, n % 128);
+    return dst;
+}
+
+// Streaming stores for large clears: the lines go straight to memory
+// instead of evicting the loader's working set
+__attribute__((target("sse2"))) static void *set_sse2_nt(void *dst, int c, size_t n)
+{
+    uint8_t *d = (uint8_t *)dst;
+    size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+    if (head > n) head = n;
+    set_erms(d, c, head);
+    d += head;
+    n -= head;
+
+    uint32_t pattern = (uint8_t)c * 0x01010101u;
+    size_t blocks = n / 64;
+    if (blocks)
+        __asm__ volatile("movd %2, %%xmm0\n\t"
+                         "pshufd $0, %%xmm0, %%xmm0\n\t"
+                         "1:\n\t"
+                         "movntdq %%xmm0, (%0)\n\t"
+                         "movntdq %%xmm0, 16(%0)\n\t"
+                         "movntdq %%xmm0, 32(%0)\n\t"
+                         "movntdq %%xmm0, 48(%0)\n\t"
+                         "add $64, %0\n\t"
+                         "dec %1\n\t"
+                         "jnz 1b\n\t"
+                         "sfence"
+                         : "+r"(d), "+r"(blocks)
+                         : "r"(pattern)
+                         : "xmm0", "memory");
+    set_erms(d, c, n % 64);
+    return dst;
+}
+
+// ------------------------------------------------------ compares, lengths
+
+static int cmp_generic(const void *a, const void *b, size_t n)
+{
+    const uint8_t *x = (const uint8_t *)a;
+    const uint8_t *y = (const uint8_t *)b;
+    for (; n; n--, x++, y++)
+        if (*x != *y) return *x - *y;
+    return 0;
+}
+
+// 16 bytes per step; the first block that differs is finished bytewise
+__attribute__((target("sse2"))) static int cmp_sse2(const void *a, const void *b, size_t n)
+{
+    const uint8_t *x = (const uint8_t *)a;
+    const uint8_t *y = (const uint8_t *)b;
+
+    for (; n >= 16; n -= 16, x += 16, y += 16)
+    {
+        uint32_t mask;
+        __asm__("movdqu (%1), %%xmm0\n\t"
+                "movdqu (%2), %%xmm1\n\t"
+                "pcmpeqb %%xmm1, %%xmm0\n\t"
+                "pmovmskb %%xmm0, %0"
+                : "=r"(mask)
+                : "r"(x), "r"(y), "m"(*(const uint8_t(*)[16])x), "m"(*(const uint8_t(*)[16])y)
+                : "xmm0", "xmm1");
+        if (mask != 0xFFFF)
+        {
+            int i = __builtin_ctz(~mask);
+            return x[i] - y[i];
+        }
+    }
+    return cmp_generic(x, y, n);
+}
+
+static size_t len_generic(const char *s)
+{
+    const char *p = s;
+    while (*p) p++;
+    return p - s;
+}
+
+// Aligned 16-byte loads never cross into an unmapped page
+__attribute__((target("sse2"))) static size_t len_sse2(const char *s)
+{
+    uintptr_t p = (uintptr_t)s & ~(uintptr_t)15;
+    uint32_t mask;
+
+    __asm__("pxor %%xmm0, %%xmm0\n\t"
+            "pcmpeqb (%1), %%xmm0\n\t"
+            "pmovmskb %%xmm0, %0"
+            : "=r"(mask)
+            : "r"(p), "m"(*(const char(*)[16])p)
+            : "xmm0");
+    mask >>= (uintptr_t)s & 15;
+    if (mask) return __builtin_ctz(mask);
+
+    for (;;)
+    {
+        p += 16;
+        __asm__("pxor %%xmm0, %%xmm0\n\t"
+                "pcmpeqb (%1), %%xmm0\n\t"
+                "pmovmskb %%xmm0, %0"
+                : "=r"(mask)
+                : "r"(p), "m"(*(const char(*)[16])p)
+                : "xmm0");
+        if (mask) return p - (uintptr_t)s + __builtin_ctz(mask);
+    }
+}
+
+// -------------------------------------------------------------- dispatch
+
+static copy_fn g_copy = copy_generic;
+static set_fn g_set = set_generic;
+static int (*g_cmp)(const void *, const void *, size_t) = cmp_generic;
+static size_t (*g_len)(const char *) = len_generic;
+static const char *g_copy_name = "rep movs";
+static const char *g_set_name = "rep stos";
+static int g_nt; // Large memsets stream
+
+static const struct
+{
+    const char *name;
+    int needs;
+    copy_fn fn;
+} g_copy_variants[] = {
+    { "rep movs", 0, copy_generic },
+    { "sse2", HAS_SSE2, copy_sse2 },
+    { "avx2", HAS_AVX2, copy_avx2 },
+    { "erms", HAS_ERMS, copy_erms },
+};
+
+static const struct
+{
+    const char *name;
+    int needs;
+    set_fn fn;
+} g_set_variants[] = {
+    { "rep stos", 0, set_generic },
+    { "sse2", HAS_SSE2, set_sse2 },
+    { "avx2", HAS_AVX2, set_avx2 },
+    { "erms", HAS_ERMS, set_erms },
+    { "sse2 nt", HAS_SSE2, set_sse2_nt },
+};
+
+#define COPY_VARIANTS (int)(sizeof(g_copy_variants) / sizeof(g_copy_variants[0]))
+#define SET_VARIANTS (int)(sizeof(g_set_variants) / sizeof(g_set_variants[0]))
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+    return g_copy(dst, src, n);
+}
+
+void *memmove(void *dst, const void *src, size_t n)
+{
+    // Every copy variant moves upwards in whole loads before storing, so
+    // only a destination above an overlapping source needs to go backwards
+    if ((uintptr_t)dst <= (uintptr_t)src || (uintptr_t)dst >= (uintptr_t)src + n)
+        return g_copy(dst, src, n);
+
+    void *d = (uint8_t *)dst + n - 1;
+    const void *s = (const uint8_t *)src + n - 1;
+    __asm__ volatile("std\n\t"
+                     "rep movsb\n\t"
+                     "cld"
+                     : "+D"(d), "+S"(s), "+c"(n)
+                     :
+                     : "memory");
+    return dst;
+}
+
+void *memset(void *dst, int c, size_t n)
+{
+    if (g_nt && n >= LIBK_NT_THRESHOLD) return set_sse2_nt(dst, c, n);
+    return g_set(dst, c, n);
+}
+
+int memcmp(const void *a, const void *b, size_t n)
+{
+    return g_cmp(a, b, n);
+}
+
+size_t strlen(const char *s)
+{
+    return g_len(s);
+}
+
+int strcmp(const char *a, const char *b)
+{
+    while (*a && *a == *b)
+    {
+        a++;
+        b++;
+    }
+    return *(const unsigned char *)a - *(const unsigned char *)b;
+}
+
+#ifndef UEFI_BUILD
+#define CR0_MP (1u << 1)
+#define CR0_EM (1u << 2)
+#define CR4_OSFXSR (1u << 9)
+#define CR4_OSXMMEXCPT (1u << 10)
+#define CR4_OSXSAVE (1u << 18)
+
+// Stage 2 leaves CR0/CR4 as the BIOS set them: SSE instructions fault
+static void enable_simd(uint32_t ecx)
+{
+    uint32_t cr0, cr4;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    __asm__ volatile("mov %0, %%cr0" : : "r"((cr0 & ~CR0_EM) | CR0_MP));
+
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    if ((ecx & CPUID_XSAVE) && (ecx & CPUID_AVX)) cr4 |= CR4_OSXSAVE;
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
+
+    if (cr4 & CR4_OSXSAVE)
+    {
+        uint64_t xcr0 = xgetbv(0) | 1 | XCR0_SSE | XCR0_AVX;
+        __asm__ volatile("xsetbv" : : "a"((uint32_t)xcr0), "d"((uint32_t)(xcr0 >> 32)), "c"(0));
+    }
+}
+#endif
+
+void libk_init(void)
+{
+    uint32_t ecx = cpuid_features_ecx();
+    uint32_t ebx7 = cpuid_features7_ebx();
+
+    g_features = 0;
+    if (cpuid_features_edx() & CPUID_SSE2)
+    {
+#ifndef UEFI_BUILD
+        enable_simd(ecx);
+        ecx = cpuid_features_ecx(); // OSXSAVE now reflects CR4
+#endif
+        g_features |= HAS_SSE2;
+    }
+    if ((ecx & CPUID_OSXSAVE) && (ecx & CPUID_AVX) && (ebx7 & CPUID_7_AVX2) &&
+        (xgetbv(0) & (XCR0_SSE | XCR0_AVX)) == (XCR0_SSE | XCR0_AVX))
+        g_features |= HAS_AVX2;
+    if (ebx7 & CPUID_7_ERMS)
+        g_features |= HAS_ERMS;
+
+    // Tables run from least to most preferred: the last one supported wins
+    for (int i = 0; i < COPY_VARIANTS; i++)
+    {
+        if ((g_copy_variants[i].needs & g_features) != g_copy_variants[i].needs) continue;
+        g_copy = g_copy_variants[i].fn;
+        g_copy_name = g_copy_variants[i].name;
+    }
+    for (int i = 0; i < SET_VARIANTS - 1; i++) // Not the streaming one
+    {
+        if ((g_set_variants[i].needs & g_features) != g_set_variants[i].needs) continue;
+        g_set = g_set_variants[i].fn;
+        g_set_name = g_set_variants[i].name;
+    }
+    g_nt = (g_features & HAS_SSE2) != 0;
+
+    if (g_features & HAS_SSE2)
+    {
+        g_cmp = cmp_sse2;
+        g_len = len_sse2;
+    }
+
+    klog("libk: memcpy ");
+    klog(g_copy_name);
+    klog(", memset ");
+    klog(g_set_name);
+    klog(g_nt ? " (streaming above 256 KB)\n" : "\n");
+}
+
+#ifndef UEFI_BUILD
+void libk_init_ap(void)
+{
+    if (g_features & HAS_SSE2) enable_simd(cpuid_features_ecx());
+}
+#endif
+
+const char *libk_memcpy_variant(void)
+{
+    return g_copy_name;
+}
+
+const char *libk_memset_variant(void)
+{
+    return g_set_name;
+}
+
+// ------------------------------------------------------------- benchmark
+
+#define BENCH_SMALL 0x1000   // Stays in L1
+#define BENCH_LARGE 0x100000 // Beyond most L2s
+#define BENCH_BYTES 0x400000 // Moved per measurement
+
+// Bytes per cycle, times 100
+static uint32_t rate(uint64_t cycles)
+{
+    if (cycles == 0) return 0;
+    if (cycles > 0xFFFFFFFF) cycles = 0xFFFFFFFF;
+    return (uint32_t)(BENCH_BYTES / 16 * 100) / ((uint32_t)cycles / 16 ? (uint32_t)cycles / 16 : 1);
+}
+
+static void put_rate(uint32_t r, char attr)
+{
+    vga_put_uint(r / 100, 7, attr);
+    vga_put_string(".", attr);
+    vga_put_uint(r / 10 % 10, 1, attr);
+    vga_put_uint(r % 10, 1, attr);
+}
+
+static uint64_t time_copy(copy_fn fn, uint8_t *dst, const uint8_t *src, uint32_t size)
+{
+    fn(dst, src, size); // Warm up
+    uint64_t t0 = rdtsc();
+    for (uint32_t done = 0; done < BENCH_BYTES; done += size)
+        fn(dst, src, size);
+    return rdtsc() - t0;
+}
+
+static uint64_t time_set(set_fn fn, uint8_t *dst, uint32_t size)
+{
+    fn(dst, 0, size);
+    uint64_t t0 = rdtsc();
+    for (uint32_t done = 0; done < BENCH_BYTES; done += size)
+        fn(dst, 0, size);
+    return rdtsc() - t0;
+}
+
+static void bench_row(const char *fn_name, const char *name, int chosen, uint64_t small, uint64_t large)
+{
+    char attr = VGA_DEFAULT_ATTR;
+    int len = 0;
+    vga_put_string(fn_name, attr);
+    vga_put_string(" ", attr);
+    vga_put_string(name, attr);
+    len = strlen(fn_name) + 1 + strlen(name);
+    if (chosen)
+    {
+        vga_put_string(" *", attr);
+        len += 2;
+    }
+    while (len++ < 22) vga_put_string(" ", attr);
+    put_rate(rate(small), attr);
+    put_rate(rate(large), attr);
+    vga_put_string("\n", attr);
+}
+
+void libk_bench(void)
+{
+    char attr = VGA_DEFAULT_ATTR;
+    vga_clear_screen(attr);
+    vga_put_string("libk variants (bytes/cycle)     4 KB      1 MB\n", attr);
+
+    uint8_t *buf = kmalloc(2 * BENCH_LARGE + 64);
+    if (!buf)
+    {
+        vga_put_string("Not enough memory for the benchmark\n", attr);
+        return;
+    }
+    uint8_t *src = (uint8_t *)ALIGN_UP((uintptr_t)buf, 64);
+    uint8_t *dst = src + BENCH_LARGE;
+    set_generic(src, 0x5A, BENCH_LARGE);
+
+    for (int i = 0; i < COPY_VARIANTS; i++)
+    {
+        if ((g_copy_variants[i].needs & g_features) != g_copy_variants[i].needs) continue;
+        copy_fn fn = g_copy_variants[i].fn;
+        bench_row("memcpy", g_copy_variants[i].name, fn == g_copy,
+                  time_copy(fn, dst, src, BENCH_SMALL), time_copy(fn, dst, src, BENCH_LARGE));
+    }
+    for (int i = 0; i < SET_VARIANTS; i++)
+    {
+        if ((g_set_variants[i].needs & g_features) != g_set_variants[i].needs) continue;
+        set_fn fn = g_set_variants[i].fn;
+        bench_row("memset", g_set_variants[i].name, fn == g_set || (g_nt && fn == set_sse2_nt),
+                  time_set(fn, dst, BENCH_SMALL), time_set(fn, dst, BENCH_LARGE));
+    }
+
+    kfree(buf);
+    vga_put_string("\n* in use (streaming memset from 256 KB)\nPress any key to return to the menu", attr);
+}
@@ -0,0 +1,435 @@
+// linux.c
+// Direct boot of Linux bzImages through the x86 boot protocol
+// (Documentation/arch/x86/boot.rst). The real-mode setup code is never
+// run: Atlas fills in boot_params itself and enters the protected-mode
+// payload at its 32-bit (BIOS) or 64-bit (UEFI, BIOS kernel_x64=) entry
+// point.
+#include "linux.h"
+#include "mem.h"
+#include "e820.h"
+#include "serial.h"
+#include "libk.h"
+
+#ifdef UEFI_BUILD
+#include "../boot/efi/efi.h"
+#else
+#include "paging.h"
+#include "smp.h"
+#endif
+
+// boot_params ("zero page") fields
+#define BP_ORIG_VIDEO_MODE   0x006
+#define BP_ORIG_VIDEO_COLS   0x007
+#define BP_ORIG_VIDEO_LINES  0x00E
+#define BP_ORIG_VIDEO_ISVGA  0x00F
+#define BP_LFB_WIDTH         0x012
+#define BP_LFB_HEIGHT        0x014
+#define BP_LFB_DEPTH         0x016
+#define BP_LFB_BASE          0x018
+#define BP_LFB_SIZE          0x01C
+#define BP_LFB_LINELENGTH    0x024
+#define BP_RED_SIZE          0x026
+#define BP_CAPABILITIES      0x036
+#define BP_EXT_LFB_BASE      0x03A
+#define BP_ACPI_RSDP_ADDR    0x070
+#define BP_EFI_INFO          0x1C0
+#define BP_E820_ENTRIES      0x1E8
+#define BP_E820_TABLE        0x2D0
+#define BP_E820_MAX          128
+
+// Setup header fields (same offsets in the bzImage and in boot_params)
+#define HDR_START            0x1F1
+#define HDR_SETUP_SECTS      0x1F1
+#define HDR_JUMP             0x200
+#define HDR_MAGIC            0x202
+#define HDR_VERSION          0x206
+#define HDR_TYPE_OF_LOADER   0x210
+#define HDR_LOADFLAGS        0x211
+#define HDR_CODE32_START     0x214
+#define HDR_RAMDISK_IMAGE    0x218
+#define HDR_RAMDISK_SIZE     0x21C
+#define HDR_CMD_LINE_PTR     0x228
+#define HDR_INITRD_ADDR_MAX  0x22C
+#define HDR_XLOADFLAGS       0x236
+#define HDR_CMDLINE_SIZE     0x238
+#define HDR_PREF_ADDRESS     0x258
+#define HDR_INIT_SIZE        0x260
+
+#define HDRS_MAGIC           0x53726448 // "HdrS"
+#define LOADED_HIGH          0x01
+#define XLF_KERNEL_64        0x01
+
+#define VIDEO_TYPE_VGAC      0x22
+#define VIDEO_TYPE_EFI       0x70
+
+#define RD8(p, off)  (*(volatile uint8_t *)((uint8_t *)(p) + (off)))
+#define RD16(p, off) (*(uint16_t *)((uint8_t *)(p) + (off)))
+#define RD32(p, off) (*(uint32_t *)((uint8_t *)(p) + (off)))
+#define RD64(p, off) (*(uint64_t *)((uint8_t *)(p) + (off)))
+
+// First two sectors of the kernel: boot sector and setup header
+static uint8_t g_setup[1024];
+
+#ifndef UEFI_BUILD
+// boot2.asm: load the boot-protocol GDT and jump with ESI = boot_params
+extern void linux_enter32(uint32_t entry, uint32_t boot_params);
+#endif
+
+int linux_detect(struct fat32_file *kernel)
+{
+    struct fat32_load_req req;
+    if (kernel->size < sizeof(g_setup)) return 0;
+
+    req.file = *kernel;
+    req.offset = 0;
+    req.length = sizeof(g_setup);
+    req.dest = g_setup;
+    req.verify = 0;
+    if (fat32_load(&req, 1) != 0) return 0;
+
+    return RD32(g_setup, HDR_MAGIC) == HDRS_MAGIC &&
+           RD16(g_setup, HDR_VERSION) >= 0x0206 &&
+           (RD8(g_setup, HDR_LOADFLAGS) & LOADED_HIGH);
+}
+
+static void add_e820(uint8_t *bp, uint64_t base, uint64_t length, uint32_t type)
+{
+    uint8_t n = RD8(bp, BP_E820_ENTRIES);
+    uint8_t *prev = bp + BP_E820_TABLE + (n - 1) * 20;
+
+    // Merge with the previous range when it is adjacent and of the same type
+    if (n > 0 && RD32(prev, 16) == type && RD64(prev, 0) + RD64(prev, 8) == base)
+    {
+        RD64(prev, 8) += length;
+        return;
+    }
+    if (n >= BP_E820_MAX) return;
+
+    uint8_t *e = bp + BP_E820_TABLE + n * 20;
+    RD64(e, 0) = base;
+    RD64(e, 8) = length;
+    RD32(e, 16) = type;
+    RD8(bp, BP_E820_ENTRIES) = n + 1;
+}
+
+#ifdef UEFI_BUILD
+static uint32_t efi_to_e820(uint32_t type)
+{
+    switch (type)
+    {
+    case EfiLoaderCode:
+    case EfiLoaderData:
+    case EfiBootServicesCode:
+    case EfiBootServicesData:
+    case EfiConventionalMemory:
+        return E820_RAM;
+    case EfiACPIReclaimMemory:
+        return E820_ACPI;
+    case EfiACPIMemoryNVS:
+        return E820_NVS;
+    case EfiUnusableMemory:
+        return E820_UNUSABLE;
+    case EfiPersistentMemory:
+        return E820_PMEM;
+    default:
+        return E820_RESERVED;
+    }
+}
+
+static int guid_equal(EFI_GUID *a, EFI_GUID *b)
+{
+    return memcmp(a, b, sizeof(EFI_GUID)) == 0;
+}
+
+static void fill_screen_info(uint8_t *bp)
+{
+    EFI_GUID gop_guid = EFI_GRAPHICS_OUTPUT_PROTOCOL_GUID;
+    EFI_GRAPHICS_OUTPUT_PROTOCOL *gop = NULL;
+
+    if (g_SystemTable->BootServices->LocateProtocol(&gop_guid, NULL, (void **)&gop) != 0 ||
+        !gop || !gop->Mode || !gop->Mode->Info)
+        return;
+
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *mi = gop->Mode->Info;
+    uint64_t base = gop->Mode->FrameBufferBase;
+
+    RD8(bp, BP_ORIG_VIDEO_ISVGA) = VIDEO_TYPE_EFI;
+    RD16(bp, BP_LFB_WIDTH) = (uint16_t)mi->HorizontalResolution;
+    RD16(bp, BP_LFB_HEIGHT) = (uint16_t)mi->VerticalResolution;
+    RD16(bp, BP_LFB_DEPTH) = 32;
+    RD32(bp, BP_LFB_BASE) = (uint32_t)base;
+    RD32(bp, BP_EXT_LFB_BASE) = (uint32_t)(base >> 32);
+    if (base >> 32)
+        RD32(bp, BP_CAPABILITIES) |= 2; // VIDEO_CAPABILITY_64BIT_BASE
+    RD32(bp, BP_LFB_SIZE) = (uint32_t)gop->Mode->FrameBufferSize;
+    RD16(bp, BP_LFB_LINELENGTH) = (uint16_t)(mi->PixelsPerScanLine * 4);
+
+    // red/green/blue/reserved size and position
+    uint8_t rgb[8] = { 8, 0, 8, 8, 8, 16, 8, 24 };
+    if (mi->PixelFormat == PixelBlueGreenRedReserved8BitPerColor)
+    {
+        rgb[1] = 16;
+        rgb[5] = 0;
+    }
+    for (int i = 0; i < 8; i++)
+        RD8(bp, BP_RED_SIZE + i) = rgb[i];
+}
+
+static void fill_acpi_rsdp(uint8_t *bp)
+{
+    EFI_GUID acpi20 = EFI_ACPI_20_TABLE_GUID;
+    EFI_GUID acpi10 = EFI_ACPI_10_TABLE_GUID;
+
+    for (UINTN i = 0; i < g_SystemTable->NumberOfTableEntries; i++)
+    {
+        EFI_CONFIGURATION_TABLE *t = &g_SystemTable->ConfigurationTable[i];
+        if (guid_equal(&t->VendorGuid, &acpi20) ||
+            (guid_equal(&t->VendorGuid, &acpi10) && RD64(bp, BP_ACPI_RSDP_ADDR) == 0))
+            RD64(bp, BP_ACPI_RSDP_ADDR) = (uint64_t)t->VendorTable;
+    }
+}
+
+// Fetch the final memory map, convert it to E820 and leave boot services.
+// Nothing may be printed once this succeeds.
+static int exit_boot_services(uint8_t *bp)
+{
+    EFI_BOOT_SERVICES *bs = g_SystemTable->BootServices;
+    UINTN map_size = 0, map_key, desc_size;
+    uint32_t desc_version;
+    EFI_MEMORY_DESCRIPTOR *map = 0;
+
+    bs->GetMemoryMap(&map_size, 0, &map_key, &desc_size, &desc_version);
+    map_size += 8 * sizeof(EFI_MEMORY_DESCRIPTOR) + 512; // Room for the heap growing for it
+    map = kmalloc(map_size);
+    if (!map) return -1;
+    UINTN buf_size = map_size;
+
+    for (int attempt = 0; attempt < 4; attempt++)
+    {
+        map_size = buf_size;
+        if (bs->GetMemoryMap(&map_size, map, &map_key, &desc_size, &desc_version) != 0)
+            return -1;
+
+        RD8(bp, BP_E820_ENTRIES) = 0;
+        for (UINTN off = 0; off < map_size; off += desc_size)
+        {
+            EFI_MEMORY_DESCRIPTOR *d = (EFI_MEMORY_DESCRIPTOR *)((uint8_t *)map + off);
+            add_e820(bp, d->PhysicalStart, d->NumberOfPages * PAGE_SIZE, efi_to_e820(d->Type));
+        }
+
+        RD32(bp, BP_EFI_INFO + 0x00) = 0x34364c45; // "EL64"
+        RD32(bp, BP_EFI_INFO + 0x04) = (uint32_t)(uintptr_t)g_SystemTable;
+        RD32(bp, BP_EFI_INFO + 0x08) = (uint32_t)desc_size;
+        RD32(bp, BP_EFI_INFO + 0x0C) = desc_version;
+        RD32(bp, BP_EFI_INFO + 0x10) = (uint32_t)(uintptr_t)map;
+        RD32(bp, BP_EFI_INFO + 0x14) = (uint32_t)map_size;
+        RD32(bp, BP_EFI_INFO + 0x18) = (uint32_t)((uintptr_t)g_SystemTable >> 32);
+        RD32(bp, BP_EFI_INFO + 0x1C) = (uint32_t)((uintptr_t)map >> 32);
+
+        // A stale key means the map changed under us: fetch it again
+        if (bs->ExitBootServices(g_ImageHandle, map_key) == 0)
+            return 0;
+    }
+    return -1;
+}
+#endif
+
+int linux_boot(struct menu_entry *entry, struct fat32_load_req *reqs, int count)
+{
+    uint8_t *hdr = g_setup;
+    uint16_t version = RD16(hdr, HDR_VERSION);
+    uint8_t *bp;
+    char *cmdline;
+
+    vga_put_string("\nLinux boot protocol ", 0x1F);
+    char ver[] = { '0' + (version >> 8), '.', '0' + ((version & 0xFF) / 10), '0' + ((version & 0xFF) % 10), 0 };
+    vga_put_string(ver, 0x1F);
+
+#ifdef UEFI_BUILD
+    if (version < 0x020C || !(RD16(hdr, HDR_XLOADFLAGS) & XLF_KERNEL_64))
+    {
+        vga_put_string("\nError: Kernel has no 64-bit entry point!", 0x1F);
+        return -1;
+    }
+
+    // Zero page and command line below 4 GB (the header fields are 32-bit)
+    UINTN handoff = 0xFFFFFFFF;
+    if (g_SystemTable->BootServices->AllocatePages(AllocateMaxAddress, EfiLoaderData, 2, &handoff) != 0)
+    {
+        vga_put_string("\nError: Cannot allocate boot_params!", 0x1F);
+        return -1;
+    }
+    bp = (uint8_t *)handoff;
+    cmdline = (char *)(handoff + PAGE_SIZE);
+#else
+    bp = (uint8_t *)LINUX_BOOT_PARAMS_ADDR;
+    cmdline = (char *)LINUX_CMDLINE_ADDR;
+#endif
+
+    // Start from a zeroed boot_params holding a copy of the setup header
+    memset(bp, 0, PAGE_SIZE);
+    uint32_t hdr_end = HDR_JUMP + 2 + RD8(hdr, HDR_JUMP + 1);
+    if (hdr_end > sizeof(g_setup)) hdr_end = sizeof(g_setup);
+    memcpy(bp + HDR_START, hdr + HDR_START, hdr_end - HDR_START);
+
+    uint32_t setup_sects = RD8(hdr, HDR_SETUP_SECTS) ? RD8(hdr, HDR_SETUP_SECTS) : 4;
+    uint32_t payload_off = (setup_sects + 1) * 512;
+    if (payload_off >= reqs[0].file.size)
+    {
+        vga_put_string("\nError: Truncated bzImage!", 0x1F);
+        return -1;
+    }
+    uint32_t payload_size = reqs[0].file.size - payload_off;
+
+    // The protected-mode payload goes straight to its preferred address and
+    // decompresses in place, so it owns init_size bytes from there.
+    uintptr_t load_addr = RD32(hdr, HDR_CODE32_START);
+    uint32_t init_size = payload_size;
+    if (version >= 0x020A)
+    {
+        load_addr = (uintptr_t)RD64(hdr, HDR_PREF_ADDRESS);
+        if (RD32(hdr, HDR_INIT_SIZE) > init_size)
+            init_size = RD32(hdr, HDR_INIT_SIZE);
+    }
+
+    if (kreserve(load_addr, init_size) != 0)
+    {
+        vga_put_string("\nError: Kernel load address occupied!", 0x1F);
+        return -1;
+    }
+
+    reqs[0].offset = payload_off;
+    reqs[0].length = payload_size;
+    reqs[0].dest = (void *)load_addr;
+    reqs[0].verify = 0; // Only part of the file is read; the setup code is skipped
+
+    // initrd= and module= files are concatenated into one initramfs. The
+    // boot protocol asks for it as high as initrd_addr_max allows; kplace
+    // keeps it clear of the heap, modules and preloaded files.
+    uint32_t initrd_size = 0;
+    for (int i = 1; i < count; i++)
+    {
+        initrd_size = ALIGN_UP(initrd_size, 4);
+        reqs[i].offset = 0;
+        reqs[i].length = reqs[i].file.size;
+        initrd_size += reqs[i].length;
+    }
+
+    uintptr_t initrd_addr = 0;
+    if (initrd_size)
+    {
+        initrd_addr = kplace_below((uint64_t)RD32(hdr, HDR_INITRD_ADDR_MAX) + 1, initrd_size);
+        if (!initrd_addr)
+        {
+            vga_put_string("\nError: No room for the initrd below initrd_addr_max!", 0x1F);
+            krelease(load_addr, init_size);
+            return -1;
+        }
+        uint32_t offset = 0;
+        for (int i = 1; i < count; i++)
+        {
+            offset = ALIGN_UP(offset, 4);
+            reqs[i].dest = (void *)(initrd_addr + offset);
+            offset += reqs[i].length;
+        }
+        RD32(bp, HDR_RAMDISK_IMAGE) = (uint32_t)initrd_addr;
+        RD32(bp, HDR_RAMDISK_SIZE) = initrd_size;
+    }
+
+    // Command line (copied now: on BIOS the payload may cover the heap)
+    uint32_t cmdline_max = RD32(hdr, HDR_CMDLINE_SIZE);
+    if (cmdline_max == 0 || cmdline_max > LINUX_CMDLINE_MAX - 1)
+        cmdline_max = LINUX_CMDLINE_MAX - 1;
+    uint32_t len = strlen(entry->cmdline);
+    if (len > cmdline_max) len = cmdline_max;
+    memcpy(cmdline, entry->cmdline, len);
+    cmdline[len] = '\0';
+    RD32(bp, HDR_CMD_LINE_PTR) = (uint32_t)(uintptr_t)cmdline;
+
+    RD8(bp, HDR_TYPE_OF_LOADER) = 0xFF; // Undefined boot loader ID
+    RD32(bp, HDR_CODE32_START) = (uint32_t)load_addr;
+
+    vga_put_string("\nLoading kernel and initrd...", 0x1F);
+    int result = fat32_load(reqs, count);
+    if (result != 0)
+    {
+        krelease(load_addr, init_size);
+        if (initrd_size) krelease(initrd_addr, initrd_size);
+        return result;
+    }
+
+#ifdef UEFI_BUILD
+    fill_screen_info(bp);
+    fill_acpi_rsdp(bp);
+
+    vga_put_string("\nExiting boot services and entering Linux...", 0x1F);
+    serial_flush();
+    if (exit_boot_services(bp) != 0)
+    {
+        vga_put_string("\nError: ExitBootServices failed!", 0x1F);
+        return -1;
+    }
+
+    // 64-bit entry: startup_64 lives 0x200 bytes into the payload. The
+    // protocol wants __BOOT_CS (0x10) and __BOOT_DS (0x18) loaded.
+    static const uint64_t gdt[] = {
+        0,
+        0,
+        0x00AF9A000000FFFF, // 0x10: 64-bit code
+        0x00CF92000000FFFF, // 0x18: data
+    };
+    struct {
+        uint16_t limit;
+        uint64_t base;
+    } __attribute__((packed)) gdtr = { sizeof(gdt) - 1, (uint64_t)gdt };
+
+    __asm__ volatile(
+        "cli\n"
+        "lgdt %0\n"
+        "mov $0x18, %%eax\n"
+        "mov %%eax, %%ds\n"
+        "mov %%eax, %%es\n"
+        "mov %%eax, %%ss\n"
+        "mov %%eax, %%fs\n"
+        "mov %%eax, %%gs\n"
+        "pushq $0x10\n"
+        "lea 1f(%%rip), %%rax\n"
+        "pushq %%rax\n"
+        "lretq\n"
+        "1:\n"
+        "jmp *%1\n"
+        :
+        : "m"(gdtr), "r"((uint64_t)load_addr + 0x200), "S"(bp)
+        : "rax", "memory");
+#else
+    // E820 map collected by Stage 2
+    struct e820_map *map = (struct e820_map *)E820_MAP_ADDR;
+    for (uint32_t i = 0; i < map->count && i < E820_MAX_ENTRIES; i++)
+        add_e820(bp, map->entries[i].base, map->entries[i].length, map->entries[i].type);
+
+    // VGA text console
+    RD8(bp, BP_ORIG_VIDEO_MODE) = 3;
+    RD8(bp, BP_ORIG_VIDEO_COLS) = LEGACY_WIDTH;
+    RD8(bp, BP_ORIG_VIDEO_LINES) = LEGACY_HEIGHT;
+    RD8(bp, BP_ORIG_VIDEO_ISVGA) = VIDEO_TYPE_VGAC;
+
+    // kernel_x64= entries use the 64-bit entry point (startup_64, 0x200 past
+    // the 32-bit one) through the identity map, like the UEFI path
+    if (entry->long_mode && version >= 0x020C && (RD16(hdr, HDR_XLOADFLAGS) & XLF_KERNEL_64))
+    {
+        vga_put_string("\nEntering Linux (64-bit)...", 0x1F);
+        serial_flush();
+        uint32_t pml4 = paging_build_identity();
+        smp_park();
+        long_mode_enter(pml4, (uint32_t)load_addr + 0x200, 0, (uint32_t)bp);
+    }
+
+    // Linux brings up the APs itself and expects them in wait-for-SIPI
+    vga_put_string("\nEntering Linux (32-bit)...", 0x1F);
+    serial_flush();
+    smp_park();
+    linux_enter32((uint32_t)load_addr, (uint32_t)bp);
+#endif
+
+    return -1;
+}
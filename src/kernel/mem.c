@@ -1,72 +1,332 @@
 // mem.c
 #include "mem.h"
+#include "libk.h"
 
 #ifdef UEFI_BUILD
 #include "../boot/efi/efi.h"
 
-void kheap_init()
+// Heap memory comes from the firmware in page runs; kmalloc then carves
+// them up like the BIOS heap instead of calling AllocatePool per string
+static uintptr_t heap_pages(uint32_t pages)
 {
-    // UEFI heap is already initialized by firmware
+    if (!g_SystemTable || !g_SystemTable->BootServices) return 0;
+
+    UINTN addr = 0;
+    if (g_SystemTable->BootServices->AllocatePages(AllocateAnyPages, EfiLoaderData, pages, &addr) != 0)
+        return 0;
+    return (uintptr_t)addr;
 }
 
-void *kmalloc(uint32_t size)
+int kreserve(uintptr_t addr, uint32_t size)
 {
-    if (g_SystemTable && g_SystemTable->BootServices) {
-        void *ptr;
-        // AllocatePool(PoolType, Size, &Buffer)
-        // EfiLoaderData = 2
-        EFI_STATUS status = g_SystemTable->BootServices->AllocatePool(2, size, &ptr);
-        if (status == 0) { // EFI_SUCCESS
-            return ptr;
-        }
+    if (!g_SystemTable || !g_SystemTable->BootServices) return -1;
+
+    UINTN pAddr = addr;
+    EFI_STATUS status = g_SystemTable->BootServices->AllocatePages(
+        AllocateAddress,
+        1,  // EfiLoaderCode
+        (size + PAGE_SIZE - 1) / PAGE_SIZE,
+        &pAddr
+    );
+    return status == 0 ? 0 : -1;
+}
+
+void krelease(uintptr_t addr, uint32_t size)
+{
+    g_SystemTable->BootServices->FreePages(addr, (size + PAGE_SIZE - 1) / PAGE_SIZE);
+}
+
+uintptr_t kplace(uintptr_t min, uint32_t size, uintptr_t align)
+{
+    // Firmware owns the map: probe aligned addresses upwards from min
+    uintptr_t addr = ALIGN_UP(min, align);
+    for (int tries = 0; tries < 256; tries++, addr += align)
+    {
+        if (kreserve(addr, size) == 0) return addr;
     }
     return 0;
 }
 
-void kfree(void *ptr)
+uintptr_t kplace_below(uint64_t limit, uint32_t size)
 {
-    if (ptr && g_SystemTable && g_SystemTable->BootServices) {
-        g_SystemTable->BootServices->FreePool(ptr);
-    }
+    if (!g_SystemTable || !g_SystemTable->BootServices || limit == 0) return 0;
+
+    UINTN addr = limit - 1;
+    if (g_SystemTable->BootServices->AllocatePages(AllocateMaxAddress, 1, // EfiLoaderCode, like kreserve
+                                                   (size + PAGE_SIZE - 1) / PAGE_SIZE, &addr) != 0)
+        return 0;
+    return (uintptr_t)addr;
 }
 
 #else
+#include "pmm.h"
+
+// Heap memory is taken from the top of physical memory, clear of
+// kernel load addresses
+static uintptr_t heap_pages(uint32_t pages)
+{
+    return pmm_alloc_top(pages);
+}
+
+int kreserve(uintptr_t addr, uint32_t size)
+{
+    if (pmm_reserve(addr, size) != 0) return -1;
+    pmm_tag_kernel(addr, size);
+    return 0;
+}
+
+void krelease(uintptr_t addr, uint32_t size)
+{
+    pmm_untag_kernel(addr);
+    pmm_free(addr, size);
+}
+
+uintptr_t kplace(uintptr_t min, uint32_t size, uintptr_t align)
+{
+    uintptr_t addr = pmm_alloc(min, (size + PAGE_SIZE - 1) / PAGE_SIZE, align);
+    if (addr) pmm_tag_kernel(addr, size);
+    return addr;
+}
+
+uintptr_t kplace_below(uint64_t limit, uint32_t size)
+{
+    uintptr_t addr = pmm_alloc_below(limit, (size + PAGE_SIZE - 1) / PAGE_SIZE);
+    if (addr) pmm_tag_kernel(addr, size);
+    return addr;
+}
+#endif
+
+// Two-level segregated fit (TLSF) heap, shared by both builds.
+//
+// Free blocks are kept in one list per size class. The first level splits
+// sizes by power of two, the second level splits each power of two into
+// 16 linear steps, and a bitmap per level finds the smallest non-empty
+// class that fits with two bit scans. Every block records the block just
+// below it in memory (boundary tag), so kfree merges both neighbours in
+// constant time as well.
+
+#define BLOCK_FREE 0x1
+
+typedef struct block_header
+{
+    struct block_header *prev_phys; // Block just below this one (0 for the first)
+    uintptr_t size;                 // Payload size | BLOCK_FREE
+    // Free blocks only: links within their size class
+    struct block_header *next_free;
+    struct block_header *prev_free;
+} block_header_t;
+
+#define BLOCK_OVERHEAD (2 * sizeof(uintptr_t)) // prev_phys + size
+#define BLOCK_MIN_SIZE (2 * sizeof(uintptr_t)) // Room for the free links
+#define ALIGN_LOG2 (sizeof(uintptr_t) == 8 ? 4 : 3)
+
+#define SL_LOG2 4
+#define SL_COUNT (1 << SL_LOG2)
+#define FL_SHIFT (SL_LOG2 + ALIGN_LOG2)
+#define SMALL_BLOCK (1u << FL_SHIFT) // Below this, classes are KHEAP_ALIGN apart
+#define FL_COUNT (33 - FL_SHIFT)
+#define MAX_ALLOC 0x80000000u
+
+static block_header_t *g_blocks[FL_COUNT][SL_COUNT];
+static uint32_t g_fl_bitmap;
+static uint32_t g_sl_bitmap[FL_COUNT];
+static struct kheap_stats g_stats;
+
+static inline int fls32(uint32_t x)
+{
+    return 31 - __builtin_clz(x);
+}
+
+static inline uint32_t block_size(block_header_t *b)
+{
+    return (uint32_t)(b->size & ~(uintptr_t)BLOCK_FREE);
+}
+
+static inline block_header_t *block_next(block_header_t *b)
+{
+    return (block_header_t *)((uint8_t *)b + BLOCK_OVERHEAD + block_size(b));
+}
+
+static void mapping_insert(uint32_t size, int *fl, int *sl)
+{
+    if (size < SMALL_BLOCK)
+    {
+        *fl = 0;
+        *sl = size >> ALIGN_LOG2;
+    }
+    else
+    {
+        int f = fls32(size);
+        *sl = (size >> (f - SL_LOG2)) ^ SL_COUNT;
+        *fl = f - FL_SHIFT + 1;
+    }
+}
+
+// Class whose every block is at least size bytes
+static void mapping_search(uint32_t size, int *fl, int *sl)
+{
+    if (size >= SMALL_BLOCK)
+        size += (1u << (fls32(size) - SL_LOG2)) - 1;
+    mapping_insert(size, fl, sl);
+}
+
+static void insert_free(block_header_t *b)
+{
+    int fl, sl;
+    mapping_insert(block_size(b), &fl, &sl);
+
+    b->size |= BLOCK_FREE;
+    b->prev_free = 0;
+    b->next_free = g_blocks[fl][sl];
+    if (b->next_free) b->next_free->prev_free = b;
+    g_blocks[fl][sl] = b;
+
+    g_fl_bitmap |= 1u << fl;
+    g_sl_bitmap[fl] |= 1u << sl;
+    g_stats.free += block_size(b);
+}
+
+static void remove_free(block_header_t *b)
+{
+    int fl, sl;
+    mapping_insert(block_size(b), &fl, &sl);
+
+    if (b->prev_free) b->prev_free->next_free = b->next_free;
+    else g_blocks[fl][sl] = b->next_free;
+    if (b->next_free) b->next_free->prev_free = b->prev_free;
+
+    if (!g_blocks[fl][sl])
+    {
+        g_sl_bitmap[fl] &= ~(1u << sl);
+        if (!g_sl_bitmap[fl]) g_fl_bitmap &= ~(1u << fl);
+    }
+
+    b->size &= ~(uintptr_t)BLOCK_FREE;
+    g_stats.free -= block_size(b);
+}
+
+static block_header_t *find_free(int fl, int sl)
+{
+    uint32_t sl_map = g_sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map)
+    {
+        uint32_t fl_map = g_fl_bitmap & (~0u << (fl + 1));
+        if (!fl_map) return 0;
+        fl = __builtin_ctz(fl_map);
+        sl_map = g_sl_bitmap[fl];
+    }
+    return g_blocks[fl][__builtin_ctz(sl_map)];
+}
+
+// Hand [base, base + size) to the heap as one free block followed by a
+// zero-sized used sentinel that stops coalescing at the end of the region.
+static void kheap_add_region(uintptr_t base, uint32_t size)
+{
+    uintptr_t start = ALIGN_UP(base, KHEAP_ALIGN);
+    if (size < (start - base) + 2 * BLOCK_OVERHEAD + BLOCK_MIN_SIZE) return;
+    size -= start - base;
+
+    uint32_t payload = (size - 2 * BLOCK_OVERHEAD) & ~(uint32_t)(KHEAP_ALIGN - 1);
+
+    block_header_t *b = (block_header_t *)start;
+    b->prev_phys = 0;
+    b->size = payload;
+
+    block_header_t *sentinel = block_next(b);
+    sentinel->prev_phys = b;
+    sentinel->size = 0;
+
+    insert_free(b);
+    g_stats.total += payload + 2 * BLOCK_OVERHEAD;
+}
+
+// Add another run of at least KHEAP_GROW_SIZE bytes to the heap
+static int kheap_grow(uint32_t size)
+{
+    uint32_t bytes = ALIGN_UP(size, PAGE_SIZE);
+    if (bytes < KHEAP_GROW_SIZE) bytes = KHEAP_GROW_SIZE;
+
+    uintptr_t base = heap_pages(bytes / PAGE_SIZE);
+    if (!base) return -1;
+
+    kheap_add_region(base, bytes);
+    return 0;
+}
 
-// Legacy Implementation
 void kheap_init()
 {
-    free_list->size = HEAP_SIZE - sizeof(block_header_t);
-    free_list->free = 1;
-    free_list->next = 0;
+    static int initialized;
+    if (initialized) return; // efi_main sets the heap up before kmain runs
+    initialized = 1;
+
+    for (int fl = 0; fl < FL_COUNT; fl++)
+    {
+        g_sl_bitmap[fl] = 0;
+        for (int sl = 0; sl < SL_COUNT; sl++) g_blocks[fl][sl] = 0;
+    }
+    g_fl_bitmap = 0;
+
+    uint8_t *st = (uint8_t *)&g_stats;
+    for (uint32_t i = 0; i < sizeof(g_stats); i++) st[i] = 0;
+
+    kheap_grow(KHEAP_GROW_SIZE);
+}
+
+// Smallest-class free block that holds size bytes
+static block_header_t *find_fit(uint32_t size)
+{
+    int fl, sl;
+    mapping_search(size, &fl, &sl);
+    block_header_t *b = fl < FL_COUNT ? find_free(fl, sl) : 0;
+    if (!b)
+    {
+        // Rounding up skipped the request's own class; its blocks may still fit
+        mapping_insert(size, &fl, &sl);
+        for (b = g_blocks[fl][sl]; b && block_size(b) < size; b = b->next_free)
+            ;
+    }
+    return b;
 }
 
 void *kmalloc(uint32_t size)
 {
-    block_header_t *curr = free_list;
+    if (size > MAX_ALLOC)
+    {
+        g_stats.failed++;
+        return 0;
+    }
 
-    while (curr)
+    size = size < BLOCK_MIN_SIZE ? BLOCK_MIN_SIZE : ALIGN_UP(size, KHEAP_ALIGN);
+
+    block_header_t *b = find_fit(size);
+    if (!b && kheap_grow(size + 2 * BLOCK_OVERHEAD) == 0)
+        b = find_fit(size);
+    if (!b)
     {
-        if (curr->free && curr->size >= size)
-        {
-            // Split block if it's large enough
-            if (curr->size >= size + sizeof(block_header_t) + 1)
-            {
-                block_header_t *new_block = (block_header_t *)((uint8_t *)curr + sizeof(block_header_t) + size);
-                new_block->size = curr->size - size - sizeof(block_header_t);
-                new_block->free = 1;
-                new_block->next = curr->next;
-
-                curr->size = size;
-                curr->next = new_block;
-            }
-
-            curr->free = 0;
-            return (uint8_t *)curr + sizeof(block_header_t);
-        }
-        curr = curr->next;
+        g_stats.failed++;
+        return 0; // Out of memory
     }
+    remove_free(b);
+
+    // Split off the tail if it can hold a block of its own
+    if (block_size(b) >= size + BLOCK_OVERHEAD + BLOCK_MIN_SIZE)
+    {
+        block_header_t *rest = (block_header_t *)((uint8_t *)b + BLOCK_OVERHEAD + size);
+        rest->prev_phys = b;
+        rest->size = block_size(b) - size - BLOCK_OVERHEAD;
+        block_next(rest)->prev_phys = rest;
+        b->size = size;
+        insert_free(rest);
+    }
+
+    int fl, sl;
+    mapping_insert(size, &fl, &sl);
+    g_stats.class_allocs[fl]++;
+    g_stats.allocs++;
+    g_stats.in_use += block_size(b);
+    if (g_stats.in_use > g_stats.peak) g_stats.peak = g_stats.in_use;
 
-    return 0; // Out of memory
+    return (uint8_t *)b + BLOCK_OVERHEAD;
 }
 
 void kfree(void *ptr)
@@ -74,22 +334,128 @@ void kfree(void *ptr)
     if (!ptr)
         return;
 
-    block_header_t *block = (block_header_t *)((uint8_t *)ptr - sizeof(block_header_t));
-    block->free = 1;
+    block_header_t *block = (block_header_t *)((uint8_t *)ptr - BLOCK_OVERHEAD);
+    g_stats.in_use -= block_size(block);
+    g_stats.frees++;
 
-    // Merge adjacent free blocks
-    block_header_t *curr = free_list;
-    while (curr && curr->next)
+    // Merge with the following block
+    block_header_t *next = block_next(block);
+    if (next->size & BLOCK_FREE)
     {
-        if (curr->free && curr->next->free)
-        {
-            curr->size += sizeof(block_header_t) + curr->next->size;
-            curr->next = curr->next->next;
-        }
-        else
+        remove_free(next);
+        block->size += BLOCK_OVERHEAD + block_size(next);
+        block_next(block)->prev_phys = block;
+    }
+
+    // Merge into the preceding block
+    block_header_t *prev = block->prev_phys;
+    if (prev && (prev->size & BLOCK_FREE))
+    {
+        remove_free(prev);
+        prev->size += BLOCK_OVERHEAD + block_size(block);
+        block_next(prev)->prev_phys = prev;
+        block = prev;
+    }
+
+    insert_free(block);
+}
+
+void kheap_get_stats(struct kheap_stats *out)
+{
+    *out = g_stats;
+
+    // The largest free block lives in the highest non-empty class
+    out->largest_free = 0;
+    if (g_fl_bitmap)
+    {
+        int fl = fls32(g_fl_bitmap);
+        int sl = fls32(g_sl_bitmap[fl]);
+        for (block_header_t *b = g_blocks[fl][sl]; b; b = b->next_free)
+            if (block_size(b) > out->largest_free) out->largest_free = block_size(b);
+    }
+
+    uint32_t contiguous_pct = out->free >= 100 ? out->largest_free / (out->free / 100) : 100;
+    out->frag_pct = contiguous_pct < 100 ? 100 - contiguous_pct : 0;
+}
+
+#define CHUNK_HEADER ALIGN_UP(sizeof(struct arena_chunk), KHEAP_ALIGN)
+
+static inline uint8_t *chunk_data(struct arena_chunk *c)
+{
+    return (uint8_t *)c + CHUNK_HEADER;
+}
+
+void arena_init(struct arena *a, uint32_t chunk_size)
+{
+    a->head = 0;
+    a->chunk_size = chunk_size;
+}
+
+void *arena_alloc_aligned(struct arena *a, uint32_t size, uint32_t align)
+{
+    struct arena_chunk *c = a->head;
+
+    if (c)
+    {
+        uintptr_t pos = ALIGN_UP((uintptr_t)chunk_data(c) + c->used, align);
+        if (pos + size <= (uintptr_t)chunk_data(c) + c->size)
         {
-            curr = curr->next;
+            c->used = (uint32_t)(pos + size - (uintptr_t)chunk_data(c));
+            return (void *)pos;
         }
     }
+
+    // Start a new chunk, big enough for this request even if it is oversized
+    uint32_t need = size + (align > KHEAP_ALIGN ? align : 0);
+    uint32_t chunk = need > a->chunk_size ? need : a->chunk_size;
+    c = kmalloc(CHUNK_HEADER + chunk);
+    if (!c) return 0;
+
+    c->prev = a->head;
+    c->size = chunk;
+    c->used = 0;
+    a->head = c;
+
+    uintptr_t pos = ALIGN_UP((uintptr_t)chunk_data(c), align);
+    c->used = (uint32_t)(pos + size - (uintptr_t)chunk_data(c));
+    return (void *)pos;
+}
+
+void *arena_alloc(struct arena *a, uint32_t size)
+{
+    return arena_alloc_aligned(a, size, KHEAP_ALIGN);
+}
+
+char *arena_strdup(struct arena *a, const char *str)
+{
+    uint32_t len = strlen(str);
+    char *copy = arena_alloc_aligned(a, len + 1, 1);
+    if (!copy) return 0;
+    memcpy(copy, str, len + 1);
+    return copy;
+}
+
+struct arena_mark arena_mark(struct arena *a)
+{
+    struct arena_mark m;
+    m.chunk = a->head;
+    m.used = a->head ? a->head->used : 0;
+    return m;
+}
+
+void arena_reset(struct arena *a, struct arena_mark mark)
+{
+    while (a->head && a->head != mark.chunk)
+    {
+        struct arena_chunk *prev = a->head->prev;
+        kfree(a->head);
+        a->head = prev;
+    }
+    if (a->head) a->head->used = mark.used;
+}
+
+void arena_release(struct arena *a)
+{
+    struct arena_mark none = { 0, 0 };
+    arena_reset(a, none);
 }
-#endif
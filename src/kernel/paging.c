@@ -0,0 +1,81 @@
+// paging.c
+#include "paging.h"
+#include "cpu.h"
+#include "e820.h"
+#include "libk.h"
+#include "smp.h"
+
+#define PTE_PRESENT 0x001
+#define PTE_WRITE   0x002
+#define PTE_LARGE   0x080 // PS: 2 MB page in a PD, 1 GB page in a PDPT
+
+#define GIB_SHIFT 30
+
+int paging_long_mode_supported(void)
+{
+    return (cpuid_ext_features() & CPUID_EXT_LM) != 0;
+}
+
+// End of the highest RAM range in the E820 map
+static uint64_t ram_top(void)
+{
+    struct e820_map *map = (struct e820_map *)E820_MAP_ADDR;
+    uint64_t top = 0;
+
+    for (uint32_t i = 0; i < map->count && i < E820_MAX_ENTRIES; i++)
+    {
+        uint64_t end = map->entries[i].base + map->entries[i].length;
+        if (map->entries[i].type == E820_RAM && end > top)
+            top = end;
+    }
+    return top;
+}
+
+// parallel_for job: PDPT entries and 2 MB page directories for GBs [begin, end)
+static void fill_pds(void *ctx, uint32_t begin, uint32_t end)
+{
+    uint64_t *pdpt = ctx;
+    uint64_t *pd = pdpt + 512;
+
+    for (uint32_t g = begin; g < end; g++)
+    {
+        pdpt[g] = (uintptr_t)(pd + g * 512) | PTE_PRESENT | PTE_WRITE;
+        for (uint32_t i = 0; i < 512; i++)
+            pd[g * 512 + i] = (((uint64_t)g << GIB_SHIFT) + (uint64_t)i * LARGE_PAGE_SIZE) |
+                              PTE_PRESENT | PTE_WRITE | PTE_LARGE;
+    }
+}
+
+uint32_t paging_build_identity(void)
+{
+    uint64_t *pml4 = (uint64_t *)PAGING_AREA_ADDR;
+    uint64_t *pdpt = pml4 + 512;
+
+    // Always cover the low 4 GB so MMIO (framebuffer, APICs) is reachable
+    uint64_t top = ram_top();
+    uint32_t gigs = (uint32_t)((top + (1ull << GIB_SHIFT) - 1) >> GIB_SHIFT);
+    if (gigs < 4) gigs = 4;
+
+    memset(pml4, 0, 2 * 0x1000); // PML4 and PDPT
+
+    pml4[0] = (uintptr_t)pdpt | PTE_PRESENT | PTE_WRITE;
+
+    if (cpuid_ext_features() & CPUID_EXT_PDPE1GB)
+    {
+        // One PDPT of 1 GB pages covers 512 GB
+        if (gigs > 512) gigs = 512;
+        for (uint32_t g = 0; g < gigs; g++)
+            pdpt[g] = ((uint64_t)g << GIB_SHIFT) | PTE_PRESENT | PTE_WRITE | PTE_LARGE;
+    }
+    else
+    {
+        // One page directory of 2 MB pages per GB, as many as the area holds
+        uint32_t max_gigs = PAGING_AREA_SIZE / 0x1000 - 2;
+        if (gigs > max_gigs) gigs = max_gigs;
+
+        // Each worker fills whole page directories
+        parallel_for(gigs, 1, fill_pds, pdpt);
+    }
+
+    return (uint32_t)(uintptr_t)pml4;
+}
@@ -0,0 +1,321 @@
+// pmm.c
+#include "pmm.h"
+#include "e820.h"
+#include "mem.h"
+#include "libk.h"
+
+#define PAGE_SHIFT 12
+#define MAX_PAGES 0x100000 // 4 GB
+#define MAX_KERNEL_RANGES 16
+
+// Assumed RAM when the BIOS has no E820 support
+#define FALLBACK_RAM_END 0x1000000
+
+static uint32_t *g_bitmap;
+static uint32_t g_pages; // Pages covered by the bitmap
+static uint32_t g_free;
+
+static struct
+{
+    uint32_t first;
+    uint32_t count;
+} g_kernel[MAX_KERNEL_RANGES];
+static int g_kernel_count;
+
+static struct e820_entry g_fallback = { 0, FALLBACK_RAM_END, E820_RAM, 1 };
+
+static inline int page_used(uint32_t p)
+{
+    return (g_bitmap[p >> 5] >> (p & 31)) & 1;
+}
+
+static void mark(uint32_t first, uint32_t count, int used)
+{
+    for (uint32_t p = first; p < first + count && p < g_pages; p++)
+    {
+        if (page_used(p) == used) continue;
+        g_bitmap[p >> 5] ^= 1u << (p & 31);
+        if (used) g_free--;
+        else g_free++;
+    }
+}
+
+// Lowest used page in [first, first + count), or -1
+static int64_t lowest_used(uint32_t first, uint32_t count)
+{
+    for (uint32_t p = first; p < first + count; p++)
+    {
+        if ((p & 31) == 0 && p + 32 <= first + count && g_bitmap[p >> 5] == 0)
+        {
+            p += 31;
+            continue;
+        }
+        if (page_used(p)) return p;
+    }
+    return -1;
+}
+
+// Highest used page in [first, first + count), or -1
+static int64_t highest_used(uint32_t first, uint32_t count)
+{
+    for (uint32_t p = first + count; p-- > first;)
+    {
+        if ((p & 31) == 31 && p >= first + 31 && g_bitmap[p >> 5] == 0)
+        {
+            p -= 31;
+            continue;
+        }
+        if (page_used(p)) return p;
+    }
+    return -1;
+}
+
+static struct e820_entry *e820_entries(uint32_t *count)
+{
+    struct e820_map *map = (struct e820_map *)E820_MAP_ADDR;
+    if (map->count == 0)
+    {
+        *count = 1;
+        return &g_fallback;
+    }
+    *count = map->count < E820_MAX_ENTRIES ? map->count : E820_MAX_ENTRIES;
+    return map->entries;
+}
+
+void pmm_init(void)
+{
+    uint32_t n;
+    struct e820_entry *e = e820_entries(&n);
+
+    uint64_t top = 0;
+    for (uint32_t i = 0; i < n; i++)
+        if (e[i].type == E820_RAM && e[i].base + e[i].length > top)
+            top = e[i].base + e[i].length;
+    g_pages = top >> PAGE_SHIFT < MAX_PAGES ? (uint32_t)(top >> PAGE_SHIFT) : MAX_PAGES;
+
+    // The bitmap goes at the top of the highest RAM range that holds it
+    uint32_t bitmap_size = ALIGN_UP((g_pages + 31) / 32 * 4, PAGE_SIZE);
+    uint64_t where = 0;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (e[i].type != E820_RAM) continue;
+        uint64_t start = (e[i].base + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+        uint64_t end = (e[i].base + e[i].length) & ~(uint64_t)(PAGE_SIZE - 1);
+        if (end > (uint64_t)g_pages << PAGE_SHIFT) end = (uint64_t)g_pages << PAGE_SHIFT;
+        if (start < PMM_LOW_LIMIT) start = PMM_LOW_LIMIT;
+        if (end < start + bitmap_size) continue;
+
+        uint64_t cand = end - bitmap_size;
+        if (cand < BOOT_INFO_ADDR + BOOT_INFO_SIZE && cand + bitmap_size > BOOT_INFO_ADDR)
+            cand = BOOT_INFO_ADDR - bitmap_size;
+        if (cand >= start && cand > where) where = cand;
+    }
+    if (!where)
+    {
+        g_pages = 0;
+        return;
+    }
+    g_bitmap = (uint32_t *)(uintptr_t)where;
+
+    // Start with everything used, free the RAM ranges, then take back
+    // anything another range marks as reserved
+    memset(g_bitmap, 0xFF, bitmap_size / 4 * 4);
+    g_free = 0;
+    g_kernel_count = 0;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (e[i].type != E820_RAM) continue;
+        uint64_t first = (e[i].base + PAGE_SIZE - 1) >> PAGE_SHIFT;
+        uint64_t last = (e[i].base + e[i].length) >> PAGE_SHIFT;
+        if (first < last && first < g_pages) mark((uint32_t)first, (uint32_t)(last - first), 0);
+    }
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (e[i].type == E820_RAM) continue;
+        uint64_t first = e[i].base >> PAGE_SHIFT;
+        uint64_t last = (e[i].base + e[i].length + PAGE_SIZE - 1) >> PAGE_SHIFT;
+        if (first < last && first < g_pages) mark((uint32_t)first, (uint32_t)(last - first), 1);
+    }
+
+    mark(0, PMM_LOW_LIMIT >> PAGE_SHIFT, 1);
+    mark(BOOT_INFO_ADDR >> PAGE_SHIFT, BOOT_INFO_SIZE >> PAGE_SHIFT, 1);
+    mark((uint32_t)(where >> PAGE_SHIFT), bitmap_size >> PAGE_SHIFT, 1);
+}
+
+uintptr_t pmm_alloc(uintptr_t min, uint32_t pages, uintptr_t align)
+{
+    uint32_t step = align > PAGE_SIZE ? align >> PAGE_SHIFT : 1;
+    if (min < PMM_LOW_LIMIT) min = PMM_LOW_LIMIT;
+    uint32_t p = ALIGN_UP((min + PAGE_SIZE - 1) >> PAGE_SHIFT, step);
+
+    while (pages && p + pages <= g_pages && p + pages > p)
+    {
+        int64_t used = lowest_used(p, pages);
+        if (used < 0)
+        {
+            mark(p, pages, 1);
+            return (uintptr_t)p << PAGE_SHIFT;
+        }
+        p = ALIGN_UP((uint32_t)used + 1, step);
+    }
+    return 0;
+}
+
+uintptr_t pmm_alloc_top(uint32_t pages)
+{
+    return pmm_alloc_below((uint64_t)g_pages << PAGE_SHIFT, pages);
+}
+
+uintptr_t pmm_alloc_below(uint64_t limit, uint32_t pages)
+{
+    uint64_t top = limit >> PAGE_SHIFT;
+    if (top > g_pages) top = g_pages;
+    if (!pages || pages > top) return 0;
+    uint32_t p = (uint32_t)top - pages;
+
+    while (p >= (PMM_LOW_LIMIT >> PAGE_SHIFT))
+    {
+        int64_t used = highest_used(p, pages);
+        if (used < 0)
+        {
+            mark(p, pages, 1);
+            return (uintptr_t)p << PAGE_SHIFT;
+        }
+        if ((uint32_t)used < pages) break;
+        p = (uint32_t)used - pages;
+    }
+    return 0;
+}
+
+int pmm_reserve(uintptr_t addr, uint32_t size)
+{
+    uint32_t first = addr >> PAGE_SHIFT;
+    uint32_t count = (uint32_t)((((uint64_t)addr + size + PAGE_SIZE - 1) >> PAGE_SHIFT) - first);
+
+    if ((uint64_t)first + count > g_pages) return -1;
+    if (lowest_used(first, count) >= 0) return -1;
+    mark(first, count, 1);
+    return 0;
+}
+
+void pmm_free(uintptr_t addr, uint32_t size)
+{
+    uint32_t first = addr >> PAGE_SHIFT;
+    uint32_t count = (uint32_t)((((uint64_t)addr + size + PAGE_SIZE - 1) >> PAGE_SHIFT) - first);
+
+    if (first < (PMM_LOW_LIMIT >> PAGE_SHIFT)) return;
+    mark(first, count, 0);
+}
+
+void pmm_tag_kernel(uintptr_t addr, uint32_t size)
+{
+    if (g_kernel_count >= MAX_KERNEL_RANGES || size == 0) return;
+    g_kernel[g_kernel_count].first = addr >> PAGE_SHIFT;
+    g_kernel[g_kernel_count].count =
+        (uint32_t)((((uint64_t)addr + size + PAGE_SIZE - 1) >> PAGE_SHIFT) - (addr >> PAGE_SHIFT));
+    g_kernel_count++;
+}
+
+void pmm_untag_kernel(uintptr_t addr)
+{
+    for (int i = 0; i < g_kernel_count; i++)
+    {
+        if (g_kernel[i].first == addr >> PAGE_SHIFT)
+        {
+            g_kernel[i] = g_kernel[--g_kernel_count];
+            return;
+        }
+    }
+}
+
+uint32_t pmm_free_pages(void)
+{
+    return g_free;
+}
+
+// Type of a RAM page in the exported map; 0 if a firmware range covers it
+static uint32_t page_type(uint32_t p, struct e820_entry *e, uint32_t n)
+{
+    if (!page_used(p)) return BOOT_MEM_USABLE;
+    for (int i = 0; i < g_kernel_count; i++)
+        if (p >= g_kernel[i].first && p - g_kernel[i].first < g_kernel[i].count)
+            return BOOT_MEM_KERNEL;
+
+    uint64_t addr = (uint64_t)p << PAGE_SHIFT;
+    for (uint32_t i = 0; i < n; i++)
+        if (e[i].type != E820_RAM && addr + PAGE_SIZE > e[i].base && addr < e[i].base + e[i].length)
+            return 0;
+    return BOOT_MEM_LOADER;
+}
+
+static void emit(struct boot_info *info, uint64_t base, uint64_t length, uint32_t type)
+{
+    if (length == 0) return;
+
+    if (info->mmap_count)
+    {
+        struct boot_mmap_entry *last = &info->mmap[info->mmap_count - 1];
+        if (last->type == type && last->base + last->length == base)
+        {
+            last->length += length;
+            return;
+        }
+    }
+    if (info->mmap_count >= BOOT_INFO_MAX_MMAP) return;
+
+    struct boot_mmap_entry *m = &info->mmap[info->mmap_count++];
+    m->base = base;
+    m->length = length;
+    m->type = type;
+    m->reserved = 0;
+}
+
+void pmm_export_map(struct boot_info *info)
+{
+    uint32_t n;
+    struct e820_entry *e = e820_entries(&n);
+
+    info->mmap_count = 0;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (e[i].type != E820_RAM)
+        {
+            emit(info, e[i].base, e[i].length, e[i].type);
+            continue;
+        }
+
+        // RAM the bitmap covers is split by what the loader did with it
+        uint64_t end = e[i].base + e[i].length;
+        uint64_t first = (e[i].base + PAGE_SIZE - 1) >> PAGE_SHIFT;
+        uint64_t last = end >> PAGE_SHIFT;
+        if (last > g_pages) last = g_pages;
+
+        for (uint64_t p = first; p < last;)
+        {
+            uint32_t type = page_type((uint32_t)p, e, n);
+            uint64_t q = p + 1;
+            while (q < last && page_type((uint32_t)q, e, n) == type) q++;
+            if (type) emit(info, p << PAGE_SHIFT, (q - p) << PAGE_SHIFT, type);
+            p = q;
+        }
+
+        uint64_t above = (uint64_t)g_pages << PAGE_SHIFT;
+        if (end > above)
+            emit(info, e[i].base > above ? e[i].base : above, end - (e[i].base > above ? e[i].base : above),
+                 BOOT_MEM_USABLE);
+    }
+
+    // E820 order is up to the BIOS; hand the kernel a sorted map
+    for (uint32_t i = 1; i < info->mmap_count; i++)
+    {
+        struct boot_mmap_entry tmp = info->mmap[i];
+        uint32_t j = i;
+        while (j > 0 && info->mmap[j - 1].base > tmp.base)
+        {
+            info->mmap[j] = info->mmap[j - 1];
+            j--;
+        }
+        info->mmap[j] = tmp;
+    }
+}
@@ -0,0 +1,247 @@
+// serial.c
+// COM1 log and console. Writers copy into a ring buffer and return; the
+// UART is fed 16 bytes (one FIFO load) at a time by whoever finds the
+// transmitter empty: the writer itself, the idle loop, or on BIOS the
+// COM1 transmit interrupt.
+#include "serial.h"
+#include "port.h"
+
+// 16550 registers (offsets from SERIAL_COM1)
+#define UART_DATA 0
+#define UART_IER  1 // Interrupt enable (DLAB=0), divisor high (DLAB=1)
+#define UART_FCR  2 // FIFO control (write), interrupt ID (read)
+#define UART_LCR  3
+#define UART_MCR  4
+#define UART_LSR  5
+
+#define IER_THRE  0x02
+#define LSR_DR    0x01
+#define LSR_THRE  0x20
+#define FIFO_SIZE 16
+
+#define RING_MASK (SERIAL_RING_SIZE - 1)
+
+int g_console = CONSOLE_VGA;
+
+static char g_ring[SERIAL_RING_SIZE];
+static volatile uint32_t g_head; // Next byte to queue
+static volatile uint32_t g_tail; // Next byte to send
+static volatile int g_draining;
+static int g_present = -1; // -1 until serial_init has run
+
+// Serial side of the mirrored screen
+static int g_row = -1, g_col = -1;
+static int g_inverse;
+
+// Several contexts queue bytes (the menu loop, and on BIOS the keyboard
+// interrupt), so the copy runs with interrupts off. It never waits.
+static inline uint32_t irq_save(void)
+{
+#ifdef UEFI_BUILD
+    return 0;
+#else
+    uint32_t flags;
+    __asm__ volatile("pushfl; popl %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+#endif
+}
+
+static inline void irq_restore(uint32_t flags)
+{
+#ifdef UEFI_BUILD
+    (void)flags;
+#else
+    if (flags & 0x200) __asm__ volatile("sti" : : : "memory");
+#endif
+}
+
+int serial_init(void)
+{
+    if (g_present >= 0) return g_present ? 0 : -1;
+
+    uint16_t divisor = 115200 / SERIAL_BAUD;
+    outb(SERIAL_COM1 + UART_IER, 0x00);
+    outb(SERIAL_COM1 + UART_LCR, 0x80); // DLAB
+    outb(SERIAL_COM1 + UART_DATA, divisor & 0xFF);
+    outb(SERIAL_COM1 + UART_IER, divisor >> 8);
+    outb(SERIAL_COM1 + UART_LCR, 0x03); // 8N1
+    outb(SERIAL_COM1 + UART_FCR, 0xC7); // FIFOs on and cleared, 14-byte RX trigger
+
+    // Loopback test: a missing UART reads back 0xFF
+    outb(SERIAL_COM1 + UART_MCR, 0x1E);
+    outb(SERIAL_COM1 + UART_DATA, 0xAE);
+    g_present = inb(SERIAL_COM1 + UART_DATA) == 0xAE;
+    if (!g_present) return -1;
+
+    outb(SERIAL_COM1 + UART_MCR, 0x0B); // DTR, RTS, OUT2 (IRQ line)
+#ifndef UEFI_BUILD
+    outb(0x21, inb(0x21) & ~0x10); // IRQ4
+#endif
+    return 0;
+}
+
+int serial_present(void)
+{
+    return g_present > 0;
+}
+
+void serial_poll(void)
+{
+    if (g_present <= 0) return;
+    if (__atomic_exchange_n(&g_draining, 1, __ATOMIC_ACQUIRE)) return;
+
+    if (inb(SERIAL_COM1 + UART_LSR) & LSR_THRE)
+    {
+        uint32_t tail = g_tail;
+        for (int n = 0; n < FIFO_SIZE && tail != g_head; n++, tail++)
+            outb(SERIAL_COM1 + UART_DATA, g_ring[tail & RING_MASK]);
+        g_tail = tail;
+    }
+
+    __atomic_store_n(&g_draining, 0, __ATOMIC_RELEASE);
+}
+
+#ifndef UEFI_BUILD
+void serial_irq_c(void)
+{
+    inb(SERIAL_COM1 + UART_FCR); // Interrupt ID: acknowledges THRE
+    serial_poll();
+    if (g_tail == g_head)
+        outb(SERIAL_COM1 + UART_IER, 0x00);
+}
+#endif
+
+static void enqueue(char c)
+{
+    if (g_head - g_tail >= SERIAL_RING_SIZE) return;
+    g_ring[g_head & RING_MASK] = c;
+    g_head++;
+}
+
+static void queue_string(const char *s)
+{
+    uint32_t flags = irq_save();
+    for (; *s; s++)
+    {
+        if (*s == '\n') enqueue('\r');
+        enqueue(*s);
+    }
+#ifndef UEFI_BUILD
+    // The transmit interrupt keeps the FIFO fed while interrupts are on
+    outb(SERIAL_COM1 + UART_IER, IER_THRE);
+#endif
+    irq_restore(flags);
+}
+
+void serial_write(const char *s)
+{
+    if (g_present <= 0) return;
+    queue_string(s);
+    serial_poll();
+}
+
+void serial_flush(void)
+{
+    // Bounded: a UART that stops transmitting must not hang the boot
+    for (uint32_t spins = 0; g_present > 0 && g_tail != g_head && spins < 10000000; spins++)
+        serial_poll();
+}
+
+void klog(const char *s)
+{
+    serial_write(s);
+    g_row = -1; // Log text moves the serial cursor
+}
+
+static void put_number(char *buf, int *len, int n)
+{
+    char digits[4];
+    int count = 0;
+    do {
+        digits[count++] = '0' + n % 10;
+        n /= 10;
+    } while (n && count < 4);
+    while (count) buf[(*len)++] = digits[--count];
+}
+
+void serial_put_cell(char c, char attr, int row, int col)
+{
+    if (g_present <= 0) return;
+
+    char buf[24];
+    int len = 0;
+
+    if (row != g_row || col != g_col)
+    {
+        buf[len++] = 0x1B;
+        buf[len++] = '[';
+        put_number(buf, &len, row + 1);
+        buf[len++] = ';';
+        put_number(buf, &len, col + 1);
+        buf[len++] = 'H';
+    }
+
+    // Light background (the selected entry) is shown in reverse video
+    int inverse = (attr & 0x70) == 0x70;
+    if (inverse != g_inverse)
+    {
+        buf[len++] = 0x1B;
+        buf[len++] = '[';
+        buf[len++] = inverse ? '7' : '0';
+        buf[len++] = 'm';
+        g_inverse = inverse;
+    }
+
+    // CP437 box drawing has no portable terminal equivalent
+    switch ((unsigned char)c)
+    {
+        case 0xC9: case 0xBB: case 0xC8: case 0xBC: c = '+'; break;
+        case 0xCD: c = '-'; break;
+        case 0xBA: c = '|'; break;
+    }
+    buf[len++] = (c >= 0x20 && c < 0x7F) ? c : ' ';
+    buf[len] = '\0';
+
+    queue_string(buf);
+    serial_poll();
+    g_row = row;
+    g_col = col + 1;
+}
+
+void serial_clear(void)
+{
+    if (g_present <= 0) return;
+    serial_write("\x1B[0m\x1B[2J\x1B[H");
+    g_row = 0;
+    g_col = 0;
+    g_inverse = 0;
+}
+
+int serial_get_scancode(void)
+{
+    static int escape; // 0: none, 1: ESC seen, 2: ESC [ seen
+
+    while (g_present > 0 && (inb(SERIAL_COM1 + UART_LSR) & LSR_DR))
+    {
+        char c = inb(SERIAL_COM1 + UART_DATA);
+        if (escape == 1)
+        {
+            escape = c == '[' ? 2 : 0;
+            continue;
+        }
+        if (escape == 2)
+        {
+            escape = 0;
+            if (c == 'A') return 0x48; // Up
+            if (c == 'B') return 0x50; // Down
+            continue;
+        }
+
+        if (c == 0x1B) escape = 1;
+        else if (c == '\r' || c == '\n') return 0x1C;
+        else if (c == 't' || c == 'T') return 0x14;
+        else if (c == 'b' || c == 'B') return 0x30;
+        else return 0x39; // Any other key (as Space)
+    }
+    return 0;
+}
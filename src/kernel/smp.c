@@ -0,0 +1,368 @@
+// smp.c
+// Application processor bring-up (Intel SDM vol. 3, 8.4.4 and chapter 10)
+// and the boot-time worker pool that runs on them.
+#include "smp.h"
+#include "acpi.h"
+#include "bootinfo.h"
+#include "cpu.h"
+#include "libk.h"
+#include "mem.h"
+#include "pmm.h"
+#include "serial.h"
+#include "timer.h"
+#include "timeline.h"
+#include "vga.h"
+
+#define LAPIC_ID 0x020
+#define LAPIC_EOI 0x0B0
+#define LAPIC_SVR 0x0F0
+#define LAPIC_ICR_LO 0x300
+#define LAPIC_ICR_HI 0x310
+
+#define LAPIC_SVR_ENABLE 0x100
+
+#define ICR_FIXED 0x000
+#define ICR_INIT 0x500
+#define ICR_STARTUP 0x600
+#define ICR_PENDING 0x1000 // xAPIC only: previous IPI not sent yet
+#define ICR_ASSERT 0x4000
+#define ICR_LEVEL 0x8000
+
+#define MSR_APIC_BASE 0x1B
+#define APIC_BASE_EXTD (1u << 10) // x2APIC mode: registers are MSRs
+#define APIC_BASE_EN (1u << 11)
+#define X2APIC_MSR(reg) (0x800 + ((reg) >> 4))
+
+// boot2.asm: real-mode code that loads the GDT and enters ap_pm_entry,
+// which takes the next stack above smp_ap_stacks and calls smp_ap_main
+extern const uint8_t smp_trampoline[];
+extern const uint8_t smp_trampoline_end[];
+extern uint32_t smp_ap_stacks;
+extern uint32_t smp_ap_limit;
+extern volatile uint32_t smp_ap_next;
+
+static volatile uint32_t *g_lapic;
+static int g_x2apic;
+
+// APs sent a SIPI (parked with INIT by smp_park), and the ones taking work
+static uint32_t g_ap_ids[SMP_MAX_CPUS];
+static uint32_t g_ap_count;
+static uint32_t g_cpu_count; // Enabled in the MADT, boot CPU included; 0 if unknown
+static uint32_t g_self;
+static uint32_t g_worker_ids[SMP_MAX_CPUS]; // APIC IDs; worker 0 is the boot CPU
+static volatile uint32_t g_worker_ready[SMP_MAX_CPUS];
+static uint32_t g_workers = 1;
+
+// One share of the current job per worker, each on its own cache line
+struct smp_share
+{
+    volatile uint32_t next;
+    uint32_t end;
+} __attribute__((aligned(64)));
+
+static struct smp_share g_shares[SMP_MAX_CPUS];
+
+static struct
+{
+    smp_fn fn;
+    void *ctx;
+    uint32_t grain;
+    uint32_t workers;           // Taking part in this job
+    volatile uint32_t active;   // APs still working on it
+    volatile uint32_t generation; // Bumped for each job
+} g_job;
+
+static uint32_t lapic_read(uint32_t reg)
+{
+    return g_x2apic ? (uint32_t)rdmsr(X2APIC_MSR(reg)) : g_lapic[reg / 4];
+}
+
+static void lapic_write(uint32_t reg, uint32_t value)
+{
+    if (g_x2apic)
+        wrmsr(X2APIC_MSR(reg), value);
+    else
+        g_lapic[reg / 4] = value;
+}
+
+static uint32_t lapic_id(void)
+{
+    return g_x2apic ? lapic_read(LAPIC_ID) : lapic_read(LAPIC_ID) >> 24;
+}
+
+static void lapic_send_ipi(uint32_t apic_id, uint32_t icr)
+{
+    if (g_x2apic)
+    {
+        wrmsr(X2APIC_MSR(LAPIC_ICR_LO), ((uint64_t)apic_id << 32) | icr);
+        return;
+    }
+    while (g_lapic[LAPIC_ICR_LO / 4] & ICR_PENDING)
+        cpu_pause();
+    g_lapic[LAPIC_ICR_HI / 4] = apic_id << 24;
+    g_lapic[LAPIC_ICR_LO / 4] = icr;
+}
+
+// TSC busy-wait; MHz rounded up so it never waits less than asked
+static void delay_us(uint32_t us)
+{
+    uint64_t end = rdtsc() + (uint64_t)(timer_tsc_khz() / 1000 + 1) * us;
+    while (rdtsc() < end)
+        cpu_pause();
+}
+
+// Processors that still need the 10 ms INIT deassert wait of the MP spec:
+// Intel family 6 and later do not (Linux skips it the same way)
+static uint32_t init_delay_us(void)
+{
+    uint32_t a, b, c, d;
+    cpuid(0, 0, &a, &b, &c, &d);
+    int intel = b == 0x756E6547 && d == 0x49656E69 && c == 0x6C65746E; // "GenuineIntel"
+    cpuid(1, 0, &a, &b, &c, &d);
+    return intel && ((a >> 8) & 0xF) >= 6 ? 0 : 10000;
+}
+
+// Local APIC address and the APIC IDs of the enabled CPUs other than this one
+static int read_madt(uint32_t self)
+{
+    const struct acpi_madt *madt = (const struct acpi_madt *)acpi_find_table("APIC");
+    if (!madt) return -1;
+
+    uint64_t lapic = madt->lapic_addr;
+    const uint8_t *p = (const uint8_t *)(madt + 1);
+    const uint8_t *end = (const uint8_t *)madt + madt->header.length;
+    g_ap_count = 0;
+    for (; p + 2 <= end && p[1] >= 2 && p + p[1] <= end; p += p[1])
+    {
+        uint32_t id, flags;
+        if (p[0] == MADT_LAPIC && p[1] >= sizeof(struct acpi_madt_lapic))
+        {
+            id = ((const struct acpi_madt_lapic *)p)->apic_id;
+            flags = ((const struct acpi_madt_lapic *)p)->flags;
+        }
+        else if (p[0] == MADT_X2APIC && p[1] >= sizeof(struct acpi_madt_x2apic))
+        {
+            id = ((const struct acpi_madt_x2apic *)p)->apic_id;
+            flags = ((const struct acpi_madt_x2apic *)p)->flags;
+            if (id > 0xFE && !g_x2apic) continue; // Not addressable in xAPIC mode
+        }
+        else
+        {
+            if (p[0] == MADT_LAPIC_OVERRIDE && p[1] >= 12)
+                memcpy(&lapic, p + 4, 8);
+            continue;
+        }
+        if (!(flags & MADT_ENABLED) || id == self) continue;
+        if (g_ap_count < SMP_MAX_CPUS - 1)
+            g_ap_ids[g_ap_count++] = id;
+    }
+
+    if (!g_x2apic)
+    {
+        if (lapic >= 0x100000000ull) return -1;
+        g_lapic = (volatile uint32_t *)(uintptr_t)lapic;
+    }
+    return 0;
+}
+
+void smp_init(void)
+{
+    g_workers = 1;
+    g_ap_count = 0;
+    g_cpu_count = 0;
+    if (!(cpuid_features_edx() & CPUID_APIC)) return;
+
+    uint64_t base = rdmsr(MSR_APIC_BASE);
+    if (!(base & APIC_BASE_EN)) return;
+    g_x2apic = (base & APIC_BASE_EXTD) != 0;
+    g_lapic = (volatile uint32_t *)(uintptr_t)(base & 0xFFFFF000);
+
+    uint32_t self = g_x2apic ? (uint32_t)rdmsr(X2APIC_MSR(LAPIC_ID)) : g_lapic[LAPIC_ID / 4] >> 24;
+    if (read_madt(self) != 0) return;
+    g_self = self;
+    g_cpu_count = g_ap_count + 1;
+    if (g_ap_count == 0) return;
+
+    uintptr_t stacks = pmm_alloc(PMM_LOW_LIMIT, g_ap_count * SMP_AP_STACK_SIZE / PAGE_SIZE, PAGE_SIZE);
+    if (!stacks)
+    {
+        g_ap_count = 0;
+        return;
+    }
+    smp_ap_stacks = (uint32_t)stacks;
+    smp_ap_limit = g_ap_count;
+    smp_ap_next = 0;
+    g_worker_ids[0] = self;
+    for (uint32_t i = 0; i < SMP_MAX_CPUS; i++)
+        g_worker_ready[i] = 0;
+    memcpy((void *)SMP_TRAMPOLINE_ADDR, smp_trampoline, smp_trampoline_end - smp_trampoline);
+
+    // INIT all of them, then the SIPIs: one wait for the lot, not one per CPU
+    for (uint32_t i = 0; i < g_ap_count; i++)
+    {
+        lapic_send_ipi(g_ap_ids[i], ICR_INIT | ICR_ASSERT | ICR_LEVEL);
+        if (!g_x2apic) lapic_send_ipi(g_ap_ids[i], ICR_INIT | ICR_LEVEL); // Deassert (P6 and older)
+    }
+    delay_us(init_delay_us());
+    for (int sipi = 0; sipi < 2; sipi++)
+    {
+        for (uint32_t i = 0; i < g_ap_count; i++)
+            lapic_send_ipi(g_ap_ids[i], ICR_STARTUP | (SMP_TRAMPOLINE_ADDR >> 12));
+        delay_us(200);
+    }
+
+    uint32_t start = timer_ms();
+    while (smp_ap_next < g_ap_count && timer_ms() - start < SMP_START_TIMEOUT_MS)
+        cpu_pause();
+
+    // Workers are numbered in arrival order: take the ones that have
+    // finished setting up, up to the first gap
+    start = timer_ms();
+    uint32_t arrived = smp_ap_next;
+    while (g_workers <= arrived && timer_ms() - start < SMP_START_TIMEOUT_MS)
+    {
+        if (g_worker_ready[g_workers])
+            g_workers++;
+        else
+            cpu_pause();
+    }
+
+    if (g_workers < g_ap_count + 1)
+        klog("SMP: Some APs did not start\n");
+    klog(g_x2apic ? "SMP: Worker pool up (x2APIC)\n" : "SMP: Worker pool up\n");
+    timeline_mark(BOOT_EV_SMP, g_workers);
+}
+
+uint32_t smp_cpu_count(void)
+{
+    return g_workers;
+}
+
+void smp_export(struct boot_info *info)
+{
+    info->cpu_count = g_cpu_count;
+    info->bsp_apic_id = g_self;
+    for (uint32_t i = 0; i + 1 < g_cpu_count && i < BOOT_INFO_MAX_CPUS - 1; i++)
+        info->apic_ids[i] = g_ap_ids[i];
+}
+
+// Take pieces from our own share, then from everyone else's
+static void run_worker(uint32_t self)
+{
+    uint32_t grain = g_job.grain;
+    for (uint32_t k = 0; k < g_job.workers; k++)
+    {
+        struct smp_share *share = &g_shares[(self + k) % g_job.workers];
+        for (;;)
+        {
+            uint32_t begin = __atomic_fetch_add(&share->next, grain, __ATOMIC_RELAXED);
+            if (begin >= share->end) break;
+            uint32_t end = share->end - begin > grain ? begin + grain : share->end;
+            g_job.fn(g_job.ctx, begin, end);
+        }
+    }
+}
+
+void smp_submit(uint32_t count, uint32_t grain, smp_fn fn, void *ctx)
+{
+    if (grain == 0) grain = 1;
+    uint32_t workers = g_workers;
+    // One share per worker, and none so close to 4G that `next` could wrap
+    if (count <= grain || count > 0x80000000u) workers = 1;
+
+    g_job.fn = fn;
+    g_job.ctx = ctx;
+    g_job.grain = grain;
+    g_job.workers = workers;
+    uint32_t each = count / workers, extra = count % workers, at = 0;
+    for (uint32_t w = 0; w < workers; w++)
+    {
+        g_shares[w].next = at;
+        at += each + (w < extra);
+        g_shares[w].end = at;
+    }
+    if (workers == 1) return;
+
+    g_job.active = workers - 1;
+    __atomic_add_fetch(&g_job.generation, 1, __ATOMIC_RELEASE);
+    for (uint32_t w = 1; w < workers; w++)
+        lapic_send_ipi(g_worker_ids[w], ICR_FIXED | SMP_WAKE_VECTOR);
+}
+
+void smp_wait(void)
+{
+    run_worker(0);
+    if (g_job.workers > 1)
+        while (__atomic_load_n(&g_job.active, __ATOMIC_ACQUIRE))
+            cpu_pause();
+    g_job.workers = 0;
+}
+
+void parallel_for(uint32_t count, uint32_t grain, smp_fn fn, void *ctx)
+{
+    smp_submit(count, grain, fn, ctx);
+    smp_wait();
+}
+
+// isr_smp_wake: the IPI only ends the HLT; the loop below sees the job
+void smp_ipi_c(void)
+{
+    lapic_write(LAPIC_EOI, 0);
+}
+
+// boot2.asm, ap_pm_entry: on the AP's own stack, in protected mode with
+// the loader's GDT and IDT. `index` is the AP's arrival order.
+void smp_ap_main(uint32_t index)
+{
+    uint32_t self = index + 1;
+    if (g_x2apic)
+    {
+        uint64_t base = rdmsr(MSR_APIC_BASE);
+        if (!(base & APIC_BASE_EXTD)) wrmsr(MSR_APIC_BASE, base | APIC_BASE_EN | APIC_BASE_EXTD);
+    }
+    libk_init_ap();
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | SMP_SPURIOUS_VECTOR);
+
+    if (self < SMP_MAX_CPUS)
+    {
+        g_worker_ids[self] = lapic_id();
+        __atomic_store_n(&g_worker_ready[self], 1, __ATOMIC_RELEASE);
+    }
+
+    uint32_t seen = 0;
+    for (;;)
+    {
+        // STI delays interrupts by one instruction, so a wake-up IPI that
+        // arrives after the check still ends the HLT
+        __asm__ volatile("cli");
+        if (__atomic_load_n(&g_job.generation, __ATOMIC_ACQUIRE) == seen)
+        {
+            __asm__ volatile("sti; hlt");
+            continue;
+        }
+        __asm__ volatile("sti");
+        seen = g_job.generation;
+        if (self < g_job.workers)
+        {
+            run_worker(self);
+            __atomic_sub_fetch(&g_job.active, 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+void smp_park(void)
+{
+    if (g_ap_count == 0) return;
+
+    // INIT leaves them waiting for a SIPI with their local APICs reset
+    for (uint32_t i = 0; i < g_ap_count; i++)
+    {
+        lapic_send_ipi(g_ap_ids[i], ICR_INIT | ICR_ASSERT | ICR_LEVEL);
+        if (!g_x2apic) lapic_send_ipi(g_ap_ids[i], ICR_INIT | ICR_LEVEL);
+    }
+    if (!g_x2apic)
+        while (g_lapic[LAPIC_ICR_LO / 4] & ICR_PENDING)
+            cpu_pause();
+    g_ap_count = 0;
+    g_workers = 1;
+}
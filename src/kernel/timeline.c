@@ -0,0 +1,123 @@
+// timeline.c
+#include "timeline.h"
+#include "timer.h"
+#include "vga.h"
+#include "libk.h"
+#include "serial.h"
+
+struct boot_timestamp g_timeline[BOOT_INFO_MAX_TIMELINE];
+uint32_t g_timeline_count;
+
+#ifndef UEFI_BUILD
+// boot2.asm: RDTSC at Stage 2 entry and on entering protected mode
+extern uint32_t stage2_tsc[2];
+extern uint32_t pmode_tsc[2];
+#endif
+
+static const char *g_event_names[] = {
+    "?", "entry", "pmode", "kmain", "fat32_init", "config",
+    "menu", "selected", "file_open", "file_read", "jump",
+    "smp",
+};
+
+void timeline_init(void)
+{
+    g_timeline_count = 0;
+#ifndef UEFI_BUILD
+    g_timeline[0].tsc = ((uint64_t)stage2_tsc[1] << 32) | stage2_tsc[0];
+    g_timeline[0].event = BOOT_EV_ENTRY;
+    g_timeline[0].arg = 0;
+    g_timeline[1].tsc = ((uint64_t)pmode_tsc[1] << 32) | pmode_tsc[0];
+    g_timeline[1].event = BOOT_EV_PMODE;
+    g_timeline[1].arg = 0;
+    g_timeline_count = 2;
+#else
+    timeline_mark(BOOT_EV_ENTRY, 0);
+#endif
+}
+
+void timeline_export(struct boot_info *info)
+{
+    info->tsc_khz = timer_tsc_khz();
+    info->timeline_count = g_timeline_count;
+    memcpy(info->timeline, g_timeline, g_timeline_count * sizeof(g_timeline[0]));
+}
+
+static char *format_uint(char *p, uint32_t n)
+{
+    char digits[10];
+    int len = 0;
+    do {
+        digits[len++] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    while (len) *p++ = digits[--len];
+    return p;
+}
+
+void timeline_log(void)
+{
+    if (!timer_tsc_khz() || !g_timeline_count) return;
+
+    uint64_t t0 = g_timeline[0].tsc;
+    for (uint32_t i = 0; i < g_timeline_count; i++)
+    {
+        struct boot_timestamp *t = &g_timeline[i];
+        const char *name = t->event < sizeof(g_event_names) / sizeof(g_event_names[0]) ? g_event_names[t->event] : "?";
+
+        char line[48];
+        char *p = line;
+        uint32_t len = strlen(name);
+        memcpy(p, "timeline ", 9);
+        p += 9;
+        memcpy(p, name, len);
+        p += len;
+        if (t->event == BOOT_EV_FILE_OPEN || t->event == BOOT_EV_FILE_READ || t->event == BOOT_EV_SMP)
+        {
+            *p++ = '#';
+            p = format_uint(p, t->arg);
+        }
+        *p++ = ' ';
+        p = format_uint(p, timer_tsc_to_us(t->tsc - t0));
+        *p++ = '\n';
+        *p = '\0';
+        klog(line);
+    }
+}
+
+// Table of probes: time since the first probe and since the previous one
+void timeline_show(void)
+{
+    char attr = VGA_DEFAULT_ATTR;
+
+    vga_clear_screen(attr);
+    vga_put_string("Boot timeline (us)        since entry     delta\n", attr);
+    if (!timer_tsc_khz() || !g_timeline_count)
+    {
+        vga_put_string("No timestamps (TSC not calibrated)\n", attr);
+        return;
+    }
+
+    uint64_t t0 = g_timeline[0].tsc;
+    for (uint32_t i = 0; i < g_timeline_count; i++)
+    {
+        struct boot_timestamp *t = &g_timeline[i];
+        const char *name = t->event < sizeof(g_event_names) / sizeof(g_event_names[0]) ? g_event_names[t->event] : "?";
+
+        int len = 0;
+        while (name[len]) len++;
+        vga_put_string(name, attr);
+        if (t->event == BOOT_EV_FILE_OPEN || t->event == BOOT_EV_FILE_READ || t->event == BOOT_EV_SMP)
+        {
+            vga_put_string(" #", attr);
+            vga_put_uint(t->arg, 0, attr);
+            len += 3;
+        }
+        while (len++ < 20) vga_put_string(" ", attr);
+
+        vga_put_uint(timer_tsc_to_us(t->tsc - t0), 18, attr);
+        vga_put_uint(i ? timer_tsc_to_us(t->tsc - g_timeline[i - 1].tsc) : 0, 10, attr);
+        vga_put_string("\n", attr);
+    }
+    vga_put_string("\nPress any key to return to the menu", attr);
+}
@@ -0,0 +1,99 @@
+// timer.c
+#include "timer.h"
+#include "cpu.h"
+
+#ifdef UEFI_BUILD
+#include "../boot/efi/efi.h"
+#else
+#include "port.h"
+
+#define PIT_FREQ 1193182
+#define PIT_CH0 0x40
+#define PIT_CH2 0x42
+#define PIT_CMD 0x43
+#define PIT_GATE 0x61 // bit 0: channel 2 gate, bit 1: speaker, bit 5: channel 2 output
+
+volatile uint32_t g_timer_ticks;
+#endif
+
+static uint64_t g_tsc_base;
+static uint32_t g_tsc_khz;
+
+// 64-by-32 division without libgcc; the quotient must fit in 32 bits
+static inline uint32_t div64_32(uint64_t n, uint32_t d)
+{
+#ifdef UEFI_BUILD
+    return (uint32_t)(n / d);
+#else
+    uint32_t q, r;
+    __asm__("divl %4" : "=a"(q), "=d"(r) : "a"((uint32_t)n), "d"((uint32_t)(n >> 32)), "rm"(d));
+    return q;
+#endif
+}
+
+#ifdef UEFI_BUILD
+static uint32_t calibrate_tsc(void)
+{
+    uint64_t t0 = rdtsc();
+    g_SystemTable->BootServices->Stall(TIMER_CALIBRATE_MS * 1000);
+    return (uint32_t)((rdtsc() - t0) / TIMER_CALIBRATE_MS);
+}
+
+void timer_init(void)
+{
+    g_tsc_khz = calibrate_tsc();
+    g_tsc_base = rdtsc();
+}
+#else
+// Count TSC cycles while PIT channel 2 runs a one-shot countdown
+static uint32_t calibrate_tsc(void)
+{
+    uint16_t latch = PIT_FREQ / (1000 / TIMER_CALIBRATE_MS);
+
+    outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01); // gate on, speaker off
+    outb(PIT_CMD, 0xB0);                           // channel 2, lo/hi, mode 0
+    outb(PIT_CH2, latch & 0xFF);
+    outb(PIT_CH2, latch >> 8);
+
+    uint64_t t0 = rdtsc();
+    while (!(inb(PIT_GATE) & 0x20))
+        ;
+    uint64_t t1 = rdtsc();
+
+    outb(PIT_GATE, inb(PIT_GATE) & ~0x01);
+    return (uint32_t)(t1 - t0) / TIMER_CALIBRATE_MS;
+}
+
+void timer_init(void)
+{
+    g_tsc_khz = calibrate_tsc();
+    g_tsc_base = rdtsc();
+
+    // Channel 0, lo/hi, mode 2 (rate generator) at TIMER_HZ, IRQ0 unmasked
+    uint16_t divisor = PIT_FREQ / TIMER_HZ;
+    outb(PIT_CMD, 0x34);
+    outb(PIT_CH0, divisor & 0xFF);
+    outb(PIT_CH0, divisor >> 8);
+    outb(0x21, inb(0x21) & ~0x01);
+}
+#endif
+
+uint32_t timer_ms(void)
+{
+    if (!g_tsc_khz) return 0;
+    return div64_32(rdtsc() - g_tsc_base, g_tsc_khz);
+}
+
+uint32_t timer_tsc_khz(void)
+{
+    return g_tsc_khz;
+}
+
+uint32_t timer_tsc_to_us(uint64_t ticks)
+{
+    if (!g_tsc_khz) return 0;
+    // Split to keep ticks * 1000 from overflowing
+    uint32_t ms = div64_32(ticks, g_tsc_khz);
+    uint64_t rest = ticks - (uint64_t)ms * g_tsc_khz;
+    return ms * 1000 + div64_32(rest * 1000, g_tsc_khz);
+}
@@ -1,5 +1,6 @@
 // vga.c
 #include "vga.h"
+#include "serial.h"
 
 #ifdef UEFI_BUILD
 #include "../boot/efi/efi.h"
@@ -53,19 +54,25 @@ void vga_init(void)
 
 void vga_clear_screen(char attr)
 {
+    if (g_console & CONSOLE_SERIAL)
+        serial_clear();
+
+    if (g_console & CONSOLE_VGA)
+    {
 #ifdef UEFI_BUILD
-    if (g_SystemTable && g_SystemTable->ConOut) {
-        g_SystemTable->ConOut->SetAttribute(g_SystemTable->ConOut, attr);
-        g_SystemTable->ConOut->ClearScreen(g_SystemTable->ConOut);
-    }
+        if (g_SystemTable && g_SystemTable->ConOut) {
+            g_SystemTable->ConOut->SetAttribute(g_SystemTable->ConOut, attr);
+            g_SystemTable->ConOut->ClearScreen(g_SystemTable->ConOut);
+        }
 #else
-    volatile vga_cell_t *vga = VGA_BUFFER;
-    for (int i = 0; i < LEGACY_WIDTH * LEGACY_HEIGHT; i++)
-    {
-        vga[i].c = ' ';
-        vga[i].attr = attr;
-    }
+        volatile vga_cell_t *vga = VGA_BUFFER;
+        for (int i = 0; i < LEGACY_WIDTH * LEGACY_HEIGHT; i++)
+        {
+            vga[i].c = ' ';
+            vga[i].attr = attr;
+        }
 #endif
+    }
     vga_cursor_row = 0;
     vga_cursor_col = 0;
 }
@@ -75,30 +82,36 @@ void vga_put_char(char c, char attr, int row, int col)
     if (row < 0 || row >= g_vga_height || col < 0 || col >= g_vga_width)
         return; // Out of bounds
 
+    if (g_console & CONSOLE_SERIAL)
+        serial_put_cell(c, attr, row, col);
+
+    if (g_console & CONSOLE_VGA)
+    {
 #ifdef UEFI_BUILD
-    if (g_SystemTable && g_SystemTable->ConOut) {
-        g_SystemTable->ConOut->SetCursorPosition(g_SystemTable->ConOut, col, row);
-        g_SystemTable->ConOut->SetAttribute(g_SystemTable->ConOut, attr);
-        
-        // Map CP437 box drawing chars to Unicode
-        short str[2] = {0, 0};
-        switch ((unsigned char)c) {
-            case 0xC9: str[0] = 0x2554; break; // ╔
-            case 0xBB: str[0] = 0x2557; break; // ╗
-            case 0xC8: str[0] = 0x255A; break; // ╚
-            case 0xBC: str[0] = 0x255D; break; // ╝
-            case 0xCD: str[0] = 0x2550; break; // ═
-            case 0xBA: str[0] = 0x2551; break; // ║
-            default:   str[0] = (unsigned char)c; break;
+        if (g_SystemTable && g_SystemTable->ConOut) {
+            g_SystemTable->ConOut->SetCursorPosition(g_SystemTable->ConOut, col, row);
+            g_SystemTable->ConOut->SetAttribute(g_SystemTable->ConOut, attr);
+            
+            // Map CP437 box drawing chars to Unicode
+            short str[2] = {0, 0};
+            switch ((unsigned char)c) {
+                case 0xC9: str[0] = 0x2554; break; // ╔
+                case 0xBB: str[0] = 0x2557; break; // ╗
+                case 0xC8: str[0] = 0x255A; break; // ╚
+                case 0xBC: str[0] = 0x255D; break; // ╝
+                case 0xCD: str[0] = 0x2550; break; // ═
+                case 0xBA: str[0] = 0x2551; break; // ║
+                default:   str[0] = (unsigned char)c; break;
+            }
+            
+            g_SystemTable->ConOut->OutputString(g_SystemTable->ConOut, str);
         }
-        
-        g_SystemTable->ConOut->OutputString(g_SystemTable->ConOut, str);
-    }
 #else
-    volatile vga_cell_t *vga = VGA_BUFFER + (row * LEGACY_WIDTH + col);
-    vga->c = c;
-    vga->attr = attr;
+        volatile vga_cell_t *vga = VGA_BUFFER + (row * LEGACY_WIDTH + col);
+        vga->c = c;
+        vga->attr = attr;
 #endif
+    }
 
     // Update cursor position
     vga_cursor_col = col + 1;
@@ -111,12 +124,42 @@ void vga_put_char(char c, char attr, int row, int col)
 
 void vga_put_string(const char *str, char attr)
 {
+    // Messages also go to the serial log unless the whole screen is mirrored
+    if (!(g_console & CONSOLE_SERIAL))
+        klog(str);
+
     while (*str)
     {
+        if (*str == '\n')
+        {
+            vga_cursor_col = 0;
+            vga_cursor_row = (vga_cursor_row + 1) % g_vga_height;
+            str++;
+            continue;
+        }
         vga_put_char(*str++, attr, vga_cursor_row, vga_cursor_col);
     }
 }
 
+// Decimal, right-aligned in width columns
+void vga_put_uint(uint32_t n, int width, char attr)
+{
+    char buf[12];
+    int len = 0;
+    do {
+        buf[len++] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+
+    while (width-- > len) vga_put_string(" ", attr);
+    char out[2] = { 0, 0 };
+    while (len)
+    {
+        out[0] = buf[--len];
+        vga_put_string(out, attr);
+    }
+}
+
 void putc_at(int row, int col, char ch, char attr)
 {
     vga_put_char(ch, attr, row, col);
@@ -185,4 +228,36 @@ void draw_menu(struct menu menu_opt)
     }
 }
 
+// Countdown line under the entries; seconds < 0 clears it
+void draw_countdown(struct menu menu_opt, int seconds)
+{
+    int menu_width = 40;
+    int center_col = (g_vga_width - menu_width) / 2;
+    if (center_col < 0) center_col = 0;
+    int row = 8 + menu_opt.length + 1;
+
+    char line[41];
+    int len = 0;
+    if (seconds >= 0)
+    {
+        const char *prefix = "Booting in ";
+        while (*prefix) line[len++] = *prefix++;
+
+        char digits[6];
+        int n = 0;
+        do {
+            digits[n++] = '0' + seconds % 10;
+            seconds /= 10;
+        } while (seconds && n < 5);
+        while (n) line[len++] = digits[--n];
+
+        const char *suffix = "s, press any key";
+        while (*suffix) line[len++] = *suffix++;
+    }
+    while (len < menu_width) line[len++] = ' ';
+
+    for (int i = 0; i < menu_width; i++)
+        putc_at(row, center_col + i, line[i], 0x07);
+}
+
 #endif // VGA_DRIVER_C
\ No newline at end of file
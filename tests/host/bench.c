@@ -0,0 +1,237 @@
+// bench.c
+// Host microbenchmarks for the loader modules. Times are host times: they
+// rank changes against each other, and the disk read counts carry over to
+// real hardware, but the absolute numbers do not. --quick runs each case
+// once (what CTest does).
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "fat_image.h"
+#include "config.h"
+#include "mem.h"
+
+#define IMAGE "bench_fat32.img"
+
+static int g_quick;
+
+static int iterations(int full)
+{
+    return g_quick ? 1 : full;
+}
+
+static void mount(struct fat_image *img)
+{
+    if (fat_image_save(img, IMAGE) != 0 || host_disk_open(IMAGE) != 0)
+    {
+        fprintf(stderr, "cannot write %s\n", IMAGE);
+        exit(1);
+    }
+    fat32_init(host_disk_bpb());
+}
+
+// Lookup cost vs directory size: open the last file of the root directory
+static void bench_lookup(void)
+{
+    static const int sizes[] = { 16, 64, 256, 1024, 4096 };
+    printf("\nfat32_open, last of N root entries (spc=1)\n");
+    printf("%8s %12s %14s\n", "entries", "us/lookup", "sectors/lookup");
+
+    for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        struct fat_image img;
+        fat_image_create(&img, 16, 1);
+        char name[16];
+        uint8_t byte = 0;
+        for (int i = 0; i < sizes[s]; i++)
+        {
+            snprintf(name, sizeof(name), "F%05d.BIN", i);
+            fat_image_add(&img, name, &byte, 1, 1);
+        }
+        mount(&img);
+
+        int n = iterations(200);
+        struct fat32_file f;
+        host_disk_reset_stats();
+        uint64_t t0 = host_now_ns();
+        for (int i = 0; i < n; i++)
+        {
+            host_output_clear();
+            if (fat32_open(name, &f) != 0) printf("lookup failed\n");
+        }
+        uint64_t t1 = host_now_ns();
+        struct host_disk_stats stats;
+        host_disk_stats(&stats);
+        printf("%8d %12.1f %14.1f\n", sizes[s], (t1 - t0) / 1000.0 / n, (double)stats.sectors / n);
+        fat_image_free(&img);
+    }
+}
+
+// Load throughput vs fragmentation: an 8 MB file whose clusters are 1, 2,
+// 4 and 16 apart
+static void bench_fragmentation(void)
+{
+    static const int strides[] = { 1, 2, 4, 16 };
+    const uint32_t size = 8u << 20;
+    printf("\nfat32_load, 8 MB file (spc=8)\n");
+    printf("%8s %10s %12s %10s\n", "stride", "MB/s", "read calls", "sectors");
+
+    uint8_t *data = malloc(size), *buf = malloc(size);
+    for (uint32_t i = 0; i < size; i++) data[i] = (uint8_t)(i * 7);
+
+    for (unsigned s = 0; s < sizeof(strides) / sizeof(strides[0]); s++)
+    {
+        struct fat_image img;
+        fat_image_create(&img, (size >> 20) * strides[s] + 4, 8);
+        fat_image_add(&img, "BIG.BIN", data, size, strides[s]);
+        mount(&img);
+
+        struct fat32_load_req req;
+        fat32_open("BIG.BIN", &req.file);
+        req.offset = 0;
+        req.length = size;
+        req.dest = buf;
+        req.verify = 0;
+
+        int n = iterations(10);
+        host_disk_reset_stats();
+        uint64_t t0 = host_now_ns();
+        for (int i = 0; i < n; i++)
+            fat32_load(&req, 1);
+        uint64_t t1 = host_now_ns();
+        struct host_disk_stats stats;
+        host_disk_stats(&stats);
+        if (memcmp(buf, data, size) != 0) printf("load mismatch\n");
+
+        double seconds = (t1 - t0) / 1e9;
+        printf("%8d %10.0f %12.0f %10.0f\n", strides[s], (double)size * n / seconds / (1 << 20),
+               (double)stats.calls / n, (double)stats.sectors / n);
+        fat_image_free(&img);
+    }
+    free(data);
+    free(buf);
+}
+
+// Allocator ops/sec: config-style small strings, a mixed churn and the
+// loader's few large buffers
+static void bench_alloc(void)
+{
+    enum { SLOTS = 1024 };
+    static void *slot[SLOTS];
+    printf("\nkmalloc/kfree\n");
+    printf("%-24s %12s %8s\n", "pattern", "Mops/s", "frag%");
+
+    struct
+    {
+        const char *name;
+        uint32_t min, max;
+        int lifo; // Free in reverse order instead of at random
+    } patterns[] = {
+        { "strings 8-64 B, lifo", 8, 64, 1 },
+        { "mixed 16 B-4 KB, random", 16, 4096, 0 },
+        { "buffers 64-512 KB", 65536, 524288, 0 },
+    };
+
+    for (unsigned p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++)
+    {
+        int slots = patterns[p].min >= 65536 ? 16 : SLOTS;
+        int rounds = iterations(200);
+        uint32_t seed = 1;
+        uint64_t ops = 0;
+        uint64_t t0 = host_now_ns();
+        for (int r = 0; r < rounds; r++)
+        {
+            for (int i = 0; i < slots; i++)
+            {
+                seed = seed * 1103515245 + 12345;
+                slot[i] = kmalloc(patterns[p].min + (seed >> 8) % (patterns[p].max - patterns[p].min + 1));
+            }
+            if (patterns[p].lifo)
+            {
+                for (int i = slots - 1; i >= 0; i--) kfree(slot[i]);
+            }
+            else
+            {
+                for (int i = 0; i < slots; i++)
+                {
+                    seed = seed * 1103515245 + 12345;
+                    int j = (seed >> 8) % slots;
+                    void *t = slot[i];
+                    slot[i] = slot[j];
+                    slot[j] = t;
+                }
+                for (int i = 0; i < slots / 2; i++) kfree(slot[i]);
+                for (int i = 0; i < slots / 2; i++)
+                {
+                    seed = seed * 1103515245 + 12345;
+                    slot[i] = kmalloc(patterns[p].min + (seed >> 8) % (patterns[p].max - patterns[p].min + 1));
+                }
+                ops += slots;
+                for (int i = 0; i < slots; i++) kfree(slot[i]);
+            }
+            ops += 2 * slots;
+        }
+        uint64_t t1 = host_now_ns();
+        struct kheap_stats stats;
+        kheap_get_stats(&stats);
+        printf("%-24s %12.2f %8u\n", patterns[p].name, ops / ((t1 - t0) / 1e3), stats.frag_pct);
+    }
+}
+
+// Parse time vs config size
+static void bench_parse(void)
+{
+    static const int sizes[] = { 4, 16, 64, 256 };
+    printf("\nconfig_parse_text\n");
+    printf("%8s %10s %12s %10s\n", "entries", "bytes", "us/parse", "MB/s");
+
+    struct menu_entry *entries = malloc(sizeof(struct menu_entry) * 256);
+    for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        size_t cap = 256 + sizes[s] * 160;
+        char *text = malloc(cap), *work = malloc(cap);
+        size_t len = snprintf(text, cap, "[menu]\ntitle=Benchmark\ntimeout=5\ndefault=Entry %d\n", sizes[s] - 1);
+        for (int i = 0; i < sizes[s]; i++)
+            len += snprintf(text + len, cap - len,
+                            "\n[entry]\nname=Entry %d\nkernel_x86=KERNEL%d.BIN\ncmdline=root=/dev/sda1 quiet\n"
+                            "module=INITRD%d.IMG\n", i, i, i);
+
+        int n = iterations(2000);
+        uint64_t total = 0;
+        for (int i = 0; i < n; i++)
+        {
+            struct arena strings;
+            arena_init(&strings, 1024);
+            memcpy(work, text, len + 1);
+            struct menu m;
+            m.entries = entries;
+            m.title = "";
+
+            uint64_t t0 = host_now_ns();
+            config_parse_text(work, &m, 256, &strings);
+            total += host_now_ns() - t0;
+
+            if (m.length != sizes[s]) printf("parse lost entries\n");
+            arena_release(&strings);
+        }
+        printf("%8d %10zu %12.2f %10.1f\n", sizes[s], len, total / 1000.0 / n, (double)len * n / (total / 1e9) / (1 << 20));
+        free(text);
+        free(work);
+    }
+    free(entries);
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--quick") == 0) g_quick = 1;
+
+    kheap_init();
+    bench_lookup();
+    bench_fragmentation();
+    bench_alloc();
+    bench_parse();
+    host_disk_close();
+    remove(IMAGE);
+    return 0;
+}
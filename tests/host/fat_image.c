@@ -0,0 +1,275 @@
+// fat_image.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fat_image.h"
+#include "fat32.h"
+#include "crc32.h"
+
+#define SECTOR 512
+#define FAT_EOC 0x0FFFFFFF
+#define ROOT_CLUSTER 2
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    put16(p, v & 0xFFFF);
+    put16(p + 2, v >> 16);
+}
+
+static uint32_t cluster_bytes(const struct fat_image *img)
+{
+    return img->sectors_per_cluster * SECTOR;
+}
+
+static uint8_t *cluster_data(const struct fat_image *img, uint32_t cluster)
+{
+    uint32_t lba = img->reserved_sectors + 2 * img->fat_sectors + (cluster - 2) * img->sectors_per_cluster;
+    return img->data + (size_t)lba * SECTOR;
+}
+
+static void set_fat(struct fat_image *img, uint32_t cluster, uint32_t value)
+{
+    for (uint32_t copy = 0; copy < 2; copy++)
+    {
+        uint8_t *fat = img->data + (size_t)(img->reserved_sectors + copy * img->fat_sectors) * SECTOR;
+        put32(fat + cluster * 4, value);
+    }
+}
+
+static uint32_t get_fat(const struct fat_image *img, uint32_t cluster)
+{
+    const uint8_t *p = img->data + (size_t)img->reserved_sectors * SECTOR + cluster * 4;
+    return (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24) & 0x0FFFFFFF;
+}
+
+// "kernel.bin" -> "KERNEL  BIN"
+static void name_83(const char *name, char out[11])
+{
+    memset(out, ' ', 11);
+    int i = 0;
+    for (; name[i] && name[i] != '.' && i < 8; i++)
+        out[i] = (name[i] >= 'a' && name[i] <= 'z') ? name[i] - 32 : name[i];
+    const char *ext = strchr(name, '.');
+    for (int j = 0; ext && ext[1 + j] && j < 3; j++)
+        out[8 + j] = (ext[1 + j] >= 'a' && ext[1 + j] <= 'z') ? ext[1 + j] - 32 : ext[1 + j];
+}
+
+int fat_image_create(struct fat_image *img, uint32_t size_mb, uint32_t sectors_per_cluster)
+{
+    uint32_t total = size_mb * 2048;
+    memset(img, 0, sizeof(*img));
+    img->sectors_per_cluster = sectors_per_cluster;
+    img->reserved_sectors = 32;
+
+    uint32_t estimate = (total - img->reserved_sectors) / sectors_per_cluster + 2;
+    img->fat_sectors = (estimate * 4 + SECTOR - 1) / SECTOR;
+    img->cluster_count = (total - img->reserved_sectors - 2 * img->fat_sectors) / sectors_per_cluster;
+    if (total <= img->reserved_sectors + 2 * img->fat_sectors || img->cluster_count < 16) return -1;
+
+    img->size = total * SECTOR;
+    img->data = calloc(1, img->size);
+    if (!img->data) return -1;
+
+    uint8_t *bs = img->data;
+    bs[0] = 0xEB;
+    bs[1] = 0x58;
+    bs[2] = 0x90;
+    memcpy(bs + 3, "ATLASTST", 8);
+    put16(bs + 11, SECTOR);
+    bs[13] = (uint8_t)sectors_per_cluster;
+    put16(bs + 14, (uint16_t)img->reserved_sectors);
+    bs[16] = 2;
+    bs[21] = 0xF8;
+    put16(bs + 24, 63);
+    put16(bs + 26, 255);
+    put32(bs + 32, total);
+    put32(bs + 36, img->fat_sectors);
+    put32(bs + 44, ROOT_CLUSTER);
+    put16(bs + 48, 1); // FSInfo
+    put16(bs + 50, 6); // Backup boot sector
+    bs[66] = 0x29;
+    memcpy(bs + 71, "ATLAS TEST ", 11);
+    memcpy(bs + 82, "FAT32   ", 8);
+    bs[510] = 0x55;
+    bs[511] = 0xAA;
+
+    set_fat(img, 0, 0x0FFFFFF8);
+    set_fat(img, 1, FAT_EOC);
+    set_fat(img, ROOT_CLUSTER, FAT_EOC);
+    img->root_last = ROOT_CLUSTER;
+    img->root_entries = 0;
+    img->next_free = ROOT_CLUSTER + 1;
+    return 0;
+}
+
+void fat_image_free(struct fat_image *img)
+{
+    free(img->data);
+    img->data = 0;
+}
+
+static int in_range(const struct fat_image *img, uint32_t cluster)
+{
+    return cluster >= 2 && cluster < img->cluster_count + 2;
+}
+
+static uint8_t *new_dir_slot(struct fat_image *img)
+{
+    if (img->root_entries == cluster_bytes(img) / 32)
+    {
+        uint32_t c = img->next_free++;
+        if (!in_range(img, c)) return 0;
+        set_fat(img, img->root_last, c);
+        set_fat(img, c, FAT_EOC);
+        memset(cluster_data(img, c), 0, cluster_bytes(img));
+        img->root_last = c;
+        img->root_entries = 0;
+    }
+    return cluster_data(img, img->root_last) + 32 * img->root_entries++;
+}
+
+int fat_image_add(struct fat_image *img, const char *name, const void *data, uint32_t size, uint32_t stride)
+{
+    uint32_t count = (size + cluster_bytes(img) - 1) / cluster_bytes(img);
+    uint32_t first = count ? img->next_free : 0;
+    if (stride == 0) stride = 1;
+    if (count && !in_range(img, first + (count - 1) * stride)) return -1;
+
+    const uint8_t *src = data;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t c = first + i * stride;
+        uint32_t chunk = size - i * cluster_bytes(img);
+        if (chunk > cluster_bytes(img)) chunk = cluster_bytes(img);
+        memcpy(cluster_data(img, c), src + (size_t)i * cluster_bytes(img), chunk);
+        set_fat(img, c, i + 1 < count ? c + stride : FAT_EOC);
+    }
+    if (count) img->next_free = first + (count - 1) * stride + 1;
+
+    uint8_t *e = new_dir_slot(img);
+    if (!e) return -1;
+    memset(e, 0, 32);
+    name_83(name, (char *)e);
+    e[11] = 0x20; // Archive
+    put16(e + 20, first >> 16);
+    put16(e + 26, first & 0xFFFF);
+    put32(e + 28, size);
+    return 0;
+}
+
+int fat_image_delete(struct fat_image *img, const char *name)
+{
+    char target[11];
+    name_83(name, target);
+
+    for (uint32_t c = ROOT_CLUSTER; in_range(img, c); c = get_fat(img, c))
+    {
+        uint8_t *dir = cluster_data(img, c);
+        for (uint32_t i = 0; i < cluster_bytes(img); i += 32)
+        {
+            if (dir[i] == 0) return -1;
+            if (memcmp(dir + i, target, 11) == 0)
+            {
+                dir[i] = 0xE5;
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+int fat_image_write_bootmap(struct fat_image *img, uint32_t volume_id)
+{
+    uint8_t *fsinfo = img->data + SECTOR;
+    uint32_t free_clusters = img->cluster_count - (img->next_free - ROOT_CLUSTER);
+    put32(img->data + 67, volume_id);
+    put32(fsinfo, 0x41615252);
+    put32(fsinfo + 484, 0x61417272);
+    put32(fsinfo + 488, free_clusters);
+    put32(fsinfo + 492, img->next_free);
+    put32(fsinfo + 508, 0xAA550000);
+
+    uint8_t *map = img->data + BOOTMAP_LBA * SECTOR;
+    struct bootmap_file files[64];
+    struct bootmap_extent extents[128];
+    uint32_t file_count = 0, extent_count = 0;
+
+    for (uint32_t c = ROOT_CLUSTER; in_range(img, c); c = get_fat(img, c))
+    {
+        const uint8_t *dir = cluster_data(img, c);
+        for (uint32_t i = 0; i < cluster_bytes(img) && dir[i]; i += 32)
+        {
+            if (dir[i] == 0xE5 || !(dir[i + 11] & 0x20)) continue;
+            if (file_count == 64) return -1;
+            struct bootmap_file *f = &files[file_count++];
+            memcpy(f->name, dir + i, 11);
+            memcpy(&f->size, dir + i + 28, 4);
+            f->first_extent = extent_count;
+            f->extent_count = 0;
+
+            // Walk the chain: a new extent wherever it jumps
+            uint16_t hi, lo;
+            memcpy(&hi, dir + i + 20, 2);
+            memcpy(&lo, dir + i + 26, 2);
+            uint32_t cluster = (uint32_t)hi << 16 | lo;
+            uint32_t left = (f->size + SECTOR - 1) / SECTOR;
+            uint32_t crc = 0, remaining = f->size;
+            while (left > 0 && in_range(img, cluster))
+            {
+                uint32_t lba = (uint32_t)((cluster_data(img, cluster) - img->data) / SECTOR);
+                uint32_t sectors = left < img->sectors_per_cluster ? left : img->sectors_per_cluster;
+                uint32_t bytes = remaining < sectors * SECTOR ? remaining : sectors * SECTOR;
+                crc = crc32c(crc, cluster_data(img, cluster), bytes);
+                remaining -= bytes;
+                left -= sectors;
+
+                struct bootmap_extent *last = f->extent_count ? &extents[extent_count - 1] : 0;
+                if (last && last->lba + last->sectors == lba)
+                    last->sectors += sectors;
+                else
+                {
+                    if (extent_count == 128) return -1;
+                    extents[extent_count].lba = lba;
+                    extents[extent_count++].sectors = sectors;
+                    f->extent_count++;
+                }
+                cluster = get_fat(img, cluster);
+            }
+            f->crc32c = crc;
+        }
+    }
+
+    struct bootmap_header h;
+    memset(&h, 0, sizeof(h));
+    h.magic = BOOTMAP_MAGIC;
+    h.version = BOOTMAP_VERSION;
+    h.file_count = (uint16_t)file_count;
+    h.volume_id = volume_id;
+    h.free_clusters = free_clusters;
+    h.next_free = img->next_free;
+    h.extent_count = (uint16_t)extent_count;
+
+    size_t used = sizeof(h) + file_count * sizeof(files[0]) + extent_count * sizeof(extents[0]);
+    if (used > BOOTMAP_SECTORS * SECTOR) return -1;
+    memset(map, 0, BOOTMAP_SECTORS * SECTOR);
+    memcpy(map, &h, sizeof(h));
+    memcpy(map + sizeof(h), files, file_count * sizeof(files[0]));
+    memcpy(map + sizeof(h) + file_count * sizeof(files[0]), extents, extent_count * sizeof(extents[0]));
+    put32(map + 8, crc32c(0, map + 12, BOOTMAP_SECTORS * SECTOR - 12));
+    return 0;
+}
+
+int fat_image_save(const struct fat_image *img, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+    size_t written = fwrite(img->data, 1, img->size, f);
+    return (fclose(f) == 0 && written == img->size) ? 0 : -1;
+}
@@ -0,0 +1,41 @@
+// fat_image.h
+// Minimal FAT32 volume writer for the host tests: volume at LBA 0 (as on
+// an Atlas disk image), two FATs, everything in the root directory.
+#ifndef FAT_IMAGE_H
+#define FAT_IMAGE_H
+
+#include <stdint.h>
+
+struct fat_image
+{
+    uint8_t *data;
+    uint32_t size;
+    uint32_t sectors_per_cluster;
+    uint32_t reserved_sectors;
+    uint32_t fat_sectors;
+    uint32_t cluster_count;
+    uint32_t next_free;    // Next cluster handed out
+    uint32_t root_last;    // Last cluster of the root directory chain
+    uint32_t root_entries; // Directory slots used in root_last
+};
+
+// A blank volume of size_mb megabytes; -1 if that is too small. Volumes
+// below the FAT32 minimum cluster count are allowed: the loader never asks.
+int fat_image_create(struct fat_image *img, uint32_t size_mb, uint32_t sectors_per_cluster);
+void fat_image_free(struct fat_image *img);
+
+// Add a root directory file. stride 1 stores it contiguously; stride n
+// leaves n - 1 free clusters after each of its clusters, so every cluster
+// is its own run. The root directory grows a cluster at a time as needed.
+int fat_image_add(struct fat_image *img, const char *name, const void *data, uint32_t size, uint32_t stride);
+// Mark a root directory entry deleted (0xE5), as DOS does
+int fat_image_delete(struct fat_image *img, const char *name);
+
+// Stamp volume_id, write FSInfo and a boot map (include/fat32.h) listing
+// every root directory file with one extent per contiguous run. Call it
+// after the last change the map should describe.
+int fat_image_write_bootmap(struct fat_image *img, uint32_t volume_id);
+
+int fat_image_save(const struct fat_image *img, const char *path);
+
+#endif // FAT_IMAGE_H
@@ -0,0 +1,79 @@
+// host.h
+// Host build of the loader modules: a file-backed disk in place of the
+// ATA driver, sinks for the screen and serial log, and plain malloc'd
+// memory in place of the physical page allocator.
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "fat32.h"
+
+// ---------------------------------------------------------------- disk
+
+// ata_read_sectors reads this image with pread; -1 if it cannot be opened
+int host_disk_open(const char *path);
+void host_disk_close(void);
+// The BPB from sector 0, as Stage 1 hands it to kmain
+struct fat32_bpb *host_disk_bpb(void);
+
+struct host_disk_stats
+{
+    uint64_t calls;   // ata_read_sectors calls
+    uint64_t sectors; // Sectors read
+};
+void host_disk_stats(struct host_disk_stats *out);
+void host_disk_reset_stats(void);
+
+// ---------------------------------------------------------------- output
+
+// Everything vga_put_string/klog would have shown; cleared by host_output_clear
+const char *host_output(void);
+void host_output_clear(void);
+
+// --------------------------------------------------------------- checks
+
+extern int g_host_failures;
+
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            g_host_failures++;                                                   \
+        }                                                                        \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                           \
+    do {                                                                         \
+        long long _a = (long long)(a), _b = (long long)(b);                      \
+        if (_a != _b) {                                                          \
+            fprintf(stderr, "%s:%d: %s == %s failed: %lld != %lld\n",            \
+                    __FILE__, __LINE__, #a, #b, _a, _b);                         \
+            g_host_failures++;                                                   \
+        }                                                                        \
+    } while (0)
+
+#define CHECK_STR(a, b)                                                          \
+    do {                                                                         \
+        const char *_a = (a), *_b = (b);                                         \
+        if (strcmp(_a, _b) != 0) {                                               \
+            fprintf(stderr, "%s:%d: %s == %s failed: \"%s\" != \"%s\"\n",        \
+                    __FILE__, __LINE__, #a, #b, _a, _b);                         \
+            g_host_failures++;                                                   \
+        }                                                                        \
+    } while (0)
+
+// Run one test function and report it; main returns host_summary()
+#define RUN(test)                                                                \
+    do {                                                                         \
+        int _before = g_host_failures;                                           \
+        test();                                                                  \
+        printf("%s %s\n", g_host_failures == _before ? "ok  " : "FAIL", #test);  \
+    } while (0)
+
+int host_summary(void);
+
+// Monotonic time in nanoseconds, for the microbenchmarks
+uint64_t host_now_ns(void);
+
+#endif // HOST_H
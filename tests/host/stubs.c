@@ -0,0 +1,204 @@
+// stubs.c
+// What the loader modules expect from the rest of Stage 2, on a host.
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host.h"
+#include "disk.h"
+#include "mem.h"
+#include "pmm.h"
+#include "paging.h"
+#include "serial.h"
+#include "smp.h"
+#include "timeline.h"
+#include "vga.h"
+
+int g_host_failures;
+
+int host_summary(void)
+{
+    if (g_host_failures)
+        printf("%d check(s) failed\n", g_host_failures);
+    return g_host_failures ? 1 : 0;
+}
+
+uint64_t host_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// ---------------------------------------------------------------- disk
+
+static int g_disk_fd = -1;
+static struct fat32_bpb g_disk_bpb;
+static struct host_disk_stats g_disk_stats;
+
+int host_disk_open(const char *path)
+{
+    host_disk_close();
+    g_disk_fd = open(path, O_RDONLY);
+    if (g_disk_fd < 0) return -1;
+
+    uint8_t sector[512];
+    if (pread(g_disk_fd, sector, sizeof(sector), 0) != (ssize_t)sizeof(sector))
+    {
+        host_disk_close();
+        return -1;
+    }
+    memcpy(&g_disk_bpb, sector + 11, sizeof(g_disk_bpb));
+    host_disk_reset_stats();
+    return 0;
+}
+
+void host_disk_close(void)
+{
+    if (g_disk_fd >= 0) close(g_disk_fd);
+    g_disk_fd = -1;
+}
+
+struct fat32_bpb *host_disk_bpb(void)
+{
+    return &g_disk_bpb;
+}
+
+void host_disk_stats(struct host_disk_stats *out)
+{
+    *out = g_disk_stats;
+}
+
+void host_disk_reset_stats(void)
+{
+    memset(&g_disk_stats, 0, sizeof(g_disk_stats));
+}
+
+// Sectors past the end of the image read as zeros, like a blank disk
+void ata_read_sectors(uint32_t lba, uint8_t count, uint16_t *buffer)
+{
+    size_t bytes = (size_t)count * 512;
+    ssize_t got = g_disk_fd >= 0 ? pread(g_disk_fd, buffer, bytes, (off_t)lba * 512) : 0;
+    if (got < 0) got = 0;
+    if ((size_t)got < bytes) memset((uint8_t *)buffer + got, 0, bytes - got);
+
+    g_disk_stats.calls++;
+    g_disk_stats.sectors += count;
+}
+
+// ---------------------------------------------------------------- output
+
+#define OUTPUT_MAX 65536
+
+static char g_output[OUTPUT_MAX];
+static size_t g_output_len;
+
+static void output_append(const char *s)
+{
+    size_t len = strlen(s);
+    if (len > OUTPUT_MAX - 1 - g_output_len) len = OUTPUT_MAX - 1 - g_output_len;
+    memcpy(g_output + g_output_len, s, len);
+    g_output_len += len;
+    g_output[g_output_len] = '\0';
+}
+
+const char *host_output(void)
+{
+    return g_output;
+}
+
+void host_output_clear(void)
+{
+    g_output_len = 0;
+    g_output[0] = '\0';
+}
+
+int g_console = CONSOLE_VGA;
+int g_vga_width = LEGACY_WIDTH;
+int g_vga_height = LEGACY_HEIGHT;
+
+void vga_put_string(const char *str, char attr)
+{
+    (void)attr;
+    output_append(str);
+}
+
+void klog(const char *s)
+{
+    output_append(s);
+}
+
+// ---------------------------------------------------------------- memory
+
+// Heap runs come from malloc; reservations for load addresses always
+// succeed, since tests load into their own buffers
+uintptr_t pmm_alloc_top(uint32_t pages)
+{
+    void *p = aligned_alloc(PAGE_SIZE, (size_t)pages * PAGE_SIZE);
+    return (uintptr_t)p;
+}
+
+uintptr_t pmm_alloc_below(uint64_t limit, uint32_t pages)
+{
+    (void)limit;
+    return pmm_alloc_top(pages);
+}
+
+uintptr_t pmm_alloc(uintptr_t min, uint32_t pages, uintptr_t align)
+{
+    (void)min;
+    return (uintptr_t)aligned_alloc(align > PAGE_SIZE ? align : PAGE_SIZE, (size_t)pages * PAGE_SIZE);
+}
+
+int pmm_reserve(uintptr_t addr, uint32_t size)
+{
+    (void)addr;
+    (void)size;
+    return 0;
+}
+
+void pmm_free(uintptr_t addr, uint32_t size)
+{
+    (void)addr;
+    (void)size;
+}
+
+void pmm_tag_kernel(uintptr_t addr, uint32_t size)
+{
+    (void)addr;
+    (void)size;
+}
+
+void pmm_untag_kernel(uintptr_t addr)
+{
+    (void)addr;
+}
+
+// The config parser asks before offering a kernel_x64= entry on BIOS
+int paging_long_mode_supported(void)
+{
+    return 1;
+}
+
+// ---------------------------------------------------------------- smp
+
+// One CPU; the pieces run last to first so a job that depends on the
+// order its pieces finish in shows up here
+void parallel_for(uint32_t count, uint32_t grain, smp_fn fn, void *ctx)
+{
+    if (grain == 0) grain = 1;
+    for (uint32_t end = count; end > 0;)
+    {
+        uint32_t begin = end > grain ? ((end - 1) / grain) * grain : 0;
+        fn(ctx, begin, end);
+        end = begin;
+    }
+}
+
+// ---------------------------------------------------------------- timeline
+
+struct boot_timestamp g_timeline[BOOT_INFO_MAX_TIMELINE];
+uint32_t g_timeline_count;
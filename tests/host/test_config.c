@@ -0,0 +1,172 @@
+// test_config.c
+// The ATLAS.CFG parser as the BIOS build runs it (kernel_x86= first)
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "config.h"
+#include "mem.h"
+#include "serial.h"
+
+#define MAX_ENTRIES 16
+
+static struct menu_entry g_entries[MAX_ENTRIES];
+static struct arena g_strings;
+
+static struct menu parse(const char *text)
+{
+    static char buf[8192];
+    strncpy(buf, text, sizeof(buf) - 1);
+
+    struct menu m;
+    memset(&m, 0, sizeof(m));
+    m.entries = g_entries;
+    m.title = "default title";
+    config_parse_text(buf, &m, MAX_ENTRIES, &g_strings);
+    return m;
+}
+
+static void test_basic(void)
+{
+    struct menu m = parse(
+        "[menu]\n"
+        "title=Atlas Test\n"
+        "\n"
+        "[entry]\n"
+        "name=Legacy\n"
+        "kernel_x86=KERNEL.BIN\n"
+        "cmdline=quiet splash\n"
+        "\n"
+        "[entry]\n"
+        "name=Generic\n"
+        "kernel=GENERIC.BIN\n");
+
+    CHECK_STR(m.title, "Atlas Test");
+    CHECK_EQ(m.length, 2);
+    CHECK_EQ(m.selected, 0);
+    CHECK_EQ(m.timeout, -1);
+    CHECK_EQ(m.fallback, -1);
+    CHECK_EQ(m.console, 0);
+    CHECK_STR(g_entries[0].name, "Legacy");
+    CHECK_STR(g_entries[0].kernel_path, "KERNEL.BIN");
+    CHECK_STR(g_entries[0].cmdline, "quiet splash");
+    CHECK_EQ(g_entries[0].long_mode, 0);
+    CHECK_STR(g_entries[1].kernel_path, "GENERIC.BIN");
+    CHECK_STR(g_entries[1].cmdline, "");
+}
+
+static void test_kernel_priority(void)
+{
+    struct menu m = parse(
+        "[entry]\n"
+        "name=Both\n"
+        "kernel_x64=K64.BIN\n"
+        "kernel_x86=K32.BIN\n"
+        "[entry]\n"
+        "name=Only64\n"
+        "kernel_x64=K64.BIN\n"
+        "[entry]\n"
+        "name=Nothing\n");
+
+    CHECK_EQ(m.length, 2); // The entry without a kernel is dropped
+    CHECK_STR(g_entries[0].kernel_path, "K32.BIN");
+    CHECK_EQ(g_entries[0].long_mode, 0);
+    CHECK_STR(g_entries[1].kernel_path, "K64.BIN");
+    CHECK_EQ(g_entries[1].long_mode, 1);
+}
+
+static void test_keys(void)
+{
+    struct menu m = parse(
+        "timeout=5\r\n"
+        "default=Second   \r\n"
+        "fallback=0\r\n"
+        "console=serial,vga\r\n"
+        "[entry]\r\n"
+        "name=First\r\n"
+        "kernel=A.BIN\r\n"
+        "[entry]\r\n"
+        "name=Empty\r\n"
+        "[entry]\r\n"
+        "name=Second\r\n"
+        "kernel=B.BIN\r\n"
+        "initrd=INITRD.IMG\r\n"
+        "module=MOD1.BIN\r\n");
+
+    CHECK_EQ(m.timeout, 5);
+    CHECK_EQ(m.length, 2);
+    CHECK_EQ(m.selected, 1); // "Second", after dropping "Empty"
+    CHECK_EQ(m.fallback, 0);
+    CHECK_EQ(m.console, CONSOLE_VGA | CONSOLE_SERIAL);
+    CHECK_STR(g_entries[1].name, "Second");
+    CHECK_EQ(g_entries[1].module_count, 2);
+    CHECK_STR(g_entries[1].modules[0], "INITRD.IMG");
+    CHECK_STR(g_entries[1].modules[1], "MOD1.BIN");
+
+    m = parse("default=7\ntimeout=x\n[entry]\nkernel=A.BIN\n");
+    CHECK_EQ(m.selected, 0); // Out of range
+    CHECK_EQ(m.timeout, -1); // Not a number
+    CHECK_STR(g_entries[0].name, "Unknown Entry");
+}
+
+static void test_limits(void)
+{
+    char text[4096] = "";
+    for (int i = 0; i < MAX_ENTRIES + 4; i++)
+        strcat(text, "[entry]\nkernel=K.BIN\n");
+    strcat(text, "[entry]\nname=Last\nkernel=L.BIN\n");
+    struct menu m = parse(text);
+    CHECK_EQ(m.length, MAX_ENTRIES);
+
+    char modules[1024] = "[entry]\nkernel=K.BIN\n";
+    for (int i = 0; i < MAX_MODULES + 3; i++)
+        strcat(modules, "module=M.BIN\n");
+    m = parse(modules);
+    CHECK_EQ(g_entries[0].module_count, MAX_MODULES);
+}
+
+static void test_checksums(void)
+{
+    parse("checksum=/KERNEL.BIN 1a2B3c4D\n"
+          "checksum=BAD.BIN 12xz\n"
+          "checksum=NOCRC.BIN\n"
+          "[entry]\nkernel=KERNEL.BIN\n");
+
+    uint32_t crc = 0;
+    CHECK_EQ(config_find_checksum("kernel.bin", &crc), 0);
+    CHECK_EQ(crc, 0x1A2B3C4D);
+    CHECK_EQ(config_find_checksum("BAD.BIN", &crc), -1);
+    CHECK_EQ(config_find_checksum("NOCRC.BIN", &crc), -1);
+}
+
+static void test_blob_detect(void)
+{
+    char text[] = "[menu]\ntitle=x\n";
+    CHECK_EQ(config_blob_detect(text), 0);
+
+    struct config_blob_header h;
+    memset(&h, 0, sizeof(h));
+    h.magic = CONFIG_BLOB_MAGIC;
+    CHECK_EQ(config_blob_detect(&h), 1);
+
+    // Right magic, wrong everything else: rejected, menu untouched
+    struct menu m;
+    m.entries = g_entries;
+    m.length = 42;
+    CHECK_EQ(config_blob_load(&h, sizeof(h), &m, MAX_ENTRIES), -1);
+    CHECK_EQ(m.length, 42);
+}
+
+int main(void)
+{
+    kheap_init();
+    arena_init(&g_strings, 1024);
+    RUN(test_basic);
+    RUN(test_kernel_priority);
+    RUN(test_keys);
+    RUN(test_limits);
+    RUN(test_checksums);
+    RUN(test_blob_detect);
+    arena_release(&g_strings);
+    return host_summary();
+}
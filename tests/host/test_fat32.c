@@ -0,0 +1,465 @@
+// test_fat32.c
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "host.h"
+#include "fat_image.h"
+#include "crc32.h"
+#include "preload.h"
+
+#define IMAGE "test_fat32.img"
+
+static uint8_t *pattern(uint32_t size, uint32_t seed)
+{
+    uint8_t *p = malloc(size ? size : 1);
+    for (uint32_t i = 0; i < size; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        p[i] = seed >> 16;
+    }
+    return p;
+}
+
+// Save the image and point the driver at it
+static void mount(struct fat_image *img)
+{
+    CHECK_EQ(fat_image_save(img, IMAGE), 0);
+    CHECK_EQ(host_disk_open(IMAGE), 0);
+    fat32_init(host_disk_bpb());
+}
+
+static int load(const char *name, void *dest, uint32_t offset, uint32_t length)
+{
+    struct fat32_load_req req;
+    if (fat32_open(name, &req.file) != 0) return -1;
+    req.offset = offset;
+    req.length = length;
+    req.dest = dest;
+    req.verify = 0;
+    return fat32_load(&req, 1);
+}
+
+static void test_open(void)
+{
+    struct fat_image img;
+    CHECK_EQ(fat_image_create(&img, 16, 8), 0);
+    uint8_t *data = pattern(10000, 1);
+    fat_image_add(&img, "KERNEL.BIN", data, 10000, 1);
+    fat_image_add(&img, "atlas.cfg", data, 17, 1);
+    fat_image_add(&img, "EMPTY", data, 0, 1);
+    mount(&img);
+
+    struct fat32_file f;
+    CHECK_EQ(fat32_open("KERNEL.BIN", &f), 0);
+    CHECK_EQ(f.size, 10000);
+    CHECK_EQ(f.cluster, 3);
+    CHECK_EQ(fat32_open("kernel.bin", &f), 0); // 8.3 names match in any case
+    CHECK_EQ(fat32_open("ATLAS.CFG", &f), 0);
+    CHECK_EQ(f.size, 17);
+    CHECK_EQ(fat32_open("EMPTY", &f), 0);
+    CHECK_EQ(f.size, 0);
+    CHECK_EQ(fat32_open("MISSING.BIN", &f), -1);
+
+    free(data);
+    fat_image_free(&img);
+}
+
+static void test_deleted_entries(void)
+{
+    struct fat_image img;
+    CHECK_EQ(fat_image_create(&img, 16, 1), 0);
+    uint8_t *data = pattern(600, 2);
+    fat_image_add(&img, "OLD.BIN", data, 600, 1);
+    fat_image_add(&img, "NEW.BIN", data, 600, 1);
+    CHECK_EQ(fat_image_delete(&img, "OLD.BIN"), 0);
+    mount(&img);
+
+    struct fat32_file f;
+    CHECK_EQ(fat32_open("OLD.BIN", &f), -1);
+    CHECK_EQ(fat32_open("NEW.BIN", &f), 0);
+
+    free(data);
+    fat_image_free(&img);
+}
+
+// 1 sector per cluster holds 16 entries: 100 files span 7 directory clusters
+static void test_multi_cluster_directory(void)
+{
+    struct fat_image img;
+    CHECK_EQ(fat_image_create(&img, 16, 1), 0);
+    uint8_t *data = pattern(64, 3);
+    char name[16];
+    for (int i = 0; i < 100; i++)
+    {
+        snprintf(name, sizeof(name), "F%03d.BIN", i);
+        data[0] = (uint8_t)i;
+        CHECK_EQ(fat_image_add(&img, name, data, 64, 1), 0);
+    }
+    mount(&img);
+
+    uint8_t buf[64];
+    CHECK_EQ(load("F000.BIN", buf, 0, 64), 0);
+    CHECK_EQ(buf[0], 0);
+    CHECK_EQ(load("F099.BIN", buf, 0, 64), 0);
+    CHECK_EQ(buf[0], 99);
+    CHECK_EQ(memcmp(buf + 1, data + 1, 63), 0);
+
+    free(data);
+    fat_image_free(&img);
+}
+
+static void test_read_sizes(void)
+{
+    static const uint32_t sizes[] = { 1, 511, 512, 513, 4095, 4096, 4097, 70000, 300000 };
+    struct fat_image img;
+    CHECK_EQ(fat_image_create(&img, 16, 8), 0);
+    uint8_t *data[9];
+    char name[16];
+    for (int i = 0; i < 9; i++)
+    {
+        data[i] = pattern(sizes[i], 10 + i);
+        snprintf(name, sizeof(name), "S%d.BIN", i);
+        fat_image_add(&img, name, data[i], sizes[i], 1);
+    }
+    mount(&img);
+
+    for (int i = 0; i < 9; i++)
+    {
+        // A guard byte after the data catches writes past the end
+        uint8_t *buf = malloc(sizes[i] + 1);
+        buf[sizes[i]] = 0xA5;
+        snprintf(name, sizeof(name), "S%d.BIN", i);
+        CHECK_EQ(load(name, buf, 0, sizes[i]), 0);
+        CHECK_EQ(memcmp(buf, data[i], sizes[i]), 0);
+        CHECK_EQ(buf[sizes[i]], 0xA5);
+        free(buf);
+        free(data[i]);
+    }
+    fat_image_free(&img);
+}
+
+static void test_fragmented(void)
+{
+    const uint32_t size = 200000;
+    struct fat_image img;
+    CHECK_EQ(fat_image_create(&img, 16, 2), 0);
+    uint8_t *data = pattern(size, 4);
+    fat_image_add(&img, "CONTIG.BIN", data, size, 1);
+    fat_image_add(&img, "FRAG.BIN", data, size, 3);
+    mount(&img);
+
+    uint8_t *buf = malloc(size);
+    struct host_disk_stats contiguous, fragmented;
+
+    host_disk_reset_stats();
+    CHECK_EQ(load("CONTIG.BIN", buf, 0, size), 0);
+    host_disk_stats(&contiguous);
+    CHECK_EQ(memcmp(buf, data, size), 0);
+
+    memset(buf, 0, size);
+    host_disk_reset_stats();
+    CHECK_EQ(load("FRAG.BIN", buf, 0, size), 0);
+    host_disk_stats(&fragmented);
+    CHECK_EQ(memcmp(buf, data, size), 0);
+
+    // Contiguous clusters are merged into runs of up to 128 sectors
+    uint32_t clusters = (size + 1023) / 1024;
+    CHECK(contiguous.calls < 16);
+    CHECK(fragmented.calls >= clusters);
+
+    free(buf);
+    free(data);
+    fat_image_free(&img);
+}
+
+static void test_offsets(void)
+{
+    const uint32_t size = 50000;
+    struct fat_image img;
+    CHECK_EQ(fat_image_create(&img, 16, 4), 0);
+    uint8_t *data = pattern(size, 5);
+    fat_image_add(&img, "PART.BIN", data, size, 2);
+    mount(&img);
+
+    uint8_t *buf = malloc(size);
+    CHECK_EQ(load("PART.BIN", buf, 2048, 5000), 0); // Second cluster onwards
+    CHECK_EQ(memcmp(buf, data + 2048, 5000), 0);
+    CHECK_EQ(load("PART.BIN", buf, 512, 100), 0); // Mid-cluster start
+    CHECK_EQ(memcmp(buf, data + 512, 100), 0);
+    CHECK_EQ(load("PART.BIN", buf, 49664, 336), 0); // Last sector
+    CHECK_EQ(memcmp(buf, data + 49664, 336), 0);
+
+    CHECK_EQ(load("PART.BIN", buf, 100, 10), -1);    // Not sector aligned
+    CHECK_EQ(load("PART.BIN", buf, 49664, 337), -1); // Past the end
+
+    free(buf);
+    free(data);
+    fat_image_free(&img);
+}
+
+static void test_plan_and_verify(void)
+{
+    struct fat_image img;
+    CHECK_EQ(fat_image_create(&img, 16, 8), 0);
+    uint8_t *a = pattern(9000, 6);
+    uint8_t *b = pattern(30000, 7);
+    fat_image_add(&img, "A.BIN", a, 9000, 1);
+    fat_image_add(&img, "B.BIN", b, 30000, 1);
+    mount(&img);
+
+    // Listed out of disk order; fat32_load sorts the plan
+    uint8_t *buf_a = malloc(9000), *buf_b = malloc(30000);
+    struct fat32_load_req reqs[2];
+    CHECK_EQ(fat32_open("B.BIN", &reqs[0].file), 0);
+    CHECK_EQ(fat32_open("A.BIN", &reqs[1].file), 0);
+    reqs[0].offset = reqs[1].offset = 0;
+    reqs[0].length = 30000;
+    reqs[1].length = 9000;
+    reqs[0].dest = buf_b;
+    reqs[1].dest = buf_a;
+    reqs[0].verify = 1;
+    reqs[0].crc32c = crc32c(0, b, 30000);
+    reqs[1].verify = 1;
+    reqs[1].crc32c = crc32c(0, a, 9000);
+    CHECK_EQ(fat32_load(reqs, 2), 0);
+    CHECK_EQ(memcmp(buf_a, a, 9000), 0);
+    CHECK_EQ(memcmp(buf_b, b, 30000), 0);
+
+    // A wrong checksum is retried, then reported
+    reqs[1].crc32c ^= 1;
+    host_disk_reset_stats();
+    CHECK_EQ(fat32_load(&reqs[1], 1), FAT32_ERR_CHECKSUM);
+    struct host_disk_stats stats;
+    host_disk_stats(&stats);
+    CHECK(stats.sectors >= (FAT32_VERIFY_RETRIES + 1) * 17u);
+
+    free(buf_a);
+    free(buf_b);
+    free(a);
+    free(b);
+    fat_image_free(&img);
+}
+
+// Files listed in the boot map load from their extents with no directory
+// or FAT reads; a stale or wrong map falls back to the FAT
+static void test_bootmap(void)
+{
+    const uint32_t size = 20000;
+    struct fat_image img;
+    CHECK_EQ(fat_image_create(&img, 16, 1), 0);
+    uint8_t *data = pattern(size, 8);
+    for (int i = 0; i < 40; i++) // Push the files past the first directory sector
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "PAD%02d.BIN", i);
+        fat_image_add(&img, name, data, 1, 1);
+    }
+    fat_image_add(&img, "CONTIG.BIN", data, size, 1);
+    fat_image_add(&img, "FRAG.BIN", data, size, 3);
+    CHECK_EQ(fat_image_write_bootmap(&img, 0x1234ABCD), 0);
+    mount(&img);
+
+    uint8_t *buf = malloc(size);
+    struct host_disk_stats stats;
+    struct fat32_load_req req;
+    host_disk_reset_stats();
+    CHECK_EQ(fat32_open("CONTIG.BIN", &req.file), 0);
+    CHECK(req.file.map != 0);
+    req.offset = 0;
+    req.length = size;
+    req.dest = buf;
+    req.verify = 0;
+    CHECK_EQ(fat32_load(&req, 1), 0);
+    host_disk_stats(&stats);
+    CHECK_EQ(memcmp(buf, data, size), 0);
+    CHECK_EQ(stats.calls, 2); // Whole sectors, then the tail
+    CHECK_EQ(stats.sectors, 40);
+
+    memset(buf, 0, size);
+    CHECK_EQ(load("FRAG.BIN", buf, 0, size), 0); // One extent per cluster
+    CHECK_EQ(memcmp(buf, data, size), 0);
+    CHECK_EQ(load("FRAG.BIN", buf, 5120, 700), 0);
+    CHECK_EQ(memcmp(buf, data + 5120, 700), 0);
+    CHECK_EQ(load("FRAG.BIN", buf, 100, 10), -1);
+
+    // Something wrote to the volume: FSInfo no longer matches
+    struct fat_image stale = img;
+    stale.data = malloc(img.size);
+    memcpy(stale.data, img.data, img.size);
+    stale.data[512 + 488]--;
+    mount(&stale);
+    CHECK_EQ(fat32_open("CONTIG.BIN", &req.file), 0);
+    CHECK(req.file.map == 0);
+    CHECK(strstr(host_output(), "Boot map is stale") != 0);
+    fat_image_free(&stale);
+
+    // The file changed in place: its CRC catches that, the FAT path reads it
+    mount(&img);
+    CHECK_EQ(fat32_open("CONTIG.BIN", &req.file), 0);
+    uint32_t lba = 32 + 2 * img.fat_sectors + (req.file.cluster - 2);
+    img.data[(size_t)lba * 512] ^= 0xFF;
+    mount(&img);
+    host_output_clear();
+    CHECK_EQ(load("CONTIG.BIN", buf, 0, size), 0);
+    CHECK_EQ(buf[0], (uint8_t)(data[0] ^ 0xFF));
+    CHECK_EQ(memcmp(buf + 1, data + 1, size - 1), 0);
+    CHECK(strstr(host_output(), "does not match") != 0);
+    CHECK_EQ(fat32_open("FRAG.BIN", &req.file), 0);
+    CHECK(req.file.map == 0); // Not trusted any more
+
+    free(buf);
+    free(data);
+    fat_image_free(&img);
+}
+
+// Files Stage 2 preloaded come from memory with no disk reads; a copy that
+// fails its checksum is dropped and the file read from disk
+static void test_preload(void)
+{
+    const uint32_t size = 20000;
+    struct fat_image img;
+    CHECK_EQ(fat_image_create(&img, 16, 1), 0);
+    uint8_t *data = pattern(size, 9);
+    fat_image_add(&img, "KERNEL.BIN", data, size, 3);
+    fat_image_add(&img, "OTHER.BIN", data, size, 1);
+    CHECK_EQ(fat_image_write_bootmap(&img, 0x5678), 0);
+    mount(&img);
+    struct fat32_file f;
+    CHECK_EQ(fat32_open("KERNEL.BIN", &f), 0);
+
+    // Stage 2 leaves addresses below 4 GB
+    uint8_t *copy = mmap(0, 0x5000, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    CHECK(copy != MAP_FAILED);
+    memcpy(copy, data, size);
+    struct preload_table table;
+    memset(&table, 0, sizeof(table));
+    table.count = 1;
+    table.base = (uint32_t)(uintptr_t)copy;
+    table.size = 0x5000;
+    memcpy(table.files[0].name, "KERNEL  BIN", 11);
+    table.files[0].cluster = f.cluster;
+    table.files[0].size = size;
+    table.files[0].addr = table.base;
+
+    fat32_use_preload(&table); // No magic: ignored
+    CHECK_EQ(fat32_open("KERNEL.BIN", &f), 0);
+    CHECK(f.preload == 0);
+    table.magic = PRELOAD_MAGIC;
+    fat32_use_preload(&table);
+
+    uint8_t *buf = malloc(size);
+    struct fat32_load_req req;
+    host_disk_reset_stats();
+    CHECK_EQ(fat32_open("KERNEL.BIN", &req.file), 0);
+    CHECK(req.file.preload == &table.files[0]);
+    CHECK_EQ(req.file.cluster, f.cluster);
+    req.offset = 0;
+    req.length = size;
+    req.dest = buf;
+    req.verify = 1;
+    req.crc32c = crc32c(0, data, size);
+    CHECK_EQ(fat32_load(&req, 1), 0);
+    CHECK_EQ(memcmp(buf, data, size), 0);
+    CHECK_EQ(load("KERNEL.BIN", buf, 1024, 100), 0);
+    CHECK_EQ(memcmp(buf, data + 1024, 100), 0);
+    struct host_disk_stats stats;
+    host_disk_stats(&stats);
+    CHECK_EQ(stats.calls, 0);
+    CHECK_EQ(fat32_open("OTHER.BIN", &f), 0); // Not preloaded: boot map
+    CHECK(f.preload == 0 && f.map != 0);
+
+    // A damaged copy: the disk has the right data
+    copy[100] ^= 0xFF;
+    host_output_clear();
+    CHECK_EQ(fat32_open("KERNEL.BIN", &req.file), 0);
+    CHECK_EQ(fat32_load(&req, 1), 0);
+    CHECK_EQ(memcmp(buf, data, size), 0);
+    CHECK(strstr(host_output(), "does not match") != 0);
+    CHECK_EQ(fat32_open("KERNEL.BIN", &f), 0);
+    CHECK(f.preload == 0);
+
+    munmap(copy, 0x5000);
+    free(buf);
+    free(data);
+    fat_image_free(&img);
+}
+
+// A preloaded file over 1 MB is checked in chunks on the worker pool and
+// the chunk CRCs combined; a damaged byte in the last chunk still shows
+static void test_preload_chunked(void)
+{
+    const uint32_t size = 0x280123;
+    const uint32_t area = 0x281000;
+    struct fat_image img;
+    CHECK_EQ(fat_image_create(&img, 16, 1), 0);
+    uint8_t *data = pattern(size, 10);
+    // Contiguous: scattered over this many clusters it would need more
+    // extents than the boot map holds
+    fat_image_add(&img, "KERNEL.BIN", data, size, 1);
+    CHECK_EQ(fat_image_write_bootmap(&img, 0x5678), 0);
+    mount(&img);
+    struct fat32_file f;
+    CHECK_EQ(fat32_open("KERNEL.BIN", &f), 0);
+
+    uint8_t *copy = mmap(0, area, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    CHECK(copy != MAP_FAILED);
+    memcpy(copy, data, size);
+    struct preload_table table;
+    memset(&table, 0, sizeof(table));
+    table.magic = PRELOAD_MAGIC;
+    table.count = 1;
+    table.base = (uint32_t)(uintptr_t)copy;
+    table.size = area;
+    memcpy(table.files[0].name, "KERNEL  BIN", 11);
+    table.files[0].cluster = f.cluster;
+    table.files[0].size = size;
+    table.files[0].addr = table.base;
+    fat32_use_preload(&table);
+
+    uint8_t *buf = malloc(size);
+    struct fat32_load_req req;
+    host_disk_reset_stats();
+    CHECK_EQ(fat32_open("KERNEL.BIN", &req.file), 0);
+    CHECK(req.file.preload == &table.files[0]);
+    req.offset = 0;
+    req.length = size;
+    req.dest = buf;
+    req.verify = 1;
+    req.crc32c = crc32c(0, data, size);
+    CHECK_EQ(fat32_load(&req, 1), 0);
+    CHECK_EQ(memcmp(buf, data, size), 0);
+    struct host_disk_stats stats;
+    host_disk_stats(&stats);
+    CHECK_EQ(stats.calls, 0);
+
+    copy[size - 100] ^= 0xFF;
+    host_output_clear();
+    memset(buf, 0, size);
+    CHECK_EQ(fat32_open("KERNEL.BIN", &req.file), 0);
+    CHECK_EQ(fat32_load(&req, 1), 0);
+    CHECK_EQ(memcmp(buf, data, size), 0);
+    CHECK(strstr(host_output(), "does not match") != 0);
+
+    munmap(copy, area);
+    free(buf);
+    free(data);
+    fat_image_free(&img);
+}
+
+int main(void)
+{
+    RUN(test_open);
+    RUN(test_deleted_entries);
+    RUN(test_multi_cluster_directory);
+    RUN(test_read_sizes);
+    RUN(test_fragmented);
+    RUN(test_offsets);
+    RUN(test_plan_and_verify);
+    RUN(test_bootmap);
+    RUN(test_preload);
+    RUN(test_preload_chunked);
+    host_disk_close();
+    remove(IMAGE);
+    return host_summary();
+}
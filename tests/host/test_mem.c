@@ -0,0 +1,155 @@
+// test_mem.c
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "mem.h"
+
+static int aligned(void *p, uintptr_t a)
+{
+    return ((uintptr_t)p & (a - 1)) == 0;
+}
+
+static void test_alloc_free(void)
+{
+    struct kheap_stats before, after;
+    kheap_get_stats(&before);
+
+    void *a = kmalloc(1);
+    void *b = kmalloc(100);
+    void *c = kmalloc(5000);
+    CHECK(a && b && c);
+    CHECK(aligned(a, KHEAP_ALIGN) && aligned(b, KHEAP_ALIGN) && aligned(c, KHEAP_ALIGN));
+    memset(a, 0x11, 1);
+    memset(b, 0x22, 100);
+    memset(c, 0x33, 5000);
+    CHECK_EQ(((uint8_t *)a)[0], 0x11);
+    CHECK_EQ(((uint8_t *)b)[99], 0x22);
+
+    kheap_get_stats(&after);
+    CHECK_EQ(after.allocs - before.allocs, 3);
+    CHECK(after.in_use >= before.in_use + 5101);
+
+    kfree(b);
+    kfree(a);
+    kfree(c);
+    kfree(0);
+    kheap_get_stats(&after);
+    CHECK_EQ(after.in_use, before.in_use);
+    CHECK_EQ(after.frees - before.frees, 3);
+}
+
+// Freed neighbours merge back: the whole region is one block again
+static void test_coalescing(void)
+{
+    void *p[64];
+    for (int i = 0; i < 64; i++) p[i] = kmalloc(1000);
+    for (int i = 0; i < 64; i += 2) kfree(p[i]);
+
+    struct kheap_stats stats;
+    kheap_get_stats(&stats);
+    CHECK(stats.frag_pct > 0);
+
+    for (int i = 1; i < 64; i += 2) kfree(p[i]);
+    kheap_get_stats(&stats);
+    CHECK_EQ(stats.in_use, 0);
+    CHECK_EQ(stats.frag_pct, 0);
+
+    // Everything free again: one allocation the size of a whole region fits
+    void *big = kmalloc(KHEAP_GROW_SIZE / 2);
+    CHECK(big != 0);
+    kfree(big);
+}
+
+static void test_grow(void)
+{
+    struct kheap_stats before, after;
+    kheap_get_stats(&before);
+    void *big = kmalloc(4 * KHEAP_GROW_SIZE);
+    CHECK(big != 0);
+    memset(big, 0x5A, 4 * KHEAP_GROW_SIZE);
+    kheap_get_stats(&after);
+    CHECK(after.total > before.total);
+    kfree(big);
+    CHECK(kmalloc(0x90000000u) == 0); // Above the largest class
+}
+
+// Random allocations and frees with a fill pattern per block: any overlap
+// or header corruption shows up as a changed byte
+static void test_random(void)
+{
+    enum { SLOTS = 512 };
+    uint8_t *ptr[SLOTS] = { 0 };
+    uint32_t size[SLOTS] = { 0 };
+    uint32_t seed = 12345;
+
+    for (int step = 0; step < 50000; step++)
+    {
+        seed = seed * 1103515245 + 12345;
+        int i = (seed >> 8) % SLOTS;
+        if (ptr[i])
+        {
+            for (uint32_t k = 0; k < size[i]; k++)
+                if (ptr[i][k] != (uint8_t)i) { CHECK(!"block contents changed"); break; }
+            kfree(ptr[i]);
+            ptr[i] = 0;
+        }
+        else
+        {
+            seed = seed * 1103515245 + 12345;
+            size[i] = (seed >> 16) % ((seed & 7) ? 256 : 20000) + 1;
+            ptr[i] = kmalloc(size[i]);
+            CHECK(ptr[i] != 0);
+            CHECK(aligned(ptr[i], KHEAP_ALIGN));
+            memset(ptr[i], i, size[i]);
+        }
+    }
+    for (int i = 0; i < SLOTS; i++) kfree(ptr[i]);
+
+    struct kheap_stats stats;
+    kheap_get_stats(&stats);
+    CHECK_EQ(stats.in_use, 0);
+    CHECK_EQ(stats.failed, 1); // The oversized request in test_grow
+}
+
+static void test_arena(void)
+{
+    struct arena a;
+    arena_init(&a, 256);
+
+    char *s = arena_strdup(&a, "kernel_x86=KERNEL.BIN");
+    CHECK_STR(s, "kernel_x86=KERNEL.BIN");
+    void *p = arena_alloc(&a, 10);
+    CHECK(aligned(p, KHEAP_ALIGN));
+    void *q = arena_alloc_aligned(&a, 10, 64);
+    CHECK(aligned(q, 64));
+    uint8_t *one = arena_alloc_aligned(&a, 1, 1);
+    uint8_t *two = arena_alloc_aligned(&a, 1, 1);
+    CHECK(two == one + 1); // Byte allocations are packed
+
+    struct arena_mark mark = arena_mark(&a);
+    void *big = arena_alloc(&a, 10000); // Oversized: a chunk of its own
+    CHECK(big != 0);
+    memset(big, 0, 10000);
+    arena_reset(&a, mark);
+    CHECK(arena_alloc_aligned(&a, 1, 1) == two + 1); // Back where the mark was
+    CHECK_STR(s, "kernel_x86=KERNEL.BIN");
+
+    arena_release(&a);
+    CHECK(a.head == 0);
+
+    struct kheap_stats stats;
+    kheap_get_stats(&stats);
+    CHECK_EQ(stats.in_use, 0);
+}
+
+int main(void)
+{
+    kheap_init();
+    RUN(test_alloc_free);
+    RUN(test_coalescing);
+    RUN(test_grow);
+    RUN(test_random);
+    RUN(test_arena);
+    return host_summary();
+}